@@ -0,0 +1,433 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org>
+*/
+#ifndef __ASYNCLOG_H__
+#define __ASYNCLOG_H__
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "macros.h"
+
+/** @file
+ * This file contains an asynchronous, lock-free logging backend that can sit
+ * behind ucprintf() and therefore behind all of the PRINTx() macros in
+ * debug.h.
+ **/
+
+/**
+ *                      Async Log Overview
+ * =====================================================================
+ * Each producer thread claims its own single-producer/single-consumer ring
+ * the first time it logs. A message is formatted straight into the next free
+ * slot of that ring (no stdio lock, no heap), and the slot is published with
+ * a single release store. A dedicated consumer thread walks all rings, writes
+ * the published slots to the output stream, and hands the slots back.
+ *
+ * Memory is bounded: there are ASYNCLOG_MAX_THREADS rings, each holding
+ * ASYNCLOG_RING_SLOTS messages of at most ASYNCLOG_MSG_SIZE bytes, all in
+ * static storage. A ring is released when its thread exits and may be
+ * claimed again by a new thread once the consumer has drained it. Threads
+ * that cannot claim a ring have their messages counted as dropped.
+ *
+ * Messages from one thread are written in order; messages from different
+ * threads are interleaved in drain order, not strict time order.
+ *
+ * Config Defines
+ * ----------------------------------------------
+ *   ASYNCLOG_MAX_THREADS      Number of producer rings        (default 32)
+ *   ASYNCLOG_RING_SLOTS       Slots per ring, power of 2      (default 256)
+ *   ASYNCLOG_MSG_SIZE         Bytes per slot                  (default 256)
+ *   ASYNCLOG_IDLE_USEC        Consumer sleep when idle        (default 1000)
+ *   ASYNCLOG_PREFIX           Stamp each record with a raw logclock.h time,
+ *                             thread ID and CPU; the consumer converts and
+ *                             prints them as a prefix (needs logclock.h)
+ *
+ * Usage
+ * ----------------------------------------------
+ * Define ASYNCLOG_IMPLEMENTATION in exactly one .c file before including
+ * this file. If ASYNCLOG_UCPRINTF is also defined there, that file provides
+ * ucprintf() so the debug.h macros log asynchronously with no other change:
+ *   #define ASYNCLOG_IMPLEMENTATION
+ *   #define ASYNCLOG_UCPRINTF
+ *   #include "asynclog.h"
+ *
+ *   asynclog_start(stderr, ASYNCLOG_POLICY_DROP);
+ *   ...
+ *   asynclog_stop();      // flushes everything still queued
+ *
+ * Until asynclog_start() is called (and after asynclog_stop()), messages are
+ * written synchronously so that nothing is lost during start-up/shutdown.
+ */
+
+//////////////////////////////////////////////////////////////////////////////
+#ifndef ASYNCLOG_MAX_THREADS
+#   define ASYNCLOG_MAX_THREADS     32
+#endif
+#ifndef ASYNCLOG_RING_SLOTS
+#   define ASYNCLOG_RING_SLOTS      256
+#endif
+#ifndef ASYNCLOG_MSG_SIZE
+#   define ASYNCLOG_MSG_SIZE        256
+#endif
+#ifndef ASYNCLOG_IDLE_USEC
+#   define ASYNCLOG_IDLE_USEC       1000
+#endif
+
+#if (ASYNCLOG_RING_SLOTS & (ASYNCLOG_RING_SLOTS - 1)) != 0
+#   error "ASYNCLOG_RING_SLOTS must be a power of 2"
+#endif
+
+/** Policy when a producer's ring is full */
+#define ASYNCLOG_POLICY_DROP    0   ///< discard the message and count it
+#define ASYNCLOG_POLICY_BLOCK   1   ///< spin/yield until the consumer frees a slot
+
+EXTERN_CPP_START
+
+/** Starts the consumer thread writing to "out"; returns 0 on success */
+int asynclog_start(FILE* out, int policy);
+
+/** Flushes all queued messages, then stops and joins the consumer thread */
+void asynclog_stop(void);
+
+/** Blocks until every message queued before the call has been written */
+void asynclog_flush(void);
+
+/** Changes the full-ring policy at run-time */
+void asynclog_set_policy(int policy);
+
+/** Returns the total number of messages dropped so far */
+uint64_t asynclog_dropped(void);
+
+/** Queues a formatted message; same return value as vsnprintf() */
+int asynclog_vprintf(const char* fmt, va_list ap);
+
+/** Queues a formatted message; same return value as snprintf() */
+int asynclog_printf(const char* fmt, ...) __attribute__((format(printf, 1, 2)));
+
+EXTERN_CPP_END
+
+
+#endif  // __ASYNCLOG_H__
+
+
+//////////////////////////////////////////////////////////////////////////////
+#if defined(ASYNCLOG_IMPLEMENTATION) && !defined(__ASYNCLOG_IMPLEMENTATION__)
+#define __ASYNCLOG_IMPLEMENTATION__
+
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef USE_FASTFMT
+#   include "fastfmt.h"
+#   define ASYNCLOG__VSNPRINTF     fmt_vsnprintf
+#else
+#   define ASYNCLOG__VSNPRINTF     vsnprintf
+#endif
+
+#define ASYNCLOG_CACHE_LINE     64
+#ifdef ASYNCLOG_PREFIX
+#   include "logclock.h"
+#   define ASYNCLOG_HDR_SIZE    (sizeof(uint64_t) + 2 * sizeof(int) + sizeof(unsigned short))
+#else
+#   define ASYNCLOG_HDR_SIZE    sizeof(unsigned short)
+#endif
+#define ASYNCLOG_TEXT_SIZE      (ASYNCLOG_MSG_SIZE - ASYNCLOG_HDR_SIZE)
+
+/** Ring ownership states */
+#define ASYNCLOG_RING_FREE      0
+#define ASYNCLOG_RING_OWNED     1
+#define ASYNCLOG_RING_ORPHANED  2   ///< owner exited, waiting to be drained
+
+struct AsyncLogSlot {
+#ifdef ASYNCLOG_PREFIX
+    uint64_t       stamp;       ///< raw logclock stamp, converted by the consumer
+    int            tid;
+    int            cpu;
+#endif
+    unsigned short len;
+    char           text[ASYNCLOG_TEXT_SIZE];
+};
+
+/** Producer and consumer indices live on separate cache lines; both are
+ *  free-running counters that are never reset, so a recycled ring keeps
+ *  flush snapshots valid.
+ */
+struct AsyncLogRing {
+    uint32_t head __attribute__((aligned(ASYNCLOG_CACHE_LINE)));   ///< producer
+    uint32_t cachedTail;                                           ///< producer
+    uint32_t busy;          ///< producer is between its running check and publish
+    uint32_t tail __attribute__((aligned(ASYNCLOG_CACHE_LINE)));   ///< consumer
+    uint32_t state;
+    struct AsyncLogSlot slots[ASYNCLOG_RING_SLOTS] __attribute__((aligned(ASYNCLOG_CACHE_LINE)));
+};
+
+static struct AsyncLogRing s_asyncLogRings[ASYNCLOG_MAX_THREADS];
+static __thread struct AsyncLogRing* t_asyncLogRing;
+
+static pthread_t       s_asyncLogThread;
+static pthread_key_t   s_asyncLogKey;
+static pthread_once_t  s_asyncLogOnce = PTHREAD_ONCE_INIT;
+static FILE*           s_asyncLogOut;
+static int             s_asyncLogRunning;
+static int             s_asyncLogStopping;
+static int             s_asyncLogPolicy;
+static uint64_t        s_asyncLogDropped;
+
+static void asynclog_release_ring(void* ring)
+{
+    __atomic_store_n(&((struct AsyncLogRing* )ring)->state, ASYNCLOG_RING_ORPHANED, __ATOMIC_RELEASE);
+}
+
+static void asynclog_make_key(void)
+{
+    pthread_key_create(&s_asyncLogKey, asynclog_release_ring);
+}
+
+static struct AsyncLogRing* asynclog_claim_ring(void)
+{
+    pthread_once(&s_asyncLogOnce, asynclog_make_key);
+    for (int i = 0; i < ASYNCLOG_MAX_THREADS; i++) {
+        struct AsyncLogRing* ring = &s_asyncLogRings[i];
+        uint32_t expected = ASYNCLOG_RING_FREE;
+        if (__atomic_compare_exchange_n(&ring->state, &expected, ASYNCLOG_RING_OWNED, 0,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            ring->cachedTail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+            pthread_setspecific(s_asyncLogKey, ring);
+            t_asyncLogRing = ring;
+            return ring;
+        }
+    }
+    return NULL;
+}
+
+static void asynclog_drop(void)
+{
+    __atomic_fetch_add(&s_asyncLogDropped, 1, __ATOMIC_RELAXED);
+}
+
+/** Writes everything currently published in every ring; consumer side only.
+ *  The new tails are only published once the output has been flushed, so an
+ *  asynclog_flush() that sees them can rely on the data being written out.
+ */
+static size_t asynclog_drain(void)
+{
+    uint32_t tails[ASYNCLOG_MAX_THREADS];
+    uint32_t states[ASYNCLOG_MAX_THREADS];
+    size_t written = 0;
+    for (int i = 0; i < ASYNCLOG_MAX_THREADS; i++) {
+        struct AsyncLogRing* ring = &s_asyncLogRings[i];
+        uint32_t state = __atomic_load_n(&ring->state, __ATOMIC_ACQUIRE);
+        states[i] = state;
+        if (state == ASYNCLOG_RING_FREE) {
+            continue;
+        }
+        uint32_t tail = ring->tail;
+        uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        for ( ; tail != head; tail++) {
+            const struct AsyncLogSlot* slot = &ring->slots[tail & (ASYNCLOG_RING_SLOTS - 1)];
+#ifdef ASYNCLOG_PREFIX
+            char prefix[LOGCLOCK_PREFIX_SIZE];
+            int prefixLen = logclock_format_prefix(prefix, sizeof(prefix), slot->stamp, slot->tid, slot->cpu);
+            fwrite(prefix, 1, (size_t)prefixLen, s_asyncLogOut);
+#endif
+            fwrite(slot->text, 1, slot->len, s_asyncLogOut);
+            written++;
+        }
+        tails[i] = tail;
+    }
+    if (written) {
+        fflush(s_asyncLogOut);
+    }
+    for (int i = 0; i < ASYNCLOG_MAX_THREADS; i++) {
+        struct AsyncLogRing* ring = &s_asyncLogRings[i];
+        if (states[i] == ASYNCLOG_RING_FREE) {
+            continue;
+        }
+        __atomic_store_n(&ring->tail, tails[i], __ATOMIC_RELEASE);
+        if (states[i] == ASYNCLOG_RING_ORPHANED) {
+            uint32_t expected = ASYNCLOG_RING_ORPHANED;
+            __atomic_compare_exchange_n(&ring->state, &expected, ASYNCLOG_RING_FREE, 0,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+        }
+    }
+    return written;
+}
+
+static void* asynclog_consumer(void* arg)
+{
+    const struct timespec idle = { ASYNCLOG_IDLE_USEC / 1000000, (ASYNCLOG_IDLE_USEC % 1000000) * 1000L };
+    (void)arg;
+    FOREVER {
+        int stopping = __atomic_load_n(&s_asyncLogStopping, __ATOMIC_ACQUIRE);
+        if (asynclog_drain() == 0) {
+            if (stopping) {
+                break;
+            }
+            nanosleep(&idle, NULL);
+        }
+    }
+    return NULL;
+}
+
+int asynclog_start(FILE* out, int policy)
+{
+    if (__atomic_load_n(&s_asyncLogRunning, __ATOMIC_ACQUIRE)) {
+        return -1;
+    }
+    s_asyncLogOut = out ? out : stderr;
+    s_asyncLogPolicy = policy;
+    s_asyncLogStopping = 0;
+    if (pthread_create(&s_asyncLogThread, NULL, asynclog_consumer, NULL) != 0) {
+        return -1;
+    }
+    __atomic_store_n(&s_asyncLogRunning, 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+void asynclog_stop(void)
+{
+    if (!__atomic_load_n(&s_asyncLogRunning, __ATOMIC_ACQUIRE)) {
+        return;
+    }
+    asynclog_flush();
+    // new messages now go out synchronously; wait for producers that saw the
+    // old flag to publish, so the consumer's final drain picks them up
+    __atomic_store_n(&s_asyncLogRunning, 0, __ATOMIC_SEQ_CST);
+    for (int i = 0; i < ASYNCLOG_MAX_THREADS; i++) {
+        while (__atomic_load_n(&s_asyncLogRings[i].busy, __ATOMIC_SEQ_CST)) {
+            sched_yield();
+        }
+    }
+    __atomic_store_n(&s_asyncLogStopping, 1, __ATOMIC_RELEASE);
+    pthread_join(s_asyncLogThread, NULL);
+}
+
+void asynclog_flush(void)
+{
+    uint32_t snapshot[ASYNCLOG_MAX_THREADS];
+
+    if (!__atomic_load_n(&s_asyncLogRunning, __ATOMIC_ACQUIRE)) {
+        if (s_asyncLogOut) {
+            asynclog_drain();
+        }
+        return;
+    }
+    for (int i = 0; i < ASYNCLOG_MAX_THREADS; i++) {
+        snapshot[i] = __atomic_load_n(&s_asyncLogRings[i].head, __ATOMIC_ACQUIRE);
+    }
+    for (int i = 0; i < ASYNCLOG_MAX_THREADS; i++) {
+        while ((int32_t)(__atomic_load_n(&s_asyncLogRings[i].tail, __ATOMIC_ACQUIRE) - snapshot[i]) < 0) {
+            sched_yield();
+        }
+    }
+}
+
+void asynclog_set_policy(int policy)
+{
+    __atomic_store_n(&s_asyncLogPolicy, policy, __ATOMIC_RELAXED);
+}
+
+uint64_t asynclog_dropped(void)
+{
+    return __atomic_load_n(&s_asyncLogDropped, __ATOMIC_RELAXED);
+}
+
+int asynclog_vprintf(const char* fmt, va_list ap)
+{
+    struct AsyncLogRing* ring;
+    uint32_t head;
+    int n;
+
+    if (!__atomic_load_n(&s_asyncLogRunning, __ATOMIC_ACQUIRE)) {
+        return vfprintf(s_asyncLogOut ? s_asyncLogOut : stderr, fmt, ap);
+    }
+    ring = t_asyncLogRing ? t_asyncLogRing : asynclog_claim_ring();
+    if (!ring) {
+        asynclog_drop();
+        return 0;
+    }
+    // pairs with asynclog_stop(): either stop waits for this message or the
+    // recheck sees the cleared flag
+    __atomic_store_n(&ring->busy, 1, __ATOMIC_SEQ_CST);
+    if (!__atomic_load_n(&s_asyncLogRunning, __ATOMIC_SEQ_CST)) {
+        __atomic_store_n(&ring->busy, 0, __ATOMIC_RELEASE);
+        return vfprintf(s_asyncLogOut ? s_asyncLogOut : stderr, fmt, ap);
+    }
+
+    head = ring->head;
+    while (head - ring->cachedTail >= ASYNCLOG_RING_SLOTS) {
+        ring->cachedTail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+        if (head - ring->cachedTail < ASYNCLOG_RING_SLOTS) {
+            break;
+        }
+        if (__atomic_load_n(&s_asyncLogPolicy, __ATOMIC_RELAXED) == ASYNCLOG_POLICY_DROP ||
+            !__atomic_load_n(&s_asyncLogRunning, __ATOMIC_ACQUIRE)) {
+            __atomic_store_n(&ring->busy, 0, __ATOMIC_RELEASE);
+            asynclog_drop();
+            return 0;
+        }
+        sched_yield();
+    }
+
+    struct AsyncLogSlot* slot = &ring->slots[head & (ASYNCLOG_RING_SLOTS - 1)];
+#ifdef ASYNCLOG_PREFIX
+    slot->stamp = logclock_now_cpu(&slot->cpu);
+    slot->tid = logclock_tid();
+#endif
+    n = ASYNCLOG__VSNPRINTF(slot->text, sizeof(slot->text), fmt, ap);
+    slot->len = (unsigned short)((n < 0) ? 0 : (n >= (int)sizeof(slot->text)) ? (int)sizeof(slot->text) - 1 : n);
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&ring->busy, 0, __ATOMIC_RELEASE);
+    return n;
+}
+
+int asynclog_printf(const char* fmt, ...)
+{
+    va_list ap;
+    int n;
+    va_start(ap, fmt);
+    n = asynclog_vprintf(fmt, ap);
+    va_end(ap);
+    return n;
+}
+
+#ifdef ASYNCLOG_UCPRINTF
+int ucprintf(const char* fmt, ...)
+{
+    va_list ap;
+    int n;
+    va_start(ap, fmt);
+    n = asynclog_vprintf(fmt, ap);
+    va_end(ap);
+    return n;
+}
+#endif
+
+#endif  // ASYNCLOG_IMPLEMENTATION
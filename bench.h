@@ -0,0 +1,284 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org>
+*/
+#ifndef __BENCH_H__
+#define __BENCH_H__
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "macros.h"
+
+/** @file
+ * This file contains a small benchmark harness for measuring the per-call
+ * cost of code such as the PRINTx() macros in debug.h, with machine-readable
+ * (CSV or JSON lines) output so results can be compared between builds.
+ **/
+
+/**
+ *                      Benchmark Harness
+ * =====================================================================
+ * A benchmark body is a function that performs "iterations" calls of the
+ * code under test. bench_run() runs the body on 1..N threads at once
+ * (released together from a barrier), repeats the run BENCH_REPEATS times,
+ * and reports the median, minimum and maximum ns per call seen by a
+ * thread. Running the same body at increasing thread counts exposes
+ * contention, e.g., in the stdio lock behind ucprintf().
+ *
+ * Measuring debug.h
+ * ----------------------------------------------
+ * bench/bench_print.c times every PRINTx() family this way. Build the same
+ * benchmark source once per configuration; BENCH_PRINT_CONFIG names the
+ * configuration picked up from the debug.h defines:
+ *   cc -O2 bench_print.c                                      compiled_out
+ *   cc -O2 -DDEBUG_PRINT -DCURRENT_PRINT_LEVEL=PRINT_LEVEL_INFO bench_print.c
+ *                                                             compile_time
+ *   cc -O2 -DDEBUG_PRINT -DRUNTIME_PRINT_LEVEL bench_print.c  runtime
+ *   cc -O2 -DDEBUG_PRINT -DDYNAMIC_PRINT ... bench_print.c    dynamic
+ * In each, time an enabled macro (e.g., PRINTW) and a suppressed one (e.g.,
+ * PRINTD) with a ucprintf() that writes to /dev/null:
+ *
+ *   static void bench_printd(void* ctx, uint64_t n)
+ *   {
+ *       for (uint64_t i = 0; i < n; i++) {
+ *           PRINTD("suppressed %d\n", (int)i);
+ *       }
+ *   }
+ *   ...
+ *   bench_header(stdout, BENCH_FORMAT_CSV);
+ *   for (int t = 1; t <= 8; t *= 2) {
+ *       bench_run("PRINTD", BENCH_PRINT_CONFIG, bench_printd, NULL, t, 1000000, &r);
+ *       bench_report(stdout, &r, BENCH_FORMAT_CSV);
+ *   }
+ *
+ * Define BENCH_IMPLEMENTATION in exactly one .c file before including this
+ * file.
+ */
+
+//////////////////////////////////////////////////////////////////////////////
+#ifndef BENCH_REPEATS
+#   define BENCH_REPEATS        5
+#endif
+#ifndef BENCH_MAX_THREADS
+#   define BENCH_MAX_THREADS    256
+#endif
+
+#define BENCH_FORMAT_CSV        0
+#define BENCH_FORMAT_JSON       1
+
+/** Name of the debug.h configuration this file was compiled with */
+#if !defined(DEBUG_PRINT)
+#   define BENCH_PRINT_CONFIG   "compiled_out"
+#elif defined(DYNAMIC_PRINT)
+#   define BENCH_PRINT_CONFIG   "dynamic"
+#elif defined(RUNTIME_PRINT_LEVEL)
+#   define BENCH_PRINT_CONFIG   "runtime"
+#else
+#   define BENCH_PRINT_CONFIG   "compile_time"
+#endif
+
+/** Keeps the compiler from discarding a value computed only for timing */
+#define BENCH_KEEP(val)         __asm__ __volatile__("" : : "r"(val) : "memory")
+
+/** Pointer to function taking a context and an iteration count, returning void */
+typedef void (*PfBenchBody)(void* ctx, uint64_t iterations);
+
+struct BenchResult {
+    const char* name;
+    const char* config;
+    int         threads;
+    uint64_t    iterations;     ///< per thread, per repeat
+    double      nsMedian;       ///< median over repeats of the mean thread ns/call
+    double      nsMin;          ///< fastest thread in any repeat
+    double      nsMax;          ///< slowest thread in any repeat
+};
+
+EXTERN_CPP_START
+
+/** Runs "body" on "threads" threads; returns 0 on success */
+int bench_run(const char* name, const char* config, PfBenchBody body, void* ctx,
+              int threads, uint64_t iterations, struct BenchResult* result);
+
+/** Writes the CSV header line (JSON output has no header) */
+void bench_header(FILE* out, int format);
+
+/** Writes one result as a CSV row or a JSON object on its own line */
+void bench_report(FILE* out, const struct BenchResult* result, int format);
+
+EXTERN_CPP_END
+
+#endif  // __BENCH_H__
+
+
+//////////////////////////////////////////////////////////////////////////////
+#if defined(BENCH_IMPLEMENTATION) && !defined(__BENCH_IMPLEMENTATION__)
+#define __BENCH_IMPLEMENTATION__
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+
+/** Holds threads until all of them exist; state is 1 to run, -1 to abort */
+struct BenchGate {
+    pthread_mutex_t     lock;
+    pthread_cond_t      cond;
+    int                 state;
+};
+
+struct BenchThread {
+    pthread_t           thread;
+    struct BenchGate*   gate;
+    pthread_barrier_t*  barrier;
+    PfBenchBody         body;
+    void*               ctx;
+    uint64_t            iterations;
+    double              nsPerCall;
+};
+
+static void bench_open_gate(struct BenchGate* gate, int state)
+{
+    pthread_mutex_lock(&gate->lock);
+    gate->state = state;
+    pthread_cond_broadcast(&gate->cond);
+    pthread_mutex_unlock(&gate->lock);
+}
+
+static double bench_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static void* bench_thread(void* arg)
+{
+    struct BenchThread* bt = (struct BenchThread* )arg;
+    double start;
+    int state;
+
+    pthread_mutex_lock(&bt->gate->lock);
+    while ((state = bt->gate->state) == 0) {
+        pthread_cond_wait(&bt->gate->cond, &bt->gate->lock);
+    }
+    pthread_mutex_unlock(&bt->gate->lock);
+    if (state < 0) {
+        return NULL;
+    }
+    pthread_barrier_wait(bt->barrier);
+    start = bench_now_ns();
+    bt->body(bt->ctx, bt->iterations);
+    bt->nsPerCall = (bench_now_ns() - start) / (double)bt->iterations;
+    return NULL;
+}
+
+static int bench_cmp_double(const void* a, const void* b)
+{
+    double x = *(const double* )a;
+    double y = *(const double* )b;
+    return (x > y) - (x < y);
+}
+
+int bench_run(const char* name, const char* config, PfBenchBody body, void* ctx,
+              int threads, uint64_t iterations, struct BenchResult* result)
+{
+    static struct BenchThread bt[BENCH_MAX_THREADS];
+    static struct BenchGate gate = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0 };
+    double means[BENCH_REPEATS];
+    pthread_barrier_t barrier;
+
+    if (threads < 1 || threads > BENCH_MAX_THREADS || iterations == 0) {
+        return -1;
+    }
+    result->name = name;
+    result->config = config;
+    result->threads = threads;
+    result->iterations = iterations;
+    result->nsMin = 1e300;
+    result->nsMax = 0;
+
+    // one untimed pass to warm caches, lazily-initialized state and the TLB
+    body(ctx, iterations < 1000 ? iterations : 1000);
+
+    for (int rep = 0; rep < BENCH_REPEATS; rep++) {
+        double sum = 0;
+        // the barrier only exists once every thread does, so a failed
+        // pthread_create() can still release and join the others
+        gate.state = 0;
+        for (int t = 0; t < threads; t++) {
+            bt[t].gate = &gate;
+            bt[t].barrier = &barrier;
+            bt[t].body = body;
+            bt[t].ctx = ctx;
+            bt[t].iterations = iterations;
+            if (t > 0 && pthread_create(&bt[t].thread, NULL, bench_thread, &bt[t]) != 0) {
+                bench_open_gate(&gate, -1);
+                while (--t > 0) {
+                    pthread_join(bt[t].thread, NULL);
+                }
+                return -1;
+            }
+        }
+        pthread_barrier_init(&barrier, NULL, (unsigned)threads);
+        bench_open_gate(&gate, 1);
+        bench_thread(&bt[0]);
+        for (int t = 1; t < threads; t++) {
+            pthread_join(bt[t].thread, NULL);
+        }
+        pthread_barrier_destroy(&barrier);
+        for (int t = 0; t < threads; t++) {
+            sum += bt[t].nsPerCall;
+            result->nsMin = MIN(result->nsMin, bt[t].nsPerCall);
+            result->nsMax = MAX(result->nsMax, bt[t].nsPerCall);
+        }
+        means[rep] = sum / threads;
+    }
+    qsort(means, BENCH_REPEATS, sizeof(means[0]), bench_cmp_double);
+    result->nsMedian = means[BENCH_REPEATS / 2];
+    return 0;
+}
+
+void bench_header(FILE* out, int format)
+{
+    if (format == BENCH_FORMAT_CSV) {
+        fputs("name,config,threads,iterations,ns_median,ns_min,ns_max\n", out);
+    }
+}
+
+void bench_report(FILE* out, const struct BenchResult* r, int format)
+{
+    if (format == BENCH_FORMAT_JSON) {
+        fprintf(out, "{\"name\":\"%s\",\"config\":\"%s\",\"threads\":%d,\"iterations\":%llu,"
+                     "\"ns_median\":%.3f,\"ns_min\":%.3f,\"ns_max\":%.3f}\n",
+                r->name, r->config, r->threads, (unsigned long long)r->iterations,
+                r->nsMedian, r->nsMin, r->nsMax);
+    }
+    else {
+        fprintf(out, "%s,%s,%d,%llu,%.3f,%.3f,%.3f\n", r->name, r->config, r->threads,
+                (unsigned long long)r->iterations, r->nsMedian, r->nsMin, r->nsMax);
+    }
+}
+
+#endif  // BENCH_IMPLEMENTATION
@@ -0,0 +1,119 @@
+/** Per-call cost of fmt_snprintf() against the C library's snprintf() for
+ *  the formats typical of log messages, on 1..N threads (to show any
+ *  locale or stdio locking inside the library version):
+ *
+ *   cc -O2 -I.. -o bench_fastfmt bench_fastfmt.c -lpthread
+ *   ./bench_fastfmt [-j] [max_threads]
+ *
+ * Both run into a 256-byte stack buffer; every case first checks that the
+ * two produce the same text.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define BENCH_IMPLEMENTATION
+#include "bench.h"
+#define FASTFMT_IMPLEMENTATION
+#include "fastfmt.h"
+
+/** Arguments live in globals so the compiler cannot fold the formatting */
+int         g_int = -123456;
+unsigned    g_hex = 0xDEADBEEFu;
+uint64_t    g_u64 = 18446744073709551557ull;
+double      g_dbl = 3.14159265358979;
+double      g_big = 6.02214076e23;
+const char* g_str = "connection reset";
+
+/** One pair of bodies per format; the call is the same for both formatters */
+#define BENCH_BODY(tag, call)  \
+    static void bench_##tag##_fast(void* ctx, uint64_t n) \
+    { \
+        char buf[256]; \
+        (void)ctx; \
+        for (uint64_t i = 0; i < n; i++) { \
+            BENCH_KEEP(fmt_##call); \
+        } \
+    } \
+    static void bench_##tag##_libc(void* ctx, uint64_t n) \
+    { \
+        char buf[256]; \
+        (void)ctx; \
+        for (uint64_t i = 0; i < n; i++) { \
+            BENCH_KEEP(call); \
+        } \
+    } \
+    static int check_##tag(void) \
+    { \
+        char buf[256]; \
+        char ref[256]; \
+        int n = call; \
+        memcpy(ref, buf, sizeof(ref)); \
+        return fmt_##call == n && strcmp(buf, ref) == 0; \
+    }
+
+BENCH_BODY(int,     snprintf(buf, sizeof(buf), "%d", g_int))
+BENCH_BODY(mixed,   snprintf(buf, sizeof(buf), "rx %s: id=%u len=%5d flags=0x%08x", g_str, (unsigned)g_u64, g_int, g_hex))
+BENCH_BODY(u64,     snprintf(buf, sizeof(buf), "%llu %llx", (unsigned long long)g_u64, (unsigned long long)g_u64))
+BENCH_BODY(f,       snprintf(buf, sizeof(buf), "%.3f", g_dbl))
+BENCH_BODY(e,       snprintf(buf, sizeof(buf), "%e", g_big))
+BENCH_BODY(g,       snprintf(buf, sizeof(buf), "%g", g_dbl))
+BENCH_BODY(a,       snprintf(buf, sizeof(buf), "%a", g_dbl))
+BENCH_BODY(str,     snprintf(buf, sizeof(buf), "%-20s|%.5s", g_str, g_str))
+
+struct BenchCase {
+    const char*     name;
+    PfBenchBody     fast;
+    PfBenchBody     libc;
+    int             (*check)(void);
+};
+
+#define BENCH_CASE(tag, name)   { name, bench_##tag##_fast, bench_##tag##_libc, check_##tag }
+
+static const struct BenchCase s_cases[] = {
+    BENCH_CASE(int,     "%d"),
+    BENCH_CASE(mixed,   "%s %u %5d %08x"),
+    BENCH_CASE(u64,     "%llu %llx"),
+    BENCH_CASE(f,       "%.3f"),
+    BENCH_CASE(e,       "%e"),
+    BENCH_CASE(g,       "%g"),
+    BENCH_CASE(a,       "%a"),
+    BENCH_CASE(str,     "%-20s %.5s"),
+};
+
+int main(int argc, char** argv)
+{
+    int format = BENCH_FORMAT_CSV;
+    int maxThreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    struct BenchResult r;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-j") == 0) {
+            format = BENCH_FORMAT_JSON;
+        }
+        else {
+            maxThreads = atoi(argv[i]);
+        }
+    }
+    maxThreads = MAX(1, MIN(maxThreads, BENCH_MAX_THREADS));
+
+    bench_header(stdout, format);
+    for (unsigned c = 0; c < NUM_ARRAY_ELEM(s_cases); c++) {
+        if (!s_cases[c].check()) {
+            fprintf(stderr, "%s: fmt_snprintf() and snprintf() differ\n", s_cases[c].name);
+            return 1;
+        }
+        for (int t = 1; t <= maxThreads; t = (t < maxThreads && t * 2 > maxThreads) ? maxThreads : t * 2) {
+            for (int libc = 0; libc <= 1; libc++) {
+                if (bench_run(s_cases[c].name, libc ? "snprintf" : "fmt_snprintf",
+                              libc ? s_cases[c].libc : s_cases[c].fast, NULL, t, 1000000, &r) != 0) {
+                    fprintf(stderr, "%s: bench_run failed at %d threads\n", s_cases[c].name, t);
+                    return 1;
+                }
+                bench_report(stdout, &r, format);
+                fflush(stdout);
+            }
+        }
+    }
+    return 0;
+}
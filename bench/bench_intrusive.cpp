@@ -0,0 +1,203 @@
+/** Per-operation cost of the intrusive.h containers against the standard
+ *  library equivalents, on 1..N threads:
+ *    - list: one push to the back and one pop from the front of a 64-entry
+ *      per-thread list, intrusive ListNode against std::list (whose every
+ *      push allocates a node, so the threaded rows include malloc);
+ *    - queue: every benchmark thread pushes into one shared queue that a
+ *      separate consumer thread drains, the Vyukov MpscQueue against a
+ *      std::deque guarded by a std::mutex. Each producer reuses a ring of
+ *      BENCH_RING messages and waits for a slot the consumer has released,
+ *      so the rows measure sustained throughput, not queue growth.
+ *
+ *   c++ -std=gnu++17 -O2 -I.. -o bench_intrusive bench_intrusive.cpp -lpthread
+ *   ./bench_intrusive [-j] [max_threads]
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+
+#include <atomic>
+#include <deque>
+#include <list>
+#include <mutex>
+#include <thread>
+
+#define BENCH_IMPLEMENTATION
+#include "bench.h"
+#include "intrusive.h"
+
+#define BENCH_LIST_DEPTH    64
+#define BENCH_RING          1024
+
+struct Item {
+    int             id;
+    struct ListNode link;
+};
+
+static void bench_list_intrusive(void* ctx, uint64_t n)
+{
+    struct Item items[BENCH_LIST_DEPTH];
+    struct ListNode head = LIST_HEAD_INIT(head);
+    (void)ctx;
+    for (int i = 0; i < BENCH_LIST_DEPTH; i++) {
+        items[i].id = i;
+        list_add_tail(&head, &items[i].link);
+    }
+    for (uint64_t i = 0; i < n; i++) {
+        struct Item* it = LIST_FIRST_ENTRY(&head, struct Item, link);
+        list_del(&it->link);
+        list_add_tail(&head, &it->link);
+        BENCH_KEEP(it->id);
+    }
+}
+
+static void bench_list_std(void* ctx, uint64_t n)
+{
+    std::list<int> list;
+    (void)ctx;
+    for (int i = 0; i < BENCH_LIST_DEPTH; i++) {
+        list.push_back(i);
+    }
+    for (uint64_t i = 0; i < n; i++) {
+        int id = list.front();
+        list.pop_front();
+        list.push_back(id);
+        BENCH_KEEP(id);
+    }
+}
+
+/** Message passed producer to consumer; "busy" is set while it is queued */
+struct Msg {
+    struct MpscNode     node;
+    std::atomic<int>    busy;
+};
+
+/** Queue under test and the consumer thread's on/off switch */
+struct QueueBench {
+    int                 mutexed;
+    struct MpscQueue    mpsc;
+    std::mutex          lock;
+    std::deque<Msg*>    deque;
+    std::atomic<int>    running;
+};
+
+static void queue_push(struct QueueBench* qb, struct Msg* m)
+{
+    if (qb->mutexed) {
+        std::lock_guard<std::mutex> guard(qb->lock);
+        qb->deque.push_back(m);
+    }
+    else {
+        mpsc_push(&qb->mpsc, &m->node);
+    }
+}
+
+static struct Msg* queue_pop(struct QueueBench* qb)
+{
+    if (qb->mutexed) {
+        std::lock_guard<std::mutex> guard(qb->lock);
+        if (qb->deque.empty()) {
+            return NULL;
+        }
+        struct Msg* m = qb->deque.front();
+        qb->deque.pop_front();
+        return m;
+    }
+    struct MpscNode* node = mpsc_pop(&qb->mpsc);
+    return node ? MPSC_ENTRY(node, struct Msg, node) : NULL;
+}
+
+static void queue_consumer(struct QueueBench* qb)
+{
+    while (qb->running.load(std::memory_order_acquire)) {
+        struct Msg* m = queue_pop(qb);
+        if (m) {
+            m->busy.store(0, std::memory_order_release);
+        }
+        else {
+            sched_yield();
+        }
+    }
+}
+
+static void bench_queue(void* ctx, uint64_t n)
+{
+    struct QueueBench* qb = (struct QueueBench* )ctx;
+    static thread_local struct Msg ring[BENCH_RING];
+
+    for (uint64_t i = 0; i < n; i++) {
+        struct Msg* m = &ring[i % BENCH_RING];
+        while (m->busy.load(std::memory_order_acquire)) {
+            sched_yield();
+        }
+        m->busy.store(1, std::memory_order_relaxed);
+        queue_push(qb, m);
+    }
+    // the ring dies with this thread, so wait until none of it is queued
+    for (int i = 0; i < BENCH_RING; i++) {
+        while (ring[i].busy.load(std::memory_order_acquire)) {
+            sched_yield();
+        }
+    }
+}
+
+struct BenchCase {
+    const char*     name;
+    PfBenchBody     body;
+    int             queue;          ///< -1 for the list cases, else "mutexed"
+    uint64_t        iterations;
+};
+
+static const struct BenchCase s_cases[] = {
+    { "ListNode",           bench_list_intrusive,   -1, 20000000 },
+    { "std::list",          bench_list_std,         -1, 5000000 },
+    { "MpscQueue",          bench_queue,            0,  1000000 },
+    { "mutex+std::deque",   bench_queue,            1,  1000000 },
+};
+
+int main(int argc, char** argv)
+{
+    int format = BENCH_FORMAT_CSV;
+    int maxThreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    struct BenchResult r;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-j") == 0) {
+            format = BENCH_FORMAT_JSON;
+        }
+        else {
+            maxThreads = atoi(argv[i]);
+        }
+    }
+    maxThreads = MAX(1, MIN(maxThreads, BENCH_MAX_THREADS));
+
+    bench_header(stdout, format);
+    for (unsigned c = 0; c < NUM_ARRAY_ELEM(s_cases); c++) {
+        for (int t = 1; t <= maxThreads; t = (t < maxThreads && t * 2 > maxThreads) ? maxThreads : t * 2) {
+            struct QueueBench qb;
+            std::thread consumer;
+            int rc;
+
+            if (s_cases[c].queue >= 0) {
+                qb.mutexed = s_cases[c].queue;
+                mpsc_init(&qb.mpsc);
+                qb.running.store(1);
+                consumer = std::thread(queue_consumer, &qb);
+            }
+            rc = bench_run(s_cases[c].name, "intrusive", s_cases[c].body, &qb, t,
+                           s_cases[c].iterations, &r);
+            if (s_cases[c].queue >= 0) {
+                qb.running.store(0, std::memory_order_release);
+                consumer.join();
+            }
+            if (rc != 0) {
+                fprintf(stderr, "%s: bench_run failed at %d threads\n", s_cases[c].name, t);
+                return 1;
+            }
+            bench_report(stdout, &r, format);
+            fflush(stdout);
+        }
+    }
+    return 0;
+}
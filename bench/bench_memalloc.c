@@ -0,0 +1,165 @@
+/** Allocator churn on 1..N threads: each thread keeps BENCH_LIVE objects
+ *  alive and every call frees a pseudo-randomly chosen one and allocates
+ *  its replacement, as a request-handling path does. The pool rows use one
+ *  shared struct Pool; the arena rows allocate BENCH_LIVE objects from a
+ *  per-thread arena and reset it, against malloc() and free() of the
+ *  same objects. Each size runs separately:
+ *
+ *   cc -O2 -I.. -o bench_memalloc bench_memalloc.c -lpthread
+ *   ./bench_memalloc [-j] [max_threads]
+ *
+ * Every allocation is touched once, so the rows include the first write
+ * to the object and not just the free-list manipulation.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define BENCH_IMPLEMENTATION
+#include "bench.h"
+#define MEMALLOC_IMPLEMENTATION
+#include "memalloc.h"
+
+#ifndef BENCH_LIVE
+#   define BENCH_LIVE       1024    ///< objects each thread keeps allocated
+#endif
+
+/** Object size and pool of the running case */
+struct ChurnCtx {
+    size_t          size;
+    struct Pool     pool;
+};
+
+static inline uint32_t churn_next(uint32_t* x)
+{
+    *x = *x * 1664525u + 1013904223u;
+    return *x >> 8;
+}
+
+static void bench_pool_churn(void* ctx, uint64_t n)
+{
+    struct ChurnCtx* cc = (struct ChurnCtx* )ctx;
+    void* live[BENCH_LIVE];
+    uint32_t x = (uint32_t)(uintptr_t)live;
+
+    for (int i = 0; i < BENCH_LIVE; i++) {
+        live[i] = pool_alloc(&cc->pool);
+    }
+    for (uint64_t i = 0; i < n; i++) {
+        uint32_t k = churn_next(&x) % BENCH_LIVE;
+        pool_free(&cc->pool, live[k]);
+        live[k] = pool_alloc(&cc->pool);
+        *(volatile uint64_t* )live[k] = i;
+    }
+    for (int i = 0; i < BENCH_LIVE; i++) {
+        pool_free(&cc->pool, live[i]);
+    }
+}
+
+static void bench_malloc_churn(void* ctx, uint64_t n)
+{
+    struct ChurnCtx* cc = (struct ChurnCtx* )ctx;
+    void* live[BENCH_LIVE];
+    uint32_t x = (uint32_t)(uintptr_t)live;
+
+    for (int i = 0; i < BENCH_LIVE; i++) {
+        live[i] = malloc(cc->size);
+    }
+    for (uint64_t i = 0; i < n; i++) {
+        uint32_t k = churn_next(&x) % BENCH_LIVE;
+        free(live[k]);
+        live[k] = malloc(cc->size);
+        *(volatile uint64_t* )live[k] = i;
+    }
+    for (int i = 0; i < BENCH_LIVE; i++) {
+        free(live[i]);
+    }
+}
+
+static void bench_arena_batch(void* ctx, uint64_t n)
+{
+    struct ChurnCtx* cc = (struct ChurnCtx* )ctx;
+    struct Arena a;
+
+    arena_init(&a, BENCH_LIVE * cc->size + 4096);
+    for (uint64_t i = 0; i < n; i += BENCH_LIVE) {
+        for (int k = 0; k < BENCH_LIVE; k++) {
+            *(volatile uint64_t* )arena_alloc(&a, cc->size) = i;
+        }
+        arena_reset(&a);
+    }
+    arena_destroy(&a);
+}
+
+static void bench_malloc_batch(void* ctx, uint64_t n)
+{
+    struct ChurnCtx* cc = (struct ChurnCtx* )ctx;
+    void* live[BENCH_LIVE];
+
+    for (uint64_t i = 0; i < n; i += BENCH_LIVE) {
+        for (int k = 0; k < BENCH_LIVE; k++) {
+            live[k] = malloc(cc->size);
+            *(volatile uint64_t* )live[k] = i;
+        }
+        for (int k = 0; k < BENCH_LIVE; k++) {
+            free(live[k]);
+        }
+    }
+}
+
+struct BenchCase {
+    const char*     name;
+    PfBenchBody     body;
+};
+
+static const struct BenchCase s_cases[] = {
+    { "pool_churn",         bench_pool_churn },
+    { "malloc_churn",       bench_malloc_churn },
+    { "arena_batch",        bench_arena_batch },
+    { "malloc_batch",       bench_malloc_batch },
+};
+
+static const size_t s_sizes[] = { 32, 128, 512 };
+
+int main(int argc, char** argv)
+{
+    int format = BENCH_FORMAT_CSV;
+    int maxThreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    struct BenchResult r;
+    struct ChurnCtx cc;
+    char config[32];
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-j") == 0) {
+            format = BENCH_FORMAT_JSON;
+        }
+        else {
+            maxThreads = atoi(argv[i]);
+        }
+    }
+    maxThreads = MAX(1, MIN(maxThreads, BENCH_MAX_THREADS));
+
+    bench_header(stdout, format);
+    for (unsigned s = 0; s < NUM_ARRAY_ELEM(s_sizes); s++) {
+        cc.size = s_sizes[s];
+        snprintf(config, sizeof(config), "%zu_bytes", cc.size);
+        for (unsigned c = 0; c < NUM_ARRAY_ELEM(s_cases); c++) {
+            for (int t = 1; t <= maxThreads; t = (t < maxThreads && t * 2 > maxThreads) ? maxThreads : t * 2) {
+                int rc;
+                if (pool_init(&cc.pool, cc.size, POOL_CACHE_ALIGNED) != 0) {
+                    fprintf(stderr, "pool_init failed\n");
+                    return 1;
+                }
+                rc = bench_run(s_cases[c].name, config, s_cases[c].body, &cc, t, 4000000, &r);
+                pool_destroy(&cc.pool);
+                if (rc != 0) {
+                    fprintf(stderr, "%s: bench_run failed at %d threads\n", s_cases[c].name, t);
+                    return 1;
+                }
+                bench_report(stdout, &r, format);
+                fflush(stdout);
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,142 @@
+/** Per-call cost of every PRINTx() family in debug.h, enabled and
+ *  suppressed, on 1..N threads. Build once per configuration and collect
+ *  the CSV (or JSON lines with "-j") from each run:
+ *
+ *   cc -O2 -I.. -o bench_print_out bench_print.c -lpthread
+ *   cc -O2 -I.. -DDEBUG_PRINT -DCURRENT_PRINT_LEVEL=PRINT_LEVEL_INFO \
+ *      -o bench_print_ct bench_print.c -lpthread
+ *   cc -O2 -I.. -DDEBUG_PRINT -DRUNTIME_PRINT_LEVEL -o bench_print_rt bench_print.c -lpthread
+ *   cc -O2 -I.. -DDEBUG_PRINT -DDYNAMIC_PRINT -DRUNTIME_PRINT_LEVEL \
+ *      -o bench_print_dyn bench_print.c -lpthread
+ *   ./bench_print_out [-j] [max_threads]
+ *
+ * The level is INFO and scope AREA00 is on, so PRINTW()/PRINTI() and
+ * SPRINTI(AREA00) print while PRINTD() and SPRINTI(AREA01) are suppressed.
+ * Output goes through vfprintf() to /dev/null, so enabled rows include the
+ * stdio lock that ucprintf() implementations typically contend on.
+ */
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define BENCH_IMPLEMENTATION
+#include "bench.h"
+#ifdef DYNAMIC_PRINT
+#   define PRINTSITE_IMPLEMENTATION
+#endif
+#include "debug.h"
+
+unsigned short g_currentPrintLevel = PRINT_LEVEL_INFO;
+unsigned short g_currentPrintScope = PRINT_SCOPE_AREA00;
+
+static FILE* s_devNull;
+
+int ucprintf(const char* fmt, ...)
+{
+    va_list ap;
+    int n;
+    va_start(ap, fmt);
+    n = vfprintf(s_devNull, fmt, ap);
+    va_end(ap);
+    return n;
+}
+
+static unsigned char s_hexBuf[64];
+
+/** One body per macro under test; BENCH_KEEP() stops a compiled-out body
+ *  from being folded into nothing, so that row measures the bare loop.
+ */
+#define BENCH_BODY(fn, stmt)  \
+    static void fn(void* ctx, uint64_t n) \
+    { \
+        (void)ctx; \
+        for (uint64_t i = 0; i < n; i++) { \
+            stmt; \
+            BENCH_KEEP(i); \
+        } \
+    }
+
+BENCH_BODY(bench_print,           PRINT("always %d\n", (int)i))
+BENCH_BODY(bench_printw,          PRINTW("warn %d\n", (int)i))
+BENCH_BODY(bench_printi,          PRINTI("info %d\n", (int)i))
+BENCH_BODY(bench_printd,          PRINTD("debug %d\n", (int)i))
+BENCH_BODY(bench_printv,          PRINTV("verbose %d\n", (int)i))
+BENCH_BODY(bench_printw_rl,       PRINTW_RATELIMITED("warn %d\n", (int)i))
+BENCH_BODY(bench_printd_rl,       PRINTD_RATELIMITED("debug %d\n", (int)i))
+BENCH_BODY(bench_printi_every,    PRINTI_EVERY_N(100, "info %d\n", (int)i))
+BENCH_BODY(bench_printd_every,    PRINTD_EVERY_N(100, "debug %d\n", (int)i))
+BENCH_BODY(bench_printi_sampled,  PRINTI_SAMPLED(100, "info %d\n", (int)i))
+BENCH_BODY(bench_printd_sampled,  PRINTD_SAMPLED(100, "debug %d\n", (int)i))
+BENCH_BODY(bench_printi_hex,      PRINTI_HEX(s_hexBuf, sizeof(s_hexBuf)))
+BENCH_BODY(bench_printd_hex,      PRINTD_HEX(s_hexBuf, sizeof(s_hexBuf)))
+#ifdef SPRINT
+BENCH_BODY(bench_sprinti_on,      SPRINTI(PRINT_SCOPE_AREA00, "info %d\n", (int)i))
+BENCH_BODY(bench_sprinti_off,     SPRINTI(PRINT_SCOPE_AREA01, "info %d\n", (int)i))
+BENCH_BODY(bench_sprintd,         SPRINTD(PRINT_SCOPE_AREA00, "debug %d\n", (int)i))
+#endif
+
+struct BenchCase {
+    const char*     name;
+    PfBenchBody     body;
+    uint64_t        iterations;     ///< fewer for bodies that really print
+};
+
+static const struct BenchCase s_cases[] = {
+    { "PRINT",                  bench_print,            200000 },
+    { "PRINTW",                 bench_printw,           200000 },
+    { "PRINTI",                 bench_printi,           200000 },
+    { "PRINTD",                 bench_printd,           10000000 },
+    { "PRINTV",                 bench_printv,           10000000 },
+    { "PRINTW_RATELIMITED",     bench_printw_rl,        2000000 },
+    { "PRINTD_RATELIMITED",     bench_printd_rl,        10000000 },
+    { "PRINTI_EVERY_N",         bench_printi_every,     2000000 },
+    { "PRINTD_EVERY_N",         bench_printd_every,     10000000 },
+    { "PRINTI_SAMPLED",         bench_printi_sampled,   2000000 },
+    { "PRINTD_SAMPLED",         bench_printd_sampled,   10000000 },
+    { "PRINTI_HEX",             bench_printi_hex,       50000 },
+    { "PRINTD_HEX",             bench_printd_hex,       10000000 },
+#ifdef SPRINT
+    { "SPRINTI_SCOPE_ON",       bench_sprinti_on,       200000 },
+    { "SPRINTI_SCOPE_OFF",      bench_sprinti_off,      10000000 },
+    { "SPRINTD",                bench_sprintd,          10000000 },
+#endif
+};
+
+int main(int argc, char** argv)
+{
+    int format = BENCH_FORMAT_CSV;
+    int maxThreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    struct BenchResult r;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-j") == 0) {
+            format = BENCH_FORMAT_JSON;
+        }
+        else {
+            maxThreads = atoi(argv[i]);
+        }
+    }
+    maxThreads = MAX(1, MIN(maxThreads, BENCH_MAX_THREADS));
+    s_devNull = fopen("/dev/null", "w");
+    if (!s_devNull) {
+        perror("/dev/null");
+        return 1;
+    }
+    memset(s_hexBuf, 0x5A, sizeof(s_hexBuf));
+
+    bench_header(stdout, format);
+    for (unsigned c = 0; c < NUM_ARRAY_ELEM(s_cases); c++) {
+        for (int t = 1; t <= maxThreads; t = (t < maxThreads && t * 2 > maxThreads) ? maxThreads : t * 2) {
+            if (bench_run(s_cases[c].name, BENCH_PRINT_CONFIG, s_cases[c].body, NULL, t,
+                          s_cases[c].iterations, &r) != 0) {
+                fprintf(stderr, "%s: bench_run failed at %d threads\n", s_cases[c].name, t);
+                return 1;
+            }
+            bench_report(stdout, &r, format);
+            fflush(stdout);
+        }
+    }
+    fclose(s_devNull);
+    return 0;
+}
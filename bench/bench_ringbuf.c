@@ -0,0 +1,341 @@
+/** Throughput and latency of the ringbuf.h rings against a bounded queue
+ *  guarded by a mutex and two condition variables, with 1..N producers
+ *  and as many consumers. Each producer pushes stamped messages as fast as
+ *  the queue takes them; each consumer records every message's latency
+ *  from push to pop. One row per queue and thread count gives the total
+ *  messages per second and the latency percentiles:
+ *
+ *   cc -O2 -I.. -o bench_ringbuf bench_ringbuf.c -lpthread
+ *   ./bench_ringbuf [-j] [-n messages_per_producer] [max_threads]
+ *
+ * The spin rows retry a failed push or pop with sched_yield(); the wait
+ * rows use the RING_BLOCKING *_wait() calls, which is the fair comparison
+ * with the condition variable queue. The SPSC ring only runs with one
+ * producer and one consumer.
+ */
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "bench.h"
+#define LOGCLOCK_IMPLEMENTATION
+#include "logclock.h"
+#define RINGBUF_IMPLEMENTATION
+#include "ringbuf.h"
+
+#ifndef BENCH_RING_CAPACITY
+#   define BENCH_RING_CAPACITY  1024
+#endif
+
+/** A message; a zero stamp tells the consumer to stop */
+struct BenchMsg {
+    uint64_t    stamp;
+    uint64_t    seq;
+};
+
+//////////////////////////////////////////////////////////////////////////////
+/** Bounded queue under a mutex, as the rings would otherwise be written */
+struct LockedQueue {
+    pthread_mutex_t     lock;
+    pthread_cond_t      notEmpty;
+    pthread_cond_t      notFull;
+    struct BenchMsg     buf[BENCH_RING_CAPACITY];
+    size_t              head;
+    size_t              tail;
+};
+
+static struct LockedQueue   s_locked;
+static struct MpmcRing      s_mpmc;
+static struct SpscRing      s_spsc;
+
+static int locked_init(void)
+{
+    s_locked.head = 0;
+    s_locked.tail = 0;
+    pthread_mutex_init(&s_locked.lock, NULL);
+    pthread_cond_init(&s_locked.notEmpty, NULL);
+    pthread_cond_init(&s_locked.notFull, NULL);
+    return 0;
+}
+
+static void locked_destroy(void)
+{
+    pthread_mutex_destroy(&s_locked.lock);
+    pthread_cond_destroy(&s_locked.notEmpty);
+    pthread_cond_destroy(&s_locked.notFull);
+}
+
+static void locked_push(const struct BenchMsg* m)
+{
+    pthread_mutex_lock(&s_locked.lock);
+    while (s_locked.head - s_locked.tail == BENCH_RING_CAPACITY) {
+        pthread_cond_wait(&s_locked.notFull, &s_locked.lock);
+    }
+    s_locked.buf[s_locked.head++ % BENCH_RING_CAPACITY] = *m;
+    pthread_cond_signal(&s_locked.notEmpty);
+    pthread_mutex_unlock(&s_locked.lock);
+}
+
+static void locked_pop(struct BenchMsg* m)
+{
+    pthread_mutex_lock(&s_locked.lock);
+    while (s_locked.head == s_locked.tail) {
+        pthread_cond_wait(&s_locked.notEmpty, &s_locked.lock);
+    }
+    *m = s_locked.buf[s_locked.tail++ % BENCH_RING_CAPACITY];
+    pthread_cond_signal(&s_locked.notFull);
+    pthread_mutex_unlock(&s_locked.lock);
+}
+
+static int mpmc_spin_init(void) { return mpmc_ring_init(&s_mpmc, BENCH_RING_CAPACITY, sizeof(struct BenchMsg), 0); }
+static int mpmc_wait_init(void) { return mpmc_ring_init(&s_mpmc, BENCH_RING_CAPACITY, sizeof(struct BenchMsg), RING_BLOCKING); }
+static void mpmc_destroy(void) { mpmc_ring_destroy(&s_mpmc); }
+
+static void mpmc_spin_push(const struct BenchMsg* m)
+{
+    while (mpmc_ring_push(&s_mpmc, m) != 0) {
+        sched_yield();
+    }
+}
+
+static void mpmc_spin_pop(struct BenchMsg* m)
+{
+    while (mpmc_ring_pop(&s_mpmc, m) != 0) {
+        sched_yield();
+    }
+}
+
+static void mpmc_wait_push(const struct BenchMsg* m) { mpmc_ring_push_wait(&s_mpmc, m); }
+static void mpmc_wait_pop(struct BenchMsg* m) { mpmc_ring_pop_wait(&s_mpmc, m); }
+
+static int spsc_wait_init(void) { return spsc_ring_init(&s_spsc, BENCH_RING_CAPACITY, sizeof(struct BenchMsg), RING_BLOCKING); }
+static void spsc_destroy(void) { spsc_ring_destroy(&s_spsc); }
+static void spsc_wait_push(const struct BenchMsg* m) { spsc_ring_push_wait(&s_spsc, m); }
+static void spsc_wait_pop(struct BenchMsg* m) { spsc_ring_pop_wait(&s_spsc, m); }
+
+struct BenchQueue {
+    const char* name;
+    int         spscOnly;
+    int         (*init)(void);
+    void        (*destroy)(void);
+    void        (*push)(const struct BenchMsg* m);
+    void        (*pop)(struct BenchMsg* m);
+};
+
+static const struct BenchQueue s_queues[] = {
+    { "mpmc_ring_spin",     0, mpmc_spin_init,  mpmc_destroy,   mpmc_spin_push, mpmc_spin_pop },
+    { "mpmc_ring_wait",     0, mpmc_wait_init,  mpmc_destroy,   mpmc_wait_push, mpmc_wait_pop },
+    { "spsc_ring_wait",     1, spsc_wait_init,  spsc_destroy,   spsc_wait_push, spsc_wait_pop },
+    { "mutex_condvar",      0, locked_init,     locked_destroy, locked_push,    locked_pop },
+};
+
+//////////////////////////////////////////////////////////////////////////////
+struct BenchConsumer {
+    pthread_t   thread;
+    uint32_t*   lat;            ///< ns from push to pop, one per message
+    size_t      count;
+    size_t      size;
+};
+
+static const struct BenchQueue* s_queue;
+static uint64_t                 s_perProducer = 200000;
+static pthread_mutex_t          s_gateLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t           s_gateOpen = PTHREAD_COND_INITIALIZER;
+static int                      s_gate;     ///< 0 closed, 1 run, -1 abandon the run
+
+/** Waits for the main thread to open the gate; returns 0 to run */
+static int bench_gate_wait(void)
+{
+    int gate;
+    pthread_mutex_lock(&s_gateLock);
+    while (s_gate == 0) {
+        pthread_cond_wait(&s_gateOpen, &s_gateLock);
+    }
+    gate = s_gate;
+    pthread_mutex_unlock(&s_gateLock);
+    return gate > 0 ? 0 : -1;
+}
+
+static void bench_gate_set(int gate)
+{
+    pthread_mutex_lock(&s_gateLock);
+    s_gate = gate;
+    pthread_cond_broadcast(&s_gateOpen);
+    pthread_mutex_unlock(&s_gateLock);
+}
+
+static void* bench_producer(void* arg)
+{
+    struct BenchMsg m;
+    (void)arg;
+    if (bench_gate_wait() != 0) {
+        return NULL;
+    }
+    for (uint64_t i = 0; i < s_perProducer; i++) {
+        m.seq = i;
+        m.stamp = logclock_now();
+        s_queue->push(&m);
+    }
+    return NULL;
+}
+
+static void* bench_consumer(void* arg)
+{
+    struct BenchConsumer* c = (struct BenchConsumer* )arg;
+    struct BenchMsg m;
+
+    if (bench_gate_wait() != 0) {
+        return NULL;
+    }
+    for (;;) {
+        s_queue->pop(&m);
+        if (m.stamp == 0) {
+            break;
+        }
+        if (c->count == c->size) {
+            size_t size = c->size ? c->size * 2 : 65536;
+            uint32_t* lat = (uint32_t* )realloc(c->lat, size * sizeof(*lat));
+            if (!lat) {
+                continue;       // keep draining; this sample is lost
+            }
+            c->lat = lat;
+            c->size = size;
+        }
+        c->lat[c->count++] = (uint32_t)MIN(logclock_delta_ns(m.stamp, logclock_now()), (int64_t)UINT32_MAX);
+    }
+    return NULL;
+}
+
+static int cmp_u32(const void* a, const void* b)
+{
+    uint32_t x = *(const uint32_t* )a;
+    uint32_t y = *(const uint32_t* )b;
+    return (x > y) - (x < y);
+}
+
+/** Runs one queue with "threads" producers and consumers; returns 0 on success */
+static int bench_queue(const struct BenchQueue* q, int threads, int format)
+{
+    pthread_t producers[BENCH_MAX_THREADS];
+    struct BenchConsumer consumers[BENCH_MAX_THREADS];
+    struct BenchMsg stop = { 0, 0 };
+    uint32_t* all;
+    size_t total = 0;
+    uint64_t start;
+    double secs;
+    int p = 0;
+    int c = 0;
+    int rc = -1;
+
+    memset(consumers, 0, sizeof(consumers));
+    if (q->init() != 0) {
+        return -1;
+    }
+    s_queue = q;
+    bench_gate_set(0);
+    for ( ; c < threads; c++) {
+        if (pthread_create(&consumers[c].thread, NULL, bench_consumer, &consumers[c]) != 0) {
+            break;
+        }
+    }
+    for ( ; c == threads && p < threads; p++) {
+        if (pthread_create(&producers[p], NULL, bench_producer, NULL) != 0) {
+            break;
+        }
+    }
+    if (c < threads || p < threads) {
+        // nothing has been queued yet, so the started threads just leave
+        bench_gate_set(-1);
+        while (p > 0) {
+            pthread_join(producers[--p], NULL);
+        }
+        while (c > 0) {
+            pthread_join(consumers[--c].thread, NULL);
+        }
+        q->destroy();
+        return -1;
+    }
+    start = logclock_now();
+    bench_gate_set(1);
+    for (p = 0; p < threads; p++) {
+        pthread_join(producers[p], NULL);
+    }
+    for (c = 0; c < threads; c++) {
+        q->push(&stop);
+    }
+    for (c = 0; c < threads; c++) {
+        pthread_join(consumers[c].thread, NULL);
+    }
+    secs = (double)logclock_delta_ns(start, logclock_now()) / 1e9;
+    q->destroy();
+
+    for (c = 0; c < threads; c++) {
+        total += consumers[c].count;
+    }
+    all = (uint32_t* )malloc(MAX(total, (size_t)1) * sizeof(*all));
+    if (all) {
+        size_t n = 0;
+        for (c = 0; c < threads; c++) {
+            memcpy(all + n, consumers[c].lat, consumers[c].count * sizeof(*all));
+            n += consumers[c].count;
+        }
+        qsort(all, total, sizeof(*all), cmp_u32);
+#define BENCH_PCT(pct)  (total ? all[(size_t)((double)(total - 1) * (pct))] : 0)
+        if (format == BENCH_FORMAT_JSON) {
+            printf("{\"name\":\"%s\",\"threads\":%d,\"messages\":%zu,\"ops_per_sec\":%.0f,"
+                   "\"p50_ns\":%u,\"p99_ns\":%u,\"p999_ns\":%u,\"max_ns\":%u}\n",
+                   q->name, threads, total, (double)total / secs,
+                   BENCH_PCT(0.5), BENCH_PCT(0.99), BENCH_PCT(0.999), BENCH_PCT(1.0));
+        }
+        else {
+            printf("%s,%d,%zu,%.0f,%u,%u,%u,%u\n", q->name, threads, total, (double)total / secs,
+                   BENCH_PCT(0.5), BENCH_PCT(0.99), BENCH_PCT(0.999), BENCH_PCT(1.0));
+        }
+#undef BENCH_PCT
+        fflush(stdout);
+        free(all);
+        rc = 0;
+    }
+    for (c = 0; c < threads; c++) {
+        free(consumers[c].lat);
+    }
+    return rc;
+}
+
+int main(int argc, char** argv)
+{
+    int format = BENCH_FORMAT_CSV;
+    int maxThreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-j") == 0) {
+            format = BENCH_FORMAT_JSON;
+        }
+        else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            s_perProducer = strtoull(argv[++i], NULL, 0);
+        }
+        else {
+            maxThreads = atoi(argv[i]);
+        }
+    }
+    maxThreads = MAX(1, MIN(maxThreads, BENCH_MAX_THREADS / 2));
+    logclock_calibrate();
+
+    if (format == BENCH_FORMAT_CSV) {
+        printf("name,threads,messages,ops_per_sec,p50_ns,p99_ns,p999_ns,max_ns\n");
+    }
+    for (unsigned q = 0; q < NUM_ARRAY_ELEM(s_queues); q++) {
+        for (int t = 1; t <= maxThreads; t = (t < maxThreads && t * 2 > maxThreads) ? maxThreads : t * 2) {
+            if (s_queues[q].spscOnly && t > 1) {
+                break;
+            }
+            if (bench_queue(&s_queues[q], t, format) != 0) {
+                fprintf(stderr, "%s: run failed at %d threads\n", s_queues[q].name, t);
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
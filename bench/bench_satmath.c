@@ -0,0 +1,133 @@
+/** Per-element cost of the satmath.h array kernels against the same work
+ *  written as a loop over the scalar CLIP()/BITSHIFT() macros from
+ *  macros.h, on 1..N threads (each with its own buffers). Every call
+ *  processes one element, so the rows compare directly:
+ *
+ *   cc -O2 -I.. -o bench_satmath bench_satmath.c -lpthread
+ *   cc -O3 -march=native -I.. -o bench_satmath_native bench_satmath.c -lpthread
+ *   ./bench_satmath [-j] [max_threads]
+ *
+ * The scalar loops are what the kernels replace; whether the compiler
+ * vectorizes them as well depends on the flags, which is the point of
+ * building both ways.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define BENCH_IMPLEMENTATION
+#include "bench.h"
+#define SATMATH_IMPLEMENTATION
+#include "satmath.h"
+
+#ifndef BENCH_SAT_BLOCK
+#   define BENCH_SAT_BLOCK      4096    ///< elements per kernel call
+#endif
+
+static __thread int16_t t_a16[BENCH_SAT_BLOCK];
+static __thread int16_t t_b16[BENCH_SAT_BLOCK];
+static __thread int16_t t_d16[BENCH_SAT_BLOCK];
+static __thread int32_t t_a32[BENCH_SAT_BLOCK];
+static __thread int32_t t_d32[BENCH_SAT_BLOCK];
+static __thread float   t_af[BENCH_SAT_BLOCK];
+static __thread float   t_df[BENCH_SAT_BLOCK];
+
+/** Bounds live in globals so the compiler cannot specialize on them */
+int16_t g_lo16 = -2048, g_hi16 = 2047;
+int32_t g_lo32 = -100000, g_hi32 = 100000;
+float   g_loF = -1.0f, g_hiF = 1.0f;
+int     g_shift = -3;
+
+static void bench_fill(void)
+{
+    uint32_t x = 0x12345678u;
+    for (int i = 0; i < BENCH_SAT_BLOCK; i++) {
+        x = x * 1664525u + 1013904223u;
+        t_a16[i] = (int16_t)(x >> 16);
+        t_b16[i] = (int16_t)x;
+        t_a32[i] = (int32_t)x;
+        t_af[i] = (float)(int16_t)x / 8192.0f;
+    }
+}
+
+/** One body per kernel; "n" elements are processed in whole blocks */
+#define BENCH_BODY(fn, stmt, out)  \
+    static void fn(void* ctx, uint64_t n) \
+    { \
+        (void)ctx; \
+        bench_fill(); \
+        for (uint64_t done = 0; done < n; done += BENCH_SAT_BLOCK) { \
+            stmt; \
+            BENCH_KEEP(out[done % BENCH_SAT_BLOCK]); \
+        } \
+    }
+
+BENCH_BODY(bench_clip_i16_array,  sat_clip_i16_array(t_d16, t_a16, BENCH_SAT_BLOCK, g_lo16, g_hi16), t_d16)
+BENCH_BODY(bench_clip_i16_macro,
+           for (int i = 0; i < BENCH_SAT_BLOCK; i++) { t_d16[i] = CLIP(t_a16[i], g_lo16, g_hi16); }, t_d16)
+BENCH_BODY(bench_clip_i32_array,  sat_clip_i32_array(t_d32, t_a32, BENCH_SAT_BLOCK, g_lo32, g_hi32), t_d32)
+BENCH_BODY(bench_clip_i32_macro,
+           for (int i = 0; i < BENCH_SAT_BLOCK; i++) { t_d32[i] = CLIP(t_a32[i], g_lo32, g_hi32); }, t_d32)
+BENCH_BODY(bench_clip_f32_array,  sat_clip_f32_array(t_df, t_af, BENCH_SAT_BLOCK, g_loF, g_hiF), t_df)
+BENCH_BODY(bench_clip_f32_macro,
+           for (int i = 0; i < BENCH_SAT_BLOCK; i++) { t_df[i] = CLIP(t_af[i], g_loF, g_hiF); }, t_df)
+BENCH_BODY(bench_add_i16_array,   sat_add_i16_array(t_d16, t_a16, t_b16, BENCH_SAT_BLOCK), t_d16)
+BENCH_BODY(bench_add_i16_macro,
+           for (int i = 0; i < BENCH_SAT_BLOCK; i++) { t_d16[i] = (int16_t)CLIP(t_a16[i] + t_b16[i], INT16_MIN, INT16_MAX); }, t_d16)
+BENCH_BODY(bench_mul_q15_array,   sat_mul_q15_array(t_d16, t_a16, t_b16, BENCH_SAT_BLOCK), t_d16)
+BENCH_BODY(bench_mul_q15_macro,
+           for (int i = 0; i < BENCH_SAT_BLOCK; i++) { t_d16[i] = (int16_t)CLIP((t_a16[i] * t_b16[i] + (1 << 14)) >> 15, INT16_MIN, INT16_MAX); }, t_d16)
+BENCH_BODY(bench_shift_i16_array, sat_shift_i16_array(t_d16, t_a16, BENCH_SAT_BLOCK, g_shift), t_d16)
+BENCH_BODY(bench_shift_i16_macro,
+           for (int i = 0; i < BENCH_SAT_BLOCK; i++) { t_d16[i] = (int16_t)CLIP(BITSHIFT((int32_t)t_a16[i], g_shift), INT16_MIN, INT16_MAX); }, t_d16)
+
+struct BenchCase {
+    const char*     name;
+    PfBenchBody     body;
+};
+
+static const struct BenchCase s_cases[] = {
+    { "sat_clip_i16_array",     bench_clip_i16_array },
+    { "CLIP_i16_loop",          bench_clip_i16_macro },
+    { "sat_clip_i32_array",     bench_clip_i32_array },
+    { "CLIP_i32_loop",          bench_clip_i32_macro },
+    { "sat_clip_f32_array",     bench_clip_f32_array },
+    { "CLIP_f32_loop",          bench_clip_f32_macro },
+    { "sat_add_i16_array",      bench_add_i16_array },
+    { "CLIP_add_i16_loop",      bench_add_i16_macro },
+    { "sat_mul_q15_array",      bench_mul_q15_array },
+    { "CLIP_mul_q15_loop",      bench_mul_q15_macro },
+    { "sat_shift_i16_array",    bench_shift_i16_array },
+    { "BITSHIFT_i16_loop",      bench_shift_i16_macro },
+};
+
+int main(int argc, char** argv)
+{
+    int format = BENCH_FORMAT_CSV;
+    int maxThreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    struct BenchResult r;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-j") == 0) {
+            format = BENCH_FORMAT_JSON;
+        }
+        else {
+            maxThreads = atoi(argv[i]);
+        }
+    }
+    maxThreads = MAX(1, MIN(maxThreads, BENCH_MAX_THREADS));
+
+    bench_header(stdout, format);
+    for (unsigned c = 0; c < NUM_ARRAY_ELEM(s_cases); c++) {
+        for (int t = 1; t <= maxThreads; t = (t < maxThreads && t * 2 > maxThreads) ? maxThreads : t * 2) {
+            if (bench_run(s_cases[c].name, "satmath", s_cases[c].body, NULL, t,
+                          64 * BENCH_SAT_BLOCK * 64, &r) != 0) {
+                fprintf(stderr, "%s: bench_run failed at %d threads\n", s_cases[c].name, t);
+                return 1;
+            }
+            bench_report(stdout, &r, format);
+            fflush(stdout);
+        }
+    }
+    return 0;
+}
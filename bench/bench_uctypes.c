@@ -0,0 +1,122 @@
+/** Throughput of the uctypes.h bulk byte swaps against a loop over the
+ *  per-element htons()/htonl()/htonll() macros, for buffers that fit in
+ *  L1, in L2/L3 and only in DRAM, on 1..N threads (each with its own
+ *  buffers):
+ *
+ *   cc -O2 -I.. -o bench_uctypes bench_uctypes.c -lpthread
+ *   cc -O3 -march=native -I.. -o bench_uctypes_native bench_uctypes.c -lpthread
+ *   ./bench_uctypes [-j] [max_threads]
+ *
+ * Each call converts one byte, so the CSV/JSON rows on stdout are ns per
+ * byte; the same results as GB/s per thread go to stderr.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define BENCH_IMPLEMENTATION
+#include "bench.h"
+#define UCTYPES_IMPLEMENTATION
+#include "uctypes.h"
+
+/** Buffer sizes measured, smallest first */
+static const size_t s_sizes[] = { 4u << 10, 1u << 20, 64u << 20 };
+
+static __thread size_t t_size;
+static __thread void*  t_src;
+static __thread void*  t_dst;
+
+/** Per-thread buffers of "size" bytes, reallocated when the size changes */
+static int bench_buffers(size_t size)
+{
+    if (t_size != size) {
+        free(t_src);
+        free(t_dst);
+        t_src = aligned_alloc(64, size);
+        t_dst = aligned_alloc(64, size);
+        if (!t_src || !t_dst) {
+            return -1;
+        }
+        memset(t_src, 0xA5, size);
+        memset(t_dst, 0, size);
+        t_size = size;
+    }
+    return 0;
+}
+
+/** One body per routine; "n" bytes are converted in whole buffers */
+#define BENCH_BODY(fn, T, stmt)  \
+    static void fn(void* ctx, uint64_t n) \
+    { \
+        size_t size = *(const size_t* )ctx; \
+        size_t count = size / sizeof(T); \
+        if (bench_buffers(size) != 0) { \
+            abort(); \
+        } \
+        T* dst = (T* )t_dst; \
+        const T* src = (const T* )t_src; \
+        for (uint64_t done = 0; done < n; done += size) { \
+            stmt; \
+            BENCH_KEEP(dst[done % count]); \
+        } \
+    }
+
+BENCH_BODY(bench_hton16_array, uint16_t, hton16_array(dst, src, count))
+BENCH_BODY(bench_hton32_array, uint32_t, hton32_array(dst, src, count))
+BENCH_BODY(bench_hton64_array, uint64_t, hton64_array(dst, src, count))
+BENCH_BODY(bench_htons_loop,   uint16_t, for (size_t i = 0; i < count; i++) { dst[i] = htons(src[i]); })
+BENCH_BODY(bench_htonl_loop,   uint32_t, for (size_t i = 0; i < count; i++) { dst[i] = htonl(src[i]); })
+BENCH_BODY(bench_htonll_loop,  uint64_t, for (size_t i = 0; i < count; i++) { dst[i] = htonll(src[i]); })
+
+struct BenchCase {
+    const char*     name;
+    PfBenchBody     body;
+};
+
+static const struct BenchCase s_cases[] = {
+    { "hton16_array",       bench_hton16_array },
+    { "htons_loop",         bench_htons_loop },
+    { "hton32_array",       bench_hton32_array },
+    { "htonl_loop",         bench_htonl_loop },
+    { "hton64_array",       bench_hton64_array },
+    { "htonll_loop",        bench_htonll_loop },
+};
+
+int main(int argc, char** argv)
+{
+    int format = BENCH_FORMAT_CSV;
+    int maxThreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    struct BenchResult r;
+    char config[32];
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-j") == 0) {
+            format = BENCH_FORMAT_JSON;
+        }
+        else {
+            maxThreads = atoi(argv[i]);
+        }
+    }
+    maxThreads = MAX(1, MIN(maxThreads, BENCH_MAX_THREADS));
+
+    bench_header(stdout, format);
+    fprintf(stderr, "%-14s %10s %8s %10s\n", "routine", "bytes", "threads", "GB/s");
+    for (unsigned s = 0; s < NUM_ARRAY_ELEM(s_sizes); s++) {
+        size_t size = s_sizes[s];
+        // at least 256 MiB per run, and at least 4 passes over the buffer
+        uint64_t bytes = MAX((uint64_t)256 << 20, (uint64_t)size * 4);
+        snprintf(config, sizeof(config), "%zu_bytes", size);
+        for (unsigned c = 0; c < NUM_ARRAY_ELEM(s_cases); c++) {
+            for (int t = 1; t <= maxThreads; t = (t < maxThreads && t * 2 > maxThreads) ? maxThreads : t * 2) {
+                if (bench_run(s_cases[c].name, config, s_cases[c].body, &size, t, bytes, &r) != 0) {
+                    fprintf(stderr, "%s: bench_run failed at %d threads\n", s_cases[c].name, t);
+                    return 1;
+                }
+                bench_report(stdout, &r, format);
+                fflush(stdout);
+                fprintf(stderr, "%-14s %10zu %8d %10.2f\n", s_cases[c].name, size, t, 1.0 / r.nsMedian);
+            }
+        }
+    }
+    return 0;
+}
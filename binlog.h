@@ -0,0 +1,834 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org>
+*/
+#ifndef __BINLOG_H__
+#define __BINLOG_H__
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "macros.h"
+
+/** @file
+ * This file contains a deferred, binary logging mode for the PRINTx()
+ * macros in debug.h plus the offline decoder that turns the binary records
+ * back into text.
+ **/
+
+/**
+ *                      Binary Log Overview
+ * =====================================================================
+ * A BINLOG() call site never formats anything. Each call site owns a static
+ * descriptor holding the format string literal, file, line, level and the
+ * argument type tags; the tags are worked out at compile time from the
+ * argument expressions (_Generic in C, type traits in C++). At run-time the
+ * call site only copies its 32-bit ID and the raw argument bytes into a
+ * per-thread buffer, which is written out in large chunks.
+ *
+ * The first time a call site fires it is assigned an ID and a definition
+ * record (ID, level, line, file, format, tags) is written to the log. Every
+ * later hit writes a message record: record type, ID, then the packed
+ * arguments (4 bytes for int-sized integers, 8 bytes for 64-bit integers,
+ * doubles and pointers, length + bytes for strings).
+ *
+ * Debug Print Integration
+ * ----------------------------------------------
+ * Defining BINARY_PRINT (together with DEBUG_PRINT) routes all PRINTx() and
+ * SPRINTx() output in debug.h through BINLOG(). In this mode the "fmt"
+ * argument MUST be a string literal, and at most BINLOG_MAX_ARGS arguments
+ * are supported.
+ *
+ * Config Defines
+ * ----------------------------------------------
+ *   BINLOG_BUF_SIZE      Per-thread buffer size in bytes    (default 64K)
+ *   BINLOG_MAX_STR       Longest string argument recorded   (default 128)
+ *
+ * Usage
+ * ----------------------------------------------
+ * Define BINLOG_IMPLEMENTATION in exactly one .c file before including this
+ * file, then:
+ *   binlog_open("app.blog");
+ *   BINLOG(PRINT_LEVEL_INFO, "rx %u bytes from %s\n", len, ifname);
+ *   binlog_close();
+ *
+ * Worker threads flush their buffers when they fill, when the thread exits,
+ * or when the thread calls binlog_flush(); binlog_close() flushes the
+ * buffers of all live threads.
+ *
+ * Decoder
+ * ----------------------------------------------
+ * binlog_decode() converts a binary log back to text. A stand-alone decoder
+ * can be built straight from this file:
+ *   cc -x c -DBINLOG_DECODER_MAIN -o binlog_decode binlog.h
+ *   ./binlog_decode app.blog > app.log
+ * The decoder must run on a host with the same byte order as the producer.
+ */
+
+//////////////////////////////////////////////////////////////////////////////
+#ifndef BINLOG_BUF_SIZE
+#   define BINLOG_BUF_SIZE      (64 * 1024)
+#endif
+#ifndef BINLOG_MAX_STR
+#   define BINLOG_MAX_STR       128
+#endif
+#define BINLOG_MAX_ARGS         12
+
+/** Largest possible message record (header plus all-string arguments) */
+#define BINLOG_MAX_RECORD       (5 + BINLOG_MAX_ARGS * (2 + BINLOG_MAX_STR))
+
+#if BINLOG_BUF_SIZE < BINLOG_MAX_RECORD
+#   error "BINLOG_BUF_SIZE must hold at least one BINLOG_MAX_RECORD record"
+#endif
+
+/** Argument type tags */
+#define BINLOG_ARG_I32          1
+#define BINLOG_ARG_U32          2
+#define BINLOG_ARG_I64          3
+#define BINLOG_ARG_U64          4
+#define BINLOG_ARG_F64          5
+#define BINLOG_ARG_STR          6
+#define BINLOG_ARG_PTR          7
+
+/** Record types */
+#define BINLOG_REC_DEF          0xD1
+#define BINLOG_REC_MSG          0xA5
+
+/** File header magic ("BLG1" in memory) */
+#define BINLOG_MAGIC            FCC('B', 'L', 'G', '1')
+
+/** Static per-call-site descriptor */
+struct BinlogSite {
+    uint32_t            id;         ///< 0 until first use
+    uint8_t             level;
+    uint8_t             nargs;
+    const uint8_t*      tags;
+    const char*         file;
+    int                 line;
+    const char*         fmt;
+    struct BinlogSite*  next;       ///< registration list
+};
+
+EXTERN_CPP_START
+
+/** Opens (truncates) "path" as the binary log; returns 0 on success */
+int binlog_open(const char* path);
+
+/** Uses an already open stream as the binary log */
+int binlog_attach(FILE* out);
+
+/** Flushes every thread's buffer and closes the log */
+void binlog_close(void);
+
+/** Writes the calling thread's buffer to the log */
+void binlog_flush(void);
+
+/** Converts a binary log back to text; returns 0 on success */
+int binlog_decode(FILE* in, FILE* out);
+
+/** Internal: assigns an ID to a site and emits its definition */
+void binlog_register(struct BinlogSite* site);
+
+/** Internal: returns room for "size" bytes in the calling thread's buffer */
+uint8_t* binlog_reserve(size_t size);
+
+/** Internal: marks the buffer as used up to "end" */
+void binlog_commit(uint8_t* end);
+
+EXTERN_CPP_END
+
+//////////////////////////////////////////////////////////////////////////////
+/** Argument packing helpers; each returns the next write position */
+static inline uint8_t* binlog__put_i32(uint8_t* p, int32_t v)   { memcpy(p, &v, 4); return p + 4; }
+static inline uint8_t* binlog__put_u32(uint8_t* p, uint32_t v)  { memcpy(p, &v, 4); return p + 4; }
+static inline uint8_t* binlog__put_i64(uint8_t* p, int64_t v)   { memcpy(p, &v, 8); return p + 8; }
+static inline uint8_t* binlog__put_u64(uint8_t* p, uint64_t v)  { memcpy(p, &v, 8); return p + 8; }
+static inline uint8_t* binlog__put_f64(uint8_t* p, double v)    { memcpy(p, &v, 8); return p + 8; }
+static inline uint8_t* binlog__put_ptr(uint8_t* p, const void* v)
+{
+    uint64_t u = (uint64_t)(uintptr_t)v;
+    memcpy(p, &u, 8);
+    return p + 8;
+}
+static inline uint8_t* binlog__put_str(uint8_t* p, const char* s)
+{
+    uint16_t len = 0;
+    if (s) {
+        while (len < BINLOG_MAX_STR && s[len]) {
+            len++;
+        }
+    }
+    memcpy(p, &len, 2);
+    if (len) {
+        memcpy(p + 2, s, len);
+    }
+    return p + 2 + len;
+}
+static inline uint8_t* binlog__put_hdr(uint8_t* p, uint32_t id)
+{
+    *p = BINLOG_REC_MSG;
+    memcpy(p + 1, &id, 4);
+    return p + 5;
+}
+
+#ifndef __cplusplus
+#   define BINLOG__TAG(x) _Generic((x), \
+        _Bool: BINLOG_ARG_I32, char: BINLOG_ARG_I32, \
+        signed char: BINLOG_ARG_I32, unsigned char: BINLOG_ARG_I32, \
+        short: BINLOG_ARG_I32, unsigned short: BINLOG_ARG_I32, \
+        int: BINLOG_ARG_I32, unsigned int: BINLOG_ARG_U32, \
+        long: BINLOG_ARG_I64, unsigned long: BINLOG_ARG_U64, \
+        long long: BINLOG_ARG_I64, unsigned long long: BINLOG_ARG_U64, \
+        float: BINLOG_ARG_F64, double: BINLOG_ARG_F64, long double: BINLOG_ARG_F64, \
+        char*: BINLOG_ARG_STR, const char*: BINLOG_ARG_STR, \
+        default: BINLOG_ARG_PTR)
+#   define BINLOG__PUT(p, x) _Generic((x), \
+        _Bool: binlog__put_i32, char: binlog__put_i32, \
+        signed char: binlog__put_i32, unsigned char: binlog__put_i32, \
+        short: binlog__put_i32, unsigned short: binlog__put_i32, \
+        int: binlog__put_i32, unsigned int: binlog__put_u32, \
+        long: binlog__put_i64, unsigned long: binlog__put_u64, \
+        long long: binlog__put_i64, unsigned long long: binlog__put_u64, \
+        float: binlog__put_f64, double: binlog__put_f64, long double: binlog__put_f64, \
+        char*: binlog__put_str, const char*: binlog__put_str, \
+        default: binlog__put_ptr)(p, x)
+#else
+#include <type_traits>
+template <typename T> struct BinlogTag
+    { enum { value = std::is_enum<T>::value ? BINLOG_ARG_I32 : BINLOG_ARG_PTR }; };
+template <> struct BinlogTag<bool>                           { enum { value = BINLOG_ARG_I32 }; };
+template <> struct BinlogTag<char>                           { enum { value = BINLOG_ARG_I32 }; };
+template <> struct BinlogTag<signed char>                    { enum { value = BINLOG_ARG_I32 }; };
+template <> struct BinlogTag<unsigned char>                  { enum { value = BINLOG_ARG_I32 }; };
+template <> struct BinlogTag<short>                          { enum { value = BINLOG_ARG_I32 }; };
+template <> struct BinlogTag<unsigned short>                 { enum { value = BINLOG_ARG_I32 }; };
+template <> struct BinlogTag<int>                            { enum { value = BINLOG_ARG_I32 }; };
+template <> struct BinlogTag<unsigned int>                   { enum { value = BINLOG_ARG_U32 }; };
+template <> struct BinlogTag<long>                           { enum { value = BINLOG_ARG_I64 }; };
+template <> struct BinlogTag<unsigned long>                  { enum { value = BINLOG_ARG_U64 }; };
+template <> struct BinlogTag<long long>                      { enum { value = BINLOG_ARG_I64 }; };
+template <> struct BinlogTag<unsigned long long>             { enum { value = BINLOG_ARG_U64 }; };
+template <> struct BinlogTag<float>                          { enum { value = BINLOG_ARG_F64 }; };
+template <> struct BinlogTag<double>                         { enum { value = BINLOG_ARG_F64 }; };
+template <> struct BinlogTag<long double>                    { enum { value = BINLOG_ARG_F64 }; };
+template <> struct BinlogTag<char*>                          { enum { value = BINLOG_ARG_STR }; };
+template <> struct BinlogTag<const char*>                    { enum { value = BINLOG_ARG_STR }; };
+static inline uint8_t* binlog__put(uint8_t* p, bool v)               { return binlog__put_i32(p, v); }
+static inline uint8_t* binlog__put(uint8_t* p, char v)               { return binlog__put_i32(p, v); }
+static inline uint8_t* binlog__put(uint8_t* p, signed char v)        { return binlog__put_i32(p, v); }
+static inline uint8_t* binlog__put(uint8_t* p, unsigned char v)      { return binlog__put_i32(p, v); }
+static inline uint8_t* binlog__put(uint8_t* p, short v)              { return binlog__put_i32(p, v); }
+static inline uint8_t* binlog__put(uint8_t* p, unsigned short v)     { return binlog__put_i32(p, v); }
+static inline uint8_t* binlog__put(uint8_t* p, int v)                { return binlog__put_i32(p, v); }
+static inline uint8_t* binlog__put(uint8_t* p, unsigned int v)       { return binlog__put_u32(p, v); }
+static inline uint8_t* binlog__put(uint8_t* p, long v)               { return binlog__put_i64(p, v); }
+static inline uint8_t* binlog__put(uint8_t* p, unsigned long v)      { return binlog__put_u64(p, v); }
+static inline uint8_t* binlog__put(uint8_t* p, long long v)          { return binlog__put_i64(p, v); }
+static inline uint8_t* binlog__put(uint8_t* p, unsigned long long v) { return binlog__put_u64(p, v); }
+static inline uint8_t* binlog__put(uint8_t* p, float v)              { return binlog__put_f64(p, v); }
+static inline uint8_t* binlog__put(uint8_t* p, double v)             { return binlog__put_f64(p, v); }
+static inline uint8_t* binlog__put(uint8_t* p, long double v)        { return binlog__put_f64(p, (double)v); }
+static inline uint8_t* binlog__put(uint8_t* p, char* v)              { return binlog__put_str(p, v); }
+static inline uint8_t* binlog__put(uint8_t* p, const char* v)        { return binlog__put_str(p, v); }
+static inline uint8_t* binlog__put(uint8_t* p, const void* v)        { return binlog__put_ptr(p, v); }
+#   define BINLOG__TAG(x)       BinlogTag<std::decay<decltype(x)>::type>::value
+#   define BINLOG__PUT(p, x)    binlog__put(p, x)
+#endif
+
+/** Worst-case packed size of one argument */
+#define BINLOG__SIZE(x)         (BINLOG__TAG(x) == BINLOG_ARG_STR ? 2 + BINLOG_MAX_STR : 8)
+
+/** Argument counting and iteration (up to BINLOG_MAX_ARGS) */
+#define BINLOG__CAT(a, b)       BINLOG__CAT_(a, b)
+#define BINLOG__CAT_(a, b)      a ## b
+#define BINLOG__NARGS(args...)  BINLOG__NARGS_(_, ## args, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define BINLOG__NARGS_(_0, _1, _2, _3, _4, _5, _6, _7, _8, _9, _10, _11, _12, n, ...) n
+#define BINLOG__FE_0(m)
+#define BINLOG__FE_1(m, a)      m(a)
+#define BINLOG__FE_2(m, a, ...) m(a) BINLOG__FE_1(m, __VA_ARGS__)
+#define BINLOG__FE_3(m, a, ...) m(a) BINLOG__FE_2(m, __VA_ARGS__)
+#define BINLOG__FE_4(m, a, ...) m(a) BINLOG__FE_3(m, __VA_ARGS__)
+#define BINLOG__FE_5(m, a, ...) m(a) BINLOG__FE_4(m, __VA_ARGS__)
+#define BINLOG__FE_6(m, a, ...) m(a) BINLOG__FE_5(m, __VA_ARGS__)
+#define BINLOG__FE_7(m, a, ...) m(a) BINLOG__FE_6(m, __VA_ARGS__)
+#define BINLOG__FE_8(m, a, ...) m(a) BINLOG__FE_7(m, __VA_ARGS__)
+#define BINLOG__FE_9(m, a, ...) m(a) BINLOG__FE_8(m, __VA_ARGS__)
+#define BINLOG__FE_10(m, a, ...) m(a) BINLOG__FE_9(m, __VA_ARGS__)
+#define BINLOG__FE_11(m, a, ...) m(a) BINLOG__FE_10(m, __VA_ARGS__)
+#define BINLOG__FE_12(m, a, ...) m(a) BINLOG__FE_11(m, __VA_ARGS__)
+#define BINLOG__FOREACH(m, args...) BINLOG__CAT(BINLOG__FE_, BINLOG__NARGS(args))(m , ## args)
+
+#define BINLOG__TAG_ITEM(x)     , (uint8_t)BINLOG__TAG(x)
+#define BINLOG__SIZE_ITEM(x)    + BINLOG__SIZE(x)
+#define BINLOG__PUT_ITEM(x)     binlog__p = BINLOG__PUT(binlog__p, x);
+
+/** Records one message; "fmt" must be a string literal */
+#define BINLOG(level, fmt, args...)  \
+    do { \
+        static const uint8_t binlog__tags[] = { 0 BINLOG__FOREACH(BINLOG__TAG_ITEM , ## args) }; \
+        static struct BinlogSite binlog__site = \
+            { 0, (uint8_t)(level), BINLOG__NARGS(args), binlog__tags + 1, __FILE__, __LINE__, "" fmt, NULL }; \
+        uint8_t* binlog__p; \
+        if (__builtin_expect(__atomic_load_n(&binlog__site.id, __ATOMIC_ACQUIRE) == 0, 0)) { \
+            binlog_register(&binlog__site); \
+        } \
+        binlog__p = binlog_reserve(5 BINLOG__FOREACH(BINLOG__SIZE_ITEM , ## args)); \
+        binlog__p = binlog__put_hdr(binlog__p, binlog__site.id); \
+        BINLOG__FOREACH(BINLOG__PUT_ITEM , ## args) \
+        binlog_commit(binlog__p); \
+    } while (0)
+
+
+#endif  // __BINLOG_H__
+
+
+//////////////////////////////////////////////////////////////////////////////
+#if (defined(BINLOG_IMPLEMENTATION) || defined(BINLOG_DECODER_MAIN)) && !defined(__BINLOG_DECODER__)
+#define __BINLOG_DECODER__
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <sys/types.h>
+
+/** Reads "len" bytes from the stream; returns 0 on success */
+static int binlog__read(FILE* in, void* dst, size_t len)
+{
+    return fread(dst, 1, len, in) == len ? 0 : -1;
+}
+
+/** Reads one packed argument of type "tag"; returns 0 on success */
+static int binlog__read_arg(FILE* in, int tag, uint8_t* val, char* str)
+{
+    uint16_t len;
+    str[0] = '\0';
+    switch (tag) {
+        case 0:
+            return 0;
+        case BINLOG_ARG_STR:
+            if (binlog__read(in, &len, 2) || len > BINLOG_MAX_STR || binlog__read(in, str, len)) {
+                return -1;
+            }
+            str[len] = '\0';
+            return 0;
+        case BINLOG_ARG_I32:
+        case BINLOG_ARG_U32:
+            return binlog__read(in, val, 4);
+        case BINLOG_ARG_I64:
+        case BINLOG_ARG_U64:
+        case BINLOG_ARG_F64:
+        case BINLOG_ARG_PTR:
+            return binlog__read(in, val, 8);
+        default:
+            return -1;
+    }
+}
+
+/** Returns a decoded integer argument as an int (used for '*' widths) */
+static int binlog__arg_int(int tag, const uint8_t* val)
+{
+    int32_t  i32;
+    int64_t  i64;
+    double   f64;
+    switch (tag) {
+        case BINLOG_ARG_I32:
+        case BINLOG_ARG_U32: memcpy(&i32, val, 4); return i32;
+        case BINLOG_ARG_F64: memcpy(&f64, val, 8); return (int)f64;
+        case BINLOG_ARG_I64:
+        case BINLOG_ARG_U64: memcpy(&i64, val, 8); return (int)i64;
+        default:             return 0;
+    }
+}
+
+/** Size in bytes of the integer an "hh", "h", "", "l", "ll", "j", "z" or
+ *  "t" length modifier converts to
+ */
+static size_t binlog__int_size(const char* mod)
+{
+    switch (mod[0]) {
+        case 'h': return (mod[1] == 'h') ? sizeof(char) : sizeof(short);
+        case 'l': return (mod[1] == 'l') ? sizeof(long long) : sizeof(long);
+        case 'j': return sizeof(intmax_t);
+        case 'z': return sizeof(size_t);
+        case 't': return sizeof(ptrdiff_t);
+        default:  return sizeof(int);
+    }
+}
+
+/** Prints "v", already truncated or extended to the size of "mod", as the
+ *  type the length modifier in "spec" expects
+ */
+static void binlog__print_int(FILE* out, const char* spec, const char* mod, int isSigned, uint64_t v)
+{
+    switch (mod[0]) {
+        case 'l':
+            if (mod[1] == 'l') {
+                isSigned ? fprintf(out, spec, (long long)v) : fprintf(out, spec, (unsigned long long)v);
+            }
+            else {
+                isSigned ? fprintf(out, spec, (long)v) : fprintf(out, spec, (unsigned long)v);
+            }
+            break;
+        case 'j':
+            isSigned ? fprintf(out, spec, (intmax_t)v) : fprintf(out, spec, (uintmax_t)v);
+            break;
+        case 'z':
+            isSigned ? fprintf(out, spec, (ssize_t)v) : fprintf(out, spec, (size_t)v);
+            break;
+        case 't':
+            fprintf(out, spec, (ptrdiff_t)v);
+            break;
+        default:    // "hh", "h" and none all take a promoted int
+            isSigned ? fprintf(out, spec, (int)v) : fprintf(out, spec, (unsigned int)v);
+            break;
+    }
+}
+
+/** Prints one conversion "spec" (flags, width and precision so far) with
+ *  length modifier "mod" for a decoded argument
+ */
+static void binlog__print_arg(FILE* out, char* spec, size_t specLen, const char* mod, char conv,
+                              int tag, const uint8_t* val, const char* str)
+{
+    int64_t  i64 = 0;
+    uint64_t u64 = 0;
+    double   f64 = 0;
+
+    switch (tag) {
+        case BINLOG_ARG_I32: { int32_t v;  memcpy(&v, val, 4); i64 = v; u64 = (uint64_t)(int64_t)v; f64 = v; break; }
+        case BINLOG_ARG_U32: { uint32_t v; memcpy(&v, val, 4); i64 = v; u64 = v; f64 = v; break; }
+        case BINLOG_ARG_I64: memcpy(&i64, val, 8); u64 = (uint64_t)i64; f64 = (double)i64; break;
+        case BINLOG_ARG_U64:
+        case BINLOG_ARG_PTR: memcpy(&u64, val, 8); i64 = (int64_t)u64; f64 = (double)u64; break;
+        case BINLOG_ARG_F64: memcpy(&f64, val, 8); i64 = (int64_t)f64; u64 = (uint64_t)i64; break;
+        default: break;
+    }
+
+    switch (conv) {
+        case 'd': case 'i': case 'u': case 'x': case 'X': case 'o': {
+            // convert to the width printf would have read, as it would
+            int isSigned = (conv == 'd' || conv == 'i');
+            size_t size = binlog__int_size(mod);
+            if (size < 8) {
+                uint64_t mask = (1ull << (size * 8)) - 1;
+                u64 &= mask;
+                if (isSigned && (u64 >> (size * 8 - 1))) {
+                    u64 |= ~mask;
+                }
+            }
+            snprintf(spec + specLen, 4, "%s%c", mod, conv);
+            binlog__print_int(out, spec, mod, isSigned, u64);
+            break;
+        }
+        case 'c':
+            strcpy(spec + specLen, "c");
+            fprintf(out, spec, (int)i64);
+            break;
+        case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+            if (mod[0] == 'L') {
+                snprintf(spec + specLen, 3, "L%c", conv);
+                fprintf(out, spec, (long double)f64);
+            }
+            else {
+                spec[specLen] = conv; spec[specLen + 1] = '\0';
+                fprintf(out, spec, f64);
+            }
+            break;
+        case 'p':
+            strcpy(spec + specLen, "p");
+            fprintf(out, spec, (void* )(uintptr_t)u64);
+            break;
+        default:    // 's' or a mismatched conversion
+            strcpy(spec + specLen, "s");
+            fprintf(out, spec, str ? str : "");
+            break;
+    }
+}
+
+int binlog_decode(FILE* in, FILE* out)
+{
+    struct BinlogSite* sites = NULL;
+    uint32_t numSites = 0;
+    uint32_t magic;
+    int result = 0;
+    int type;
+
+    if (binlog__read(in, &magic, 4) || magic != BINLOG_MAGIC) {
+        return -1;
+    }
+    // any record cut short, unknown or out of range ends the decode with -1
+    while (result == 0 && (type = fgetc(in)) != EOF) {
+        uint32_t id;
+        result = -1;
+        if (binlog__read(in, &id, 4)) {
+            break;
+        }
+        if (type == BINLOG_REC_DEF) {
+            uint8_t hdr[2];
+            int32_t line;
+            uint16_t lens[2];
+            struct BinlogSite* site;
+            char* strs;
+            uint8_t* tags;
+            if (id == 0 || binlog__read(in, hdr, 2) || hdr[1] > BINLOG_MAX_ARGS ||
+                binlog__read(in, &line, 4) || binlog__read(in, lens, 4)) {
+                break;
+            }
+            if (id > numSites) {
+                struct BinlogSite* grown = (struct BinlogSite* )realloc(sites, id * sizeof(*sites));
+                if (!grown) {
+                    break;
+                }
+                memset(grown + numSites, 0, (id - numSites) * sizeof(*sites));
+                sites = grown;
+                numSites = id;
+            }
+            site = &sites[id - 1];
+            strs = (char* )malloc(lens[0] + lens[1] + 2u);
+            tags = (uint8_t* )malloc(hdr[1] + 1u);
+            if (!strs || !tags || binlog__read(in, strs, lens[0]) ||
+                binlog__read(in, strs + lens[0] + 1, lens[1]) || binlog__read(in, tags, hdr[1])) {
+                free(strs);
+                free(tags);
+                break;
+            }
+            strs[lens[0]] = '\0';
+            strs[lens[0] + 1 + lens[1]] = '\0';
+            free((void* )site->file);   // a repeated definition replaces the old one
+            free((void* )site->tags);
+            site->id = id;
+            site->level = hdr[0];
+            site->nargs = hdr[1];
+            site->tags = tags;
+            site->file = strs;
+            site->line = line;
+            site->fmt = strs + lens[0] + 1;
+            result = 0;
+            for (unsigned i = 0; i < hdr[1]; i++) {
+                if (tags[i] < BINLOG_ARG_I32 || tags[i] > BINLOG_ARG_PTR) {
+                    result = -1;
+                }
+            }
+        }
+        else if (type == BINLOG_REC_MSG && id >= 1 && id <= numSites && sites[id - 1].id == id) {
+            const struct BinlogSite* site = &sites[id - 1];
+            const char* f = site->fmt;
+            unsigned argi = 0;
+            int bad = 0;
+            uint8_t val[8] = { 0 };
+            char str[BINLOG_MAX_STR + 1];
+            int tag;
+            while (*f && !bad) {
+                char spec[64];
+                char mod[3];
+                size_t specLen = 0;
+                size_t modLen = 0;
+
+                if (*f != '%') {
+                    fputc(*f++, out);
+                    continue;
+                }
+                if (f[1] == '%') {
+                    fputc('%', out);
+                    f += 2;
+                    continue;
+                }
+                // copy flags/width/precision, expanding '*' from the recorded args
+                spec[specLen++] = *f++;
+                while (*f && strchr("-+ #0123456789.*", *f) && specLen < sizeof(spec) - 24) {
+                    if (*f == '*') {
+                        tag = (argi < site->nargs) ? site->tags[argi++] : 0;
+                        bad |= binlog__read_arg(in, tag, val, str);
+                        specLen += (size_t)snprintf(spec + specLen, 12, "%d", binlog__arg_int(tag, val));
+                    }
+                    else {
+                        spec[specLen++] = *f;
+                    }
+                    f++;
+                }
+                while (*f && strchr("hljztL", *f)) {
+                    if (modLen < sizeof(mod) - 1) {
+                        mod[modLen++] = *f;
+                    }
+                    f++;
+                }
+                mod[modLen] = '\0';
+                if (!*f) {
+                    break;
+                }
+                tag = (argi < site->nargs) ? site->tags[argi++] : 0;
+                bad |= binlog__read_arg(in, tag, val, str);
+                if (!bad && *f != 'n') {
+                    binlog__print_arg(out, spec, specLen, mod, *f, tag, val, str);
+                }
+                f++;
+            }
+            // skip arguments the format string did not consume
+            while (!bad && argi < site->nargs) {
+                bad |= binlog__read_arg(in, site->tags[argi++], val, str);
+            }
+            result = bad ? -1 : 0;
+        }
+        // anything else is an unknown record or undefined ID: stream is corrupt
+    }
+
+    for (uint32_t i = 0; i < numSites; i++) {
+        free((void* )sites[i].file);
+        free((void* )sites[i].tags);
+    }
+    free(sites);
+    return (result || ferror(in)) ? -1 : 0;
+}
+
+#endif  // BINLOG_IMPLEMENTATION || BINLOG_DECODER_MAIN
+
+
+//////////////////////////////////////////////////////////////////////////////
+#if defined(BINLOG_IMPLEMENTATION) && !defined(__BINLOG_IMPLEMENTATION__)
+#define __BINLOG_IMPLEMENTATION__
+
+#include <pthread.h>
+#include <sched.h>
+
+/** Per-thread buffer. "busy" is held by the owner from binlog_reserve() to
+ *  binlog_commit() and by whoever flushes the buffer; s_binlogLock is always
+ *  taken first, so the owner never waits for it while holding "busy".
+ */
+struct BinlogBuffer {
+    int                   busy;
+    size_t                used;
+    struct BinlogBuffer*  next;     ///< s_binlogBufs list, under s_binlogLock
+    uint8_t               data[BINLOG_BUF_SIZE];
+};
+
+static __thread struct BinlogBuffer* t_binlogBuf;
+static __thread uint8_t     t_binlogScratch[BINLOG_MAX_RECORD];    ///< used when no buffer could be allocated
+static struct BinlogBuffer* s_binlogBufs;
+static FILE*                s_binlogOut;
+static int                  s_binlogOwnsOut;
+static uint32_t             s_binlogNextId = 1;
+static struct BinlogSite*   s_binlogSites;
+static pthread_mutex_t      s_binlogLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t        s_binlogKey;
+static pthread_once_t       s_binlogOnce = PTHREAD_ONCE_INIT;
+
+/** Writes one definition record; caller holds s_binlogLock */
+static void binlog__write_def(const struct BinlogSite* site)
+{
+    uint8_t hdr[1 + 4 + 2 + 4 + 4];
+    uint16_t fileLen = (uint16_t)strlen(site->file);
+    uint16_t fmtLen = (uint16_t)strlen(site->fmt);
+    int32_t line = site->line;
+
+    hdr[0] = BINLOG_REC_DEF;
+    memcpy(hdr + 1, &site->id, 4);
+    hdr[5] = site->level;
+    hdr[6] = site->nargs;
+    memcpy(hdr + 7, &line, 4);
+    memcpy(hdr + 11, &fileLen, 2);
+    memcpy(hdr + 13, &fmtLen, 2);
+    fwrite(hdr, 1, sizeof(hdr), s_binlogOut);
+    fwrite(site->file, 1, fileLen, s_binlogOut);
+    fwrite(site->fmt, 1, fmtLen, s_binlogOut);
+    fwrite(site->tags, 1, site->nargs, s_binlogOut);
+}
+
+static void binlog__lock_buf(struct BinlogBuffer* buf)
+{
+    while (__atomic_exchange_n(&buf->busy, 1, __ATOMIC_ACQUIRE)) {
+        sched_yield();
+    }
+}
+
+static void binlog__unlock_buf(struct BinlogBuffer* buf)
+{
+    __atomic_store_n(&buf->busy, 0, __ATOMIC_RELEASE);
+}
+
+/** Writes out a buffer; caller holds s_binlogLock */
+static void binlog__flush_buf_locked(struct BinlogBuffer* buf)
+{
+    binlog__lock_buf(buf);
+    if (buf->used) {
+        if (s_binlogOut) {
+            fwrite(buf->data, 1, buf->used, s_binlogOut);
+        }
+        buf->used = 0;
+    }
+    binlog__unlock_buf(buf);
+}
+
+static void binlog__flush_buf(struct BinlogBuffer* buf)
+{
+    pthread_mutex_lock(&s_binlogLock);
+    binlog__flush_buf_locked(buf);
+    pthread_mutex_unlock(&s_binlogLock);
+}
+
+static void binlog__thread_exit(void* arg)
+{
+    struct BinlogBuffer* buf = (struct BinlogBuffer* )arg;
+    pthread_mutex_lock(&s_binlogLock);
+    binlog__flush_buf_locked(buf);
+    for (struct BinlogBuffer** link = &s_binlogBufs; *link; link = &(*link)->next) {
+        if (*link == buf) {
+            *link = buf->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&s_binlogLock);
+    free(buf);
+}
+
+static void binlog__make_key(void)
+{
+    pthread_key_create(&s_binlogKey, binlog__thread_exit);
+}
+
+void binlog_register(struct BinlogSite* site)
+{
+    pthread_mutex_lock(&s_binlogLock);
+    if (site->id == 0) {
+        site->id = s_binlogNextId++;
+        site->next = s_binlogSites;
+        s_binlogSites = site;
+        if (s_binlogOut) {
+            binlog__write_def(site);
+        }
+        __atomic_store_n(&site->id, site->id, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&s_binlogLock);
+}
+
+uint8_t* binlog_reserve(size_t size)
+{
+    struct BinlogBuffer* buf = t_binlogBuf;
+    if (__builtin_expect(buf == NULL, 0)) {
+        pthread_once(&s_binlogOnce, binlog__make_key);
+        buf = (struct BinlogBuffer* )malloc(sizeof(*buf));
+        if (!buf) {
+            return t_binlogScratch;     // record is discarded by binlog_commit()
+        }
+        buf->busy = 0;
+        buf->used = 0;
+        pthread_setspecific(s_binlogKey, buf);
+        pthread_mutex_lock(&s_binlogLock);
+        buf->next = s_binlogBufs;
+        s_binlogBufs = buf;
+        pthread_mutex_unlock(&s_binlogLock);
+        t_binlogBuf = buf;
+    }
+    if (buf->used + size > sizeof(buf->data)) {
+        binlog__flush_buf(buf);
+    }
+    binlog__lock_buf(buf);
+    return buf->data + buf->used;
+}
+
+void binlog_commit(uint8_t* end)
+{
+    struct BinlogBuffer* buf = t_binlogBuf;
+    if (buf) {
+        buf->used = (size_t)(end - buf->data);
+        binlog__unlock_buf(buf);
+    }
+}
+
+void binlog_flush(void)
+{
+    pthread_mutex_lock(&s_binlogLock);
+    if (t_binlogBuf) {
+        binlog__flush_buf_locked(t_binlogBuf);
+    }
+    if (s_binlogOut) {
+        fflush(s_binlogOut);
+    }
+    pthread_mutex_unlock(&s_binlogLock);
+}
+
+int binlog_attach(FILE* out)
+{
+    uint32_t magic = BINLOG_MAGIC;
+    if (!out) {
+        return -1;
+    }
+    pthread_mutex_lock(&s_binlogLock);
+    s_binlogOut = out;
+    fwrite(&magic, 1, 4, out);
+    // sites that fired before the log was opened still need definitions
+    for (struct BinlogSite* site = s_binlogSites; site; site = site->next) {
+        binlog__write_def(site);
+    }
+    pthread_mutex_unlock(&s_binlogLock);
+    return 0;
+}
+
+int binlog_open(const char* path)
+{
+    FILE* out = fopen(path, "wb");
+    if (!out) {
+        return -1;
+    }
+    s_binlogOwnsOut = 1;
+    return binlog_attach(out);
+}
+
+void binlog_close(void)
+{
+    pthread_mutex_lock(&s_binlogLock);
+    for (struct BinlogBuffer* buf = s_binlogBufs; buf; buf = buf->next) {
+        binlog__flush_buf_locked(buf);
+    }
+    if (s_binlogOut) {
+        fflush(s_binlogOut);
+    }
+    if (s_binlogOut && s_binlogOwnsOut) {
+        fclose(s_binlogOut);
+    }
+    s_binlogOut = NULL;
+    s_binlogOwnsOut = 0;
+    pthread_mutex_unlock(&s_binlogLock);
+}
+
+#endif  // BINLOG_IMPLEMENTATION
+
+
+//////////////////////////////////////////////////////////////////////////////
+#if defined(BINLOG_DECODER_MAIN) && !defined(__BINLOG_DECODER_MAIN__)
+#define __BINLOG_DECODER_MAIN__
+int main(int argc, char** argv)
+{
+    FILE* in = (argc > 1) ? fopen(argv[1], "rb") : stdin;
+    if (!in) {
+        perror(argv[1]);
+        return 1;
+    }
+    if (binlog_decode(in, stdout) != 0) {
+        fprintf(stderr, "binlog_decode: bad or truncated log\n");
+        return 1;
+    }
+    return 0;
+}
+#endif  // BINLOG_DECODER_MAIN
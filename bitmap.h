@@ -0,0 +1,501 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org>
+*/
+#ifndef __BITMAP_H__
+#define __BITMAP_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "macros.h"
+
+/** @file
+ * This file contains arbitrary-length bit arrays: single-bit and range
+ * operations, first-set/first-zero searches, population count, bulk logical
+ * operations, and a three-level hierarchical bitmap for slot allocation.
+ **/
+
+/**
+ *                      Bitmap Overview
+ * =====================================================================
+ * A bitmap is a plain array of 64-bit BitmapWord; bit n lives in word
+ * n / 64 at position n % 64. The length in bits is passed to every function
+ * that scans, so one array type serves any size:
+ *
+ *   BITMAP_DECLARE(inUse, 100000);      // or BitmapWord* from malloc()
+ *   bitmap_zero(inUse, 100000);
+ *   bitmap_set(inUse, 4711);
+ *   size_t freeSlot = bitmap_find_next_zero(inUse, 100000, 0);
+ *
+ * Bits past the length in the last word must stay zero; every function here
+ * keeps them so, and bitmap_popcount() and the searches rely on it. The
+ * searches return the length itself when nothing is found. Searches skip a
+ * whole word at a time and locate the bit with one count-trailing-zeros
+ * instruction (TZCNT/BSF, or RBIT+CLZ on ARM).
+ *
+ * The bulk operations bitmap_and(), bitmap_or(), bitmap_xor() and
+ * bitmap_andnot() (dst = a & ~b) work 256 bits at a time with GCC vector
+ * extensions and on x86 are cloned for AVX2 with target_clones, as in
+ * satmath.h; define BITMAP_NO_DISPATCH to build only the baseline version.
+ * dst may equal either source.
+ *
+ * None of these functions are atomic; protect a bitmap shared between
+ * threads with a lock.
+ *
+ * Hierarchical Bitmap
+ * ----------------------------------------------
+ * Searching a large, mostly full bitmap for a zero is a linear scan. struct
+ * HBitmap adds two summary bitmaps with one bit per 64-bit word: whether the
+ * word is full, and whether it is nonempty, and above those a second pair
+ * with one bit per summary word. A search scans the top level, where each
+ * word covers 262144 bits, and then looks at one summary word and one bits
+ * word, so it costs O(nbits / 2^18) word reads instead of O(nbits / 2^12)
+ * (four words for a million bits). hbitmap_set() and hbitmap_clear() touch
+ * the upper levels only when a word becomes full, nonfull, empty or
+ * nonempty:
+ *
+ *   struct HBitmap slots;
+ *   hbitmap_init(&slots, 1000000);
+ *   size_t id = hbitmap_alloc(&slots);      // first zero, now set
+ *   ...
+ *   hbitmap_clear(&slots, id);
+ *
+ * Define BITMAP_IMPLEMENTATION in exactly one .c file before including
+ * this file.
+ */
+
+//////////////////////////////////////////////////////////////////////////////
+typedef uint64_t BitmapWord;
+
+#define BITMAP_WORD_BITS        64
+
+/** Number of words holding "nbits" bits */
+#define BITMAP_WORDS(nbits)     (((size_t)(nbits) + BITMAP_WORD_BITS - 1) / BITMAP_WORD_BITS)
+
+/** Declares a bitmap array (initialize it with bitmap_zero() or = { 0 }) */
+#define BITMAP_DECLARE(name, nbits)     BitmapWord name[BITMAP_WORDS(nbits)]
+
+#define BITMAP__WORD(n)         ((n) / BITMAP_WORD_BITS)
+#define BITMAP__MASK(n)         ((BitmapWord)1 << ((n) % BITMAP_WORD_BITS))
+
+/** Valid bits of the last word of an "nbits" bitmap */
+#define BITMAP__LAST_MASK(nbits)  \
+    (((nbits) % BITMAP_WORD_BITS) ? ((BitmapWord)1 << ((nbits) % BITMAP_WORD_BITS)) - 1 : ~(BitmapWord)0)
+
+static inline void bitmap_set(BitmapWord* map, size_t n)
+{
+    map[BITMAP__WORD(n)] |= BITMAP__MASK(n);
+}
+
+static inline void bitmap_clear(BitmapWord* map, size_t n)
+{
+    map[BITMAP__WORD(n)] &= ~BITMAP__MASK(n);
+}
+
+static inline void bitmap_toggle(BitmapWord* map, size_t n)
+{
+    map[BITMAP__WORD(n)] ^= BITMAP__MASK(n);
+}
+
+/** Returns 1 if bit n is set, else 0 */
+static inline int bitmap_test(const BitmapWord* map, size_t n)
+{
+    return (int)((map[BITMAP__WORD(n)] >> (n % BITMAP_WORD_BITS)) & 1);
+}
+
+/** Index of the lowest set bit of a nonzero word */
+static inline unsigned bitmap_word_ffs(BitmapWord w)
+{
+    return (unsigned)__builtin_ctzll(w);
+}
+
+/** Index of the highest set bit of a nonzero word */
+static inline unsigned bitmap_word_fls(BitmapWord w)
+{
+    return (unsigned)(BITMAP_WORD_BITS - 1 - __builtin_clzll(w));
+}
+
+EXTERN_CPP_START
+
+/** Clears or sets all "nbits" bits (bitmap_fill() keeps the tail bits zero) */
+void bitmap_zero(BitmapWord* map, size_t nbits);
+void bitmap_fill(BitmapWord* map, size_t nbits);
+
+/** Sets or clears bits [start, start + len) */
+void bitmap_set_range(BitmapWord* map, size_t start, size_t len);
+void bitmap_clear_range(BitmapWord* map, size_t start, size_t len);
+
+/** First set or zero bit at or after "from"; returns nbits if there is none */
+size_t bitmap_find_next_set(const BitmapWord* map, size_t nbits, size_t from);
+size_t bitmap_find_next_zero(const BitmapWord* map, size_t nbits, size_t from);
+
+/** Last set bit; returns nbits if there is none */
+size_t bitmap_find_last_set(const BitmapWord* map, size_t nbits);
+
+/** Number of set bits */
+size_t bitmap_popcount(const BitmapWord* map, size_t nbits);
+
+/** Nonzero if no bit is set */
+int bitmap_empty(const BitmapWord* map, size_t nbits);
+
+/** dst = a OP b over "nbits" bits */
+void bitmap_and(BitmapWord* dst, const BitmapWord* a, const BitmapWord* b, size_t nbits);
+void bitmap_or(BitmapWord* dst, const BitmapWord* a, const BitmapWord* b, size_t nbits);
+void bitmap_xor(BitmapWord* dst, const BitmapWord* a, const BitmapWord* b, size_t nbits);
+void bitmap_andnot(BitmapWord* dst, const BitmapWord* a, const BitmapWord* b, size_t nbits);
+
+EXTERN_CPP_END
+
+/** Iterates "bit" (a size_t) over the set bits of the bitmap, in order */
+#define BITMAP_FOR_EACH_SET(bit, map, nbits)  \
+    for ((bit) = bitmap_find_next_set(map, nbits, 0); (bit) < (nbits); \
+         (bit) = bitmap_find_next_set(map, nbits, (bit) + 1))
+
+//////////////////////////////////////////////////////////////////////////////
+struct HBitmap {
+    size_t      nbits;
+    BitmapWord* bits;
+    BitmapWord* full;       ///< bit w: bits word w has every valid bit set
+    BitmapWord* nonEmpty;   ///< bit w: bits word w has any bit set
+    BitmapWord* full2;      ///< bit s: full word s has every valid bit set
+    BitmapWord* nonEmpty2;  ///< bit s: nonEmpty word s has any bit set
+};
+
+EXTERN_CPP_START
+
+/** Allocates an all-zero hierarchical bitmap; returns 0 on success */
+int hbitmap_init(struct HBitmap* h, size_t nbits);
+void hbitmap_destroy(struct HBitmap* h);
+
+/** First zero bit, or nbits if every bit is set */
+size_t hbitmap_find_first_zero(const struct HBitmap* h);
+
+/** First set bit at or after "from", or nbits if there is none */
+size_t hbitmap_find_next_set(const struct HBitmap* h, size_t from);
+
+/** Sets and returns the first zero bit, or returns nbits if every bit is set */
+size_t hbitmap_alloc(struct HBitmap* h);
+
+EXTERN_CPP_END
+
+static inline int hbitmap_test(const struct HBitmap* h, size_t n)
+{
+    return bitmap_test(h->bits, n);
+}
+
+/** Value of word "w" of an "nbits" bitmap when all its valid bits are set */
+#define BITMAP__FULL_WORD(w, nbits)  \
+    (((w) == BITMAP__WORD((nbits) - 1)) ? BITMAP__LAST_MASK(nbits) : ~(BitmapWord)0)
+
+static inline void hbitmap_set(struct HBitmap* h, size_t n)
+{
+    size_t w = BITMAP__WORD(n);
+    size_t s = BITMAP__WORD(w);
+    h->bits[w] |= BITMAP__MASK(n);
+    h->nonEmpty[s] |= BITMAP__MASK(w);
+    bitmap_set(h->nonEmpty2, s);
+    if (h->bits[w] == BITMAP__FULL_WORD(w, h->nbits)) {
+        h->full[s] |= BITMAP__MASK(w);
+        if (h->full[s] == BITMAP__FULL_WORD(s, BITMAP_WORDS(h->nbits))) {
+            bitmap_set(h->full2, s);
+        }
+    }
+}
+
+static inline void hbitmap_clear(struct HBitmap* h, size_t n)
+{
+    size_t w = BITMAP__WORD(n);
+    size_t s = BITMAP__WORD(w);
+    h->bits[w] &= ~BITMAP__MASK(n);
+    h->full[s] &= ~BITMAP__MASK(w);
+    bitmap_clear(h->full2, s);
+    if (h->bits[w] == 0) {
+        h->nonEmpty[s] &= ~BITMAP__MASK(w);
+        if (h->nonEmpty[s] == 0) {
+            bitmap_clear(h->nonEmpty2, s);
+        }
+    }
+}
+
+#endif  // __BITMAP_H__
+
+
+//////////////////////////////////////////////////////////////////////////////
+#if defined(BITMAP_IMPLEMENTATION) && !defined(__BITMAP_IMPLEMENTATION__)
+#define __BITMAP_IMPLEMENTATION__
+
+#include <stdlib.h>
+#include <string.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && !defined(BITMAP_NO_DISPATCH)
+#   define BITMAP__DISPATCH         __attribute__((target_clones("avx2", "default")))
+#   define BITMAP__DISPATCH_POPCNT  __attribute__((target_clones("popcnt", "default")))
+#else
+#   define BITMAP__DISPATCH
+#   define BITMAP__DISPATCH_POPCNT
+#endif
+
+/** One AVX2 register; two SSE2/NEON registers */
+typedef BitmapWord BitmapVec __attribute__((vector_size(32)));
+
+#define BITMAP__VEC_WORDS   (sizeof(BitmapVec) / sizeof(BitmapWord))
+
+void bitmap_zero(BitmapWord* map, size_t nbits)
+{
+    memset(map, 0, BITMAP_WORDS(nbits) * sizeof(*map));
+}
+
+void bitmap_fill(BitmapWord* map, size_t nbits)
+{
+    size_t words = BITMAP_WORDS(nbits);
+    if (words) {
+        memset(map, 0xFF, words * sizeof(*map));
+        map[words - 1] = BITMAP__LAST_MASK(nbits);
+    }
+}
+
+void bitmap_set_range(BitmapWord* map, size_t start, size_t len)
+{
+    size_t end = start + len;
+    size_t w = BITMAP__WORD(start);
+    size_t last = BITMAP__WORD(end - 1);
+    BitmapWord head = ~(BitmapWord)0 << (start % BITMAP_WORD_BITS);
+    BitmapWord tail = BITMAP__LAST_MASK(end);
+
+    if (len == 0) {
+        return;
+    }
+    if (w == last) {
+        map[w] |= head & tail;
+        return;
+    }
+    map[w++] |= head;
+    while (w < last) {
+        map[w++] = ~(BitmapWord)0;
+    }
+    map[last] |= tail;
+}
+
+void bitmap_clear_range(BitmapWord* map, size_t start, size_t len)
+{
+    size_t end = start + len;
+    size_t w = BITMAP__WORD(start);
+    size_t last = BITMAP__WORD(end - 1);
+    BitmapWord head = ~(BitmapWord)0 << (start % BITMAP_WORD_BITS);
+    BitmapWord tail = BITMAP__LAST_MASK(end);
+
+    if (len == 0) {
+        return;
+    }
+    if (w == last) {
+        map[w] &= ~(head & tail);
+        return;
+    }
+    map[w++] &= ~head;
+    while (w < last) {
+        map[w++] = 0;
+    }
+    map[last] &= ~tail;
+}
+
+/** Shared search loop; "invert" is 0 to find a set bit or ~0 for a zero bit */
+static inline size_t bitmap__find_next(const BitmapWord* map, size_t nbits, size_t from, BitmapWord invert)
+{
+    size_t words = BITMAP_WORDS(nbits);
+    size_t w = BITMAP__WORD(from);
+    BitmapWord cur;
+
+    if (from >= nbits) {
+        return nbits;
+    }
+    cur = (map[w] ^ invert) & (~(BitmapWord)0 << (from % BITMAP_WORD_BITS));
+    while (cur == 0) {
+        if (++w >= words) {
+            return nbits;
+        }
+        cur = map[w] ^ invert;
+    }
+    // a zero search can hit the always-zero bits past the end
+    return MIN(w * BITMAP_WORD_BITS + bitmap_word_ffs(cur), nbits);
+}
+
+size_t bitmap_find_next_set(const BitmapWord* map, size_t nbits, size_t from)
+{
+    return bitmap__find_next(map, nbits, from, 0);
+}
+
+size_t bitmap_find_next_zero(const BitmapWord* map, size_t nbits, size_t from)
+{
+    return bitmap__find_next(map, nbits, from, ~(BitmapWord)0);
+}
+
+size_t bitmap_find_last_set(const BitmapWord* map, size_t nbits)
+{
+    for (size_t w = BITMAP_WORDS(nbits); w-- > 0; ) {
+        if (map[w]) {
+            return w * BITMAP_WORD_BITS + bitmap_word_fls(map[w]);
+        }
+    }
+    return nbits;
+}
+
+BITMAP__DISPATCH_POPCNT size_t bitmap_popcount(const BitmapWord* map, size_t nbits)
+{
+    size_t words = BITMAP_WORDS(nbits);
+    size_t count = 0;
+    for (size_t w = 0; w < words; w++) {
+        count += (size_t)__builtin_popcountll(map[w]);
+    }
+    return count;
+}
+
+int bitmap_empty(const BitmapWord* map, size_t nbits)
+{
+    return bitmap_find_next_set(map, nbits, 0) == nbits;
+}
+
+/** Defines a bulk logical operation; "op" combines two words or vectors */
+#define BITMAP__BULK(name, op)  \
+    BITMAP__DISPATCH void name(BitmapWord* dst, const BitmapWord* a, const BitmapWord* b, size_t nbits) \
+    { \
+        size_t words = BITMAP_WORDS(nbits); \
+        size_t w = 0; \
+        for ( ; w + BITMAP__VEC_WORDS <= words; w += BITMAP__VEC_WORDS) { \
+            BitmapVec va, vb, vd; \
+            memcpy(&va, a + w, sizeof(va)); \
+            memcpy(&vb, b + w, sizeof(vb)); \
+            vd = op(va, vb); \
+            memcpy(dst + w, &vd, sizeof(vd)); \
+        } \
+        for ( ; w < words; w++) { \
+            dst[w] = op(a[w], b[w]); \
+        } \
+    }
+
+#define BITMAP__AND(x, y)       ((x) & (y))
+#define BITMAP__OR(x, y)        ((x) | (y))
+#define BITMAP__XOR(x, y)       ((x) ^ (y))
+#define BITMAP__ANDNOT(x, y)    ((x) & ~(y))
+
+BITMAP__BULK(bitmap_and, BITMAP__AND)
+BITMAP__BULK(bitmap_or, BITMAP__OR)
+BITMAP__BULK(bitmap_xor, BITMAP__XOR)
+BITMAP__BULK(bitmap_andnot, BITMAP__ANDNOT)
+
+//////////////////////////////////////////////////////////////////////////////
+int hbitmap_init(struct HBitmap* h, size_t nbits)
+{
+    size_t words = BITMAP_WORDS(nbits);
+    size_t summaryWords = BITMAP_WORDS(words);
+    size_t topWords = BITMAP_WORDS(summaryWords);
+
+    memset(h, 0, sizeof(*h));
+    if (nbits == 0) {
+        return -1;
+    }
+    h->bits = (BitmapWord* )calloc(words + 2 * summaryWords + 2 * topWords, sizeof(BitmapWord));
+    if (!h->bits) {
+        return -1;
+    }
+    h->full = h->bits + words;
+    h->nonEmpty = h->full + summaryWords;
+    h->full2 = h->nonEmpty + summaryWords;
+    h->nonEmpty2 = h->full2 + topWords;
+    h->nbits = nbits;
+    return 0;
+}
+
+void hbitmap_destroy(struct HBitmap* h)
+{
+    free(h->bits);
+    memset(h, 0, sizeof(*h));
+}
+
+size_t hbitmap_find_first_zero(const struct HBitmap* h)
+{
+    size_t words = BITMAP_WORDS(h->nbits);
+    size_t s = bitmap_find_next_zero(h->full2, BITMAP_WORDS(words), 0);
+    size_t w;
+
+    if (s >= BITMAP_WORDS(words)) {
+        return h->nbits;
+    }
+    // a clear bit in an upper level means a zero among the valid bits below,
+    // and the invalid tail bits of a level are zero, so ~word finds it first
+    w = s * BITMAP_WORD_BITS + bitmap_word_ffs(~h->full[s]);
+    return w * BITMAP_WORD_BITS + bitmap_word_ffs(~h->bits[w]);
+}
+
+/** First set bit at or after "from" of "map", using "summary" to skip empty words */
+static size_t hbitmap__next_set(const BitmapWord* map, const BitmapWord* summary, size_t nbits, size_t from)
+{
+    size_t w = BITMAP__WORD(from);
+    BitmapWord cur;
+
+    if (from >= nbits) {
+        return nbits;
+    }
+    cur = map[w] & (~(BitmapWord)0 << (from % BITMAP_WORD_BITS));
+    if (cur == 0) {
+        w = bitmap_find_next_set(summary, BITMAP_WORDS(nbits), w + 1);
+        if (w >= BITMAP_WORDS(nbits)) {
+            return nbits;
+        }
+        cur = map[w];
+    }
+    return w * BITMAP_WORD_BITS + bitmap_word_ffs(cur);
+}
+
+size_t hbitmap_find_next_set(const struct HBitmap* h, size_t from)
+{
+    size_t words = BITMAP_WORDS(h->nbits);
+    size_t w = BITMAP__WORD(from);
+    BitmapWord cur;
+
+    if (from >= h->nbits) {
+        return h->nbits;
+    }
+    cur = h->bits[w] & (~(BitmapWord)0 << (from % BITMAP_WORD_BITS));
+    if (cur == 0) {
+        w = hbitmap__next_set(h->nonEmpty, h->nonEmpty2, words, w + 1);
+        if (w >= words) {
+            return h->nbits;
+        }
+        cur = h->bits[w];
+    }
+    return w * BITMAP_WORD_BITS + bitmap_word_ffs(cur);
+}
+
+size_t hbitmap_alloc(struct HBitmap* h)
+{
+    size_t n = hbitmap_find_first_zero(h);
+    if (n < h->nbits) {
+        hbitmap_set(h, n);
+    }
+    return n;
+}
+
+#endif  // BITMAP_IMPLEMENTATION
@@ -72,6 +72,27 @@ For more information, please refer to <http://unlicense.org>
  *   SPRINTD    prints if level is DEBUG   or lower
  *   SPRINTV    prints if level is ALL
  *
+ * For messages that may fire in hot loops, the following variants keep a
+ * little lock-free state per call site and thin the output after the level
+ * check has passed (x is W, I or D):
+ *   PRINTx_RATELIMITED(fmt, ...)  at most PRINT_RATELIMIT_BURST messages per
+ *                                 PRINT_RATELIMIT_INTERVAL_MS; when a new
+ *                                 interval starts, a "N messages suppressed"
+ *                                 summary is printed for the previous one
+ *   PRINTx_EVERY_N(n, fmt, ...)   prints the 1st, (n+1)th, (2n+1)th... hit
+ *   PRINTx_SAMPLED(n, fmt, ...)   prints each hit with probability 1/n, using
+ *                                 a per-thread generator (no shared state)
+ *
+ * Buffers can be dumped as offset/hex/ASCII lines, 16 bytes per line, with
+ * the same level and scope gating (x is W, I, D or V, or empty to always
+ * print; SPRINTx_HEX() needs SPRINTx()):
+ *   PRINTx_HEX(ptr, len)          dumps "len" bytes at "ptr"
+ *   SPRINTx_HEX(scope, ptr, len)
+ * At most PRINT_HEX_MAX_BYTES are dumped per call, followed by a line with
+ * the number of bytes left out, so a large buffer can't stall the caller.
+ * Each line is encoded with vector operations and output with one
+ * DEBUG_PRINT_OUT() (see hexdump.h).
+ *
  * Debug Print Output Control
  * ----------------------------------------------
  * By defining the current print level to a particular threshold, print
@@ -102,6 +123,73 @@ For more information, please refer to <http://unlicense.org>
  * In addition, the project must include two global variable as follows:
  *   unsigned short g_currentPrintLevel = <Print level setting above>;
  *   unsigned short g_currentPrintScope = <Print scope setting>;
+ *
+ * Named Print Scopes
+ * ----------------------------------------------
+ * The PRINT_SCOPE_AREAxx bits below only cover 16 areas. printscope.h adds
+ * an unbounded set of dotted, hierarchical scope names (e.g., "net.rx.tcp"),
+ * each with its own level, and the NSPRINTx() macros that check them.
+ *
+ * Asynchronous Output
+ * ----------------------------------------------
+ * ucprintf() is supplied by the project. To move stdio locking and the
+ * actual writes off the calling thread, asynclog.h can provide ucprintf()
+ * backed by per-thread lock-free rings and a consumer thread (see that file).
+ *
+ * Output Sinks
+ * ----------------------------------------------
+ * Defining LOG_SINKS sends PRINTx() output, with its level, to logsink.h
+ * instead of ucprintf(): records are batched and fanned out to stderr,
+ * rotating files and in-memory rings, each with its own minimum level, and
+ * written with one writev() per batch.
+ *
+ * Formatting
+ * ----------------------------------------------
+ * ucprintf() is declared with the printf format attribute, so arguments to
+ * every PRINTx() are checked by the compiler. Defining USE_FASTFMT where the
+ * asynclog.h, logsink.h or flightrec.h implementation is compiled formats
+ * with fastfmt.h instead of vsnprintf(): no locale or heap, and safe in
+ * signal handlers.
+ *
+ * Binary Output
+ * ----------------------------------------------
+ * Defining BINARY_PRINT skips formatting at the call site altogether: each
+ * PRINTx() records a call-site ID and its raw arguments via binlog.h, and the
+ * log is turned back into text offline. In this mode "fmt" MUST be a string
+ * literal.
+ *
+ * Record Prefix
+ * ----------------------------------------------
+ * Defining PRINT_PREFIX prepends "HH:MM:SS.uuuuuu T<tid> C<cpu> " to every
+ * PRINTx() line, using the TSC-based clock, cached thread ID and CPU from
+ * logclock.h. "fmt" MUST be a string literal in this mode. When ucprintf()
+ * comes from asynclog.h, use ASYNCLOG_PREFIX there instead so the stamp is
+ * taken raw and only converted when the consumer writes the record.
+ *
+ * Trace Spans
+ * ----------------------------------------------
+ * trace.h adds TRACE_SCOPE(scope, "name") spans gated by the same
+ * PRINT_SCOPE_* bits as SPRINTx(), timed with logclock.h and exported as
+ * Chrome trace-event JSON for Perfetto or chrome://tracing.
+ *
+ * Metrics
+ * ----------------------------------------------
+ * metrics.h adds COUNTER_INC(), GAUGE_SET() and HISTOGRAM_RECORD() on
+ * per-thread sharded storage, compiled out and scope-gated like SPRINTx(),
+ * with a dump of totals and p50/p99/p999 through ucprintf().
+ *
+ * Flight Recorder
+ * ----------------------------------------------
+ * Defining FLIGHT_RECORDER additionally records every PRINTx()/SPRINTx()
+ * message, at any level, into a crash-persistent memory-mapped ring (see
+ * flightrec.h), so suppressed history can be extracted after a crash.
+ *
+ * Per-Site Output Control
+ * ----------------------------------------------
+ * Defining DYNAMIC_PRINT gives every PRINTx()/SPRINTx() call site its own
+ * enable flag, registered the first time the site runs, so single sites can
+ * be turned on or off by file, line or pattern at run-time (see
+ * printsite.h). In this mode the per-site flag replaces the level check.
  */
 
 //////////////////////////////////////////////////////////////////////////////
@@ -130,6 +218,16 @@ For more information, please refer to <http://unlicense.org>
 #define PRINT_SCOPE_AREA15   (1 << 15)
 #define PRINT_SCOPE_ALL      0xFFFF
 
+#ifndef PRINT_RATELIMIT_INTERVAL_MS
+#   define PRINT_RATELIMIT_INTERVAL_MS  5000
+#endif
+#ifndef PRINT_RATELIMIT_BURST
+#   define PRINT_RATELIMIT_BURST        10
+#endif
+#ifndef PRINT_HEX_MAX_BYTES
+#   define PRINT_HEX_MAX_BYTES          256
+#endif
+
 extern unsigned short g_currentPrintLevel;
 extern unsigned short g_currentPrintScope;
 
@@ -137,74 +235,306 @@ extern unsigned short g_currentPrintScope;
 /** Define PRINTx macros (only creates output in debug builds)
  *  See above for details on using these macros.
  */
-    extern int ucprintf(const char* fmt, ...);
-#   define PRINT(fmt, args...)   ucprintf(fmt , ## args)
+    extern int ucprintf(const char* fmt, ...) __attribute__((format(printf, 1, 2)));
 
-#   ifndef RUNTIME_PRINT_LEVEL
+/** All PRINTx() output funnels through DEBUG_PRINT_OUT(); "level" is the
+ *  level of the message itself (PRINT_LEVEL_NONE for PRINT() and SPRINT())
+ */
+#   ifdef LOG_SINKS
+#       include "logsink.h"
+#       define DEBUG_PRINT_TEXT(level, fmt, args...)  logsink_printf(level, fmt , ## args)
+#   else
+#       define DEBUG_PRINT_TEXT(level, fmt, args...)  ucprintf(fmt , ## args)
+#   endif
+#   ifdef BINARY_PRINT
+#       include "binlog.h"
+#       define DEBUG_PRINT_OUT(level, fmt, args...)  BINLOG(level, fmt , ## args)
+#   elif defined(PRINT_PREFIX)
+#       include "logclock.h"
+#       define DEBUG_PRINT_OUT(level, fmt, args...)  \
+            do { \
+                char print__prefix[LOGCLOCK_PREFIX_SIZE]; \
+                logclock_prefix(print__prefix, sizeof(print__prefix)); \
+                DEBUG_PRINT_TEXT(level, "%s" fmt, print__prefix , ## args); \
+            } while (0)
+#   else
+#       define DEBUG_PRINT_OUT(level, fmt, args...)  DEBUG_PRINT_TEXT(level, fmt , ## args)
+#   endif
+#   define PRINT(fmt, args...)   DEBUG_PRINT_OUT(PRINT_LEVEL_NONE, fmt , ## args)
+
+#   if defined(DYNAMIC_PRINT)
+#       include "printsite.h"
+#       define DEBUG_PRINT_GATED(level, fmt, stmt...)  PRINT_SITE(level, fmt, stmt)
+#       define PRINTW(fmt, args...)  \
+            PRINT_SITE(PRINT_LEVEL_WARN, fmt, DEBUG_PRINT_OUT(PRINT_LEVEL_WARN, fmt , ## args))
+#       define PRINTI(fmt, args...)  \
+            PRINT_SITE(PRINT_LEVEL_INFO, fmt, DEBUG_PRINT_OUT(PRINT_LEVEL_INFO, fmt , ## args))
+#       define PRINTD(fmt, args...)  \
+            PRINT_SITE(PRINT_LEVEL_DEBUG, fmt, DEBUG_PRINT_OUT(PRINT_LEVEL_DEBUG, fmt , ## args))
+#       define PRINTV(fmt, args...)  \
+            PRINT_SITE(PRINT_LEVEL_ALL, fmt, DEBUG_PRINT_OUT(PRINT_LEVEL_ALL, fmt , ## args))
+
+#       define SPRINT(scope, fmt, args...)  \
+            PRINT_SITE(PRINT_LEVEL_NONE, fmt, \
+                if (g_currentPrintScope & (scope)) { DEBUG_PRINT_OUT(PRINT_LEVEL_NONE, fmt , ## args); })
+#       define SPRINTW(scope, fmt, args...)  \
+            PRINT_SITE(PRINT_LEVEL_WARN, fmt, \
+                if (g_currentPrintScope & (scope)) { DEBUG_PRINT_OUT(PRINT_LEVEL_WARN, fmt , ## args); })
+#       define SPRINTI(scope, fmt, args...)  \
+            PRINT_SITE(PRINT_LEVEL_INFO, fmt, \
+                if (g_currentPrintScope & (scope)) { DEBUG_PRINT_OUT(PRINT_LEVEL_INFO, fmt , ## args); })
+#       define SPRINTD(scope, fmt, args...)  \
+            PRINT_SITE(PRINT_LEVEL_DEBUG, fmt, \
+                if (g_currentPrintScope & (scope)) { DEBUG_PRINT_OUT(PRINT_LEVEL_DEBUG, fmt , ## args); })
+#       define SPRINTV(scope, fmt, args...)  \
+            PRINT_SITE(PRINT_LEVEL_ALL, fmt, \
+                if (g_currentPrintScope & (scope)) { DEBUG_PRINT_OUT(PRINT_LEVEL_ALL, fmt , ## args); })
+#   elif !defined(RUNTIME_PRINT_LEVEL)
+#       define DEBUG_PRINT_GATED(level, fmt, stmt...)  \
+            do { \
+                if (CURRENT_PRINT_LEVEL <= (level)) { stmt; } \
+            } while (0)
 #       define PRINTW(fmt, args...)  \
             do { \
-                if (CURRENT_PRINT_LEVEL <= PRINT_LEVEL_WARN) { ucprintf(fmt , ## args); } \
+                if (CURRENT_PRINT_LEVEL <= PRINT_LEVEL_WARN) { DEBUG_PRINT_OUT(PRINT_LEVEL_WARN, fmt , ## args); } \
             } while (0)
 #       define PRINTI(fmt, args...)  \
             do { \
-                if (CURRENT_PRINT_LEVEL <= PRINT_LEVEL_INFO) { ucprintf(fmt , ## args); } \
+                if (CURRENT_PRINT_LEVEL <= PRINT_LEVEL_INFO) { DEBUG_PRINT_OUT(PRINT_LEVEL_INFO, fmt , ## args); } \
             } while (0)
 #       define PRINTD(fmt, args...)  \
             do { \
-                if (CURRENT_PRINT_LEVEL <= PRINT_LEVEL_DEBUG) { ucprintf(fmt , ## args); } \
+                if (CURRENT_PRINT_LEVEL <= PRINT_LEVEL_DEBUG) { DEBUG_PRINT_OUT(PRINT_LEVEL_DEBUG, fmt , ## args); } \
             } while (0)
 #       define PRINTV(fmt, args...)  \
             do { \
-                if (CURRENT_PRINT_LEVEL == PRINT_LEVEL_ALL) { ucprintf(fmt , ## args); } \
+                if (CURRENT_PRINT_LEVEL == PRINT_LEVEL_ALL) { DEBUG_PRINT_OUT(PRINT_LEVEL_ALL, fmt , ## args); } \
             } while (0)
 #   else
+#       define DEBUG_PRINT_GATED(level, fmt, stmt...)  \
+            do { \
+                extern unsigned short g_currentPrintLevel; \
+                if (g_currentPrintLevel <= (level)) { stmt; } \
+            } while (0)
 #       define PRINTW(fmt, args...)  \
             do { \
                 extern unsigned short g_currentPrintLevel; \
-                if (g_currentPrintLevel <= PRINT_LEVEL_WARN) { ucprintf(fmt , ## args); } \
+                if (g_currentPrintLevel <= PRINT_LEVEL_WARN) { DEBUG_PRINT_OUT(PRINT_LEVEL_WARN, fmt , ## args); } \
             } while (0)
 #       define PRINTI(fmt, args...)  \
             do { \
                 extern unsigned short g_currentPrintLevel; \
-                if (g_currentPrintLevel <= PRINT_LEVEL_INFO) { ucprintf(fmt , ## args); } \
+                if (g_currentPrintLevel <= PRINT_LEVEL_INFO) { DEBUG_PRINT_OUT(PRINT_LEVEL_INFO, fmt , ## args); } \
             } while (0)
 #       define PRINTD(fmt, args...)  \
             do { \
                 extern unsigned short g_currentPrintLevel; \
-                if (g_currentPrintLevel <= PRINT_LEVEL_DEBUG) { ucprintf(fmt , ## args); } \
+                if (g_currentPrintLevel <= PRINT_LEVEL_DEBUG) { DEBUG_PRINT_OUT(PRINT_LEVEL_DEBUG, fmt , ## args); } \
             } while (0)
 #       define PRINTV(fmt, args...)  \
             do { \
                 extern unsigned short g_currentPrintLevel; \
-                if (g_currentPrintLevel == PRINT_LEVEL_ALL) { ucprintf(fmt , ## args); } \
+                if (g_currentPrintLevel == PRINT_LEVEL_ALL) { DEBUG_PRINT_OUT(PRINT_LEVEL_ALL, fmt , ## args); } \
             } while (0)
 
 #       define SPRINT(scope, fmt, args...)  \
             do { \
                 extern unsigned short g_currentPrintScope; \
-                if (g_currentPrintScope & scope) { ucprintf(fmt , ## args); } \
+                if (g_currentPrintScope & scope) { DEBUG_PRINT_OUT(PRINT_LEVEL_NONE, fmt , ## args); } \
             } while (0)
 #       define SPRINTW(scope, fmt, args...)  \
             do { \
                 extern unsigned short g_currentPrintLevel, g_currentPrintScope; \
-                if ((scope & g_currentPrintScope) && (g_currentPrintLevel <= PRINT_LEVEL_WARN)) { ucprintf(fmt , ## args); } \
+                if ((scope & g_currentPrintScope) && (g_currentPrintLevel <= PRINT_LEVEL_WARN)) { DEBUG_PRINT_OUT(PRINT_LEVEL_WARN, fmt , ## args); } \
             } while (0)
 #       define SPRINTI(scope, fmt, args...)  \
             do { \
                 extern unsigned short g_currentPrintLevel, g_currentPrintScope; \
-                if ((scope & g_currentPrintScope) && (g_currentPrintLevel <= PRINT_LEVEL_INFO)) { ucprintf(fmt , ## args); } \
+                if ((scope & g_currentPrintScope) && (g_currentPrintLevel <= PRINT_LEVEL_INFO)) { DEBUG_PRINT_OUT(PRINT_LEVEL_INFO, fmt , ## args); } \
             } while (0)
 #       define SPRINTD(scope, fmt, args...)  \
             do { \
                 extern unsigned short g_currentPrintLevel, g_currentPrintScope; \
-                if ((scope & g_currentPrintScope) && (g_currentPrintLevel <= PRINT_LEVEL_DEBUG)) { ucprintf(fmt , ## args); } \
+                if ((scope & g_currentPrintScope) && (g_currentPrintLevel <= PRINT_LEVEL_DEBUG)) { DEBUG_PRINT_OUT(PRINT_LEVEL_DEBUG, fmt , ## args); } \
             } while (0)
 #       define SPRINTV(scope, fmt, args...)  \
             do { \
                 extern unsigned short g_currentPrintLevel, g_currentPrintScope; \
-                if ((scope & g_currentPrintScope) && (g_currentPrintLevel <= PRINT_LEVEL_ALL)) { ucprintf(fmt , ## args); } \
+                if ((scope & g_currentPrintScope) && (g_currentPrintLevel <= PRINT_LEVEL_ALL)) { DEBUG_PRINT_OUT(PRINT_LEVEL_ALL, fmt , ## args); } \
             } while (0)
 #   endif
+
+#   ifdef FLIGHT_RECORDER
+/** Every PRINTx()/SPRINTx() message goes to the flight recorder first,
+ *  whatever its level or scope; the normal output stays gated as above.
+ */
+#       include "flightrec.h"
+#       undef PRINT
+#       undef PRINTW
+#       undef PRINTI
+#       undef PRINTD
+#       undef PRINTV
+/** "record" is the parenthesized FLIGHTREC() argument list, so that the
+ *  gated statement can come last and stay variadic
+ */
+#       define DEBUG_PRINT_RECORDED(level, fmt, record, stmt...)  \
+            do { \
+                FLIGHTREC record; \
+                DEBUG_PRINT_GATED(level, fmt, stmt); \
+            } while (0)
+#       define PRINT(fmt, args...)   \
+            DEBUG_PRINT_RECORDED(PRINT_LEVEL_NONE, fmt, (PRINT_LEVEL_NONE, fmt , ## args), \
+                DEBUG_PRINT_OUT(PRINT_LEVEL_NONE, fmt , ## args))
+#       define PRINTW(fmt, args...)  \
+            DEBUG_PRINT_RECORDED(PRINT_LEVEL_WARN, fmt, (PRINT_LEVEL_WARN, fmt , ## args), \
+                DEBUG_PRINT_OUT(PRINT_LEVEL_WARN, fmt , ## args))
+#       define PRINTI(fmt, args...)  \
+            DEBUG_PRINT_RECORDED(PRINT_LEVEL_INFO, fmt, (PRINT_LEVEL_INFO, fmt , ## args), \
+                DEBUG_PRINT_OUT(PRINT_LEVEL_INFO, fmt , ## args))
+#       define PRINTD(fmt, args...)  \
+            DEBUG_PRINT_RECORDED(PRINT_LEVEL_DEBUG, fmt, (PRINT_LEVEL_DEBUG, fmt , ## args), \
+                DEBUG_PRINT_OUT(PRINT_LEVEL_DEBUG, fmt , ## args))
+#       define PRINTV(fmt, args...)  \
+            DEBUG_PRINT_RECORDED(PRINT_LEVEL_ALL, fmt, (PRINT_LEVEL_ALL, fmt , ## args), \
+                DEBUG_PRINT_OUT(PRINT_LEVEL_ALL, fmt , ## args))
+#       ifdef SPRINT
+#           undef SPRINT
+#           undef SPRINTW
+#           undef SPRINTI
+#           undef SPRINTD
+#           undef SPRINTV
+#           define DEBUG_SPRINT_RECORDED(level, scope, fmt, args...)  \
+                DEBUG_PRINT_RECORDED(level, fmt, (level, fmt , ## args), \
+                    if (g_currentPrintScope & (scope)) { DEBUG_PRINT_OUT(level, fmt , ## args); })
+#           define SPRINT(scope, fmt, args...)   DEBUG_SPRINT_RECORDED(PRINT_LEVEL_NONE, scope, fmt , ## args)
+#           define SPRINTW(scope, fmt, args...)  DEBUG_SPRINT_RECORDED(PRINT_LEVEL_WARN, scope, fmt , ## args)
+#           define SPRINTI(scope, fmt, args...)  DEBUG_SPRINT_RECORDED(PRINT_LEVEL_INFO, scope, fmt , ## args)
+#           define SPRINTD(scope, fmt, args...)  DEBUG_SPRINT_RECORDED(PRINT_LEVEL_DEBUG, scope, fmt , ## args)
+#           define SPRINTV(scope, fmt, args...)  DEBUG_SPRINT_RECORDED(PRINT_LEVEL_ALL, scope, fmt , ## args)
+#       endif
+#   endif
+
+/** Rate-limited and sampled PRINTx variants (see above). All state is per
+ *  call site and only touched once the level check has passed.
+ */
+#   include <time.h>
+
+    struct PrintRatelimit {
+        unsigned long long  begin;      ///< start of the current window (ms)
+        unsigned int        printed;    ///< messages printed in this window
+        unsigned int        missed;     ///< messages suppressed in this window
+    };
+
+    static inline unsigned long long print_ratelimit_now_ms(void)
+    {
+        struct timespec ts;
+#   ifdef CLOCK_MONOTONIC_COARSE
+        clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+#   else
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+#   endif
+        return (unsigned long long)ts.tv_sec * 1000 + (unsigned long long)ts.tv_nsec / 1000000;
+    }
+
+    /** Returns nonzero if the caller may print. When this call opens a new
+     *  window, *missed receives the count suppressed in the previous one.
+     */
+    static inline int print_ratelimit(struct PrintRatelimit* rl, unsigned int intervalMs,
+                                      unsigned int burst, unsigned int* missed)
+    {
+        unsigned long long now = print_ratelimit_now_ms();
+        unsigned long long begin = __atomic_load_n(&rl->begin, __ATOMIC_RELAXED);
+
+        *missed = 0;
+        if (now - begin >= intervalMs &&
+            __atomic_compare_exchange_n(&rl->begin, &begin, now, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+            *missed = __atomic_exchange_n(&rl->missed, 0, __ATOMIC_RELAXED);
+            __atomic_store_n(&rl->printed, 0, __ATOMIC_RELAXED);
+        }
+        // plain load first so a saturated window doesn't keep bouncing the line
+        if (__atomic_load_n(&rl->printed, __ATOMIC_RELAXED) < burst &&
+            __atomic_fetch_add(&rl->printed, 1, __ATOMIC_RELAXED) < burst) {
+            return 1;
+        }
+        __atomic_fetch_add(&rl->missed, 1, __ATOMIC_RELAXED);
+        return 0;
+    }
+
+    /** Per-thread xorshift32 used by the _SAMPLED variants */
+    static inline unsigned int print_sample_rand(void)
+    {
+        static __thread unsigned int state;
+        unsigned int x = state;
+        if (x == 0) {
+            x = (unsigned int)(unsigned long)&state | 1;
+        }
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        state = x;
+        return x;
+    }
+
+#   define DEBUG_PRINT_RATELIMITED(level, fmt, args...)  \
+        DEBUG_PRINT_GATED(level, fmt, \
+            static struct PrintRatelimit print__rl; \
+            unsigned int print__missed; \
+            int print__ok = print_ratelimit(&print__rl, PRINT_RATELIMIT_INTERVAL_MS, PRINT_RATELIMIT_BURST, &print__missed); \
+            if (print__missed) { DEBUG_PRINT_OUT(level, "%s:%d: %u messages suppressed\n", __FILE__, __LINE__, print__missed); } \
+            if (print__ok) { DEBUG_PRINT_OUT(level, fmt , ## args); })
+#   define DEBUG_PRINT_EVERY_N(level, n, fmt, args...)  \
+        DEBUG_PRINT_GATED(level, fmt, \
+            static unsigned int print__count; \
+            if (__atomic_fetch_add(&print__count, 1, __ATOMIC_RELAXED) % (n) == 0) { DEBUG_PRINT_OUT(level, fmt , ## args); })
+#   define DEBUG_PRINT_SAMPLED(level, n, fmt, args...)  \
+        DEBUG_PRINT_GATED(level, fmt, \
+            if (print_sample_rand() % (n) == 0) { DEBUG_PRINT_OUT(level, fmt , ## args); })
+
+#   define PRINTW_RATELIMITED(fmt, args...)     DEBUG_PRINT_RATELIMITED(PRINT_LEVEL_WARN, fmt , ## args)
+#   define PRINTI_RATELIMITED(fmt, args...)     DEBUG_PRINT_RATELIMITED(PRINT_LEVEL_INFO, fmt , ## args)
+#   define PRINTD_RATELIMITED(fmt, args...)     DEBUG_PRINT_RATELIMITED(PRINT_LEVEL_DEBUG, fmt , ## args)
+#   define PRINTW_EVERY_N(n, fmt, args...)      DEBUG_PRINT_EVERY_N(PRINT_LEVEL_WARN, n, fmt , ## args)
+#   define PRINTI_EVERY_N(n, fmt, args...)      DEBUG_PRINT_EVERY_N(PRINT_LEVEL_INFO, n, fmt , ## args)
+#   define PRINTD_EVERY_N(n, fmt, args...)      DEBUG_PRINT_EVERY_N(PRINT_LEVEL_DEBUG, n, fmt , ## args)
+#   define PRINTW_SAMPLED(n, fmt, args...)      DEBUG_PRINT_SAMPLED(PRINT_LEVEL_WARN, n, fmt , ## args)
+#   define PRINTI_SAMPLED(n, fmt, args...)      DEBUG_PRINT_SAMPLED(PRINT_LEVEL_INFO, n, fmt , ## args)
+#   define PRINTD_SAMPLED(n, fmt, args...)      DEBUG_PRINT_SAMPLED(PRINT_LEVEL_DEBUG, n, fmt , ## args)
+
+/** Hex dumps of at most PRINT_HEX_MAX_BYTES, one DEBUG_PRINT_OUT() per line */
+#   include "hexdump.h"
+
+#   define DEBUG_PRINT_HEX_LINES(level, ptr, len)  \
+        do { \
+            const unsigned char* print__data = (const unsigned char*)(ptr); \
+            size_t print__len = (len); \
+            size_t print__max = MIN(print__len, (size_t)PRINT_HEX_MAX_BYTES); \
+            char print__line[HEXDUMP_LINE_SIZE]; \
+            for (size_t print__off = 0; print__off < print__max; print__off += HEXDUMP_LINE_BYTES) { \
+                hexdump_line(print__line, print__data + print__off, print__max - print__off, print__off); \
+                DEBUG_PRINT_OUT(level, "%s", print__line); \
+            } \
+            if (print__max < print__len) { \
+                DEBUG_PRINT_OUT(level, "... %zu more bytes\n", print__len - print__max); \
+            } \
+        } while (0)
+#   define DEBUG_PRINT_HEX(level, ptr, len)  \
+        DEBUG_PRINT_GATED(level, "hex dump of " #ptr "\n", DEBUG_PRINT_HEX_LINES(level, ptr, len))
+#   define DEBUG_SPRINT_HEX(level, scope, ptr, len)  \
+        DEBUG_PRINT_GATED(level, "hex dump of " #ptr "\n", \
+            if (g_currentPrintScope & (scope)) { DEBUG_PRINT_HEX_LINES(level, ptr, len); })
+
+#   define PRINT_HEX(ptr, len)      DEBUG_PRINT_HEX(PRINT_LEVEL_NONE, ptr, len)
+#   define PRINTW_HEX(ptr, len)     DEBUG_PRINT_HEX(PRINT_LEVEL_WARN, ptr, len)
+#   define PRINTI_HEX(ptr, len)     DEBUG_PRINT_HEX(PRINT_LEVEL_INFO, ptr, len)
+#   define PRINTD_HEX(ptr, len)     DEBUG_PRINT_HEX(PRINT_LEVEL_DEBUG, ptr, len)
+#   define PRINTV_HEX(ptr, len)     DEBUG_PRINT_HEX(PRINT_LEVEL_ALL, ptr, len)
+#   ifdef SPRINT
+#       define SPRINT_HEX(scope, ptr, len)   DEBUG_SPRINT_HEX(PRINT_LEVEL_NONE, scope, ptr, len)
+#       define SPRINTW_HEX(scope, ptr, len)  DEBUG_SPRINT_HEX(PRINT_LEVEL_WARN, scope, ptr, len)
+#       define SPRINTI_HEX(scope, ptr, len)  DEBUG_SPRINT_HEX(PRINT_LEVEL_INFO, scope, ptr, len)
+#       define SPRINTD_HEX(scope, ptr, len)  DEBUG_SPRINT_HEX(PRINT_LEVEL_DEBUG, scope, ptr, len)
+#       define SPRINTV_HEX(scope, ptr, len)  DEBUG_SPRINT_HEX(PRINT_LEVEL_ALL, scope, ptr, len)
+#   endif
 #else
 #   define PRINT(fmt, args...)
 #   define PRINTW(fmt, args...)
@@ -217,6 +547,28 @@ extern unsigned short g_currentPrintScope;
 #   define SPRINTI(scope, fmt, args...)
 #   define SPRINTD(scope, fmt, args...)
 #   define SPRINTV(scope, fmt, args...)
+
+#   define PRINTW_RATELIMITED(fmt, args...)
+#   define PRINTI_RATELIMITED(fmt, args...)
+#   define PRINTD_RATELIMITED(fmt, args...)
+#   define PRINTW_EVERY_N(n, fmt, args...)
+#   define PRINTI_EVERY_N(n, fmt, args...)
+#   define PRINTD_EVERY_N(n, fmt, args...)
+#   define PRINTW_SAMPLED(n, fmt, args...)
+#   define PRINTI_SAMPLED(n, fmt, args...)
+#   define PRINTD_SAMPLED(n, fmt, args...)
+
+#   define PRINT_HEX(ptr, len)
+#   define PRINTW_HEX(ptr, len)
+#   define PRINTI_HEX(ptr, len)
+#   define PRINTD_HEX(ptr, len)
+#   define PRINTV_HEX(ptr, len)
+
+#   define SPRINT_HEX(scope, ptr, len)
+#   define SPRINTW_HEX(scope, ptr, len)
+#   define SPRINTI_HEX(scope, ptr, len)
+#   define SPRINTD_HEX(scope, ptr, len)
+#   define SPRINTV_HEX(scope, ptr, len)
 #endif
 
 
@@ -0,0 +1,1180 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org>
+*/
+#ifndef __FASTFMT_H__
+#define __FASTFMT_H__
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "macros.h"
+
+/** @file
+ * This file contains a self-contained printf-compatible formatter that writes
+ * into caller-supplied buffers, with no locale, heap or lock use, plus
+ * shortest round-trip double to text conversion.
+ **/
+
+/**
+ *                      Fast Formatter Overview
+ * =====================================================================
+ * fmt_vsnprintf() and fmt_snprintf() behave like vsnprintf()/snprintf() for
+ * the subset used in log messages:
+ *   conversions   d i u o x X c s p f F e E g G a A n %, and glibc's m
+ *   wide          lc ls (also C S)
+ *   flags         - + space # 0
+ *   width and precision, including *
+ *   lengths       hh h l ll j z t L (L reads a long double, which is
+ *                 converted to double before formatting)
+ * An unknown conversion character is copied to the output as is and, like
+ * in glibc, consumes no argument. Output is always NUL-terminated when "size"
+ * is nonzero, and the return value is the length the full output would have
+ * had, or -1 if a wide character has no multibyte form.
+ *
+ * Integers are converted two digits at a time from a 200-byte table. Floating
+ * point conversions are exact and correctly rounded (ties to even, as glibc
+ * does) using a fixed-size big integer on the stack, so the output matches
+ * glibc's digit for digit. %a prints the exact hexadecimal mantissa as glibc
+ * does (subnormals as 0x0.<digits>p-1022), rounding to nearest-even when a
+ * precision cuts it short. Except for %m (strerror()) and the wide
+ * conversions (wcrtomb() in the current locale), nothing touches global
+ * state, so the formatter may be called from signal handlers.
+ *
+ * fmt_double() prints the shortest digit string that reads back as exactly
+ * the same double (Steele & White / Burger & Dybvig free-format output), in
+ * the style of %g: 0.1 rather than %.17g's 0.10000000000000001.
+ *
+ * ucprintf() backends use this formatter in place of vsnprintf() when
+ * USE_FASTFMT is defined where they are implemented (asynclog.h, logsink.h,
+ * flightrec.h).
+ *
+ * Define FASTFMT_IMPLEMENTATION in exactly one .c file before including
+ * this file.
+ */
+
+//////////////////////////////////////////////////////////////////////////////
+/** Buffer size that holds any fmt_double() result */
+#define FMT_DOUBLE_SIZE     32
+
+EXTERN_CPP_START
+
+/** vsnprintf() replacement; see above for the supported subset */
+int fmt_vsnprintf(char* buf, size_t size, const char* fmt, va_list ap);
+
+/** snprintf() replacement */
+int fmt_snprintf(char* buf, size_t size, const char* fmt, ...) __attribute__((format(printf, 3, 4)));
+
+/** Writes the shortest round-trip text of "v"; returns its length */
+int fmt_double(char* buf, size_t size, double v);
+
+EXTERN_CPP_END
+
+#endif  // __FASTFMT_H__
+
+
+//////////////////////////////////////////////////////////////////////////////
+#if defined(FASTFMT_IMPLEMENTATION) && !defined(__FASTFMT_IMPLEMENTATION__)
+#define __FASTFMT_IMPLEMENTATION__
+
+#include <errno.h>
+#include <limits.h>
+#include <string.h>
+#include <wchar.h>
+
+/** Enough for any double: the largest scaled values need about 1130 bits */
+#define FMT__BIG_WORDS      40
+
+/** Most significant digits a double's exact decimal expansion can have is
+ *  767; beyond that every digit is 0
+ */
+#define FMT__MAX_DIGITS     800
+
+struct FmtOut {
+    char*   buf;
+    size_t  size;
+    size_t  pos;
+};
+
+struct FmtSpec {
+    int     minus;
+    int     plus;
+    int     space;
+    int     hash;
+    int     zero;
+    int     width;
+    int     prec;           ///< -1 if none
+    int     upper;
+};
+
+/** Little-endian 32-bit words; "n" words in use, no leading zero words */
+struct FmtBig {
+    int         n;
+    uint32_t    w[FMT__BIG_WORDS];
+};
+
+static const char s_fmtDigits2[201] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+//////////////////////////////////////////////////////////////////////////////
+static void fmt__put(struct FmtOut* o, const char* s, size_t n)
+{
+    if (o->pos + 1 < o->size) {
+        size_t room = o->size - 1 - o->pos;
+        memcpy(o->buf + o->pos, s, MIN(n, room));
+    }
+    o->pos += n;
+}
+
+static void fmt__fill(struct FmtOut* o, char c, size_t n)
+{
+    if (o->pos + 1 < o->size) {
+        size_t room = o->size - 1 - o->pos;
+        memset(o->buf + o->pos, c, MIN(n, room));
+    }
+    o->pos += n;
+}
+
+/** Writes "v" in decimal ending just before "end"; returns the digit count */
+static int fmt__utoa10(uint64_t v, char* end)
+{
+    char* p = end;
+    while (v >= 100) {
+        unsigned i = (unsigned)(v % 100) * 2;
+        v /= 100;
+        p -= 2;
+        p[0] = s_fmtDigits2[i];
+        p[1] = s_fmtDigits2[i + 1];
+    }
+    if (v >= 10) {
+        p -= 2;
+        p[0] = s_fmtDigits2[v * 2];
+        p[1] = s_fmtDigits2[v * 2 + 1];
+    }
+    else {
+        *--p = (char)('0' + v);
+    }
+    return (int)(end - p);
+}
+
+/** As fmt__utoa10() for base 8 or 16 */
+static int fmt__utoa_pow2(uint64_t v, char* end, unsigned shift, int upper)
+{
+    const char* digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+    unsigned mask = (1u << shift) - 1;
+    char* p = end;
+    do {
+        *--p = digits[v & mask];
+        v >>= shift;
+    } while (v);
+    return (int)(end - p);
+}
+
+/** Pads and writes prefix, "zeros" zeros and the body, honoring width/flags */
+static void fmt__emit(struct FmtOut* o, const struct FmtSpec* sp, const char* prefix, size_t plen,
+                      size_t zeros, const char* body, size_t blen)
+{
+    size_t len = plen + zeros + blen;
+    size_t pad = (sp->width > 0 && (size_t)sp->width > len) ? (size_t)sp->width - len : 0;
+
+    if (!sp->minus && !sp->zero) {
+        fmt__fill(o, ' ', pad);
+    }
+    fmt__put(o, prefix, plen);
+    if (!sp->minus && sp->zero) {
+        fmt__fill(o, '0', pad);
+    }
+    fmt__fill(o, '0', zeros);
+    fmt__put(o, body, blen);
+    if (sp->minus) {
+        fmt__fill(o, ' ', pad);
+    }
+}
+
+static void fmt__integer(struct FmtOut* o, struct FmtSpec* sp, uint64_t v, int negative, char conv)
+{
+    char digits[24];
+    char prefix[3];
+    char* end = digits + sizeof(digits);
+    size_t plen = 0;
+    int len;
+
+    if (negative) {
+        prefix[plen++] = '-';
+    }
+    else if ((conv == 'd' || conv == 'i') && sp->plus) {
+        prefix[plen++] = '+';
+    }
+    else if ((conv == 'd' || conv == 'i') && sp->space) {
+        prefix[plen++] = ' ';
+    }
+
+    if (conv == 'x' || conv == 'X') {
+        len = fmt__utoa_pow2(v, end, 4, conv == 'X');
+        if (sp->hash && v) {
+            prefix[plen++] = '0';
+            prefix[plen++] = conv;
+        }
+    }
+    else if (conv == 'o') {
+        len = fmt__utoa_pow2(v, end, 3, 0);
+    }
+    else {
+        len = fmt__utoa10(v, end);
+    }
+    if (sp->prec == 0 && v == 0) {
+        len = 0;        // "%.0d" of 0 prints no digits
+    }
+    if (conv == 'o' && sp->hash && (len == 0 || end[-len] != '0') && sp->prec <= len) {
+        prefix[plen++] = '0';
+    }
+    if (sp->prec >= 0) {
+        sp->zero = 0;
+    }
+    fmt__emit(o, sp, prefix, plen, (sp->prec > len) ? (size_t)(sp->prec - len) : 0, end - len, (size_t)len);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+static void fmt__big_set(struct FmtBig* b, uint64_t v)
+{
+    b->w[0] = (uint32_t)v;
+    b->w[1] = (uint32_t)(v >> 32);
+    b->n = b->w[1] ? 2 : (b->w[0] ? 1 : 0);
+}
+
+static void fmt__big_mul_small(struct FmtBig* b, uint32_t m)
+{
+    uint64_t carry = 0;
+    for (int i = 0; i < b->n; i++) {
+        uint64_t t = (uint64_t)b->w[i] * m + carry;
+        b->w[i] = (uint32_t)t;
+        carry = t >> 32;
+    }
+    if (carry) {
+        b->w[b->n++] = (uint32_t)carry;
+    }
+}
+
+static void fmt__big_mul_pow10(struct FmtBig* b, int n)
+{
+    static const uint32_t pow10[10] = {
+        1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000
+    };
+    for ( ; n >= 9; n -= 9) {
+        fmt__big_mul_small(b, pow10[9]);
+    }
+    if (n > 0) {
+        fmt__big_mul_small(b, pow10[n]);
+    }
+}
+
+static void fmt__big_shl(struct FmtBig* b, int bits)
+{
+    int words = bits / 32;
+    int shift = bits % 32;
+
+    if (b->n == 0) {
+        return;
+    }
+    if (shift) {
+        uint32_t carry = 0;
+        for (int i = 0; i < b->n; i++) {
+            uint32_t w = b->w[i];
+            b->w[i] = (w << shift) | carry;
+            carry = w >> (32 - shift);
+        }
+        if (carry) {
+            b->w[b->n++] = carry;
+        }
+    }
+    if (words) {
+        memmove(b->w + words, b->w, (size_t)b->n * sizeof(b->w[0]));
+        memset(b->w, 0, (size_t)words * sizeof(b->w[0]));
+        b->n += words;
+    }
+}
+
+static int fmt__big_cmp(const struct FmtBig* a, const struct FmtBig* b)
+{
+    if (a->n != b->n) {
+        return (a->n > b->n) ? 1 : -1;
+    }
+    for (int i = a->n - 1; i >= 0; i--) {
+        if (a->w[i] != b->w[i]) {
+            return (a->w[i] > b->w[i]) ? 1 : -1;
+        }
+    }
+    return 0;
+}
+
+/** a -= b; requires a >= b */
+static void fmt__big_sub(struct FmtBig* a, const struct FmtBig* b)
+{
+    uint64_t borrow = 0;
+    for (int i = 0; i < a->n; i++) {
+        uint64_t t = (uint64_t)a->w[i] - (i < b->n ? b->w[i] : 0) - borrow;
+        a->w[i] = (uint32_t)t;
+        borrow = (t >> 32) & 1;
+    }
+    while (a->n > 0 && a->w[a->n - 1] == 0) {
+        a->n--;
+    }
+}
+
+static void fmt__big_add(struct FmtBig* out, const struct FmtBig* a, const struct FmtBig* b)
+{
+    int n = MAX(a->n, b->n);
+    uint64_t carry = 0;
+    for (int i = 0; i < n; i++) {
+        uint64_t t = (uint64_t)(i < a->n ? a->w[i] : 0) + (i < b->n ? b->w[i] : 0) + carry;
+        out->w[i] = (uint32_t)t;
+        carry = t >> 32;
+    }
+    out->n = n;
+    if (carry) {
+        out->w[out->n++] = (uint32_t)carry;
+    }
+}
+
+/** r = r mod s; returns the quotient, which must be below 10 */
+static int fmt__big_divmod(struct FmtBig* r, const struct FmtBig* s)
+{
+    int q = 0;
+    while (fmt__big_cmp(r, s) >= 0) {
+        fmt__big_sub(r, s);
+        q++;
+    }
+    return q;
+}
+
+/** v = f * 2^e */
+static void fmt__split(double v, uint64_t* f, int* e)
+{
+    uint64_t bits;
+
+    memcpy(&bits, &v, sizeof(bits));
+    *f = bits & ((1ULL << 52) - 1);
+    *e = (int)((bits >> 52) & 0x7FF);
+    if (*e == 0) {
+        *e = -1074;
+    }
+    else {
+        *f |= 1ULL << 52;
+        *e -= 1075;
+    }
+}
+
+/** Sets up v = r / s with gaps to the neighbouring doubles of mPlus / s and
+ *  mMinus / s, scaled so that r / s < 1 <= 10 * r / s; returns k where
+ *  v = (r / s) * 10^k. "shortest" selects whether (r + mPlus) or r must
+ *  stay below s.
+ */
+static int fmt__scale(double v, struct FmtBig* r, struct FmtBig* s, struct FmtBig* mPlus, struct FmtBig* mMinus,
+                      int shortest, int* even)
+{
+    uint64_t f;
+    int e;
+    int k;
+    int unequal;
+
+    fmt__split(v, &f, &e);
+    unequal = (f == 1ULL << 52 && e > -1074);   // the gap below a power of 2 is half the gap above
+    *even = !(f & 1);
+
+    // v = f * 2^e = r / s, with margins of half a unit in the last place
+    if (e >= 0) {
+        fmt__big_set(r, f);
+        fmt__big_shl(r, e + 1 + unequal);
+        fmt__big_set(s, 2u << unequal);
+        fmt__big_set(mPlus, 1);
+        fmt__big_shl(mPlus, e + unequal);
+        fmt__big_set(mMinus, 1);
+        fmt__big_shl(mMinus, e);
+    }
+    else {
+        fmt__big_set(r, f << (1 + unequal));
+        fmt__big_set(s, 1);
+        fmt__big_shl(s, 1 - e + unequal);
+        fmt__big_set(mPlus, 1u << unequal);
+        fmt__big_set(mMinus, 1);
+    }
+
+    // estimate k = ceil(log10(v)) from the binary exponent; never too high
+    k = (int)__builtin_ceil((e + 63 - __builtin_clzll(f)) * 0.30102999566398114 - 1e-10);
+    if (k >= 0) {
+        fmt__big_mul_pow10(s, k);
+    }
+    else {
+        fmt__big_mul_pow10(r, -k);
+        fmt__big_mul_pow10(mPlus, -k);
+        fmt__big_mul_pow10(mMinus, -k);
+    }
+
+    FOREVER {
+        struct FmtBig high;
+        int c;
+        if (shortest) {
+            fmt__big_add(&high, r, mPlus);
+            c = fmt__big_cmp(&high, s);
+            if (!(*even ? c >= 0 : c > 0)) {
+                break;
+            }
+        }
+        else if (fmt__big_cmp(r, s) < 0) {
+            break;
+        }
+        fmt__big_mul_small(s, 10);
+        k++;
+    }
+    return k;
+}
+
+/** Shortest digits that read back as v (> 0); returns the digit count and
+ *  sets *k so that v = 0.d1d2... * 10^k
+ */
+static int fmt__shortest(double v, char* d, int* k)
+{
+    struct FmtBig r, s, mPlus, mMinus;
+    int even;
+    int n = 0;
+
+    *k = fmt__scale(v, &r, &s, &mPlus, &mMinus, 1, &even);
+    FOREVER {
+        struct FmtBig high;
+        int low;
+        int up;
+        int digit;
+
+        fmt__big_mul_small(&r, 10);
+        fmt__big_mul_small(&mPlus, 10);
+        fmt__big_mul_small(&mMinus, 10);
+        digit = fmt__big_divmod(&r, &s);
+
+        low = fmt__big_cmp(&r, &mMinus);
+        low = even ? (low <= 0) : (low < 0);
+        fmt__big_add(&high, &r, &mPlus);
+        up = fmt__big_cmp(&high, &s);
+        up = even ? (up >= 0) : (up > 0);
+
+        if (!low && !up) {
+            d[n++] = (char)('0' + digit);
+            continue;
+        }
+        if (low && up) {
+            // both roundings read back correctly: take the nearer
+            struct FmtBig twice = r;
+            int c;
+            fmt__big_shl(&twice, 1);
+            c = fmt__big_cmp(&twice, &s);
+            up = (c > 0) || (c == 0 && (digit & 1));
+        }
+        d[n++] = (char)('0' + digit + (up ? 1 : 0));
+        return n;
+    }
+}
+
+/** Digits of v = f * 2^e using 64-bit arithmetic when -60 <= e <= 11, so
+ *  the integer part and ten times the fraction both fit. Returns -1 if
+ *  fmt__fixed_big() must be used instead; *cmp is the remainder compared
+ *  with half of the last digit.
+ */
+static int fmt__fixed_small(uint64_t f, int e, int count, int frac, char* d, int* k, int* cmp)
+{
+    int shift = (e < 0) ? -e : 0;
+    uint64_t mask = (1ULL << shift) - 1;
+    uint64_t ipart = (e < 0) ? f >> shift : f << e;
+    uint64_t rest = f & mask;
+    uint64_t half;
+    int want;
+    int n = 0;
+
+    if (ipart) {
+        char tmp[20];
+        n = fmt__utoa10(ipart, tmp + sizeof(tmp));
+        memcpy(d, tmp + sizeof(tmp) - n, (size_t)n);
+        *k = n;
+    }
+    else {
+        *k = 0;
+        while ((rest * 10) >> shift == 0) {
+            rest *= 10;
+            (*k)--;
+        }
+    }
+    want = frac ? *k + count : count;
+    if (want < n || want <= 0) {
+        return -1;      // rounds within the integer part, or to nothing
+    }
+    for ( ; n < MIN(want, FMT__MAX_DIGITS); n++) {
+        rest *= 10;
+        d[n] = (char)('0' + (rest >> shift));
+        rest &= mask;
+    }
+    half = shift ? 1ULL << (shift - 1) : 1;
+    *cmp = (rest > half) ? 1 : ((rest == half) ? 0 : -1);
+    return n;
+}
+
+/** As fmt__fixed_small() for any v */
+static int fmt__fixed_big(double v, int count, int frac, char* d, int* k, int* cmp)
+{
+    struct FmtBig r, s, mPlus, mMinus;
+    int even;
+    int want;
+    int n;
+
+    *k = fmt__scale(v, &r, &s, &mPlus, &mMinus, 0, &even);
+    want = frac ? *k + count : count;
+    if (want < 0) {
+        *cmp = -1;      // below half of the last place: rounds to 0
+        return 0;
+    }
+    for (n = 0; n < MIN(want, FMT__MAX_DIGITS); n++) {
+        fmt__big_mul_small(&r, 10);
+        d[n] = (char)('0' + fmt__big_divmod(&r, &s));
+    }
+    fmt__big_shl(&r, 1);
+    *cmp = fmt__big_cmp(&r, &s);
+    return n;
+}
+
+/** Correctly rounded digits of v (> 0): "count" significant digits, or with
+ *  "frac" the digits down to 10^-count. Returns the digit count (may be 0
+ *  if v rounds to 0) and sets *k so the value is 0.d1d2... * 10^k; digits
+ *  past the count returned are zero.
+ */
+static int fmt__fixed(double v, int count, int frac, char* d, int* k)
+{
+    uint64_t f;
+    int e;
+    int n = -1;
+    int cmp;
+
+    fmt__split(v, &f, &e);
+    if (e >= -60 && e <= 11) {
+        n = fmt__fixed_small(f, e, count, frac, d, k, &cmp);
+    }
+    if (n < 0) {
+        n = fmt__fixed_big(v, count, frac, d, k, &cmp);
+    }
+
+    // round half to even on what is left
+    if (cmp > 0 || (cmp == 0 && n > 0 && ((d[n - 1] - '0') & 1))) {
+        int i = n - 1;
+        while (i >= 0 && d[i] == '9') {
+            d[i--] = '0';
+        }
+        if (i >= 0) {
+            d[i]++;
+        }
+        else {
+            // 99.9 -> 100.0: one more leading digit
+            d[0] = '1';
+            if (n > 0) {
+                d[n] = '0';
+            }
+            (*k)++;
+            if (frac || n == 0) {
+                n++;
+            }
+        }
+    }
+    return n;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+/** Writes "digits" (n of them, zero-extended to "len") from position "from" */
+static void fmt__put_digits(struct FmtOut* o, const char* d, int n, int from, int len)
+{
+    int have = MAX(0, MIN(n - from, len));
+    fmt__put(o, d + from, (size_t)have);
+    fmt__fill(o, '0', (size_t)(len - have));
+}
+
+/** %f body for digits 0.d1d2... * 10^k with "prec" fraction digits */
+static size_t fmt__f_len(int k, int prec, int point)
+{
+    return (size_t)(MAX(k, 1) + (point ? 1 : 0) + prec);
+}
+
+static void fmt__f_body(struct FmtOut* o, const char* d, int n, int k, int prec, int point)
+{
+    if (k > 0) {
+        fmt__put_digits(o, d, n, 0, k);
+    }
+    else {
+        fmt__put(o, "0", 1);
+    }
+    if (point) {
+        fmt__put(o, ".", 1);
+    }
+    if (k < 0) {
+        int lead = MIN(-k, prec);
+        fmt__fill(o, '0', (size_t)lead);
+        fmt__put_digits(o, d, n, 0, prec - lead);
+    }
+    else {
+        fmt__put_digits(o, d, n, k, prec);
+    }
+}
+
+/** %e body for digits d1.d2d3... * 10^exp with "prec" fraction digits */
+static size_t fmt__e_len(int exp, int prec, int point)
+{
+    int aexp = (exp < 0) ? -exp : exp;
+    return (size_t)(1 + (point ? 1 : 0) + prec + 2 + ((aexp >= 100) ? 3 : 2));
+}
+
+static void fmt__e_body(struct FmtOut* o, const char* d, int n, int exp, int prec, int point, int upper)
+{
+    char tail[8];
+    char* end = tail + sizeof(tail);
+    int len;
+    int aexp = (exp < 0) ? -exp : exp;
+
+    fmt__put_digits(o, d, n, 0, 1);
+    if (point) {
+        fmt__put(o, ".", 1);
+    }
+    fmt__put_digits(o, d, n, 1, prec);
+    len = fmt__utoa10((uint64_t)aexp, end);
+    if (len < 2) {
+        *(end - ++len) = '0';
+    }
+    *(end - ++len) = (exp < 0) ? '-' : '+';
+    *(end - ++len) = upper ? 'E' : 'e';
+    fmt__put(o, end - len, (size_t)len);
+}
+
+static void fmt__float(struct FmtOut* o, struct FmtSpec* sp, double v, char conv)
+{
+    char d[FMT__MAX_DIGITS + 2];
+    char prefix[1];
+    size_t plen = 0;
+    size_t len;
+    size_t pad;
+    uint64_t bits;
+    int upper = (conv == 'F' || conv == 'E' || conv == 'G');
+    int prec = (sp->prec < 0) ? 6 : sp->prec;
+    int style = conv | 0x20;        // 'f', 'e' or 'g'
+    int n = 0;
+    int k = 0;
+    int point;
+
+    memcpy(&bits, &v, sizeof(bits));
+    if (bits >> 63) {
+        prefix[plen++] = '-';
+        v = -v;
+    }
+    else if (sp->plus) {
+        prefix[plen++] = '+';
+    }
+    else if (sp->space) {
+        prefix[plen++] = ' ';
+    }
+
+    if (v != v || v > 1.7976931348623157e308) {
+        sp->zero = 0;
+        fmt__emit(o, sp, prefix, plen, 0, (v != v) ? (upper ? "NAN" : "nan") : (upper ? "INF" : "inf"), 3);
+        return;
+    }
+
+    if (style == 'g') {
+        int exp;
+        prec = prec ? prec : 1;
+        if (v != 0) {
+            n = fmt__fixed(v, prec, 0, d, &k);
+        }
+        exp = (v != 0) ? k - 1 : 0;
+        if (exp >= -4 && exp < prec) {
+            style = 'f';
+            prec = prec - 1 - exp;
+        }
+        else {
+            style = 'e';
+            prec = prec - 1;
+        }
+        if (!sp->hash) {
+            // drop trailing zeros of the significant digits
+            int sig = MIN(n, (style == 'f') ? k + prec : prec + 1);
+            while (sig > 0 && d[sig - 1] == '0') {
+                sig--;
+            }
+            n = sig;
+            prec = (style == 'f') ? MAX(0, MIN(prec, n - k)) : MAX(0, n - 1);
+        }
+    }
+    else if (v != 0) {
+        n = fmt__fixed(v, (style == 'f') ? prec : prec + 1, style == 'f', d, &k);
+    }
+
+    point = prec > 0 || sp->hash;
+    if (style == 'f') {
+        if (n == 0) {
+            k = 1;          // plain zero: "0" before the point
+        }
+        len = fmt__f_len(k, prec, point);
+    }
+    else {
+        if (n == 0) {
+            k = 1;
+        }
+        len = fmt__e_len(k - 1, prec, point);
+    }
+
+    len += plen;
+    pad = (sp->width > 0 && (size_t)sp->width > len) ? (size_t)sp->width - len : 0;
+    if (!sp->minus && !sp->zero) {
+        fmt__fill(o, ' ', pad);
+    }
+    fmt__put(o, prefix, plen);
+    if (!sp->minus && sp->zero) {
+        fmt__fill(o, '0', pad);
+    }
+    if (style == 'f') {
+        fmt__f_body(o, d, n, k, prec, point);
+    }
+    else {
+        fmt__e_body(o, d, n, k - 1, prec, point, upper);
+    }
+    if (sp->minus) {
+        fmt__fill(o, ' ', pad);
+    }
+}
+
+/** %a and %A: 0x<lead>.<hex digits>p<exponent> */
+static void fmt__hexfloat(struct FmtOut* o, struct FmtSpec* sp, double v, int upper)
+{
+    const char* hex = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+    char prefix[3];
+    char digits[13];
+    char exp[8];
+    char* expEnd = exp + sizeof(exp);
+    size_t plen = 0;
+    size_t elen;
+    size_t len;
+    size_t pad;
+    uint64_t bits;
+    uint64_t mant;
+    int e;
+    int n;          // hex digits after the point taken from the mantissa
+    int zeros;      // further zeros asked for by the precision
+
+    memcpy(&bits, &v, sizeof(bits));
+    if (bits >> 63) {
+        prefix[plen++] = '-';
+        v = -v;
+    }
+    else if (sp->plus) {
+        prefix[plen++] = '+';
+    }
+    else if (sp->space) {
+        prefix[plen++] = ' ';
+    }
+    if (v != v || v > 1.7976931348623157e308) {
+        sp->zero = 0;
+        fmt__emit(o, sp, prefix, plen, 0, (v != v) ? (upper ? "NAN" : "nan") : (upper ? "INF" : "inf"), 3);
+        return;
+    }
+
+    // lead digit and 52 fraction bits in one integer, so rounding can carry
+    mant = bits & ((1ULL << 52) - 1);
+    e = (int)((bits >> 52) & 0x7FF);
+    if (e) {
+        mant |= 1ULL << 52;
+        e -= 1023;
+    }
+    else {
+        e = mant ? -1022 : 0;
+    }
+    if (sp->prec < 0) {
+        n = 13;
+        while (n > 0 && ((mant >> (4 * (13 - n))) & 0xF) == 0) {
+            n--;
+        }
+        zeros = 0;
+    }
+    else if (sp->prec < 13) {
+        unsigned shift = 4 * (13 - (unsigned)sp->prec);
+        uint64_t rem = mant & ((1ULL << shift) - 1);
+        uint64_t half = 1ULL << (shift - 1);
+        mant >>= shift;
+        if (rem > half || (rem == half && (mant & 1))) {
+            mant++;         // may carry into the lead digit: 0x1.f rounds to 0x2, as in glibc
+        }
+        mant <<= shift;
+        n = sp->prec;
+        zeros = 0;
+    }
+    else {
+        n = 13;
+        zeros = sp->prec - 13;
+    }
+    for (int i = 0; i < n; i++) {
+        digits[i] = hex[(mant >> (4 * (12 - i))) & 0xF];
+    }
+
+    elen = (size_t)fmt__utoa10((uint64_t)((e < 0) ? -e : e), expEnd);
+    *(expEnd - elen - 1) = (e < 0) ? '-' : '+';
+    *(expEnd - elen - 2) = upper ? 'P' : 'p';
+    elen += 2;
+
+    prefix[plen++] = '0';
+    prefix[plen++] = upper ? 'X' : 'x';
+    len = plen + 1 + ((n + zeros || sp->hash) ? 1 : 0) + (size_t)n + (size_t)zeros + elen;
+    pad = (sp->width > 0 && (size_t)sp->width > len) ? (size_t)sp->width - len : 0;
+
+    if (!sp->minus && !sp->zero) {
+        fmt__fill(o, ' ', pad);
+    }
+    fmt__put(o, prefix, plen);
+    if (!sp->minus && sp->zero) {
+        fmt__fill(o, '0', pad);
+    }
+    fmt__fill(o, hex[mant >> 52], 1);
+    if (n + zeros || sp->hash) {
+        fmt__put(o, ".", 1);
+    }
+    fmt__put(o, digits, (size_t)n);
+    fmt__fill(o, '0', (size_t)zeros);
+    fmt__put(o, expEnd - elen, elen);
+    if (sp->minus) {
+        fmt__fill(o, ' ', pad);
+    }
+}
+
+/** %ls: converts "s" through the current locale, at most "prec" bytes
+ *  (whole characters only); returns -1 if a character has no multibyte form
+ */
+static int fmt__wide(struct FmtOut* o, struct FmtSpec* sp, const wchar_t* s, size_t count)
+{
+    char mb[MB_LEN_MAX];
+    mbstate_t st;
+    size_t limit = (sp->prec >= 0) ? (size_t)sp->prec : (size_t)-1;
+    size_t len = 0;
+    size_t pad;
+
+    // first pass for the length the padding needs, second pass to write
+    memset(&st, 0, sizeof(st));
+    for (size_t i = 0; i < count; i++) {
+        size_t n = wcrtomb(mb, s[i], &st);
+        if (n == (size_t)-1) {
+            return -1;
+        }
+        if (n > limit - len) {
+            break;
+        }
+        len += n;
+    }
+    pad = (sp->width > 0 && (size_t)sp->width > len) ? (size_t)sp->width - len : 0;
+    if (!sp->minus) {
+        fmt__fill(o, ' ', pad);
+    }
+    memset(&st, 0, sizeof(st));
+    for (size_t i = 0, done = 0; done < len; i++) {
+        size_t n = wcrtomb(mb, s[i], &st);
+        fmt__put(o, mb, n);
+        done += n;
+    }
+    if (sp->minus) {
+        fmt__fill(o, ' ', pad);
+    }
+    return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+int fmt_vsnprintf(char* buf, size_t size, const char* fmt, va_list ap)
+{
+    struct FmtOut out;
+    int err = errno;        // for %m, before anything here can change it
+    int failed = 0;
+
+    out.buf = buf;
+    out.size = size;
+    out.pos = 0;
+
+    while (*fmt && !failed) {
+        struct FmtSpec sp;
+        const char* start;
+        const char* lit = fmt;
+        int length = 0;     // 'H' hh, 'h', 'l', 'q' ll, 'j', 'z', 't', 'L'
+        char conv;
+
+        while (*fmt && *fmt != '%') {
+            fmt++;
+        }
+        fmt__put(&out, lit, (size_t)(fmt - lit));
+        if (!*fmt) {
+            break;
+        }
+        start = fmt++;
+
+        memset(&sp, 0, sizeof(sp));
+        sp.prec = -1;
+        for ( ; ; fmt++) {
+            if (*fmt == '-') { sp.minus = 1; }
+            else if (*fmt == '+') { sp.plus = 1; }
+            else if (*fmt == ' ') { sp.space = 1; }
+            else if (*fmt == '#') { sp.hash = 1; }
+            else if (*fmt == '0') { sp.zero = 1; }
+            else { break; }
+        }
+        if (*fmt == '*') {
+            sp.width = va_arg(ap, int);
+            if (sp.width < 0) {
+                sp.minus = 1;
+                sp.width = -sp.width;
+            }
+            fmt++;
+        }
+        else {
+            while (*fmt >= '0' && *fmt <= '9') {
+                sp.width = sp.width * 10 + (*fmt++ - '0');
+            }
+        }
+        if (*fmt == '.') {
+            fmt++;
+            sp.prec = 0;
+            if (*fmt == '*') {
+                sp.prec = va_arg(ap, int);
+                sp.prec = (sp.prec < 0) ? -1 : sp.prec;
+                fmt++;
+            }
+            else {
+                while (*fmt >= '0' && *fmt <= '9') {
+                    sp.prec = sp.prec * 10 + (*fmt++ - '0');
+                }
+            }
+        }
+        if (sp.minus) {
+            sp.zero = 0;
+        }
+
+        switch (*fmt) {
+        case 'h':   length = (fmt[1] == 'h') ? (fmt++, 'H') : 'h';  fmt++;  break;
+        case 'l':   length = (fmt[1] == 'l') ? (fmt++, 'q') : 'l';  fmt++;  break;
+        case 'j':
+        case 'z':
+        case 't':
+        case 'L':   length = *fmt++;                                        break;
+        default:                                                            break;
+        }
+
+        conv = *fmt;
+        if (conv) {
+            fmt++;
+        }
+        switch (conv) {
+        case 'd':
+        case 'i': {
+            int64_t v;
+            switch (length) {
+            case 'H':   v = (signed char)va_arg(ap, int);   break;
+            case 'h':   v = (short)va_arg(ap, int);         break;
+            case 'l':   v = va_arg(ap, long);               break;
+            case 'q':   v = va_arg(ap, long long);          break;
+            case 'j':   v = va_arg(ap, intmax_t);           break;
+            case 'z':   v = (int64_t)va_arg(ap, size_t);    break;
+            case 't':   v = va_arg(ap, ptrdiff_t);          break;
+            default:    v = va_arg(ap, int);                break;
+            }
+            fmt__integer(&out, &sp, (v < 0) ? 0 - (uint64_t)v : (uint64_t)v, v < 0, conv);
+            break;
+        }
+        case 'u':
+        case 'o':
+        case 'x':
+        case 'X': {
+            uint64_t v;
+            switch (length) {
+            case 'H':   v = (unsigned char)va_arg(ap, unsigned);    break;
+            case 'h':   v = (unsigned short)va_arg(ap, unsigned);   break;
+            case 'l':   v = va_arg(ap, unsigned long);              break;
+            case 'q':   v = va_arg(ap, unsigned long long);         break;
+            case 'j':   v = va_arg(ap, uintmax_t);                  break;
+            case 'z':   v = va_arg(ap, size_t);                     break;
+            case 't':   v = (uint64_t)va_arg(ap, ptrdiff_t);        break;
+            default:    v = va_arg(ap, unsigned);                   break;
+            }
+            fmt__integer(&out, &sp, v, 0, conv);
+            break;
+        }
+        case 'p': {
+            void* p = va_arg(ap, void*);
+            if (p) {
+                sp.hash = 1;
+                fmt__integer(&out, &sp, (uintptr_t)p, 0, 'x');
+            }
+            else {
+                sp.zero = 0;
+                fmt__emit(&out, &sp, "", 0, 0, "(nil)", 5);
+            }
+            break;
+        }
+        case 'c':
+        case 'C': {
+            if (length == 'l' || conv == 'C') {
+                wchar_t wc = (wchar_t)va_arg(ap, wint_t);
+                sp.prec = -1;
+                failed = fmt__wide(&out, &sp, &wc, 1);
+            }
+            else {
+                char c = (char)va_arg(ap, int);
+                sp.zero = 0;
+                fmt__emit(&out, &sp, "", 0, 0, &c, 1);
+            }
+            break;
+        }
+        case 's':
+        case 'S':
+        case 'm': {
+            const char* s;
+            size_t len;
+            if (conv == 'm') {
+                s = strerror(err);
+            }
+            else if (length == 'l' || conv == 'S') {
+                const wchar_t* ws = va_arg(ap, const wchar_t*);
+                if (ws) {
+                    failed = fmt__wide(&out, &sp, ws, wcslen(ws));
+                    break;
+                }
+                s = NULL;
+            }
+            else {
+                s = va_arg(ap, const char*);
+            }
+            if (!s) {
+                s = (sp.prec < 0 || sp.prec >= 6) ? "(null)" : "";
+            }
+            len = (sp.prec >= 0) ? strnlen(s, (size_t)sp.prec) : strlen(s);
+            sp.zero = 0;
+            fmt__emit(&out, &sp, "", 0, 0, s, len);
+            break;
+        }
+        case 'f':
+        case 'F':
+        case 'e':
+        case 'E':
+        case 'g':
+        case 'G': {
+            double v = (length == 'L') ? (double)va_arg(ap, long double) : va_arg(ap, double);
+            fmt__float(&out, &sp, v, conv);
+            break;
+        }
+        case 'a':
+        case 'A': {
+            double v = (length == 'L') ? (double)va_arg(ap, long double) : va_arg(ap, double);
+            fmt__hexfloat(&out, &sp, v, conv == 'A');
+            break;
+        }
+        case 'n': {
+            // stores the count so far, as printf does; writes nothing
+            switch (length) {
+            case 'H':   *va_arg(ap, signed char*) = (signed char)out.pos;  break;
+            case 'h':   *va_arg(ap, short*) = (short)out.pos;              break;
+            case 'l':   *va_arg(ap, long*) = (long)out.pos;                break;
+            case 'q':   *va_arg(ap, long long*) = (long long)out.pos;      break;
+            case 'j':   *va_arg(ap, intmax_t*) = (intmax_t)out.pos;        break;
+            case 'z':   *va_arg(ap, size_t*) = out.pos;                    break;
+            case 't':   *va_arg(ap, ptrdiff_t*) = (ptrdiff_t)out.pos;      break;
+            default:    *va_arg(ap, int*) = (int)out.pos;                  break;
+            }
+            break;
+        }
+        case '%':
+            fmt__put(&out, "%", 1);
+            break;
+        default:
+            // unknown: copy the directive through; it consumes no argument
+            fmt__put(&out, start, (size_t)(fmt - start));
+            break;
+        }
+    }
+
+    if (size) {
+        buf[MIN(out.pos, size - 1)] = '\0';
+    }
+    if (failed) {
+        errno = EILSEQ;
+        return -1;
+    }
+    return (out.pos > 0x7FFFFFFF) ? -1 : (int)out.pos;
+}
+
+int fmt_snprintf(char* buf, size_t size, const char* fmt, ...)
+{
+    va_list ap;
+    int n;
+    va_start(ap, fmt);
+    n = fmt_vsnprintf(buf, size, fmt, ap);
+    va_end(ap);
+    return n;
+}
+
+int fmt_double(char* buf, size_t size, double v)
+{
+    struct FmtOut out;
+    struct FmtSpec sp;
+    char d[24];
+    uint64_t bits;
+    int n;
+    int k;
+
+    out.buf = buf;
+    out.size = size;
+    out.pos = 0;
+    memset(&sp, 0, sizeof(sp));
+    memcpy(&bits, &v, sizeof(bits));
+    if (bits >> 63) {
+        fmt__put(&out, "-", 1);
+        v = -v;
+    }
+    if (v != v || v > 1.7976931348623157e308) {
+        fmt__put(&out, (v != v) ? "nan" : "inf", 3);
+    }
+    else if (v == 0) {
+        fmt__put(&out, "0", 1);
+    }
+    else {
+        n = fmt__shortest(v, d, &k);
+        // %g layout: plain notation for 1e-4 <= v < 1e17
+        if (k - 1 >= -4 && k - 1 < 17) {
+            fmt__f_body(&out, d, n, k, MAX(0, n - k), n > k);
+        }
+        else {
+            fmt__e_body(&out, d, n, k - 1, n - 1, n > 1, 0);
+        }
+    }
+    if (size) {
+        buf[MIN(out.pos, size - 1)] = '\0';
+    }
+    return (int)out.pos;
+}
+
+#endif  // FASTFMT_IMPLEMENTATION
@@ -0,0 +1,346 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org>
+*/
+#ifndef __FLIGHTREC_H__
+#define __FLIGHTREC_H__
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#if defined(FLIGHTREC_EXTRACT_MAIN) && !defined(LOGCLOCK_IMPLEMENTATION)
+#   define LOGCLOCK_IMPLEMENTATION
+#endif
+#include "logclock.h"
+#include "macros.h"
+
+/** @file
+ * This file contains a crash-persistent flight recorder: a fixed-size,
+ * memory-mapped circular file that keeps the most recent log messages of
+ * every level, plus the tool that extracts them after a crash.
+ **/
+
+/**
+ *                      Flight Recorder Overview
+ * =====================================================================
+ * flightrec_open() creates a file of fixed-size record slots and maps it
+ * MAP_SHARED. Every message is formatted straight into the next slot; a
+ * writer claims the slot with one atomic add, writes it, and publishes it by
+ * storing its sequence number last, so a slot torn by a crash mid-write is
+ * recognizable and skipped. No system call is made per message.
+ *
+ * Because the mapping is shared, the data lives in the kernel page cache
+ * rather than in the process: it survives SIGSEGV, abort() and even
+ * SIGKILL, and only a kernel crash or power loss before write-back can lose
+ * it. The header carries the logclock.h calibration so raw TSC stamps can be
+ * converted by the extractor.
+ *
+ * Debug Print Integration
+ * ----------------------------------------------
+ * Defining FLIGHT_RECORDER (with DEBUG_PRINT) makes every PRINTx() and
+ * SPRINTx() in debug.h record its message here regardless of the print
+ * level or scope; output to ucprintf() still follows g_currentPrintLevel
+ * (or CURRENT_PRINT_LEVEL). Messages are only recorded once flightrec_open()
+ * has succeeded. Note this formats every message, including the PRINTD()
+ * and PRINTV() ones that are otherwise suppressed.
+ *
+ * Extraction
+ * ----------------------------------------------
+ * A restarted process doesn't overwrite the recording of the run that
+ * crashed: flightrec_open() keeps it as "<path>.prev". Build the extractor
+ * and print the last N records (default all):
+ *   cc -x c -DFLIGHTREC_EXTRACT_MAIN -o flightrec_extract flightrec.h
+ *   ./flightrec_extract app.frec 200
+ * The extractor must run on a host with the same byte order as the producer.
+ *
+ * Define FLIGHTREC_IMPLEMENTATION in exactly one .c file before including
+ * this file (logclock.h needs LOGCLOCK_IMPLEMENTATION as well).
+ */
+
+//////////////////////////////////////////////////////////////////////////////
+#ifndef FLIGHTREC_RECORD_SIZE
+#   define FLIGHTREC_RECORD_SIZE    256
+#endif
+
+/** File header magic ("FRC1" in memory) */
+#define FLIGHTREC_MAGIC         FCC('F', 'R', 'C', '1')
+
+/** One slot; "seq" is 0 while empty or being written */
+struct FlightRecRecord {
+    uint64_t    seq;
+    uint64_t    stamp;          ///< logclock_now() raw stamp
+    int32_t     tid;
+    uint16_t    cpu;
+    uint8_t     level;
+    uint8_t     reserved;
+    char        text[FLIGHTREC_RECORD_SIZE - 24];
+};
+
+/** Start of the mapped file; the slots follow at "headerSize" */
+struct FlightRecHeader {
+    uint32_t        magic;
+    uint32_t        headerSize;
+    uint32_t        recordSize;
+    uint32_t        records;
+    struct LogClock clock;
+    uint64_t        next __attribute__((aligned(64)));  ///< next ticket to claim
+} __attribute__((aligned(64)));
+
+extern struct FlightRecHeader* g_flightRec;
+
+EXTERN_CPP_START
+
+/** Creates and maps "path" with room for at least "bytes" of records;
+ *  returns 0 on success. An existing file (the previous run's recording) is
+ *  first renamed to "<path>.prev", replacing any older one.
+ */
+int flightrec_open(const char* path, size_t bytes);
+
+/** Syncs and unmaps the recorder; call only once no thread is logging */
+void flightrec_close(void);
+
+/** Records one message at a debug.h PRINT_LEVEL_* level */
+void flightrec_vprintf(unsigned level, const char* fmt, va_list ap);
+void flightrec_printf(unsigned level, const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+
+/** Writes the last "last" records (0 for all) of a recorder file to "out",
+ *  oldest first; returns 0 on success.
+ */
+int flightrec_extract(const char* path, unsigned last, FILE* out);
+
+EXTERN_CPP_END
+
+/** Records a message if the recorder is open */
+#define FLIGHTREC(level, fmt, args...)  \
+    do { \
+        if (g_flightRec) { flightrec_printf(level, fmt , ## args); } \
+    } while (0)
+
+#endif  // __FLIGHTREC_H__
+
+
+//////////////////////////////////////////////////////////////////////////////
+#if (defined(FLIGHTREC_IMPLEMENTATION) || defined(FLIGHTREC_EXTRACT_MAIN)) && !defined(__FLIGHTREC_EXTRACT__)
+#define __FLIGHTREC_EXTRACT__
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static int flightrec__cmp_seq(const void* a, const void* b)
+{
+    uint64_t x = (*(const struct FlightRecRecord* const* )a)->seq;
+    uint64_t y = (*(const struct FlightRecRecord* const* )b)->seq;
+    return (x > y) - (x < y);
+}
+
+int flightrec_extract(const char* path, unsigned last, FILE* out)
+{
+    static const char* const levelNames[] = { "all", "debug", "info", "warn", "always" };
+    const struct FlightRecHeader* hdr;
+    const struct FlightRecRecord** sorted;
+    struct stat st;
+    unsigned count = 0;
+    unsigned first;
+    void* map;
+    int fd = open(path, O_RDONLY);
+
+    if (fd < 0) {
+        return -1;
+    }
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(*hdr)) {
+        close(fd);
+        return -1;
+    }
+    map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+    hdr = (const struct FlightRecHeader* )map;
+    if (hdr->magic != FLIGHTREC_MAGIC || hdr->recordSize != sizeof(struct FlightRecRecord) ||
+        hdr->headerSize + (uint64_t)hdr->records * hdr->recordSize > (uint64_t)st.st_size ||
+        (sorted = (const struct FlightRecRecord** )malloc((hdr->records + 1) * sizeof(*sorted))) == NULL) {
+        munmap(map, (size_t)st.st_size);
+        return -1;
+    }
+
+    for (unsigned i = 0; i < hdr->records; i++) {
+        const struct FlightRecRecord* rec =
+            (const struct FlightRecRecord* )((const char* )map + hdr->headerSize + (size_t)i * hdr->recordSize);
+        if (rec->seq != 0) {
+            sorted[count++] = rec;
+        }
+    }
+    qsort(sorted, count, sizeof(*sorted), flightrec__cmp_seq);
+
+    first = (last && last < count) ? count - last : 0;
+    for (unsigned i = first; i < count; i++) {
+        const struct FlightRecRecord* rec = sorted[i];
+        char prefix[LOGCLOCK_PREFIX_SIZE];
+        size_t len = strnlen(rec->text, sizeof(rec->text));
+        // stamps are only meaningful against the producer's calibration
+        logclock_format_prefix_with(&hdr->clock, prefix, sizeof(prefix), rec->stamp, rec->tid, rec->cpu);
+        fprintf(out, "%s%-6s %.*s", prefix,
+                rec->level < NUM_ARRAY_ELEM(levelNames) ? levelNames[rec->level] : "?",
+                (int)len, rec->text);
+        if (len == 0 || rec->text[len - 1] != '\n') {
+            fputc('\n', out);
+        }
+    }
+
+    free(sorted);
+    munmap(map, (size_t)st.st_size);
+    return 0;
+}
+
+#endif  // FLIGHTREC_IMPLEMENTATION || FLIGHTREC_EXTRACT_MAIN
+
+
+//////////////////////////////////////////////////////////////////////////////
+#if defined(FLIGHTREC_IMPLEMENTATION) && !defined(__FLIGHTREC_IMPLEMENTATION__)
+#define __FLIGHTREC_IMPLEMENTATION__
+
+#ifdef USE_FASTFMT
+#   include "fastfmt.h"
+#   define FLIGHTREC__VSNPRINTF    fmt_vsnprintf
+#else
+#   define FLIGHTREC__VSNPRINTF    vsnprintf
+#endif
+
+struct FlightRecHeader* g_flightRec;
+static size_t           s_flightRecBytes;
+
+int flightrec_open(const char* path, size_t bytes)
+{
+    size_t headerSize = sizeof(struct FlightRecHeader);
+    size_t records = (bytes + sizeof(struct FlightRecRecord) - 1) / sizeof(struct FlightRecRecord);
+    size_t total = headerSize + records * sizeof(struct FlightRecRecord);
+    struct FlightRecHeader* hdr;
+    char prev[PATH_MAX];
+    int fd;
+
+    if (g_flightRec || records == 0 || records > 0xFFFFFFFFu) {
+        return -1;
+    }
+    // keep the previous run's ring for post-mortem extraction
+    if (snprintf(prev, sizeof(prev), "%s.prev", path) >= (int)sizeof(prev) ||
+        (rename(path, prev) != 0 && errno != ENOENT)) {
+        return -1;
+    }
+    fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return -1;
+    }
+    // allocate every block now: a sparse mapping would SIGBUS on a full disk
+    if (posix_fallocate(fd, 0, (off_t)total) != 0) {
+        close(fd);
+        unlink(path);
+        return -1;
+    }
+    hdr = (struct FlightRecHeader* )mmap(NULL, total, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (hdr == MAP_FAILED) {
+        return -1;
+    }
+    hdr->headerSize = (uint32_t)headerSize;
+    hdr->recordSize = sizeof(struct FlightRecRecord);
+    hdr->records = (uint32_t)records;
+    logclock_calibrate();       // the extractor needs the tick rate
+    hdr->clock = g_logClock;
+    hdr->next = 0;
+    __atomic_store_n(&hdr->magic, FLIGHTREC_MAGIC, __ATOMIC_RELEASE);
+
+    s_flightRecBytes = total;
+    __atomic_store_n(&g_flightRec, hdr, __ATOMIC_RELEASE);
+    return 0;
+}
+
+void flightrec_close(void)
+{
+    struct FlightRecHeader* hdr = __atomic_exchange_n(&g_flightRec, NULL, __ATOMIC_ACQ_REL);
+    if (hdr) {
+        msync(hdr, s_flightRecBytes, MS_SYNC);
+        munmap(hdr, s_flightRecBytes);
+    }
+}
+
+void flightrec_vprintf(unsigned level, const char* fmt, va_list ap)
+{
+    struct FlightRecHeader* hdr = __atomic_load_n(&g_flightRec, __ATOMIC_ACQUIRE);
+    struct FlightRecRecord* rec;
+    uint64_t ticket;
+    int cpu;
+
+    if (!hdr) {
+        return;
+    }
+    ticket = __atomic_fetch_add(&hdr->next, 1, __ATOMIC_RELAXED);
+    rec = (struct FlightRecRecord* )((char* )hdr + hdr->headerSize) + ticket % hdr->records;
+
+    __atomic_store_n(&rec->seq, 0, __ATOMIC_RELAXED);
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+    rec->stamp = logclock_now_cpu(&cpu);
+    rec->tid = logclock_tid();
+    rec->cpu = (uint16_t)cpu;
+    rec->level = (uint8_t)level;
+    FLIGHTREC__VSNPRINTF(rec->text, sizeof(rec->text), fmt, ap);
+    __atomic_store_n(&rec->seq, ticket + 1, __ATOMIC_RELEASE);
+}
+
+void flightrec_printf(unsigned level, const char* fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    flightrec_vprintf(level, fmt, ap);
+    va_end(ap);
+}
+
+#endif  // FLIGHTREC_IMPLEMENTATION
+
+
+//////////////////////////////////////////////////////////////////////////////
+#if defined(FLIGHTREC_EXTRACT_MAIN) && !defined(__FLIGHTREC_EXTRACT_MAIN__)
+#define __FLIGHTREC_EXTRACT_MAIN__
+int main(int argc, char** argv)
+{
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <file> [last-n]\n", argv[0]);
+        return 1;
+    }
+    if (flightrec_extract(argv[1], (argc > 2) ? (unsigned)strtoul(argv[2], NULL, 0) : 0, stdout) != 0) {
+        fprintf(stderr, "flightrec_extract: cannot read %s\n", argv[1]);
+        return 1;
+    }
+    return 0;
+}
+#endif  // FLIGHTREC_EXTRACT_MAIN
@@ -0,0 +1,125 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org>
+*/
+#ifndef __HEXDUMP_H__
+#define __HEXDUMP_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "macros.h"
+
+/** @file
+ * This file contains an inline hex/ASCII line formatter used by the
+ * PRINTx_HEX() macros in debug.h.
+ **/
+
+/**
+ *                      Hex Dump Overview
+ * =====================================================================
+ * hexdump_line() formats up to 16 bytes as one classic offset/hex/ASCII
+ * line, the same layout as "hexdump -C":
+ *   00000010  48 65 6c 6c 6f 2c 20 77  6f 72 6c 64 21 0a 00 ff  |Hello, world!...|
+ *
+ * The whole line is encoded at once: the high and low nibbles of all 16
+ * bytes are turned into ASCII digits, and non-printable bytes into '.', with
+ * 16-byte GNU C vector operations (SSE2 on x86-64, NEON on ARM), so there
+ * is no per-byte printf() or table lookup. Only placing the digits into
+ * their columns is done a byte at a time.
+ *
+ * The output buffer must hold HEXDUMP_LINE_SIZE bytes; nothing else is
+ * touched, so it is safe in signal handlers.
+ */
+
+//////////////////////////////////////////////////////////////////////////////
+/** Bytes per dump line */
+#define HEXDUMP_LINE_BYTES  16
+
+/** Buffer size for one line, including the newline and NUL */
+#define HEXDUMP_LINE_SIZE   96
+
+typedef uint8_t HexdumpVec __attribute__((vector_size(HEXDUMP_LINE_BYTES)));
+
+/** Nibbles (0-15) to '0'-'9', 'a'-'f' */
+static inline HexdumpVec hexdump__digits(HexdumpVec n)
+{
+    return n + '0' + ((HexdumpVec)(n > 9) & ('a' - '0' - 10));
+}
+
+/** Formats "len" bytes (at most HEXDUMP_LINE_BYTES) of "data" as one dump
+ *  line labelled with "offset"; returns the length written, excluding the
+ *  NUL.
+ */
+static inline size_t hexdump_line(char* out, const void* data, size_t len, size_t offset)
+{
+    HexdumpVec bytes = { 0 };
+    HexdumpVec hi;
+    HexdumpVec lo;
+    HexdumpVec printable;
+    HexdumpVec ascii;
+    char* p = out;
+    int digits = 8;
+
+    len = MIN(len, (size_t)HEXDUMP_LINE_BYTES);
+    memcpy(&bytes, data, len);
+    hi = hexdump__digits(bytes >> 4);
+    lo = hexdump__digits(bytes & 0x0F);
+    printable = (HexdumpVec)((bytes >= 0x20) & (bytes < 0x7F));
+    ascii = (bytes & printable) | ((HexdumpVec)(printable == 0) & '.');
+
+    while (digits < (int)(2 * sizeof(offset)) && (offset >> (4 * digits))) {
+        digits++;
+    }
+    while (digits--) {
+        unsigned n = (unsigned)(offset >> (4 * digits)) & 0x0F;
+        *p++ = (char)((n < 10) ? '0' + n : 'a' - 10 + n);
+    }
+    *p++ = ' ';
+
+    for (size_t i = 0; i < HEXDUMP_LINE_BYTES; i++) {
+        if (i == HEXDUMP_LINE_BYTES / 2) {
+            *p++ = ' ';
+        }
+        p[0] = ' ';
+        p[1] = (i < len) ? (char)hi[i] : ' ';
+        p[2] = (i < len) ? (char)lo[i] : ' ';
+        p += 3;
+    }
+
+    p[0] = ' ';
+    p[1] = ' ';
+    p[2] = '|';
+    p += 3;
+    memcpy(p, &ascii, len);
+    p += len;
+    p[0] = '|';
+    p[1] = '\n';
+    p[2] = '\0';
+    return (size_t)(p + 2 - out);
+}
+
+#endif  // __HEXDUMP_H__
@@ -0,0 +1,293 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org>
+*/
+#ifndef __INTRUSIVE_H__
+#define __INTRUSIVE_H__
+
+#include <stddef.h>
+
+#include "macros.h"
+
+/** @file
+ * This file contains intrusive containers: a circular doubly-linked list,
+ * a singly-headed hash-bucket list (hlist) and a lock-free
+ * multi-producer/single-consumer queue.
+ **/
+
+/**
+ *                      Intrusive Containers Overview
+ * =====================================================================
+ * The link fields live inside the element itself, under any member name,
+ * so no node is allocated per element and an element can sit on several
+ * containers at once (one link member per container). CONTAINER_OF() from
+ * macros.h gets from a link back to the element.
+ *
+ *   struct Job {
+ *       int             id;
+ *       struct ListNode link;       // on the run list
+ *       struct HListNode hash;      // in the ID hash table
+ *   };
+ *
+ *   struct ListNode runList;
+ *   list_init(&runList);
+ *   list_add_tail(&runList, &job->link);
+ *   LIST_FOR_EACH_ENTRY(j, &runList, link) { ... }
+ *
+ * List
+ * ----------------------------------------------
+ * struct ListNode serves as both the list head and the per-element link;
+ * the list is circular through the head, so insert, delete, move and
+ * splice are all O(1) with no NULL tests. The _SAFE iterators allow the
+ * current element to be deleted.
+ *
+ * HList
+ * ----------------------------------------------
+ * struct HListHead is a single pointer, halving the size of a hash table's
+ * bucket array. Elements still delete in O(1) without knowing their bucket.
+ *
+ * MPSC Queue
+ * ----------------------------------------------
+ * struct MpscQueue is D. Vyukov's intrusive multi-producer/single-consumer
+ * queue. mpsc_push() is wait-free (one atomic exchange) and may be called
+ * from any thread; mpsc_pop() must only be called from the one consumer
+ * thread. mpsc_pop() can return NULL while a producer is between its two
+ * steps even though the queue is not empty; the consumer simply tries
+ * again later. A node must not be pushed again until it has been popped.
+ */
+
+//////////////////////////////////////////////////////////////////////////////
+/** Doubly-linked list head or element link */
+struct ListNode {
+    struct ListNode* next;
+    struct ListNode* prev;
+};
+
+/** Static initializer for a list head named "name" */
+#define LIST_HEAD_INIT(name)    { &(name), &(name) }
+
+static inline void list_init(struct ListNode* head)
+{
+    head->next = head;
+    head->prev = head;
+}
+
+static inline int list_empty(const struct ListNode* head)
+{
+    return head->next == head;
+}
+
+static inline void list__insert(struct ListNode* node, struct ListNode* prev, struct ListNode* next)
+{
+    next->prev = node;
+    node->next = next;
+    node->prev = prev;
+    prev->next = node;
+}
+
+/** Inserts "node" at the front of the list */
+static inline void list_add_head(struct ListNode* head, struct ListNode* node)
+{
+    list__insert(node, head, head->next);
+}
+
+/** Inserts "node" at the back of the list */
+static inline void list_add_tail(struct ListNode* head, struct ListNode* node)
+{
+    list__insert(node, head->prev, head);
+}
+
+/** Unlinks "node" from whatever list it is on; it is left self-linked */
+static inline void list_del(struct ListNode* node)
+{
+    node->next->prev = node->prev;
+    node->prev->next = node->next;
+    list_init(node);
+}
+
+/** Moves "node" to the back of another (or the same) list */
+static inline void list_move_tail(struct ListNode* head, struct ListNode* node)
+{
+    node->next->prev = node->prev;
+    node->prev->next = node->next;
+    list_add_tail(head, node);
+}
+
+/** Appends every element of "from" to "head" and leaves "from" empty */
+static inline void list_splice_tail(struct ListNode* head, struct ListNode* from)
+{
+    if (!list_empty(from)) {
+        from->next->prev = head->prev;
+        head->prev->next = from->next;
+        from->prev->next = head;
+        head->prev = from->prev;
+        list_init(from);
+    }
+}
+
+/** Element containing link "ptr" */
+#define LIST_ENTRY(ptr, type, member)       CONTAINER_OF(ptr, type, member)
+#define LIST_FIRST_ENTRY(head, type, member) LIST_ENTRY((head)->next, type, member)
+
+#define LIST_FOR_EACH(pos, head)  \
+    for ((pos) = (head)->next; (pos) != (head); (pos) = (pos)->next)
+
+#define LIST_FOR_EACH_SAFE(pos, tmp, head)  \
+    for ((pos) = (head)->next, (tmp) = (pos)->next; (pos) != (head); (pos) = (tmp), (tmp) = (pos)->next)
+
+/** Iterates "pos" (a pointer to the element type) over the list */
+#define LIST_FOR_EACH_ENTRY(pos, head, member)  \
+    for ((pos) = LIST_ENTRY((head)->next, __typeof__(*(pos)), member); \
+         &(pos)->member != (head); \
+         (pos) = LIST_ENTRY((pos)->member.next, __typeof__(*(pos)), member))
+
+/** As LIST_FOR_EACH_ENTRY(), but "pos" may be deleted in the body */
+#define LIST_FOR_EACH_ENTRY_SAFE(pos, tmp, head, member)  \
+    for ((pos) = LIST_ENTRY((head)->next, __typeof__(*(pos)), member), \
+         (tmp) = LIST_ENTRY((pos)->member.next, __typeof__(*(pos)), member); \
+         &(pos)->member != (head); \
+         (pos) = (tmp), (tmp) = LIST_ENTRY((tmp)->member.next, __typeof__(*(pos)), member))
+
+//////////////////////////////////////////////////////////////////////////////
+/** Hash bucket head; zero-initialized is empty */
+struct HListHead {
+    struct HListNode* first;
+};
+
+/** Element link; "pprev" points at whatever pointer points at this node */
+struct HListNode {
+    struct HListNode*  next;
+    struct HListNode** pprev;
+};
+
+static inline int hlist_empty(const struct HListHead* head)
+{
+    return head->first == NULL;
+}
+
+static inline void hlist_add_head(struct HListHead* head, struct HListNode* node)
+{
+    node->next = head->first;
+    if (node->next) {
+        node->next->pprev = &node->next;
+    }
+    head->first = node;
+    node->pprev = &head->first;
+}
+
+static inline void hlist_del(struct HListNode* node)
+{
+    *node->pprev = node->next;
+    if (node->next) {
+        node->next->pprev = node->pprev;
+    }
+    node->next = NULL;
+    node->pprev = NULL;
+}
+
+/** Nonzero if "node" is on a list (after hlist_del() it is not) */
+static inline int hlist_linked(const struct HListNode* node)
+{
+    return node->pprev != NULL;
+}
+
+#define HLIST_ENTRY(ptr, type, member)      CONTAINER_OF(ptr, type, member)
+
+/** Iterates "pos" (a pointer to the element type) over the bucket. The
+ *  helper "tmp" is a struct HListNode*; "pos" may be deleted in the body.
+ */
+#define HLIST_FOR_EACH_ENTRY(pos, tmp, head, member)  \
+    for ((tmp) = (head)->first; \
+         (tmp) && ((pos) = HLIST_ENTRY(tmp, __typeof__(*(pos)), member), (tmp) = (tmp)->next, 1); )
+
+//////////////////////////////////////////////////////////////////////////////
+/** MPSC queue link */
+struct MpscNode {
+    struct MpscNode* next;
+};
+
+struct MpscQueue {
+    struct MpscNode* head __attribute__((aligned(64)));    ///< producers' end
+    struct MpscNode* tail __attribute__((aligned(64)));    ///< consumer's end
+    struct MpscNode  stub;
+};
+
+static inline void mpsc_init(struct MpscQueue* q)
+{
+    q->stub.next = NULL;
+    q->head = &q->stub;
+    q->tail = &q->stub;
+}
+
+/** Enqueues "node"; safe from any number of threads */
+static inline void mpsc_push(struct MpscQueue* q, struct MpscNode* node)
+{
+    struct MpscNode* prev;
+    __atomic_store_n(&node->next, NULL, __ATOMIC_RELAXED);
+    prev = __atomic_exchange_n(&q->head, node, __ATOMIC_ACQ_REL);
+    // until this store the new node is unreachable from the consumer's end
+    __atomic_store_n(&prev->next, node, __ATOMIC_RELEASE);
+}
+
+/** Dequeues the oldest node, or returns NULL; consumer thread only */
+static inline struct MpscNode* mpsc_pop(struct MpscQueue* q)
+{
+    struct MpscNode* tail = q->tail;
+    struct MpscNode* next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+
+    if (tail == &q->stub) {
+        if (!next) {
+            return NULL;
+        }
+        q->tail = next;
+        tail = next;
+        next = __atomic_load_n(&next->next, __ATOMIC_ACQUIRE);
+    }
+    if (next) {
+        q->tail = next;
+        return tail;
+    }
+    if (tail != __atomic_load_n(&q->head, __ATOMIC_ACQUIRE)) {
+        return NULL;        // a producer is mid-push
+    }
+    // "tail" is the last node: park the stub behind it so it can be handed out
+    mpsc_push(q, &q->stub);
+    next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+    if (next) {
+        q->tail = next;
+        return tail;
+    }
+    return NULL;
+}
+
+/** Nonzero if nothing is queued (a racing push may be missed) */
+static inline int mpsc_empty(struct MpscQueue* q)
+{
+    return q->tail == &q->stub && __atomic_load_n(&q->stub.next, __ATOMIC_ACQUIRE) == NULL;
+}
+
+#define MPSC_ENTRY(ptr, type, member)       CONTAINER_OF(ptr, type, member)
+
+#endif  // __INTRUSIVE_H__
@@ -0,0 +1,383 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org>
+*/
+#ifndef __LOGCLOCK_H__
+#define __LOGCLOCK_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "macros.h"
+
+/** TSC stamps need RDTSC and the 128-bit product in the conversion */
+#if defined(__x86_64__)
+#   define LOGCLOCK_TSC
+#   include <x86intrin.h>
+#endif
+
+/** @file
+ * This file contains a low-overhead clock, thread ID and CPU source for
+ * stamping log records, plus the formatting of the record prefix.
+ **/
+
+/**
+ *                      Log Clock Overview
+ * =====================================================================
+ * logclock_now() returns a raw 64-bit timestamp. On x86-64 CPUs with an
+ * invariant TSC it is a bare RDTSC; elsewhere (or if the TSC is not
+ * invariant) it falls back to CLOCK_MONOTONIC in nanoseconds. The choice is
+ * made before the first stamp is handed out (at start-up, or by whichever
+ * stamp comes first), together with a base TSC/CLOCK_MONOTONIC pair and the
+ * offset to CLOCK_REALTIME; it costs a CPUID and two clock reads.
+ *
+ * The TSC rate is only measured when a stamp is first converted to
+ * wall-clock time (logclock_calibrate()), as the time elapsed since the base
+ * pair, so nothing busy-waits at load time. A conversion within
+ * LOGCLOCK_CALIBRATE_NS of start-up sleeps for the rest of that window
+ * once. Raw stamps are only converted when a record is finally written
+ * out.
+ *
+ * logclock_tid() caches the kernel thread ID per thread (one gettid system
+ * call per thread), and logclock_now_cpu() returns the CPU number along
+ * with the timestamp (from RDTSCP in TSC mode, else the getcpu system call).
+ *
+ * Prefix format produced by logclock_format_prefix():
+ *   HH:MM:SS.uuuuuu T<tid> C<cpu>
+ * followed by a single space, in local time.
+ *
+ * Debug Print Integration
+ * ----------------------------------------------
+ * Defining PRINT_PREFIX (with DEBUG_PRINT) makes every PRINTx() in debug.h
+ * prepend the prefix; "fmt" must then be a string literal. With asynclog.h,
+ * define ASYNCLOG_PREFIX instead so records carry raw stamps and the prefix
+ * is formatted by the consumer thread.
+ *
+ * Define LOGCLOCK_IMPLEMENTATION in exactly one .c file before including
+ * this file.
+ */
+
+//////////////////////////////////////////////////////////////////////////////
+/** Buffer size that always holds a formatted prefix */
+#define LOGCLOCK_PREFIX_SIZE    48
+
+/** What raw stamps are */
+#define LOGCLOCK_MODE_UNSET     0   ///< not decided yet; no stamp handed out
+#define LOGCLOCK_MODE_TSC       1   ///< TSC ticks
+#define LOGCLOCK_MODE_NS        2   ///< CLOCK_MONOTONIC ns
+
+/** Calibration data shared by all threads */
+struct LogClock {
+    int         mode;           ///< LOGCLOCK_MODE_*, set last
+    uint64_t    baseTicks;      ///< raw stamp at the base point (process start)
+    int64_t     baseNs;         ///< CLOCK_MONOTONIC ns at the base point
+    uint64_t    nsPerTick32;    ///< ns per tick, 32.32 fixed point; 0 until calibrated
+    int64_t     realOffsetNs;   ///< CLOCK_REALTIME - CLOCK_MONOTONIC
+};
+
+extern struct LogClock g_logClock;
+extern __thread int g_logClockTid;
+
+EXTERN_CPP_START
+
+/** Picks the stamp source and captures the base point; runs automatically
+ *  before the first stamp and may be re-run to restart calibration
+ */
+void logclock_init(void);
+
+/** Slow path of logclock_now() while the mode is not yet set */
+uint64_t logclock_now_slow(void);
+
+/** Measures the TSC rate if not done yet; may sleep up to
+ *  LOGCLOCK_CALIBRATE_NS shortly after start-up
+ */
+void logclock_calibrate(void);
+
+/** Returns the calling thread's kernel thread ID (slow path of logclock_tid) */
+int logclock_gettid(void);
+
+/** Returns the current CPU (fallback when RDTSCP is not used) */
+int logclock_getcpu(void);
+
+/** Converts a raw stamp to wall-clock time */
+void logclock_to_timespec(uint64_t raw, struct timespec* wall);
+
+/** Converts a raw stamp taken under "clock", a calibrated copy of
+ *  g_logClock from this or another process, to wall-clock time
+ */
+void logclock_to_timespec_with(const struct LogClock* clock, uint64_t raw, struct timespec* wall);
+
+/** Nanoseconds from raw stamp "from" to raw stamp "to", scaled from the
+ *  raw difference so short intervals stay exact
+ */
+int64_t logclock_delta_ns(uint64_t from, uint64_t to);
+
+/** Formats "HH:MM:SS.uuuuuu T<tid> C<cpu> "; returns the length */
+int logclock_format_prefix(char* buf, size_t size, uint64_t raw, int tid, int cpu);
+
+/** logclock_format_prefix() for a stamp taken under "clock" */
+int logclock_format_prefix_with(const struct LogClock* clock, char* buf, size_t size,
+                                uint64_t raw, int tid, int cpu);
+
+EXTERN_CPP_END
+
+/** Raw timestamp; see logclock_to_timespec() */
+static inline uint64_t logclock_now(void)
+{
+    int mode = __atomic_load_n(&g_logClock.mode, __ATOMIC_ACQUIRE);
+#ifdef LOGCLOCK_TSC
+    if (__builtin_expect(mode == LOGCLOCK_MODE_TSC, 1)) {
+        return __rdtsc();
+    }
+#endif
+    if (__builtin_expect(mode == LOGCLOCK_MODE_UNSET, 0)) {
+        return logclock_now_slow();
+    }
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+/** Raw timestamp plus the CPU the caller is running on */
+static inline uint64_t logclock_now_cpu(int* cpu)
+{
+#ifdef LOGCLOCK_TSC
+    if (__builtin_expect(__atomic_load_n(&g_logClock.mode, __ATOMIC_ACQUIRE) == LOGCLOCK_MODE_TSC, 1)) {
+        unsigned int aux;
+        uint64_t ticks = __rdtscp(&aux);
+        *cpu = (int)(aux & 0xFFF);      // Linux stores (node << 12) | cpu
+        return ticks;
+    }
+#endif
+    *cpu = logclock_getcpu();
+    return logclock_now();
+}
+
+/** Cached kernel thread ID */
+static inline int logclock_tid(void)
+{
+    int tid = g_logClockTid;
+    return __builtin_expect(tid != 0, 1) ? tid : logclock_gettid();
+}
+
+/** Formats the prefix for "now" into buf */
+static inline int logclock_prefix(char* buf, size_t size)
+{
+    int cpu;
+    uint64_t raw = logclock_now_cpu(&cpu);
+    return logclock_format_prefix(buf, size, raw, logclock_tid(), cpu);
+}
+
+#endif  // __LOGCLOCK_H__
+
+
+//////////////////////////////////////////////////////////////////////////////
+#if defined(LOGCLOCK_IMPLEMENTATION) && !defined(__LOGCLOCK_IMPLEMENTATION__)
+#define __LOGCLOCK_IMPLEMENTATION__
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#ifndef _GNU_SOURCE
+// glibc only declares it with _GNU_SOURCE, but always exports it
+extern int sched_getcpu(void);
+#endif
+#ifdef LOGCLOCK_TSC
+#   include <cpuid.h>
+#endif
+
+#ifndef LOGCLOCK_CALIBRATE_NS
+#   define LOGCLOCK_CALIBRATE_NS    10000000    ///< 10 ms
+#endif
+
+struct LogClock g_logClock;
+__thread int g_logClockTid;
+
+static pthread_once_t   s_logClockOnce = PTHREAD_ONCE_INIT;
+static pthread_mutex_t  s_logClockLock = PTHREAD_MUTEX_INITIALIZER;
+
+static int64_t logclock_ns(clockid_t id)
+{
+    struct timespec ts;
+    clock_gettime(id, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+#ifdef LOGCLOCK_TSC
+/** CPUID.80000007H:EDX[8] advertises a constant-rate, always-running TSC */
+static int logclock_invariant_tsc(void)
+{
+    unsigned int eax, ebx, ecx, edx;
+    if (__get_cpuid(0x80000000, &eax, &ebx, &ecx, &edx) && eax >= 0x80000007 &&
+        __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx)) {
+        return (edx >> 8) & 1;
+    }
+    return 0;
+}
+#endif
+
+void logclock_init(void)
+{
+    int mode = LOGCLOCK_MODE_NS;
+
+    pthread_mutex_lock(&s_logClockLock);
+    g_logClock.baseNs = logclock_ns(CLOCK_MONOTONIC);
+    g_logClock.baseTicks = (uint64_t)g_logClock.baseNs;
+#ifdef LOGCLOCK_TSC
+    if (logclock_invariant_tsc()) {
+        mode = LOGCLOCK_MODE_TSC;
+        g_logClock.baseTicks = __rdtsc();
+    }
+#endif
+    g_logClock.nsPerTick32 = 0;
+    g_logClock.realOffsetNs = logclock_ns(CLOCK_REALTIME) - logclock_ns(CLOCK_MONOTONIC);
+    __atomic_store_n(&g_logClock.mode, mode, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&s_logClockLock);
+}
+
+uint64_t logclock_now_slow(void)
+{
+    pthread_once(&s_logClockOnce, logclock_init);
+    return logclock_now();
+}
+
+void logclock_calibrate(void)
+{
+#ifdef LOGCLOCK_TSC
+    if (__atomic_load_n(&g_logClock.mode, __ATOMIC_ACQUIRE) != LOGCLOCK_MODE_TSC ||
+        __atomic_load_n(&g_logClock.nsPerTick32, __ATOMIC_ACQUIRE) != 0) {
+        return;
+    }
+    pthread_mutex_lock(&s_logClockLock);
+    if (g_logClock.nsPerTick32 == 0) {
+        int64_t elapsed = logclock_ns(CLOCK_MONOTONIC) - g_logClock.baseNs;
+        int64_t ns1;
+        uint64_t ticks1;
+        if (elapsed < LOGCLOCK_CALIBRATE_NS) {
+            int64_t wait = LOGCLOCK_CALIBRATE_NS - elapsed;
+            struct timespec ts = { (time_t)(wait / 1000000000), (long)(wait % 1000000000) };
+            nanosleep(&ts, NULL);
+        }
+        ns1 = logclock_ns(CLOCK_MONOTONIC);
+        ticks1 = __rdtsc();
+        // the window can be hours long, so scale in double rather than shift
+        if (ticks1 > g_logClock.baseTicks) {
+            double rate = (double)(ns1 - g_logClock.baseNs) / (double)(ticks1 - g_logClock.baseTicks);
+            __atomic_store_n(&g_logClock.nsPerTick32, (uint64_t)(rate * 4294967296.0), __ATOMIC_RELEASE);
+        }
+    }
+    pthread_mutex_unlock(&s_logClockLock);
+#endif
+}
+
+__attribute__((constructor)) static void logclock_auto_init(void)
+{
+    pthread_once(&s_logClockOnce, logclock_init);
+}
+
+int logclock_getcpu(void)
+{
+    // served from the vDSO where the kernel provides it, unlike a raw syscall
+    int cpu = sched_getcpu();
+    return (cpu < 0) ? 0 : cpu;
+}
+
+int logclock_gettid(void)
+{
+    g_logClockTid = (int)syscall(SYS_gettid);
+    return g_logClockTid;
+}
+
+void logclock_to_timespec(uint64_t raw, struct timespec* wall)
+{
+#ifdef LOGCLOCK_TSC
+    if (g_logClock.mode == LOGCLOCK_MODE_TSC) {
+        logclock_calibrate();
+    }
+#endif
+    logclock_to_timespec_with(&g_logClock, raw, wall);
+}
+
+void logclock_to_timespec_with(const struct LogClock* clock, uint64_t raw, struct timespec* wall)
+{
+    int64_t ns = (int64_t)raw;
+#ifdef LOGCLOCK_TSC
+    if (clock->mode == LOGCLOCK_MODE_TSC) {
+        __int128 delta = (__int128)(int64_t)(raw - clock->baseTicks) * (__int128)clock->nsPerTick32;
+        ns = clock->baseNs + (int64_t)(delta >> 32);
+    }
+#endif
+    ns += clock->realOffsetNs;
+    wall->tv_sec = (time_t)(ns / 1000000000);
+    wall->tv_nsec = (long)(ns % 1000000000);
+}
+
+int64_t logclock_delta_ns(uint64_t from, uint64_t to)
+{
+    int64_t delta = (int64_t)(to - from);
+#ifdef LOGCLOCK_TSC
+    if (g_logClock.mode == LOGCLOCK_MODE_TSC) {
+        logclock_calibrate();
+        delta = (int64_t)(((__int128)delta * (__int128)g_logClock.nsPerTick32) >> 32);
+    }
+#endif
+    return delta;
+}
+
+int logclock_format_prefix(char* buf, size_t size, uint64_t raw, int tid, int cpu)
+{
+#ifdef LOGCLOCK_TSC
+    if (g_logClock.mode == LOGCLOCK_MODE_TSC) {
+        logclock_calibrate();
+    }
+#endif
+    return logclock_format_prefix_with(&g_logClock, buf, size, raw, tid, cpu);
+}
+
+int logclock_format_prefix_with(const struct LogClock* clock, char* buf, size_t size,
+                                uint64_t raw, int tid, int cpu)
+{
+    // the broken-down time only changes once a second; cache it per thread
+    static __thread time_t s_lastSec = -1;
+    static __thread char s_hms[16];
+    struct timespec wall;
+    int n;
+
+    logclock_to_timespec_with(clock, raw, &wall);
+    if (wall.tv_sec != s_lastSec) {
+        struct tm tm;
+        localtime_r(&wall.tv_sec, &tm);
+        strftime(s_hms, sizeof(s_hms), "%H:%M:%S", &tm);
+        s_lastSec = wall.tv_sec;
+    }
+    n = snprintf(buf, size, "%s.%06ld T%d C%d ", s_hms, wall.tv_nsec / 1000, tid, cpu);
+    return (n < 0) ? 0 : (n >= (int)size) ? (int)size - 1 : n;
+}
+
+#endif  // LOGCLOCK_IMPLEMENTATION
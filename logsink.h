@@ -0,0 +1,765 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org>
+*/
+#ifndef __LOGSINK_H__
+#define __LOGSINK_H__
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "macros.h"
+
+/** @file
+ * This file contains a batched, multi-sink output layer: formatted records
+ * are coalesced into large buffers, fanned out to several sinks filtered by
+ * level, and written with one writev() per batch.
+ **/
+
+/**
+ *                      Log Sink Overview
+ * =====================================================================
+ * A sink is an fd (e.g., stderr), a file with size-based rotation, or an
+ * in-memory ring holding the most recent output. Each record is formatted
+ * once and offered to every sink whose minimum level it meets; levels are
+ * the debug.h PRINT_LEVEL_* values, and PRINT_LEVEL_NONE (what PRINT() and
+ * SPRINT() use) reaches every sink.
+ *
+ * Batching
+ * ----------------------------------------------
+ * An fd or file sink appends records to the current of LOGSINK_CHUNKS
+ * buffers of LOGSINK_CHUNK_SIZE bytes each; a producer holds the sink's lock
+ * only for that memcpy. Once logsink_start() has been called, a flusher
+ * thread writes the filled buffers in one writev() when a buffer fills, and
+ * writes whatever is pending every LOGSINK_FLUSH_MSEC, so at high message
+ * rates the layer makes one system call per LOGSINK_CHUNK_SIZE bytes per
+ * sink rather than one per message. File rotation (path -> path.1 -> ... ->
+ * path.<keep>) happens on the flusher thread, between batches, so producers
+ * never wait for it. If every buffer of a sink is waiting to be written, the
+ * record is dropped and counted (LOGSINK_POLICY_DROP) or the producer waits
+ * (LOGSINK_POLICY_BLOCK).
+ *
+ * Before logsink_start() and after logsink_stop(), each record is written
+ * through immediately, so nothing is lost during start-up or shutdown.
+ *
+ * logsink_shutdown() may run while other threads are still logging: it
+ * first turns new logsink_write() and logsink_flush() calls away, waits for
+ * the ones already inside to return, and only then frees the sinks.
+ * Records offered from that point on are discarded. Sink handles (for
+ * logsink_ring_read() and logsink_stats()) are invalid once it returns.
+ *
+ * Usage
+ * ----------------------------------------------
+ *   logsink_add_fd(STDERR_FILENO, PRINT_LEVEL_WARN);
+ *   logsink_add_file("app.log", PRINT_LEVEL_ALL, 64 << 20, 5);
+ *   crash = logsink_add_ring(256 * 1024, PRINT_LEVEL_DEBUG);
+ *   logsink_start(LOGSINK_POLICY_BLOCK);
+ *   ...
+ *   logsink_shutdown();        // flushes, closes and frees every sink
+ *
+ * Defining LOG_SINKS (with DEBUG_PRINT) sends every PRINTx()/SPRINTx()
+ * through logsink_printf() with the level of the message, in place of
+ * ucprintf(). Alternatively, defining LOGSINK_UCPRINTF where
+ * LOGSINK_IMPLEMENTATION is defined provides a ucprintf() that writes at
+ * PRINT_LEVEL_NONE.
+ *
+ * Config Defines
+ * ----------------------------------------------
+ *   LOGSINK_MAX_SINKS         Number of sinks                 (default 8)
+ *   LOGSINK_CHUNK_SIZE        Bytes per batch buffer          (default 64K)
+ *   LOGSINK_CHUNKS            Batch buffers per sink          (default 8)
+ *   LOGSINK_FLUSH_MSEC        Longest time a record waits     (default 100)
+ *   LOGSINK_MSG_SIZE          Longest formatted record        (default 1024)
+ *
+ * Define LOGSINK_IMPLEMENTATION in exactly one .c file before including
+ * this file.
+ */
+
+//////////////////////////////////////////////////////////////////////////////
+#ifndef LOGSINK_MAX_SINKS
+#   define LOGSINK_MAX_SINKS        8
+#endif
+#ifndef LOGSINK_CHUNK_SIZE
+#   define LOGSINK_CHUNK_SIZE       (64 * 1024)
+#endif
+#ifndef LOGSINK_CHUNKS
+#   define LOGSINK_CHUNKS           8
+#endif
+#ifndef LOGSINK_FLUSH_MSEC
+#   define LOGSINK_FLUSH_MSEC       100
+#endif
+#ifndef LOGSINK_MSG_SIZE
+#   define LOGSINK_MSG_SIZE         1024
+#endif
+
+#if LOGSINK_MSG_SIZE > LOGSINK_CHUNK_SIZE
+#   error "LOGSINK_MSG_SIZE must not exceed LOGSINK_CHUNK_SIZE"
+#endif
+
+/** Policy when all of a sink's buffers are waiting to be written */
+#define LOGSINK_POLICY_DROP     0   ///< discard the record and count it
+#define LOGSINK_POLICY_BLOCK    1   ///< wait for the flusher thread
+
+struct LogSink;
+
+struct LogSinkStats {
+    uint64_t    records;
+    uint64_t    bytes;
+    uint64_t    writes;         ///< write()/writev() system calls
+    uint64_t    dropped;
+    uint64_t    rotations;
+};
+
+EXTERN_CPP_START
+
+/** Adds a sink writing to an open descriptor, which is not closed by
+ *  logsink_shutdown(); records below "minLevel" are skipped. Sinks may be
+ *  added at any time. Returns NULL on failure.
+ */
+struct LogSink* logsink_add_fd(int fd, unsigned minLevel);
+
+/** Adds a sink appending to "path". When the file would grow past
+ *  "rotateBytes" (0 for never), it is renamed to path.1 (older files shift up
+ *  to path.<keep>; keep 0 just truncates) and a new file is started.
+ */
+struct LogSink* logsink_add_file(const char* path, unsigned minLevel, size_t rotateBytes, unsigned keep);
+
+/** Adds a sink keeping the last "bytes" of output in memory */
+struct LogSink* logsink_add_ring(size_t bytes, unsigned minLevel);
+
+/** Copies the ring's contents, oldest first, NUL-terminated; returns the length */
+size_t logsink_ring_read(struct LogSink* sink, char* buf, size_t size);
+
+/** Starts the flusher thread; returns 0 on success */
+int logsink_start(int policy);
+
+/** Writes everything pending, then stops and joins the flusher thread */
+void logsink_stop(void);
+
+/** Writes everything pending in every sink */
+void logsink_flush(void);
+
+/** Stops, flushes, closes and frees every sink, waiting out writers that
+ *  are already inside logsink_write(); sinks may be added again afterwards
+ */
+void logsink_shutdown(void);
+
+void logsink_stats(const struct LogSink* sink, struct LogSinkStats* stats);
+
+/** Offers one record of "len" bytes to every sink */
+void logsink_write(unsigned level, const char* text, size_t len);
+
+/** Formats and offers a record; same return value as vsnprintf() */
+int logsink_vprintf(unsigned level, const char* fmt, va_list ap);
+int logsink_printf(unsigned level, const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+
+EXTERN_CPP_END
+
+#endif  // __LOGSINK_H__
+
+
+//////////////////////////////////////////////////////////////////////////////
+#if defined(LOGSINK_IMPLEMENTATION) && !defined(__LOGSINK_IMPLEMENTATION__)
+#define __LOGSINK_IMPLEMENTATION__
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef USE_FASTFMT
+#   include "fastfmt.h"
+#   define LOGSINK__VSNPRINTF     fmt_vsnprintf
+#else
+#   define LOGSINK__VSNPRINTF     vsnprintf
+#endif
+
+#define LOGSINK_KIND_FD     0
+#define LOGSINK_KIND_FILE   1
+#define LOGSINK_KIND_RING   2
+
+struct LogSinkChunk {
+    size_t  used;
+    char    data[LOGSINK_CHUNK_SIZE];
+};
+
+/** Chunks are used in ring order by free-running counters: producers append
+ *  to chunk "head", chunks [tail, head) are sealed and waiting to be
+ *  written, and only the flusher advances "tail".
+ */
+struct LogSink {
+    pthread_mutex_t         lock;
+    pthread_cond_t          space;          ///< a chunk was written
+    pthread_mutex_t         flushLock;      ///< one flusher per sink at a time
+    int                     kind;
+    unsigned                minLevel;
+    int                     fd;
+    char*                   path;
+    size_t                  rotateBytes;
+    unsigned                keep;
+    size_t                  fileBytes;      ///< flusher only
+    struct LogSinkChunk*    chunks;
+    uint32_t                head;
+    uint32_t                tail;
+    char*                   ring;
+    size_t                  ringSize;
+    uint64_t                ringWritten;
+    struct LogSinkStats     stats;
+};
+
+static struct LogSink*  s_logSinks[LOGSINK_MAX_SINKS];
+static unsigned         s_logSinkCount;
+static unsigned         s_logSinkMinLevel = ~0u;    ///< lowest level any sink takes
+static pthread_mutex_t  s_logSinkAddLock = PTHREAD_MUTEX_INITIALIZER;
+
+static pthread_t        s_logSinkThread;
+static pthread_mutex_t  s_logSinkWakeLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t   s_logSinkWake = PTHREAD_COND_INITIALIZER;
+static int              s_logSinkRunning;
+static int              s_logSinkStopping;
+static int              s_logSinkPolicy;
+static unsigned         s_logSinkWriters;           ///< threads inside logsink_write()/logsink_flush()
+static int              s_logSinkClosing;           ///< logsink_shutdown() is freeing the sinks
+
+static struct LogSink* logsink_new(int kind, unsigned minLevel)
+{
+    struct LogSink* sink = (struct LogSink* )calloc(1, sizeof(*sink));
+    if (!sink) {
+        return NULL;
+    }
+    pthread_mutex_init(&sink->lock, NULL);
+    pthread_cond_init(&sink->space, NULL);
+    pthread_mutex_init(&sink->flushLock, NULL);
+    sink->kind = kind;
+    sink->minLevel = minLevel;
+    sink->fd = -1;
+    return sink;
+}
+
+static void logsink_free(struct LogSink* sink)
+{
+    if (sink->kind == LOGSINK_KIND_FILE && sink->fd >= 0) {
+        close(sink->fd);
+    }
+    pthread_mutex_destroy(&sink->lock);
+    pthread_cond_destroy(&sink->space);
+    pthread_mutex_destroy(&sink->flushLock);
+    free(sink->chunks);
+    free(sink->ring);
+    free(sink->path);
+    free(sink);
+}
+
+/** Publishes a fully set up sink; producers may see it immediately */
+static struct LogSink* logsink_register(struct LogSink* sink)
+{
+    pthread_mutex_lock(&s_logSinkAddLock);
+    if (s_logSinkCount >= LOGSINK_MAX_SINKS) {
+        pthread_mutex_unlock(&s_logSinkAddLock);
+        logsink_free(sink);
+        return NULL;
+    }
+    s_logSinks[s_logSinkCount] = sink;
+    __atomic_store_n(&s_logSinkCount, s_logSinkCount + 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&s_logSinkMinLevel, MIN(s_logSinkMinLevel, sink->minLevel), __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&s_logSinkAddLock);
+    return sink;
+}
+
+static struct LogSink* logsink_new_batched(int kind, int fd, unsigned minLevel)
+{
+    struct LogSink* sink = logsink_new(kind, minLevel);
+    if (!sink) {
+        return NULL;
+    }
+    sink->fd = fd;
+    sink->chunks = (struct LogSinkChunk* )malloc(LOGSINK_CHUNKS * sizeof(*sink->chunks));
+    if (!sink->chunks) {
+        sink->fd = -1;      // the caller owns it on failure
+        logsink_free(sink);
+        return NULL;
+    }
+    sink->chunks[0].used = 0;
+    return sink;
+}
+
+struct LogSink* logsink_add_fd(int fd, unsigned minLevel)
+{
+    struct LogSink* sink = logsink_new_batched(LOGSINK_KIND_FD, fd, minLevel);
+    return sink ? logsink_register(sink) : NULL;
+}
+
+struct LogSink* logsink_add_file(const char* path, unsigned minLevel, size_t rotateBytes, unsigned keep)
+{
+    struct LogSink* sink;
+    struct stat st;
+    int fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+
+    if (fd < 0) {
+        return NULL;
+    }
+    sink = logsink_new_batched(LOGSINK_KIND_FILE, fd, minLevel);
+    if (!sink) {
+        close(fd);
+        return NULL;
+    }
+    sink->path = strdup(path);
+    sink->rotateBytes = sink->path ? rotateBytes : 0;
+    sink->keep = keep;
+    sink->fileBytes = (fstat(fd, &st) == 0) ? (size_t)st.st_size : 0;
+    return logsink_register(sink);
+}
+
+struct LogSink* logsink_add_ring(size_t bytes, unsigned minLevel)
+{
+    struct LogSink* sink = logsink_new(LOGSINK_KIND_RING, minLevel);
+    if (!sink) {
+        return NULL;
+    }
+    sink->ringSize = bytes ? bytes : 1;
+    sink->ring = (char* )malloc(sink->ringSize);
+    if (!sink->ring) {
+        logsink_free(sink);
+        return NULL;
+    }
+    return logsink_register(sink);
+}
+
+size_t logsink_ring_read(struct LogSink* sink, char* buf, size_t size)
+{
+    size_t len;
+    size_t start;
+
+    if (size == 0) {
+        return 0;
+    }
+    pthread_mutex_lock(&sink->lock);
+    len = (size_t)MIN(sink->ringWritten, (uint64_t)sink->ringSize);
+    len = MIN(len, size - 1);
+    start = (size_t)((sink->ringWritten - len) % sink->ringSize);
+    if (start + len <= sink->ringSize) {
+        memcpy(buf, sink->ring + start, len);
+    }
+    else {
+        size_t first = sink->ringSize - start;
+        memcpy(buf, sink->ring + start, first);
+        memcpy(buf + first, sink->ring, len - first);
+    }
+    pthread_mutex_unlock(&sink->lock);
+    buf[len] = '\0';
+    return len;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+/** Shifts path.N-1 -> path.N ... path -> path.1 and reopens "path";
+ *  returns 1 if a new file was started
+ */
+static int logsink_rotate(struct LogSink* sink)
+{
+    size_t len = strlen(sink->path) + 16;
+    char* from = (char* )malloc(len);
+    char* to = (char* )malloc(len);
+    int fd;
+
+    if (from && to && sink->keep) {
+        for (unsigned i = sink->keep; i > 1; i--) {
+            snprintf(from, len, "%s.%u", sink->path, i - 1);
+            snprintf(to, len, "%s.%u", sink->path, i);
+            rename(from, to);
+        }
+        snprintf(to, len, "%s.1", sink->path);
+        rename(sink->path, to);
+    }
+    free(from);
+    free(to);
+
+    fd = open(sink->path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+    if (fd >= 0) {
+        // producers never touch the fd, so it can change under them
+        close(sink->fd);
+        sink->fd = fd;
+        sink->fileBytes = 0;
+        return 1;
+    }
+    return 0;
+}
+
+/** Writes every byte of "iov", retrying short writes; returns the number
+ *  of system calls made
+ */
+static unsigned logsink_writev_all(int fd, struct iovec* iov, int count)
+{
+    unsigned calls = 0;
+    while (count > 0) {
+        ssize_t n = writev(fd, iov, count);
+        calls++;
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        while (count > 0 && (size_t)n >= iov->iov_len) {
+            n -= (ssize_t)iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (char* )iov->iov_base + n;
+            iov->iov_len -= (size_t)n;
+        }
+    }
+    return calls;
+}
+
+/** Writes the sealed chunks (and, if "partial", the one being filled) */
+static void logsink_flush_sink(struct LogSink* sink, int partial)
+{
+    struct iovec iov[LOGSINK_CHUNKS];
+    uint32_t tail;
+    uint32_t head;
+    size_t bytes = 0;
+    unsigned writes;
+    int rotated = 0;
+    int count = 0;
+
+    if (sink->kind == LOGSINK_KIND_RING) {
+        return;
+    }
+    pthread_mutex_lock(&sink->flushLock);
+    pthread_mutex_lock(&sink->lock);
+    if (partial && sink->chunks[sink->head % LOGSINK_CHUNKS].used > 0 &&
+        sink->head + 1 - sink->tail < LOGSINK_CHUNKS) {
+        sink->head++;
+        sink->chunks[sink->head % LOGSINK_CHUNKS].used = 0;
+    }
+    tail = sink->tail;
+    head = sink->head;
+    pthread_mutex_unlock(&sink->lock);
+
+    // chunks [tail, head) belong to the flusher until "tail" moves
+    for (uint32_t c = tail; c != head; c++) {
+        struct LogSinkChunk* chunk = &sink->chunks[c % LOGSINK_CHUNKS];
+        iov[count].iov_base = chunk->data;
+        iov[count].iov_len = chunk->used;
+        bytes += chunk->used;
+        count++;
+    }
+    if (count) {
+        if (sink->kind == LOGSINK_KIND_FILE && sink->rotateBytes &&
+            sink->fileBytes > 0 && sink->fileBytes + bytes > sink->rotateBytes) {
+            rotated = logsink_rotate(sink);
+        }
+        writes = logsink_writev_all(sink->fd, iov, count);
+        sink->fileBytes += bytes;
+
+        pthread_mutex_lock(&sink->lock);
+        sink->stats.writes += writes;
+        sink->stats.rotations += (uint64_t)rotated;
+        sink->tail = head;
+        pthread_cond_broadcast(&sink->space);
+        pthread_mutex_unlock(&sink->lock);
+    }
+    pthread_mutex_unlock(&sink->flushLock);
+}
+
+static void logsink_wake_flusher(void)
+{
+    pthread_mutex_lock(&s_logSinkWakeLock);
+    pthread_cond_signal(&s_logSinkWake);
+    pthread_mutex_unlock(&s_logSinkWakeLock);
+}
+
+static void logsink_put_ring(struct LogSink* sink, const char* text, size_t len)
+{
+    size_t pos;
+
+    if (len > sink->ringSize) {
+        text += len - sink->ringSize;
+        len = sink->ringSize;
+    }
+    pthread_mutex_lock(&sink->lock);
+    pos = (size_t)(sink->ringWritten % sink->ringSize);
+    if (pos + len <= sink->ringSize) {
+        memcpy(sink->ring + pos, text, len);
+    }
+    else {
+        size_t first = sink->ringSize - pos;
+        memcpy(sink->ring + pos, text, first);
+        memcpy(sink->ring, text + first, len - first);
+    }
+    sink->ringWritten += len;
+    sink->stats.records++;
+    sink->stats.bytes += len;
+    pthread_mutex_unlock(&sink->lock);
+}
+
+static void logsink_put_chunk(struct LogSink* sink, const char* text, size_t len)
+{
+    struct LogSinkChunk* chunk;
+    int sealed = 0;
+    int running = __atomic_load_n(&s_logSinkRunning, __ATOMIC_ACQUIRE);
+
+    pthread_mutex_lock(&sink->lock);
+    chunk = &sink->chunks[sink->head % LOGSINK_CHUNKS];
+    while (chunk->used + len > LOGSINK_CHUNK_SIZE) {
+        if (sink->head + 1 - sink->tail < LOGSINK_CHUNKS) {
+            sink->head++;
+            chunk = &sink->chunks[sink->head % LOGSINK_CHUNKS];
+            chunk->used = 0;
+            sealed = 1;
+        }
+        else if (!running) {
+            pthread_mutex_unlock(&sink->lock);
+            logsink_flush_sink(sink, 0);
+            pthread_mutex_lock(&sink->lock);
+            chunk = &sink->chunks[sink->head % LOGSINK_CHUNKS];
+        }
+        else if (__atomic_load_n(&s_logSinkPolicy, __ATOMIC_RELAXED) == LOGSINK_POLICY_BLOCK) {
+            logsink_wake_flusher();
+            pthread_cond_wait(&sink->space, &sink->lock);
+            running = __atomic_load_n(&s_logSinkRunning, __ATOMIC_ACQUIRE);
+            chunk = &sink->chunks[sink->head % LOGSINK_CHUNKS];
+        }
+        else {
+            sink->stats.dropped++;
+            pthread_mutex_unlock(&sink->lock);
+            logsink_wake_flusher();
+            return;
+        }
+    }
+    memcpy(chunk->data + chunk->used, text, len);
+    chunk->used += len;
+    sink->stats.records++;
+    sink->stats.bytes += len;
+    pthread_mutex_unlock(&sink->lock);
+
+    if (!running) {
+        logsink_flush_sink(sink, 1);
+    }
+    else if (sealed) {
+        logsink_wake_flusher();
+    }
+}
+
+/** Marks the caller as using the sinks; returns 0 (and does not mark it)
+ *  if logsink_shutdown() has begun. The sequentially consistent increment
+ *  and load pair with the store and load in logsink_shutdown(), so either
+ *  the caller sees "closing" or shutdown sees the caller.
+ */
+static int logsink_enter(void)
+{
+    __atomic_add_fetch(&s_logSinkWriters, 1, __ATOMIC_SEQ_CST);
+    if (__builtin_expect(__atomic_load_n(&s_logSinkClosing, __ATOMIC_SEQ_CST), 0)) {
+        __atomic_sub_fetch(&s_logSinkWriters, 1, __ATOMIC_RELEASE);
+        return 0;
+    }
+    return 1;
+}
+
+static void logsink_leave(void)
+{
+    __atomic_sub_fetch(&s_logSinkWriters, 1, __ATOMIC_RELEASE);
+}
+
+void logsink_write(unsigned level, const char* text, size_t len)
+{
+    unsigned count;
+
+    if (!logsink_enter()) {
+        return;
+    }
+    count = __atomic_load_n(&s_logSinkCount, __ATOMIC_ACQUIRE);
+    len = MIN(len, (size_t)LOGSINK_CHUNK_SIZE);
+    for (unsigned i = 0; i < count; i++) {
+        struct LogSink* sink = s_logSinks[i];
+        if (level < sink->minLevel) {
+            continue;
+        }
+        if (sink->kind == LOGSINK_KIND_RING) {
+            logsink_put_ring(sink, text, len);
+        }
+        else {
+            logsink_put_chunk(sink, text, len);
+        }
+    }
+    logsink_leave();
+}
+
+int logsink_vprintf(unsigned level, const char* fmt, va_list ap)
+{
+    char buf[LOGSINK_MSG_SIZE];
+    int n;
+
+    if (level < __atomic_load_n(&s_logSinkMinLevel, __ATOMIC_RELAXED)) {
+        return 0;       // no sink takes it; skip the formatting
+    }
+    n = LOGSINK__VSNPRINTF(buf, sizeof(buf), fmt, ap);
+    if (n > 0) {
+        logsink_write(level, buf, MIN((size_t)n, sizeof(buf) - 1));
+    }
+    return n;
+}
+
+int logsink_printf(unsigned level, const char* fmt, ...)
+{
+    va_list ap;
+    int n;
+    va_start(ap, fmt);
+    n = logsink_vprintf(level, fmt, ap);
+    va_end(ap);
+    return n;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+static void logsink_flush_all(void)
+{
+    unsigned count = __atomic_load_n(&s_logSinkCount, __ATOMIC_ACQUIRE);
+    for (unsigned i = 0; i < count; i++) {
+        // twice: the first pass may leave the partial chunk if all were sealed
+        logsink_flush_sink(s_logSinks[i], 1);
+        logsink_flush_sink(s_logSinks[i], 1);
+    }
+}
+
+void logsink_flush(void)
+{
+    if (logsink_enter()) {
+        logsink_flush_all();
+        logsink_leave();
+    }
+}
+
+static void* logsink_flusher(void* arg)
+{
+    (void)arg;
+    pthread_mutex_lock(&s_logSinkWakeLock);
+    while (!s_logSinkStopping) {
+        struct timespec until;
+        clock_gettime(CLOCK_REALTIME, &until);
+        until.tv_nsec += LOGSINK_FLUSH_MSEC * 1000000L;
+        until.tv_sec += until.tv_nsec / 1000000000L;
+        until.tv_nsec %= 1000000000L;
+        pthread_cond_timedwait(&s_logSinkWake, &s_logSinkWakeLock, &until);
+        pthread_mutex_unlock(&s_logSinkWakeLock);
+        logsink_flush();
+        pthread_mutex_lock(&s_logSinkWakeLock);
+    }
+    pthread_mutex_unlock(&s_logSinkWakeLock);
+    return NULL;
+}
+
+int logsink_start(int policy)
+{
+    if (__atomic_load_n(&s_logSinkRunning, __ATOMIC_ACQUIRE)) {
+        return -1;
+    }
+    s_logSinkPolicy = policy;
+    s_logSinkStopping = 0;
+    if (pthread_create(&s_logSinkThread, NULL, logsink_flusher, NULL) != 0) {
+        return -1;
+    }
+    __atomic_store_n(&s_logSinkRunning, 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+void logsink_stop(void)
+{
+    unsigned count;
+
+    if (!__atomic_load_n(&s_logSinkRunning, __ATOMIC_ACQUIRE)) {
+        return;
+    }
+    pthread_mutex_lock(&s_logSinkWakeLock);
+    s_logSinkStopping = 1;
+    pthread_cond_signal(&s_logSinkWake);
+    pthread_mutex_unlock(&s_logSinkWakeLock);
+    pthread_join(s_logSinkThread, NULL);
+    __atomic_store_n(&s_logSinkRunning, 0, __ATOMIC_RELEASE);
+
+    // release blocked producers; they now write through themselves
+    count = __atomic_load_n(&s_logSinkCount, __ATOMIC_ACQUIRE);
+    for (unsigned i = 0; i < count; i++) {
+        pthread_mutex_lock(&s_logSinks[i]->lock);
+        pthread_cond_broadcast(&s_logSinks[i]->space);
+        pthread_mutex_unlock(&s_logSinks[i]->lock);
+    }
+    logsink_flush();
+}
+
+void logsink_shutdown(void)
+{
+    unsigned count;
+
+    logsink_stop();
+
+    // turn new writers away, then wait for those already using the sinks;
+    // they write through (the flusher is gone), so none waits on another
+    __atomic_store_n(&s_logSinkClosing, 1, __ATOMIC_SEQ_CST);
+    while (__atomic_load_n(&s_logSinkWriters, __ATOMIC_SEQ_CST) != 0) {
+        sched_yield();
+    }
+    logsink_flush_all();
+
+    pthread_mutex_lock(&s_logSinkAddLock);
+    count = s_logSinkCount;
+    __atomic_store_n(&s_logSinkCount, 0, __ATOMIC_RELEASE);
+    __atomic_store_n(&s_logSinkMinLevel, ~0u, __ATOMIC_RELAXED);
+    for (unsigned i = 0; i < count; i++) {
+        logsink_free(s_logSinks[i]);
+        s_logSinks[i] = NULL;
+    }
+    pthread_mutex_unlock(&s_logSinkAddLock);
+    __atomic_store_n(&s_logSinkClosing, 0, __ATOMIC_RELEASE);
+}
+
+void logsink_stats(const struct LogSink* sink, struct LogSinkStats* stats)
+{
+    pthread_mutex_lock((pthread_mutex_t* )&sink->lock);
+    *stats = sink->stats;
+    pthread_mutex_unlock((pthread_mutex_t* )&sink->lock);
+}
+
+#ifdef LOGSINK_UCPRINTF
+int ucprintf(const char* fmt, ...)
+{
+    va_list ap;
+    int n;
+    va_start(ap, fmt);
+    n = logsink_vprintf(~0u, fmt, ap);     // above every level: all sinks
+    va_end(ap);
+    return n;
+}
+#endif
+
+#endif  // LOGSINK_IMPLEMENTATION
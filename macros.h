@@ -66,6 +66,14 @@ For more information, please refer to <http://unlicense.org>
 #   define PREV(x)  ((x)->prev)
 #endif
 
+/** Gets from a pointer to "member" back to its enclosing "type" (intrusive
+ *  containers: see intrusive.h, whose links may have any member name)
+ */
+#ifndef CONTAINER_OF
+#   define CONTAINER_OF(ptr, type, member)  \
+        ((type* )((char* )(ptr) - __builtin_offsetof(type, member)))
+#endif
+
 /** Test for even or odd value */
 #ifndef IS_ODD
 #   define IS_ODD(val)     ((val) & 0x1)
@@ -79,7 +87,8 @@ For more information, please refer to <http://unlicense.org>
  *  any prefix/postfix operators, you may get unexpected results, e.g.,
  *  int result = CLIP(*pData++, 0, 255);
  *  ALIGNB(), FLOORB(), and CEILB() are faster versions if only aligning
- *  to power of 2 numbers.
+ *  to power of 2 numbers. satmath.h has single-evaluation SAT_CLIP() etc.
+ *  and vectorized array versions.
  */
 #ifndef ALIGNB
 #   define ALIGNB(val, align)  (((val) + ((align) - 1)) & ~((align) - 1))
@@ -118,7 +127,9 @@ For more information, please refer to <http://unlicense.org>
 #   define ABS(x)              (((x) <  0) ? -(x) : (x))
 #endif
 
-/** Typical bit operations as macros */
+/** Typical bit operations as macros, for bits 0..63 of an integer; see
+ *  bitmap.h for bit arrays of any length.
+ */
 /** Shifts to the right if shift if positive and to the left if shift is negative
  *  Same caveat applies regarding multiple evaluations.
  */
@@ -128,12 +139,12 @@ For more information, please refer to <http://unlicense.org>
 
 /** Sets the n-th bit of x to 1 */
 #ifndef BITSET
-#   define BITSET(x, n)        ((x) | (1 << (n)))
+#   define BITSET(x, n)        ((x) | (1ULL << (n)))
 #endif
 
 /** Clears the n-th bit of x to 0 */
 #ifndef BITCLR
-#   define BITCLR(x, n)        ((x) & (~(1 << (n))))
+#   define BITCLR(x, n)        ((x) & (~(1ULL << (n))))
 #endif
 
 /** returns the n-th bit of x */
@@ -159,8 +170,13 @@ For more information, please refer to <http://unlicense.org>
 //------------------------------------------------------------------------------
 //------------------------------------------------------------------------------
 /** the FILENAME macro extracts just the name of the file from the full path __FILE__ */
+/** Compilers that provide __FILE_NAME__ (gcc >= 12, clang >= 9) do this at compile time */
 #ifndef FILENAME
-#   define FILENAME         (const char* )(strrchr(__FILE__, '/') + 1)
+#   ifdef __FILE_NAME__
+#       define FILENAME     (const char* )(__FILE_NAME__)
+#   else
+#       define FILENAME     (const char* )(strrchr(__FILE__, '/') + 1)
+#   endif
 #endif
 
 #endif  // __MACROS_H__
@@ -0,0 +1,610 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org>
+*/
+#ifndef __MEMALLOC_H__
+#define __MEMALLOC_H__
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "macros.h"
+#include "uctypes.h"
+
+/** @file
+ * This file contains a bump-pointer arena and a fixed-size object pool for
+ * replacing malloc() on hot per-request allocation paths.
+ **/
+
+/**
+ *                      Arena Allocator
+ * =====================================================================
+ * An arena hands out memory by bumping a pointer through cache-line-aligned
+ * blocks of ARENA blockSize bytes (larger requests get a block of their
+ * own). Allocations are rounded with ROUND_UP_DATATYPE_SIZE() so every
+ * pointer suits any basic type; arena_alloc_aligned() gives more, e.g.,
+ * CACHE_LINE_SIZE. Nothing is freed individually: arena_mark() records the
+ * current position and arena_reset_to() releases everything allocated
+ * since, and arena_reset() empties the arena but keeps its newest block, so
+ * a per-request arena stops calling malloc() once warmed up. An arena is
+ * not thread-safe; use one per thread or per request.
+ *
+ *   struct Arena a;
+ *   arena_init(&a, 64 * 1024);
+ *   for (each request) {
+ *       struct Msg* m = (struct Msg* )arena_alloc(&a, sizeof(*m));
+ *       ...
+ *       arena_reset(&a);
+ *   }
+ *   arena_destroy(&a);
+ *
+ *                      Pool Allocator
+ * =====================================================================
+ * A pool hands out objects of one size. Each thread keeps its own free list
+ * for the pool, so pool_alloc() and pool_free() are a few instructions with
+ * no locking; only when a thread's list runs dry (or grows past
+ * 2 * POOL_BATCH) is a batch of POOL_BATCH objects moved to or from the
+ * shared list under the pool's mutex. Memory comes in slabs of
+ * POOL_SLAB_OBJECTS objects that are only returned by pool_destroy().
+ * Objects may be freed on a different thread from the one that allocated
+ * them. With POOL_CACHE_ALIGNED, objects are rounded up to whole cache lines
+ * so objects used by different threads never share one.
+ *
+ * pool_destroy() must only be called once no other thread uses the pool.
+ *
+ * Debugging and Statistics
+ * ----------------------------------------------
+ * Defining MEMALLOC_DEBUG fills newly allocated memory with 0xCD and freed
+ * pool objects (and memory released by an arena reset) with 0xDD, so use of
+ * uninitialized or freed memory shows up quickly. arena_stats() and
+ * pool_stats() report usage; the counters are per arena or per thread, so
+ * they cost no shared writes. A thread's pool counters are only written by
+ * that thread, with relaxed atomic stores, so pool_stats() can read them
+ * from any thread at the cost of a plain increment. When a thread exits, its
+ * counters are folded into the pool's totals and its cache record is reused
+ * by the next thread to use the pool.
+ *
+ * Define MEMALLOC_IMPLEMENTATION in exactly one .c file before including
+ * this file.
+ */
+
+//////////////////////////////////////////////////////////////////////////////
+#ifndef POOL_BATCH
+#   define POOL_BATCH           32
+#endif
+#ifndef POOL_SLAB_OBJECTS
+#   define POOL_SLAB_OBJECTS    256
+#endif
+
+#define POOL_CACHE_ALIGNED      0x1     ///< pool_init() flag
+
+#define MEMALLOC_POISON_ALLOC   0xCD
+#define MEMALLOC_POISON_FREE    0xDD
+
+#ifdef MEMALLOC_DEBUG
+#   define MEMALLOC_POISON(ptr, byte, len)  memset((ptr), (byte), (len))
+#else
+#   define MEMALLOC_POISON(ptr, byte, len)  do { } while (0)
+#endif
+
+/** Arena block header; padded so the data that follows is cache-line aligned */
+struct ArenaBlock {
+    struct ArenaBlock*  prev;
+    size_t              size;       ///< usable bytes after the header
+    size_t              used;
+} __attribute__((aligned(CACHE_LINE_SIZE)));
+
+struct ArenaStats {
+    size_t  allocs;         ///< allocations since init
+    size_t  bytesInUse;     ///< rounded bytes currently allocated
+    size_t  bytesPeak;
+    size_t  blocks;         ///< blocks currently held
+    size_t  blockBytes;     ///< memory currently held from malloc()
+};
+
+struct Arena {
+    struct ArenaBlock*  current;
+    size_t              blockSize;
+    struct ArenaStats   stats;
+};
+
+/** A position in an arena to reset back to */
+struct ArenaMark {
+    struct ArenaBlock*  block;
+    struct ArenaBlock*  prev;       ///< oversized blocks get linked in before this
+    size_t              used;
+    size_t              bytesInUse;
+};
+
+/** Per-thread free list of one pool */
+struct PoolCache {
+    void*               head;
+    unsigned            count;
+    size_t              allocs;
+    size_t              frees;
+    struct Pool*        pool;
+    struct PoolCache*   next;       ///< live caches of the pool, or its free caches
+};
+
+struct PoolStats {
+    size_t  objSize;        ///< rounded object size
+    size_t  objects;        ///< objects carved from slabs
+    size_t  inUse;          ///< allocated and not yet freed
+    size_t  slabs;
+    size_t  threads;        ///< threads that have used the pool
+};
+
+struct Pool {
+    size_t              objSize;
+    pthread_key_t       key;        ///< this thread's struct PoolCache
+    pthread_mutex_t     lock;       ///< protects everything below
+    void*               freeList;
+    unsigned            freeCount;
+    unsigned char*      carve;      ///< unused tail of the newest slab
+    unsigned char*      carveEnd;
+    void*               slabs;      ///< each slab starts with a pointer to the previous
+    size_t              slabCount;
+    size_t              objects;
+    struct PoolCache*   caches;
+    struct PoolCache*   freeCaches; ///< records of exited threads, for reuse
+    size_t              allocs;     ///< folded in from exited threads' caches
+    size_t              frees;
+    size_t              exited;     ///< threads whose caches were folded in
+};
+
+EXTERN_CPP_START
+
+/** Initializes an empty arena; blocks are "blockSize" bytes */
+void arena_init(struct Arena* a, size_t blockSize);
+
+/** Frees every block */
+void arena_destroy(struct Arena* a);
+
+/** Slow path of arena_alloc_aligned(): starts a new block */
+void* arena_alloc_slow(struct Arena* a, size_t n, size_t align);
+
+/** Releases everything allocated after "mark" was taken */
+void arena_reset_to(struct Arena* a, struct ArenaMark mark);
+
+/** Releases everything, keeping the newest block for reuse */
+void arena_reset(struct Arena* a);
+
+/** Initializes a pool of "objSize" objects; returns 0 on success */
+int pool_init(struct Pool* p, size_t objSize, unsigned flags);
+
+/** Frees every slab; no thread may use the pool any more */
+void pool_destroy(struct Pool* p);
+
+/** Slow paths of pool_alloc()/pool_free(): exchange a batch with the pool */
+void* pool_refill(struct Pool* p, struct PoolCache* c);
+void pool_drain(struct Pool* p, struct PoolCache* c, unsigned keep);
+
+/** Returns this thread's cache for "p", creating it on first use */
+struct PoolCache* pool_cache_create(struct Pool* p);
+
+void pool_stats(struct Pool* p, struct PoolStats* stats);
+void pool_stats_print(struct Pool* p, FILE* out, const char* name);
+void arena_stats_print(const struct Arena* a, FILE* out, const char* name);
+
+EXTERN_CPP_END
+
+//////////////////////////////////////////////////////////////////////////////
+/** Allocates "n" bytes aligned to "align" (a power of two); NULL if out of memory */
+static inline void* arena_alloc_aligned(struct Arena* a, size_t n, size_t align)
+{
+    struct ArenaBlock* b = a->current;
+    n = ROUND_UP_DATATYPE_SIZE(n);
+    if (__builtin_expect(b != NULL, 1)) {
+        uintptr_t base = (uintptr_t)(b + 1);
+        size_t start = (size_t)(ALIGNB(base + b->used, (uintptr_t)align) - base);
+        if (__builtin_expect(start <= b->size && n <= b->size - start, 1)) {
+            void* ptr = (void* )(base + start);
+            a->stats.bytesInUse += n + (start - b->used);
+            a->stats.bytesPeak = MAX(a->stats.bytesPeak, a->stats.bytesInUse);
+            a->stats.allocs++;
+            b->used = start + n;
+            MEMALLOC_POISON(ptr, MEMALLOC_POISON_ALLOC, n);
+            return ptr;
+        }
+    }
+    return arena_alloc_slow(a, n, align);
+}
+
+/** Allocates "n" bytes suitably aligned for any basic type */
+static inline void* arena_alloc(struct Arena* a, size_t n)
+{
+    return arena_alloc_aligned(a, n, MAX_DATATYPE_SIZE);
+}
+
+/** Allocates zeroed memory */
+static inline void* arena_calloc(struct Arena* a, size_t n)
+{
+    void* ptr = arena_alloc(a, n);
+    return ptr ? memset(ptr, 0, n) : NULL;
+}
+
+static inline struct ArenaMark arena_mark(const struct Arena* a)
+{
+    struct ArenaMark m;
+    m.block = a->current;
+    m.prev = a->current ? a->current->prev : NULL;
+    m.used = a->current ? a->current->used : 0;
+    m.bytesInUse = a->stats.bytesInUse;
+    return m;
+}
+
+static inline const struct ArenaStats* arena_stats(const struct Arena* a)
+{
+    return &a->stats;
+}
+
+static inline struct PoolCache* pool_cache(struct Pool* p)
+{
+    struct PoolCache* c = (struct PoolCache* )pthread_getspecific(p->key);
+    return __builtin_expect(c != NULL, 1) ? c : pool_cache_create(p);
+}
+
+/** Allocates one object; NULL if out of memory */
+static inline void* pool_alloc(struct Pool* p)
+{
+    struct PoolCache* c = pool_cache(p);
+    void* obj;
+    if (__builtin_expect(c == NULL, 0)) {
+        return NULL;
+    }
+    obj = c->head;
+    if (__builtin_expect(obj == NULL, 0) && (obj = pool_refill(p, c)) == NULL) {
+        return NULL;
+    }
+    c->head = *(void** )obj;
+    c->count--;
+    __atomic_store_n(&c->allocs, c->allocs + 1, __ATOMIC_RELAXED);
+    MEMALLOC_POISON(obj, MEMALLOC_POISON_ALLOC, p->objSize);
+    return obj;
+}
+
+/** Returns an object to the pool (from any thread) */
+static inline void pool_free(struct Pool* p, void* obj)
+{
+    struct PoolCache* c = pool_cache(p);
+    if (__builtin_expect(c == NULL, 0)) {
+        return;         // cannot happen once this thread has allocated
+    }
+    MEMALLOC_POISON(obj, MEMALLOC_POISON_FREE, p->objSize);
+    *(void** )obj = c->head;
+    c->head = obj;
+    __atomic_store_n(&c->frees, c->frees + 1, __ATOMIC_RELAXED);
+    if (__builtin_expect(++c->count > 2 * POOL_BATCH, 0)) {
+        pool_drain(p, c, POOL_BATCH);
+    }
+}
+
+#endif  // __MEMALLOC_H__
+
+
+//////////////////////////////////////////////////////////////////////////////
+#if defined(MEMALLOC_IMPLEMENTATION) && !defined(__MEMALLOC_IMPLEMENTATION__)
+#define __MEMALLOC_IMPLEMENTATION__
+
+#include <stdlib.h>
+
+void arena_init(struct Arena* a, size_t blockSize)
+{
+    memset(a, 0, sizeof(*a));
+    a->blockSize = ROUND_UP_CACHE_LINE(blockSize ? blockSize : 4096);
+}
+
+static void arena_free_block(struct Arena* a, struct ArenaBlock* b)
+{
+    a->stats.blocks--;
+    a->stats.blockBytes -= sizeof(*b) + b->size;
+    free(b);
+}
+
+void arena_destroy(struct Arena* a)
+{
+    while (a->current) {
+        struct ArenaBlock* prev = a->current->prev;
+        arena_free_block(a, a->current);
+        a->current = prev;
+    }
+    a->stats.bytesInUse = 0;
+}
+
+void* arena_alloc_slow(struct Arena* a, size_t n, size_t align)
+{
+    // the data area starts cache-line aligned, so only larger alignments need slack
+    size_t slack = (align > CACHE_LINE_SIZE) ? align : 0;
+    size_t size = MAX(a->blockSize, ROUND_UP_CACHE_LINE(n + slack));
+    struct ArenaBlock* b;
+
+    if (n + slack < n || (b = (struct ArenaBlock* )aligned_alloc(CACHE_LINE_SIZE, sizeof(*b) + size)) == NULL) {
+        return NULL;
+    }
+    b->size = size;
+    b->used = 0;
+    // a request too big for the standard block size must not strand the
+    // current block's free space; slot its private block in behind it
+    if (a->current && size > a->blockSize) {
+        void* ptr = (void* )ALIGNB((uintptr_t)(b + 1), (uintptr_t)align);
+        b->prev = a->current->prev;
+        a->current->prev = b;
+        b->used = size;
+        a->stats.blocks++;
+        a->stats.blockBytes += sizeof(*b) + size;
+        a->stats.bytesInUse += n;
+        a->stats.bytesPeak = MAX(a->stats.bytesPeak, a->stats.bytesInUse);
+        a->stats.allocs++;
+        MEMALLOC_POISON(ptr, MEMALLOC_POISON_ALLOC, n);
+        return ptr;
+    }
+    b->prev = a->current;
+    a->current = b;
+    a->stats.blocks++;
+    a->stats.blockBytes += sizeof(*b) + size;
+    return arena_alloc_aligned(a, n, align);
+}
+
+void arena_reset_to(struct Arena* a, struct ArenaMark mark)
+{
+    while (a->current && a->current != mark.block) {
+        struct ArenaBlock* prev = a->current->prev;
+        arena_free_block(a, a->current);
+        a->current = prev;
+    }
+    if (a->current) {
+        while (a->current->prev != mark.prev) {
+            struct ArenaBlock* prev = a->current->prev->prev;
+            arena_free_block(a, a->current->prev);
+            a->current->prev = prev;
+        }
+        MEMALLOC_POISON((unsigned char* )(a->current + 1) + mark.used, MEMALLOC_POISON_FREE,
+                        a->current->used - mark.used);
+        a->current->used = mark.used;
+    }
+    a->stats.bytesInUse = mark.bytesInUse;
+}
+
+void arena_reset(struct Arena* a)
+{
+    struct ArenaBlock* keep = a->current;
+    if (keep) {
+        while (keep->prev) {
+            struct ArenaBlock* prev = keep->prev->prev;
+            arena_free_block(a, keep->prev);
+            keep->prev = prev;
+        }
+        MEMALLOC_POISON(keep + 1, MEMALLOC_POISON_FREE, keep->used);
+        keep->used = 0;
+    }
+    a->stats.bytesInUse = 0;
+}
+
+void arena_stats_print(const struct Arena* a, FILE* out, const char* name)
+{
+    fprintf(out, "arena %s: allocs=%zu in_use=%zu peak=%zu blocks=%zu held=%zu\n", name,
+            a->stats.allocs, a->stats.bytesInUse, a->stats.bytesPeak, a->stats.blocks, a->stats.blockBytes);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+static void pool_thread_exit(void* arg)
+{
+    struct PoolCache* c = (struct PoolCache* )arg;
+    struct Pool* p = c->pool;
+    struct PoolCache** link;
+
+    // hand the exiting thread's objects back, then park the record
+    pool_drain(p, c, 0);
+    pthread_mutex_lock(&p->lock);
+    for (link = &p->caches; *link != c; link = &(*link)->next) {
+    }
+    *link = c->next;
+    p->allocs += c->allocs;
+    p->frees += c->frees;
+    p->exited++;
+    c->next = p->freeCaches;
+    p->freeCaches = c;
+    pthread_mutex_unlock(&p->lock);
+}
+
+int pool_init(struct Pool* p, size_t objSize, unsigned flags)
+{
+    memset(p, 0, sizeof(*p));
+    p->objSize = ROUND_UP_DATATYPE_SIZE(MAX(objSize, sizeof(void*)));
+    if (flags & POOL_CACHE_ALIGNED) {
+        p->objSize = ROUND_UP_CACHE_LINE(p->objSize);
+    }
+    if (pthread_mutex_init(&p->lock, NULL) != 0) {
+        return -1;
+    }
+    if (pthread_key_create(&p->key, pool_thread_exit) != 0) {
+        pthread_mutex_destroy(&p->lock);
+        return -1;
+    }
+    return 0;
+}
+
+void pool_destroy(struct Pool* p)
+{
+    pthread_key_delete(p->key);
+    while (p->slabs) {
+        void* prev = *(void** )p->slabs;
+        free(p->slabs);
+        p->slabs = prev;
+    }
+    while (p->caches) {
+        struct PoolCache* next = p->caches->next;
+        free(p->caches);
+        p->caches = next;
+    }
+    while (p->freeCaches) {
+        struct PoolCache* next = p->freeCaches->next;
+        free(p->freeCaches);
+        p->freeCaches = next;
+    }
+    pthread_mutex_destroy(&p->lock);
+}
+
+struct PoolCache* pool_cache_create(struct Pool* p)
+{
+    struct PoolCache* c;
+
+    pthread_mutex_lock(&p->lock);
+    c = p->freeCaches;
+    if (c) {
+        p->freeCaches = c->next;
+    }
+    else {
+        pthread_mutex_unlock(&p->lock);
+        c = (struct PoolCache* )aligned_alloc(CACHE_LINE_SIZE, ROUND_UP_CACHE_LINE(sizeof(*c)));
+        if (!c) {
+            return NULL;
+        }
+        pthread_mutex_lock(&p->lock);
+    }
+    memset(c, 0, sizeof(*c));
+    c->pool = p;
+    c->next = p->caches;
+    p->caches = c;
+    pthread_mutex_unlock(&p->lock);
+    pthread_setspecific(p->key, c);
+    return c;
+}
+
+/** Adds a slab; caller holds p->lock */
+static int pool_grow(struct Pool* p)
+{
+    // the first cache line holds the slab link, keeping objects line-aligned
+    size_t bytes = CACHE_LINE_SIZE + p->objSize * POOL_SLAB_OBJECTS;
+    unsigned char* slab = (unsigned char* )aligned_alloc(CACHE_LINE_SIZE, ROUND_UP_CACHE_LINE(bytes));
+    if (!slab) {
+        return -1;
+    }
+    *(void** )slab = p->slabs;
+    p->slabs = slab;
+    p->slabCount++;
+    p->carve = slab + CACHE_LINE_SIZE;
+    p->carveEnd = slab + bytes;
+    return 0;
+}
+
+void* pool_refill(struct Pool* p, struct PoolCache* c)
+{
+    unsigned n = 0;
+
+    pthread_mutex_lock(&p->lock);
+    while (n < POOL_BATCH) {
+        void* obj;
+        if (p->freeList) {
+            obj = p->freeList;
+            p->freeList = *(void** )obj;
+            p->freeCount--;
+        }
+        else if (p->carve < p->carveEnd || pool_grow(p) == 0) {
+            obj = p->carve;
+            p->carve += p->objSize;
+            p->objects++;
+        }
+        else {
+            break;
+        }
+        *(void** )obj = c->head;
+        c->head = obj;
+        n++;
+    }
+    pthread_mutex_unlock(&p->lock);
+    c->count += n;
+    return c->head;
+}
+
+void pool_drain(struct Pool* p, struct PoolCache* c, unsigned keep)
+{
+    void* first;
+    void* last;
+    unsigned n = 1;
+
+    if (c->count <= keep) {
+        return;
+    }
+    // keep the "keep" most recently freed objects, which are the likeliest
+    // to still be in this CPU's cache, and detach the older rest as one chain
+    if (keep == 0) {
+        first = c->head;
+        c->head = NULL;
+    }
+    else {
+        void* kept = c->head;
+        for (unsigned i = 1; i < keep; i++) {
+            kept = *(void** )kept;
+        }
+        first = *(void** )kept;
+        *(void** )kept = NULL;
+    }
+    for (last = first; *(void** )last; last = *(void** )last) {
+        n++;
+    }
+    c->count = keep;
+
+    pthread_mutex_lock(&p->lock);
+    *(void** )last = p->freeList;
+    p->freeList = first;
+    p->freeCount += n;
+    pthread_mutex_unlock(&p->lock);
+}
+
+void pool_stats(struct Pool* p, struct PoolStats* stats)
+{
+    size_t allocs;
+    size_t frees;
+
+    memset(stats, 0, sizeof(*stats));
+    pthread_mutex_lock(&p->lock);
+    allocs = p->allocs;
+    frees = p->frees;
+    stats->threads = p->exited;
+    for (const struct PoolCache* c = p->caches; c; c = c->next) {
+        allocs += __atomic_load_n(&c->allocs, __ATOMIC_RELAXED);
+        frees += __atomic_load_n(&c->frees, __ATOMIC_RELAXED);
+        stats->threads++;
+    }
+    stats->objSize = p->objSize;
+    stats->objects = p->objects;
+    stats->slabs = p->slabCount;
+    pthread_mutex_unlock(&p->lock);
+    stats->inUse = allocs - frees;
+}
+
+void pool_stats_print(struct Pool* p, FILE* out, const char* name)
+{
+    struct PoolStats s;
+    pool_stats(p, &s);
+    fprintf(out, "pool %s: obj_size=%zu objects=%zu in_use=%zu slabs=%zu threads=%zu\n", name,
+            s.objSize, s.objects, s.inUse, s.slabs, s.threads);
+}
+
+#endif  // MEMALLOC_IMPLEMENTATION
@@ -0,0 +1,448 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org>
+*/
+#ifndef __METRICS_H__
+#define __METRICS_H__
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "debug.h"
+#include "macros.h"
+
+/** @file
+ * This file contains cheap numeric instrumentation to go with the PRINTx()
+ * macros in debug.h: counters, gauges and latency histograms.
+ **/
+
+/**
+ *                      Metrics Overview
+ * =====================================================================
+ * A metric is a static struct Metric defined once with METRIC_DEFINE() and
+ * registered before main(). Counters and histograms are sharded: each thread
+ * is given its own cache-line-sized shard on first use, so recording is a
+ * plain load/add/store with no lock prefix and no line shared with another
+ * thread. When a thread exits its shard, and everything recorded in it, is
+ * handed to the next new thread. While more than METRICS_SHARDS threads are
+ * live, the extra ones are spread over METRICS_SHARED_SHARDS shards that are
+ * never handed out exclusively, and use relaxed atomic adds there. Gauges
+ * hold a single value (last write wins).
+ *
+ * Histograms use log-linear (HDR-style) buckets: values below
+ * 2^METRICS_SUB_BITS are exact, above that each power of two is split into
+ * 2^METRICS_SUB_BITS linear buckets, so any recorded value is reported
+ * within 1/2^METRICS_SUB_BITS (6.25% by default) of its true value over the
+ * whole 64-bit range. A shard's bucket array is allocated the first time
+ * its thread records.
+ *
+ * metrics_snapshot() merges the shards of one metric; metrics_dump() writes
+ * totals, and for histograms count/mean/p50/p99/p999/max, for every metric
+ * through ucprintf() (out == NULL) or to a file. Reads race benignly with
+ * writers, so a snapshot taken under load is approximate.
+ *
+ * Configuration
+ * ----------------------------------------------
+ * Like the PRINTx() macros, recording compiles to nothing unless DEBUG_PRINT
+ * is defined. With it, each record first tests the metric's scope against
+ * g_currentPrintScope, which the project must provide, so metrics can be
+ * switched on and off at run-time by PRINT_SCOPE_* area.
+ *
+ * Usage
+ * ----------------------------------------------
+ *   METRIC_DEFINE(g_rxPackets, METRIC_COUNTER,   "net.rx.packets", PRINT_SCOPE_AREA03);
+ *   METRIC_DEFINE(g_rxLatency, METRIC_HISTOGRAM, "net.rx.ns",      PRINT_SCOPE_AREA03);
+ *   ...
+ *   COUNTER_INC(g_rxPackets);
+ *   HISTOGRAM_RECORD(g_rxLatency, t1 - t0);
+ *   ...
+ *   metrics_dump(NULL);
+ *
+ * In other files, METRIC_DECLARE(g_rxPackets) before use. Define
+ * METRICS_IMPLEMENTATION in exactly one .c file before including this file.
+ */
+
+//////////////////////////////////////////////////////////////////////////////
+#ifndef METRICS_SHARDS
+#   define METRICS_SHARDS       32
+#endif
+#ifndef METRICS_SHARED_SHARDS
+#   define METRICS_SHARED_SHARDS    4
+#endif
+#ifndef METRICS_SUB_BITS
+#   define METRICS_SUB_BITS     4
+#endif
+
+#define METRICS_TOTAL_SHARDS    (METRICS_SHARDS + METRICS_SHARED_SHARDS)
+
+#define METRICS_SUB_COUNT       (1u << METRICS_SUB_BITS)
+#define METRICS_BUCKETS         ((64 - METRICS_SUB_BITS + 1) << METRICS_SUB_BITS)
+
+#define METRIC_COUNTER          0
+#define METRIC_GAUGE            1
+#define METRIC_HISTOGRAM        2
+
+/** One thread's slice of a metric; a whole cache line so shards never share */
+struct MetricShard {
+    uint64_t    count;          ///< counter total, or histogram sample count
+    uint64_t    sum;            ///< histogram sum of values
+    uint64_t    max;            ///< histogram maximum value
+    uint64_t*   buckets;        ///< histogram buckets, allocated on first use
+} __attribute__((aligned(64)));
+
+struct Metric {
+    struct MetricShard  shards[METRICS_TOTAL_SHARDS];   ///< exclusive ones first
+    const char*         name;
+    unsigned short      scope;
+    unsigned char       type;
+    struct Metric*      next;
+};
+
+/** Merged view of one metric */
+struct MetricSnapshot {
+    const char* name;
+    int         type;
+    uint64_t    count;          ///< counter total, gauge value, or sample count
+    uint64_t    sum;
+    uint64_t    max;
+    uint64_t    p50;
+    uint64_t    p99;
+    uint64_t    p999;
+};
+
+/** Shard of the calling thread: index + 1, negated if the shard is shared */
+extern __thread int g_metricShard;
+
+/** Defines a metric and registers it before main() */
+#define METRIC_DEFINE(var, type, name, scope)  \
+    struct Metric var = { {{0, 0, 0, NULL}}, (name), (scope), (type), NULL }; \
+    __attribute__((constructor)) static void metrics_init_ ## var(void) \
+    { \
+        metrics_register(&var); \
+    } \
+    extern struct Metric var
+
+/** Declares a metric defined elsewhere */
+#define METRIC_DECLARE(var)     extern struct Metric var
+
+EXTERN_CPP_START
+
+/** Links a metric into the registry (done by METRIC_DEFINE) */
+void metrics_register(struct Metric* m);
+
+/** Assigns the calling thread a shard (slow path of metrics_shard) */
+int metrics_assign_shard(void);
+
+/** Allocates a shard's histogram buckets; returns NULL on failure */
+uint64_t* metrics_alloc_buckets(struct MetricShard* shard);
+
+/** Merges the shards of "m" into "snap" */
+void metrics_snapshot(const struct Metric* m, struct MetricSnapshot* snap);
+
+/** Writes one line per metric through ucprintf() (out == NULL) or to "out" */
+void metrics_dump(FILE* out);
+
+/** Zeroes every metric */
+void metrics_reset(void);
+
+EXTERN_CPP_END
+
+/** Bucket index of "v" */
+static inline unsigned metrics_bucket(uint64_t v)
+{
+    unsigned e;
+    if (v < METRICS_SUB_COUNT) {
+        return (unsigned)v;
+    }
+    e = 63 - (unsigned)__builtin_clzll(v);
+    return ((e - METRICS_SUB_BITS + 1) << METRICS_SUB_BITS) |
+           (unsigned)((v >> (e - METRICS_SUB_BITS)) & (METRICS_SUB_COUNT - 1));
+}
+
+static inline int metrics_shard(void)
+{
+    int shard = g_metricShard;
+    return __builtin_expect(shard != 0, 1) ? shard : metrics_assign_shard();
+}
+
+/** Adds to a shard field; no lock prefix when the shard is ours alone */
+static inline void metrics_add(uint64_t* p, uint64_t n, int exclusive)
+{
+    if (__builtin_expect(exclusive, 1)) {
+        __atomic_store_n(p, __atomic_load_n(p, __ATOMIC_RELAXED) + n, __ATOMIC_RELAXED);
+    }
+    else {
+        __atomic_fetch_add(p, n, __ATOMIC_RELAXED);
+    }
+}
+
+static inline void metrics_count(struct Metric* m, uint64_t n)
+{
+    int shard = metrics_shard();
+    int exclusive = shard > 0;
+    metrics_add(&m->shards[(exclusive ? shard : -shard) - 1].count, n, exclusive);
+}
+
+static inline void metrics_set(struct Metric* m, int64_t v)
+{
+    __atomic_store_n(&m->shards[0].count, (uint64_t)v, __ATOMIC_RELAXED);
+}
+
+static inline void metrics_record(struct Metric* m, uint64_t v)
+{
+    int shard = metrics_shard();
+    int exclusive = shard > 0;
+    struct MetricShard* s = &m->shards[(exclusive ? shard : -shard) - 1];
+    uint64_t* buckets = __atomic_load_n(&s->buckets, __ATOMIC_ACQUIRE);
+    uint64_t max;
+
+    if (__builtin_expect(buckets == NULL, 0) && (buckets = metrics_alloc_buckets(s)) == NULL) {
+        return;
+    }
+    metrics_add(&buckets[metrics_bucket(v)], 1, exclusive);
+    metrics_add(&s->count, 1, exclusive);
+    metrics_add(&s->sum, v, exclusive);
+    max = __atomic_load_n(&s->max, __ATOMIC_RELAXED);
+    while (v > max && !__atomic_compare_exchange_n(&s->max, &max, v, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+#ifdef DEBUG_PRINT
+#   define METRIC__GATED(var, stmt)  \
+        do { \
+            if (g_currentPrintScope & (var).scope) { stmt; } \
+        } while (0)
+#   define COUNTER_INC(var)             METRIC__GATED(var, metrics_count(&(var), 1))
+#   define COUNTER_ADD(var, n)          METRIC__GATED(var, metrics_count(&(var), (n)))
+#   define GAUGE_SET(var, v)            METRIC__GATED(var, metrics_set(&(var), (v)))
+#   define HISTOGRAM_RECORD(var, v)     METRIC__GATED(var, metrics_record(&(var), (v)))
+#else
+#   define COUNTER_INC(var)
+#   define COUNTER_ADD(var, n)
+#   define GAUGE_SET(var, v)
+#   define HISTOGRAM_RECORD(var, v)
+#endif
+
+#endif  // __METRICS_H__
+
+
+//////////////////////////////////////////////////////////////////////////////
+#if defined(METRICS_IMPLEMENTATION) && !defined(__METRICS_IMPLEMENTATION__)
+#define __METRICS_IMPLEMENTATION__
+
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+__thread int g_metricShard;
+
+static struct Metric*   s_metrics;
+static int              s_metricNextShard;      ///< exclusive shards ever handed out
+static int              s_metricFree[METRICS_SHARDS];   ///< released exclusive shards
+static int              s_metricFreeCount;
+static unsigned         s_metricOverflow;
+static pthread_mutex_t  s_metricLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t    s_metricKey;
+static pthread_once_t   s_metricOnce = PTHREAD_ONCE_INIT;
+
+void metrics_register(struct Metric* m)
+{
+    m->next = __atomic_load_n(&s_metrics, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&s_metrics, &m->next, m, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+    }
+}
+
+/** pthread key destructor: returns an exclusive shard for reuse */
+static void metrics_thread_exit(void* arg)
+{
+    g_metricShard = 0;
+    pthread_mutex_lock(&s_metricLock);
+    s_metricFree[s_metricFreeCount++] = (int)(intptr_t)arg;
+    pthread_mutex_unlock(&s_metricLock);
+}
+
+static void metrics_make_key(void)
+{
+    pthread_key_create(&s_metricKey, metrics_thread_exit);
+}
+
+int metrics_assign_shard(void)
+{
+    int shard;
+
+    pthread_once(&s_metricOnce, metrics_make_key);
+    pthread_mutex_lock(&s_metricLock);
+    // the lock also orders the previous owner's plain adds before ours
+    if (s_metricFreeCount > 0) {
+        shard = s_metricFree[--s_metricFreeCount];
+    }
+    else if (s_metricNextShard < METRICS_SHARDS) {
+        shard = ++s_metricNextShard;
+    }
+    else {
+        // overflow threads only ever get the shared shards, which every
+        // writer updates atomically; an exclusive shard's plain add is
+        // never raced
+        shard = -(METRICS_SHARDS + (int)(s_metricOverflow++ % METRICS_SHARED_SHARDS) + 1);
+    }
+    pthread_mutex_unlock(&s_metricLock);
+    if (shard > 0) {
+        pthread_setspecific(s_metricKey, (void* )(intptr_t)shard);
+    }
+    g_metricShard = shard;
+    return shard;
+}
+
+uint64_t* metrics_alloc_buckets(struct MetricShard* shard)
+{
+    uint64_t* expected = NULL;
+    uint64_t* buckets = (uint64_t* )calloc(METRICS_BUCKETS, sizeof(uint64_t));
+
+    if (buckets && !__atomic_compare_exchange_n(&shard->buckets, &expected, buckets, 0,
+                                                __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        free(buckets);          // a thread sharing this shard got there first
+        buckets = expected;
+    }
+    return buckets;
+}
+
+/** Highest value that falls in bucket "idx" */
+static uint64_t metrics_bucket_upper(unsigned idx)
+{
+    unsigned e;
+    uint64_t lower;
+    if (idx < METRICS_SUB_COUNT) {
+        return idx;
+    }
+    e = (idx >> METRICS_SUB_BITS) + METRICS_SUB_BITS - 1;
+    lower = (uint64_t)(METRICS_SUB_COUNT | (idx & (METRICS_SUB_COUNT - 1))) << (e - METRICS_SUB_BITS);
+    return lower + ((uint64_t)1 << (e - METRICS_SUB_BITS)) - 1;
+}
+
+static uint64_t metrics_percentile(const uint64_t* buckets, uint64_t count, uint64_t max, double pct)
+{
+    uint64_t rank = (uint64_t)(pct * (double)count + 0.999999);
+    uint64_t seen = 0;
+
+    for (unsigned i = 0; i < METRICS_BUCKETS; i++) {
+        seen += buckets[i];
+        if (seen >= rank && seen > 0) {
+            return MIN(metrics_bucket_upper(i), max);
+        }
+    }
+    return max;
+}
+
+void metrics_snapshot(const struct Metric* m, struct MetricSnapshot* snap)
+{
+    static __thread uint64_t merged[METRICS_BUCKETS];
+
+    memset(snap, 0, sizeof(*snap));
+    snap->name = m->name;
+    snap->type = m->type;
+    if (m->type == METRIC_GAUGE) {
+        snap->count = __atomic_load_n(&m->shards[0].count, __ATOMIC_RELAXED);
+        return;
+    }
+    memset(merged, 0, sizeof(merged));
+    for (int i = 0; i < METRICS_TOTAL_SHARDS; i++) {
+        const struct MetricShard* s = &m->shards[i];
+        const uint64_t* buckets = __atomic_load_n(&s->buckets, __ATOMIC_ACQUIRE);
+        snap->count += __atomic_load_n(&s->count, __ATOMIC_RELAXED);
+        snap->sum += __atomic_load_n(&s->sum, __ATOMIC_RELAXED);
+        snap->max = MAX(snap->max, __atomic_load_n(&s->max, __ATOMIC_RELAXED));
+        if (buckets) {
+            for (unsigned b = 0; b < METRICS_BUCKETS; b++) {
+                merged[b] += __atomic_load_n(&buckets[b], __ATOMIC_RELAXED);
+            }
+        }
+    }
+    if (m->type == METRIC_HISTOGRAM && snap->count) {
+        snap->p50 = metrics_percentile(merged, snap->count, snap->max, 0.50);
+        snap->p99 = metrics_percentile(merged, snap->count, snap->max, 0.99);
+        snap->p999 = metrics_percentile(merged, snap->count, snap->max, 0.999);
+    }
+}
+
+static void metrics_out(FILE* out, const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+static void metrics_out(FILE* out, const char* fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+#ifdef DEBUG_PRINT
+    if (!out) {
+        char line[256];
+        vsnprintf(line, sizeof(line), fmt, ap);
+        ucprintf("%s", line);
+        va_end(ap);
+        return;
+    }
+#endif
+    vfprintf(out ? out : stdout, fmt, ap);
+    va_end(ap);
+}
+
+void metrics_dump(FILE* out)
+{
+    struct MetricSnapshot snap;
+
+    for (const struct Metric* m = __atomic_load_n(&s_metrics, __ATOMIC_ACQUIRE); m; m = m->next) {
+        metrics_snapshot(m, &snap);
+        if (m->type == METRIC_COUNTER) {
+            metrics_out(out, "%s counter total=%llu\n", snap.name, (unsigned long long)snap.count);
+        }
+        else if (m->type == METRIC_GAUGE) {
+            metrics_out(out, "%s gauge value=%lld\n", snap.name, (long long)snap.count);
+        }
+        else {
+            metrics_out(out, "%s histogram count=%llu mean=%.1f p50=%llu p99=%llu p999=%llu max=%llu\n",
+                        snap.name, (unsigned long long)snap.count,
+                        snap.count ? (double)snap.sum / (double)snap.count : 0.0,
+                        (unsigned long long)snap.p50, (unsigned long long)snap.p99,
+                        (unsigned long long)snap.p999, (unsigned long long)snap.max);
+        }
+    }
+}
+
+void metrics_reset(void)
+{
+    for (struct Metric* m = __atomic_load_n(&s_metrics, __ATOMIC_ACQUIRE); m; m = m->next) {
+        for (int i = 0; i < METRICS_TOTAL_SHARDS; i++) {
+            struct MetricShard* s = &m->shards[i];
+            __atomic_store_n(&s->count, 0, __ATOMIC_RELAXED);
+            __atomic_store_n(&s->sum, 0, __ATOMIC_RELAXED);
+            __atomic_store_n(&s->max, 0, __ATOMIC_RELAXED);
+            if (s->buckets) {
+                for (unsigned b = 0; b < METRICS_BUCKETS; b++) {
+                    __atomic_store_n(&s->buckets[b], 0, __ATOMIC_RELAXED);
+                }
+            }
+        }
+    }
+}
+
+#endif  // METRICS_IMPLEMENTATION
@@ -0,0 +1,396 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org>
+*/
+#ifndef __PRINTSCOPE_H__
+#define __PRINTSCOPE_H__
+
+#include <stdio.h>
+
+#include "debug.h"
+#include "macros.h"
+
+/** @file
+ * This file contains a registry of named, hierarchical print scopes that
+ * lifts the 16-area limit of the PRINT_SCOPE_AREAxx bits in debug.h.
+ **/
+
+/**
+ *                      Named Print Scopes
+ * =====================================================================
+ * Scopes are dotted names such as "net", "net.rx" and "net.rx.tcp"; there is
+ * no limit on how many a program registers. Each scope is resolved to a
+ * small integer ID once, at static-init time, and owns one byte in the
+ * g_printScopeLevels[] table holding its current print level threshold. The
+ * NSPRINTx() macros test that byte and nothing else, so a check is a single
+ * indexed load, never a string comparison.
+ *
+ * Levels are applied hierarchically: setting "net" to DEBUG applies to
+ * "net" and every scope below it, unless a more specific rule (for example
+ * "net.rx.tcp=warn") overrides it. Rules are remembered, so scopes that
+ * register later still pick them up.
+ *
+ * Scope Definition
+ * ----------------------------------------------
+ * In exactly one .c file per scope:
+ *   PRINT_SCOPE_DEFINE(g_scopeTcp, "net.rx.tcp");
+ * Anywhere else it is used:
+ *   PRINT_SCOPE_DECLARE(g_scopeTcp);
+ *   NSPRINTD(g_scopeTcp, "retransmit seq=%u\n", seq);
+ *
+ * The NSPRINTx() macros mirror SPRINTx() from debug.h and are recorded with
+ * FLIGHT_RECORDER like them, but the scope level alone decides whether they
+ * print: the global print level (or per-site flag with DYNAMIC_PRINT) is not
+ * consulted, so "info,net=debug" lets NSPRINTD() through for "net":
+ *   NSPRINT     prints unless the scope is PRINT_SCOPE_LEVEL_OFF
+ *   NSPRINTW    prints if the scope level is WARNING or lower
+ *   NSPRINTI    prints if the scope level is INFO    or lower
+ *   NSPRINTD    prints if the scope level is DEBUG   or lower
+ *   NSPRINTV    prints if the scope level is ALL
+ *
+ * Spec Strings
+ * ----------------------------------------------
+ * printscope_parse() takes a comma- or space-separated list of rules:
+ *   "info,net=debug,net.rx.tcp=all,disk=off"
+ * A bare level sets the default for every scope. Levels are none, warn,
+ * info, debug, all, off (case-insensitive) or their numeric values. The
+ * first time a scope registers, the spec in the environment variable named
+ * by PRINT_SCOPE_ENV (default "PRINT_SCOPES") is parsed automatically.
+ *
+ * Define PRINTSCOPE_IMPLEMENTATION in exactly one .c file before including
+ * this file.
+ */
+
+//////////////////////////////////////////////////////////////////////////////
+/** Scope level that suppresses even NSPRINT() */
+#define PRINT_SCOPE_LEVEL_OFF   (PRINT_LEVEL_NONE + 1)
+
+/** ID returned when a scope can't be registered; NSPRINTx() never prints it */
+#define PRINT_SCOPE_INVALID     ((unsigned int)-1)
+
+#ifndef PRINT_SCOPE_ENV
+#   define PRINT_SCOPE_ENV      "PRINT_SCOPES"
+#endif
+
+/** Per-scope level thresholds indexed by scope ID */
+extern unsigned char* g_printScopeLevels;
+
+/** Defines a scope variable and registers it before main() */
+#define PRINT_SCOPE_DEFINE(var, name)  \
+    unsigned int var; \
+    __attribute__((constructor)) static void printscope_init_ ## var(void) \
+    { \
+        var = printscope_register(name); \
+    } \
+    extern unsigned int var
+
+/** Declares a scope variable defined elsewhere */
+#define PRINT_SCOPE_DECLARE(var)    extern unsigned int var
+
+EXTERN_CPP_START
+
+/** Returns the ID for "name", registering it on first use, or
+ *  PRINT_SCOPE_INVALID if it could not be allocated
+ */
+unsigned int printscope_register(const char* name);
+
+/** Sets the level of "name" and all scopes below it ("" or "*" for all) */
+int printscope_set(const char* name, unsigned short level);
+
+/** Applies a spec string; returns 0 if every rule parsed */
+int printscope_parse(const char* spec);
+
+/** Writes one line per scope: name, ID and current level */
+void printscope_list(FILE* out);
+
+EXTERN_CPP_END
+
+/** True if scope "id" lets through a message of "level" */
+static inline int printscope_enabled(unsigned int id, unsigned char level)
+{
+    return id != PRINT_SCOPE_INVALID && __atomic_load_n(&g_printScopeLevels, __ATOMIC_ACQUIRE)[id] <= level;
+}
+
+#ifdef DEBUG_PRINT
+#   ifdef FLIGHT_RECORDER
+#       define DEBUG_NSPRINT_RECORD(level, fmt, args...)  FLIGHTREC(level, fmt , ## args)
+#   else
+#       define DEBUG_NSPRINT_RECORD(level, fmt, args...)  do { } while (0)
+#   endif
+#   define DEBUG_NSPRINT(level, scope, fmt, args...)  \
+        do { \
+            DEBUG_NSPRINT_RECORD(level, fmt , ## args); \
+            if (printscope_enabled(scope, level)) { DEBUG_PRINT_OUT(level, fmt , ## args); } \
+        } while (0)
+#   define NSPRINT(scope, fmt, args...)     DEBUG_NSPRINT(PRINT_LEVEL_NONE, scope, fmt , ## args)
+#   define NSPRINTW(scope, fmt, args...)    DEBUG_NSPRINT(PRINT_LEVEL_WARN, scope, fmt , ## args)
+#   define NSPRINTI(scope, fmt, args...)    DEBUG_NSPRINT(PRINT_LEVEL_INFO, scope, fmt , ## args)
+#   define NSPRINTD(scope, fmt, args...)    DEBUG_NSPRINT(PRINT_LEVEL_DEBUG, scope, fmt , ## args)
+#   define NSPRINTV(scope, fmt, args...)    DEBUG_NSPRINT(PRINT_LEVEL_ALL, scope, fmt , ## args)
+#else
+#   define NSPRINT(scope, fmt, args...)
+#   define NSPRINTW(scope, fmt, args...)
+#   define NSPRINTI(scope, fmt, args...)
+#   define NSPRINTD(scope, fmt, args...)
+#   define NSPRINTV(scope, fmt, args...)
+#endif
+
+#endif  // __PRINTSCOPE_H__
+
+
+//////////////////////////////////////////////////////////////////////////////
+#if defined(PRINTSCOPE_IMPLEMENTATION) && !defined(__PRINTSCOPE_IMPLEMENTATION__)
+#define __PRINTSCOPE_IMPLEMENTATION__
+
+#include <ctype.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+/** Level used before any rule is given */
+#ifndef PRINT_SCOPE_DEFAULT_LEVEL
+#   define PRINT_SCOPE_DEFAULT_LEVEL    PRINT_LEVEL_WARN
+#endif
+
+struct PrintScopeRule {
+    char*           name;       ///< "" matches every scope
+    unsigned char   level;
+};
+
+/** Until the first scope registers, every ID reads the default level */
+static unsigned char    s_printScopeBoot[1] = { PRINT_SCOPE_DEFAULT_LEVEL };
+unsigned char*          g_printScopeLevels = s_printScopeBoot;
+
+static char**                   s_printScopeNames;
+static unsigned int             s_printScopeCount;
+static unsigned int             s_printScopeCap;
+static struct PrintScopeRule*   s_printScopeRules;
+static unsigned int             s_printScopeRuleCount;
+static int                      s_printScopeEnvDone;
+static pthread_mutex_t          s_printScopeLock = PTHREAD_MUTEX_INITIALIZER;
+
+/** True if "rule" is "name" itself or one of its ancestors */
+static int printscope_rule_matches(const char* rule, const char* name)
+{
+    size_t len = strlen(rule);
+    return len == 0 || (strncmp(rule, name, len) == 0 && (name[len] == '\0' || name[len] == '.'));
+}
+
+/** Most specific (longest) matching rule wins */
+static unsigned char printscope_resolve(const char* name)
+{
+    unsigned char level = PRINT_SCOPE_DEFAULT_LEVEL;
+    size_t best = 0;
+    int found = 0;
+
+    for (unsigned int i = 0; i < s_printScopeRuleCount; i++) {
+        const struct PrintScopeRule* rule = &s_printScopeRules[i];
+        size_t len = strlen(rule->name);
+        if (printscope_rule_matches(rule->name, name) && (!found || len >= best)) {
+            level = rule->level;
+            best = len;
+            found = 1;
+        }
+    }
+    return level;
+}
+
+static int printscope_parse_level(const char* text, size_t len, unsigned char* level)
+{
+    static const char* const names[] = { "all", "debug", "info", "warn", "none", "off" };
+    if (len == 1 && text[0] >= '0' && text[0] <= '0' + PRINT_SCOPE_LEVEL_OFF) {
+        *level = (unsigned char)(text[0] - '0');
+        return 0;
+    }
+    for (unsigned int i = 0; i < NUM_ARRAY_ELEM(names); i++) {
+        if (strlen(names[i]) == len && strncasecmp(names[i], text, len) == 0) {
+            *level = (unsigned char)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/** printscope_set() body; caller holds s_printScopeLock */
+static int printscope_set_locked(const char* name, unsigned char level)
+{
+    unsigned int i;
+
+    if (strcmp(name, "*") == 0) {
+        name = "";
+    }
+    for (i = 0; i < s_printScopeRuleCount; i++) {
+        if (strcmp(s_printScopeRules[i].name, name) == 0) {
+            break;
+        }
+    }
+    if (i == s_printScopeRuleCount) {
+        struct PrintScopeRule* rules = (struct PrintScopeRule* )realloc(s_printScopeRules, (i + 1) * sizeof(*rules));
+        if (!rules) {
+            return -1;
+        }
+        s_printScopeRules = rules;
+        s_printScopeRules[i].name = strdup(name);
+        if (!s_printScopeRules[i].name) {
+            return -1;
+        }
+        s_printScopeRuleCount++;
+    }
+    s_printScopeRules[i].level = level;
+    for (unsigned int id = 0; id < s_printScopeCount; id++) {
+        if (printscope_rule_matches(name, s_printScopeNames[id])) {
+            __atomic_store_n(&g_printScopeLevels[id], printscope_resolve(s_printScopeNames[id]), __ATOMIC_RELAXED);
+        }
+    }
+    return 0;
+}
+
+/** printscope_parse() body; caller holds s_printScopeLock */
+static int printscope_parse_locked(const char* spec)
+{
+    int result = 0;
+
+    while (*spec) {
+        const char* item;
+        const char* eq;
+        size_t len;
+        unsigned char level;
+
+        while (*spec == ',' || isspace((unsigned char)*spec)) {
+            spec++;
+        }
+        item = spec;
+        while (*spec && *spec != ',' && !isspace((unsigned char)*spec)) {
+            spec++;
+        }
+        len = (size_t)(spec - item);
+        if (len == 0) {
+            continue;
+        }
+        eq = (const char* )memchr(item, '=', len);
+        if (!eq) {
+            if (printscope_parse_level(item, len, &level) == 0) {
+                result |= printscope_set_locked("", level);
+            }
+            else {
+                result = -1;
+            }
+        }
+        else if (eq > item && printscope_parse_level(eq + 1, len - (size_t)(eq + 1 - item), &level) == 0) {
+            char name[128];
+            size_t nameLen = MIN((size_t)(eq - item), sizeof(name) - 1);
+            memcpy(name, item, nameLen);
+            name[nameLen] = '\0';
+            result |= printscope_set_locked(name, level);
+        }
+        else {
+            result = -1;
+        }
+    }
+    return result;
+}
+
+unsigned int printscope_register(const char* name)
+{
+    unsigned int id;
+
+    pthread_mutex_lock(&s_printScopeLock);
+    if (!s_printScopeEnvDone) {
+        const char* spec = getenv(PRINT_SCOPE_ENV);
+        s_printScopeEnvDone = 1;
+        if (spec) {
+            printscope_parse_locked(spec);
+        }
+    }
+    for (id = 0; id < s_printScopeCount; id++) {
+        if (strcmp(s_printScopeNames[id], name) == 0) {
+            pthread_mutex_unlock(&s_printScopeLock);
+            return id;
+        }
+    }
+    if (s_printScopeCount == s_printScopeCap) {
+        unsigned int cap = s_printScopeCap ? s_printScopeCap * 2 : 64;
+        unsigned char* levels = (unsigned char* )malloc(cap);
+        char** names = (char** )realloc(s_printScopeNames, cap * sizeof(*names));
+        if (names) {
+            s_printScopeNames = names;
+        }
+        if (!levels || !names) {
+            free(levels);
+            pthread_mutex_unlock(&s_printScopeLock);
+            return PRINT_SCOPE_INVALID;
+        }
+        memcpy(levels, g_printScopeLevels, s_printScopeCount);
+        // The old table is deliberately leaked: other threads may still be
+        // reading through it. Growth is geometric, so the total is bounded.
+        __atomic_store_n(&g_printScopeLevels, levels, __ATOMIC_RELEASE);
+        s_printScopeCap = cap;
+    }
+    id = s_printScopeCount;
+    s_printScopeNames[id] = strdup(name);
+    if (!s_printScopeNames[id]) {
+        pthread_mutex_unlock(&s_printScopeLock);
+        return PRINT_SCOPE_INVALID;
+    }
+    g_printScopeLevels[id] = printscope_resolve(name);
+    s_printScopeCount++;
+    pthread_mutex_unlock(&s_printScopeLock);
+    return id;
+}
+
+int printscope_set(const char* name, unsigned short level)
+{
+    int result;
+    pthread_mutex_lock(&s_printScopeLock);
+    result = printscope_set_locked(name, (unsigned char)level);
+    pthread_mutex_unlock(&s_printScopeLock);
+    return result;
+}
+
+int printscope_parse(const char* spec)
+{
+    int result;
+    pthread_mutex_lock(&s_printScopeLock);
+    s_printScopeEnvDone = 1;
+    result = printscope_parse_locked(spec);
+    pthread_mutex_unlock(&s_printScopeLock);
+    return result;
+}
+
+void printscope_list(FILE* out)
+{
+    static const char* const names[] = { "all", "debug", "info", "warn", "none", "off" };
+
+    pthread_mutex_lock(&s_printScopeLock);
+    for (unsigned int id = 0; id < s_printScopeCount; id++) {
+        unsigned char level = g_printScopeLevels[id];
+        fprintf(out, "%-32s %4u %s\n", s_printScopeNames[id], id,
+                level < NUM_ARRAY_ELEM(names) ? names[level] : "?");
+    }
+    pthread_mutex_unlock(&s_printScopeLock);
+}
+
+#endif  // PRINTSCOPE_IMPLEMENTATION
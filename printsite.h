@@ -0,0 +1,310 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org>
+*/
+#ifndef __PRINTSITE_H__
+#define __PRINTSITE_H__
+
+#include <stdio.h>
+
+#include "macros.h"
+
+/** @file
+ * This file contains a per-call-site enable registry for the PRINTx()
+ * macros in debug.h, loosely modeled on Linux dynamic debug.
+ **/
+
+/**
+ *                      Print Site Overview
+ * =====================================================================
+ * With DYNAMIC_PRINT defined (together with DEBUG_PRINT), every PRINTx() and
+ * SPRINTx() expansion in debug.h owns a static struct PrintSite holding the
+ * file basename, line, function, message level, format string and a one-byte
+ * enable flag. At run-time a call site checks only its own flag, so a
+ * disabled site costs one load and one (predicted not-taken) branch.
+ * SPRINTx() sites check the scope mask only after their own flag is set.
+ *
+ * A site registers itself the first time it runs: the flag starts out as
+ * PRINT_SITE_UNREGISTERED, which sends the first hit down a slow path that
+ * links the descriptor into a global list and works out its real state.
+ * This works the same for sites in ordinary functions, inline functions and
+ * C++ templates (whose static locals are COMDAT and can't share a named
+ * linker section with the others). The format recorded for a site is the
+ * one it was first called with, so "fmt" doesn't have to be a literal.
+ *
+ * Sites only appear in printsite_list() once they have run. To cover the
+ * rest, every printsite_enable() call is also kept as a rule and replayed,
+ * in order, on each site that registers later. Code containing sites must
+ * not be unloaded (dlclose()) while the registry is in use.
+ *
+ * Initial State
+ * ----------------------------------------------
+ * A newly registered site is enabled when its level passes the threshold
+ * from the last printsite_set_level() call. Before any such call the
+ * threshold is g_currentPrintLevel with RUNTIME_PRINT_LEVEL, else
+ * CURRENT_PRINT_LEVEL if defined, else PRINT_LEVEL_WARN. Call
+ * printsite_set_level() after changing g_currentPrintLevel to re-sync every
+ * site; this also forgets the printsite_enable() rules.
+ *
+ * Usage
+ * ----------------------------------------------
+ * Define PRINTSITE_IMPLEMENTATION in exactly one .c file before including
+ * this file, then for example:
+ *   printsite_enable("net*.c", 0, NULL, 1);       // every site in net*.c
+ *   printsite_enable("tcp.c", 214, NULL, 1);      // one site
+ *   printsite_enable(NULL, 0, "*retransmit*", 0); // by format or function
+ *   printsite_list(stdout);
+ */
+
+//////////////////////////////////////////////////////////////////////////////
+/** Compile-time file basename (gcc >= 12, clang >= 9); otherwise the full
+ *  path is stored and trimmed when sites are listed or matched.
+ */
+#ifdef __FILE_NAME__
+#   define PRINT_SITE_FILE      __FILE_NAME__
+#else
+#   define PRINT_SITE_FILE      __FILE__
+#endif
+
+/** Enable state a site starts with when no run-time level applies */
+#ifdef CURRENT_PRINT_LEVEL
+#   define PRINT_SITE_DEFAULT(level)    ((level) >= CURRENT_PRINT_LEVEL)
+#else
+#   define PRINT_SITE_DEFAULT(level)    ((level) >= PRINT_LEVEL_WARN)
+#endif
+
+/** "enabled" value of a site that hasn't run yet */
+#define PRINT_SITE_UNREGISTERED     0xFF
+
+/** Static per-call-site descriptor; "enabled" is first so the hot-path test
+ *  is a single byte load from the start of the object.
+ */
+struct PrintSite {
+    unsigned char       enabled;    ///< 0, 1 or PRINT_SITE_UNREGISTERED
+    unsigned char       level;
+    unsigned char       initial;    ///< PRINT_SITE_DEFAULT() in the site's file
+    int                 line;
+    const char*         file;
+    const char*         func;
+    const char*         fmt;        ///< set on registration
+    struct PrintSite*   next;       ///< registry list
+};
+
+/** Declares this call site's descriptor */
+#define PRINT_SITE_DECLARE(name, level)  \
+    static struct PrintSite name = \
+        { PRINT_SITE_UNREGISTERED, (level), PRINT_SITE_DEFAULT(level), __LINE__, PRINT_SITE_FILE, __func__, NULL, NULL }
+
+/** Runs "stmt" if this call site is enabled; "stmt" is variadic so that
+ *  an already expanded statement with bare commas (brace initializers from
+ *  BINARY_PRINT) can be passed on unchanged
+ */
+#define PRINT_SITE(level, fmt, stmt...)  \
+    do { \
+        PRINT_SITE_DECLARE(print__site, level); \
+        unsigned char print__on = __atomic_load_n(&print__site.enabled, __ATOMIC_RELAXED); \
+        if (__builtin_expect(print__on, 0)) { \
+            if (print__on == 1 || printsite_register(&print__site, fmt)) { stmt; } \
+        } \
+    } while (0)
+
+EXTERN_CPP_START
+
+/** Enables (enable != 0) or disables every site matching all given filters:
+ *  "file" is a glob on the basename, "line" an exact line, "pattern" a glob
+ *  on the format string or function name. NULL/0 filters match anything.
+ *  The filters are also kept for sites that register later. Returns the
+ *  number of registered sites matched.
+ */
+int printsite_enable(const char* file, int line, const char* pattern, int enable);
+
+/** Re-derives every site's flag from a print level threshold */
+void printsite_set_level(unsigned short level);
+
+/** Writes one line per registered site: file:line [func] level flag "fmt" */
+void printsite_list(FILE* out);
+
+/** Returns the most recently registered site; follow "next" for the rest */
+struct PrintSite* printsite_first(void);
+
+/** Internal: links in a site on its first hit; returns its enable state */
+int printsite_register(struct PrintSite* site, const char* fmt);
+
+EXTERN_CPP_END
+
+#endif  // __PRINTSITE_H__
+
+
+//////////////////////////////////////////////////////////////////////////////
+#if defined(PRINTSITE_IMPLEMENTATION) && !defined(__PRINTSITE_IMPLEMENTATION__)
+#define __PRINTSITE_IMPLEMENTATION__
+
+#include <fnmatch.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** A printsite_enable() call, replayed on sites that register later */
+struct PrintSiteRule {
+    char*                   file;
+    char*                   pattern;
+    int                     line;
+    int                     enable;
+    struct PrintSiteRule*   next;
+};
+
+static struct PrintSite*        s_printSites;
+static struct PrintSiteRule*    s_printSiteRules;
+static struct PrintSiteRule**   s_printSiteRulesTail = &s_printSiteRules;
+static int                      s_printSiteLevel = -1;     ///< -1 until printsite_set_level()
+static pthread_mutex_t          s_printSiteLock = PTHREAD_MUTEX_INITIALIZER;
+
+static const char* printsite_basename(const char* path)
+{
+    const char* slash = strrchr(path, '/');
+    return slash ? slash + 1 : path;
+}
+
+static int printsite_match(const struct PrintSite* site, const char* file, int line, const char* pattern)
+{
+    if (file && fnmatch(file, printsite_basename(site->file), 0) != 0) {
+        return 0;
+    }
+    if (line && line != site->line) {
+        return 0;
+    }
+    if (pattern && fnmatch(pattern, site->fmt, 0) != 0 && fnmatch(pattern, site->func, 0) != 0) {
+        return 0;
+    }
+    return 1;
+}
+
+static void printsite_free_rules(void)
+{
+    while (s_printSiteRules) {
+        struct PrintSiteRule* rule = s_printSiteRules;
+        s_printSiteRules = rule->next;
+        free(rule->file);
+        free(rule->pattern);
+        free(rule);
+    }
+    s_printSiteRulesTail = &s_printSiteRules;
+}
+
+struct PrintSite* printsite_first(void)
+{
+    return __atomic_load_n(&s_printSites, __ATOMIC_ACQUIRE);
+}
+
+int printsite_register(struct PrintSite* site, const char* fmt)
+{
+    int enabled;
+
+    pthread_mutex_lock(&s_printSiteLock);
+    if (site->enabled == PRINT_SITE_UNREGISTERED) {
+        site->fmt = fmt ? fmt : "";
+        if (s_printSiteLevel >= 0) {
+            enabled = site->level >= s_printSiteLevel;
+        }
+        else {
+#if defined(RUNTIME_PRINT_LEVEL) && !defined(CURRENT_PRINT_LEVEL)
+            extern unsigned short g_currentPrintLevel;
+            enabled = site->level >= g_currentPrintLevel;
+#else
+            enabled = site->initial;
+#endif
+        }
+        for (const struct PrintSiteRule* rule = s_printSiteRules; rule; rule = rule->next) {
+            if (printsite_match(site, rule->file, rule->line, rule->pattern)) {
+                enabled = rule->enable;
+            }
+        }
+        site->next = s_printSites;
+        __atomic_store_n(&s_printSites, site, __ATOMIC_RELEASE);
+        __atomic_store_n(&site->enabled, enabled ? 1 : 0, __ATOMIC_RELAXED);
+    }
+    enabled = site->enabled;
+    pthread_mutex_unlock(&s_printSiteLock);
+    return enabled;
+}
+
+int printsite_enable(const char* file, int line, const char* pattern, int enable)
+{
+    struct PrintSiteRule* rule = (struct PrintSiteRule* )calloc(1, sizeof(*rule));
+    int matched = 0;
+
+    pthread_mutex_lock(&s_printSiteLock);
+    for (struct PrintSite* site = s_printSites; site; site = site->next) {
+        if (printsite_match(site, file, line, pattern)) {
+            __atomic_store_n(&site->enabled, enable ? 1 : 0, __ATOMIC_RELAXED);
+            matched++;
+        }
+    }
+    if (rule) {
+        rule->file = file ? strdup(file) : NULL;
+        rule->pattern = pattern ? strdup(pattern) : NULL;
+        rule->line = line;
+        rule->enable = enable ? 1 : 0;
+        *s_printSiteRulesTail = rule;
+        s_printSiteRulesTail = &rule->next;
+    }
+    pthread_mutex_unlock(&s_printSiteLock);
+    return matched;
+}
+
+void printsite_set_level(unsigned short level)
+{
+    pthread_mutex_lock(&s_printSiteLock);
+    s_printSiteLevel = level;
+    printsite_free_rules();
+    for (struct PrintSite* site = s_printSites; site; site = site->next) {
+        __atomic_store_n(&site->enabled, site->level >= level, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&s_printSiteLock);
+}
+
+void printsite_list(FILE* out)
+{
+    static const char* const levelNames[] = { "all", "debug", "info", "warn", "always" };
+
+    pthread_mutex_lock(&s_printSiteLock);
+    for (const struct PrintSite* site = s_printSites; site; site = site->next) {
+        fprintf(out, "%s:%d [%s] %s =%c \"", printsite_basename(site->file), site->line, site->func,
+                site->level < NUM_ARRAY_ELEM(levelNames) ? levelNames[site->level] : "?",
+                site->enabled ? 'p' : '_');
+        for (const char* c = site->fmt; *c; c++) {
+            if (*c == '\n') {
+                fputs("\\n", out);
+            }
+            else {
+                fputc(*c, out);
+            }
+        }
+        fputs("\"\n", out);
+    }
+    pthread_mutex_unlock(&s_printSiteLock);
+}
+
+#endif  // PRINTSITE_IMPLEMENTATION
@@ -0,0 +1,585 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org>
+*/
+#ifndef __RINGBUF_H__
+#define __RINGBUF_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "macros.h"
+#include "uctypes.h"
+
+/** @file
+ * This file contains bounded lock-free ring buffers of fixed-size elements:
+ * a single-producer/single-consumer ring and a multi-producer/multi-consumer
+ * ring, with batch operations and optional blocking waits, plus C++
+ * wrappers.
+ **/
+
+/**
+ *                      Ring Buffer Overview
+ * =====================================================================
+ * Both rings copy elements of a size fixed at init into a power-of-two
+ * number of slots. Slots are ALIGNB()-rounded to NATIVE_ALIGNMENT, and the
+ * producer's index, the consumer's index and the read-only fields each sit
+ * on their own cache line, so producers and consumers never invalidate each
+ * other's lines except to hand over data.
+ *
+ * SPSC Ring
+ * ----------------------------------------------
+ * struct SpscRing may have one pushing thread and one popping thread. Each
+ * side keeps a private copy of the other side's index and only re-reads the
+ * shared one when the copy says the ring is full (or empty), so a push or pop
+ * is normally a memcpy and one release store.
+ *
+ * MPMC Ring
+ * ----------------------------------------------
+ * struct MpmcRing is D. Vyukov's bounded queue: every slot carries a
+ * sequence number telling whether it is free or full for the current lap, so
+ * a push or pop is one compare-and-swap on the shared index plus the copy.
+ * Batch operations claim several consecutive slots with one compare-and-swap.
+ *
+ * Blocking
+ * ----------------------------------------------
+ * The plain calls never block: push fails when full, pop when empty. With
+ * RING_BLOCKING at init, *_push_wait() and *_pop_wait() sleep until they can
+ * proceed (a futex on Linux, yielding elsewhere); every push and pop on such
+ * a ring then also pays one full memory fence to check for sleepers.
+ *
+ *   struct SpscRing r;
+ *   spsc_ring_init(&r, 1024, sizeof(struct Msg), RING_BLOCKING);
+ *   producer:  spsc_ring_push_wait(&r, &msg);
+ *   consumer:  spsc_ring_pop_wait(&r, &msg);
+ *
+ * In C++, SpscQueue<T> and MpmcQueue<T> wrap the rings for trivially
+ * copyable T.
+ *
+ * Define RINGBUF_IMPLEMENTATION in exactly one .c file before including
+ * this file.
+ */
+
+//////////////////////////////////////////////////////////////////////////////
+#define RING_BLOCKING           0x1     ///< init flag: enable the *_wait() calls
+
+/** Sleep/wake state shared by both ring types */
+struct RingWait {
+    uint32_t    pushes;         ///< bumped to wake poppers
+    uint32_t    pops;           ///< bumped to wake pushers
+    uint32_t    popWaiters;     ///< sleeping in *_pop_wait()
+    uint32_t    pushWaiters;    ///< sleeping in *_push_wait()
+};
+
+struct SpscRing {
+    uint32_t        head __attribute__((aligned(CACHE_LINE_SIZE)));     ///< next slot to push
+    uint32_t        cachedTail;                                         ///< producer's copy
+    uint32_t        tail __attribute__((aligned(CACHE_LINE_SIZE)));     ///< next slot to pop
+    uint32_t        cachedHead;                                         ///< consumer's copy
+    unsigned char*  slots __attribute__((aligned(CACHE_LINE_SIZE)));
+    uint32_t        mask;
+    uint32_t        stride;
+    uint32_t        elemSize;
+    unsigned        flags;
+    struct RingWait wait __attribute__((aligned(CACHE_LINE_SIZE)));
+};
+
+struct MpmcRing {
+    size_t          head __attribute__((aligned(CACHE_LINE_SIZE)));     ///< next position to push
+    size_t          tail __attribute__((aligned(CACHE_LINE_SIZE)));     ///< next position to pop
+    unsigned char*  slots __attribute__((aligned(CACHE_LINE_SIZE)));
+    size_t          mask;
+    uint32_t        stride;
+    uint32_t        elemSize;
+    unsigned        flags;
+    struct RingWait wait __attribute__((aligned(CACHE_LINE_SIZE)));
+};
+
+/** An MPMC slot is its sequence number followed by the element */
+#define RING__SEQ_SIZE          ALIGNB(sizeof(size_t), NATIVE_ALIGNMENT)
+
+EXTERN_CPP_START
+
+/** Sets up a ring of "capacity" (a power of two, and at least 2 for an
+ *  MPMC ring) elements of "elemSize" bytes; returns 0 on success.
+ */
+int spsc_ring_init(struct SpscRing* r, uint32_t capacity, uint32_t elemSize, unsigned flags);
+void spsc_ring_destroy(struct SpscRing* r);
+int mpmc_ring_init(struct MpmcRing* r, size_t capacity, uint32_t elemSize, unsigned flags);
+void mpmc_ring_destroy(struct MpmcRing* r);
+
+/** Push or pop up to "n" elements (contiguous in "elems"); return the count */
+size_t spsc_ring_push_n(struct SpscRing* r, const void* elems, size_t n);
+size_t spsc_ring_pop_n(struct SpscRing* r, void* elems, size_t n);
+size_t mpmc_ring_push_n(struct MpmcRing* r, const void* elems, size_t n);
+size_t mpmc_ring_pop_n(struct MpmcRing* r, void* elems, size_t n);
+
+/** Blocking forms; the ring must have been set up with RING_BLOCKING */
+void spsc_ring_push_wait(struct SpscRing* r, const void* elem);
+void spsc_ring_pop_wait(struct SpscRing* r, void* elem);
+void mpmc_ring_push_wait(struct MpmcRing* r, const void* elem);
+void mpmc_ring_pop_wait(struct MpmcRing* r, void* elem);
+
+/** Wakes sleepers after a push ("pushed" nonzero) or a pop */
+void ring_wait_notify(struct RingWait* w, int pushed);
+
+EXTERN_CPP_END
+
+/** After a push or pop on a RING_BLOCKING ring: wakes the other side if asleep */
+static inline void ring__notify(struct RingWait* w, unsigned flags, int pushed)
+{
+    if (__builtin_expect(flags & RING_BLOCKING, 0)) {
+        // orders the index store before the sleeper check; pairs with the
+        // fence in RING__WAIT_LOOP()
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if (__atomic_load_n(pushed ? &w->popWaiters : &w->pushWaiters, __ATOMIC_RELAXED)) {
+            ring_wait_notify(w, pushed);
+        }
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+/** Copies "elem" in; returns 0 on success, -1 if full (producer thread only) */
+static inline int spsc_ring_push(struct SpscRing* r, const void* elem)
+{
+    uint32_t head = r->head;
+    if (__builtin_expect(head - r->cachedTail > r->mask, 0)) {
+        r->cachedTail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+        if (head - r->cachedTail > r->mask) {
+            return -1;
+        }
+    }
+    memcpy(r->slots + (size_t)(head & r->mask) * r->stride, elem, r->elemSize);
+    __atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+    ring__notify(&r->wait, r->flags, 1);
+    return 0;
+}
+
+/** Copies the oldest element out; returns 0 on success, -1 if empty
+ *  (consumer thread only)
+ */
+static inline int spsc_ring_pop(struct SpscRing* r, void* elem)
+{
+    uint32_t tail = r->tail;
+    if (__builtin_expect(tail == r->cachedHead, 0)) {
+        r->cachedHead = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+        if (tail == r->cachedHead) {
+            return -1;
+        }
+    }
+    memcpy(elem, r->slots + (size_t)(tail & r->mask) * r->stride, r->elemSize);
+    __atomic_store_n(&r->tail, tail + 1, __ATOMIC_RELEASE);
+    ring__notify(&r->wait, r->flags, 0);
+    return 0;
+}
+
+/** Number of queued elements (a snapshot; either side may call it) */
+static inline uint32_t spsc_ring_count(const struct SpscRing* r)
+{
+    return __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+}
+
+static inline size_t* mpmc__seq(const struct MpmcRing* r, size_t pos)
+{
+    return (size_t* )(r->slots + (pos & r->mask) * r->stride);
+}
+
+/** Copies "elem" in; returns 0 on success, -1 if full (any thread) */
+static inline int mpmc_ring_push(struct MpmcRing* r, const void* elem)
+{
+    size_t pos = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+    size_t* seq;
+
+    FOREVER {
+        intptr_t dif;
+        seq = mpmc__seq(r, pos);
+        dif = (intptr_t)__atomic_load_n(seq, __ATOMIC_ACQUIRE) - (intptr_t)pos;
+        if (dif == 0) {
+            if (__atomic_compare_exchange_n(&r->head, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        }
+        else if (dif < 0) {
+            return -1;
+        }
+        else {
+            pos = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+        }
+    }
+    memcpy((unsigned char* )seq + RING__SEQ_SIZE, elem, r->elemSize);
+    __atomic_store_n(seq, pos + 1, __ATOMIC_RELEASE);
+    ring__notify(&r->wait, r->flags, 1);
+    return 0;
+}
+
+/** Copies the oldest element out; returns 0 on success, -1 if empty (any thread) */
+static inline int mpmc_ring_pop(struct MpmcRing* r, void* elem)
+{
+    size_t pos = __atomic_load_n(&r->tail, __ATOMIC_RELAXED);
+    size_t* seq;
+
+    FOREVER {
+        intptr_t dif;
+        seq = mpmc__seq(r, pos);
+        dif = (intptr_t)__atomic_load_n(seq, __ATOMIC_ACQUIRE) - (intptr_t)(pos + 1);
+        if (dif == 0) {
+            if (__atomic_compare_exchange_n(&r->tail, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        }
+        else if (dif < 0) {
+            return -1;
+        }
+        else {
+            pos = __atomic_load_n(&r->tail, __ATOMIC_RELAXED);
+        }
+    }
+    memcpy(elem, (unsigned char* )seq + RING__SEQ_SIZE, r->elemSize);
+    __atomic_store_n(seq, pos + r->mask + 1, __ATOMIC_RELEASE);
+    ring__notify(&r->wait, r->flags, 0);
+    return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+#ifdef __cplusplus
+#include <new>
+#include <type_traits>
+
+/** Typed SPSC queue; throws std::bad_alloc if the ring cannot be set up */
+template <typename T>
+class SpscQueue {
+    static_assert(std::is_trivially_copyable<T>::value, "SpscQueue elements are copied with memcpy");
+public:
+    explicit SpscQueue(uint32_t capacity, unsigned flags = 0)
+    {
+        if (spsc_ring_init(&m_ring, capacity, sizeof(T), flags) != 0) {
+            throw std::bad_alloc();
+        }
+    }
+    ~SpscQueue() { spsc_ring_destroy(&m_ring); }
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    bool push(const T& v) { return spsc_ring_push(&m_ring, &v) == 0; }
+    bool pop(T& v) { return spsc_ring_pop(&m_ring, &v) == 0; }
+    size_t push(const T* v, size_t n) { return spsc_ring_push_n(&m_ring, v, n); }
+    size_t pop(T* v, size_t n) { return spsc_ring_pop_n(&m_ring, v, n); }
+    void push_wait(const T& v) { spsc_ring_push_wait(&m_ring, &v); }
+    void pop_wait(T& v) { spsc_ring_pop_wait(&m_ring, &v); }
+    uint32_t size() const { return spsc_ring_count(&m_ring); }
+
+private:
+    struct SpscRing m_ring;
+};
+
+/** Typed MPMC queue; throws std::bad_alloc if the ring cannot be set up */
+template <typename T>
+class MpmcQueue {
+    static_assert(std::is_trivially_copyable<T>::value, "MpmcQueue elements are copied with memcpy");
+public:
+    explicit MpmcQueue(size_t capacity, unsigned flags = 0)
+    {
+        if (mpmc_ring_init(&m_ring, capacity, sizeof(T), flags) != 0) {
+            throw std::bad_alloc();
+        }
+    }
+    ~MpmcQueue() { mpmc_ring_destroy(&m_ring); }
+    MpmcQueue(const MpmcQueue&) = delete;
+    MpmcQueue& operator=(const MpmcQueue&) = delete;
+
+    bool push(const T& v) { return mpmc_ring_push(&m_ring, &v) == 0; }
+    bool pop(T& v) { return mpmc_ring_pop(&m_ring, &v) == 0; }
+    size_t push(const T* v, size_t n) { return mpmc_ring_push_n(&m_ring, v, n); }
+    size_t pop(T* v, size_t n) { return mpmc_ring_pop_n(&m_ring, v, n); }
+    void push_wait(const T& v) { mpmc_ring_push_wait(&m_ring, &v); }
+    void pop_wait(T& v) { mpmc_ring_pop_wait(&m_ring, &v); }
+
+private:
+    struct MpmcRing m_ring;
+};
+#endif  // __cplusplus
+
+#endif  // __RINGBUF_H__
+
+
+//////////////////////////////////////////////////////////////////////////////
+#if defined(RINGBUF_IMPLEMENTATION) && !defined(__RINGBUF_IMPLEMENTATION__)
+#define __RINGBUF_IMPLEMENTATION__
+
+#include <limits.h>
+#include <sched.h>
+#include <stdlib.h>
+#ifdef __linux__
+#   include <linux/futex.h>
+#   include <sys/syscall.h>
+#   include <unistd.h>
+#endif
+
+#define RING__SPINS     256     ///< polls before sleeping
+
+static int ring__power_of_2(size_t n)
+{
+    return n != 0 && (n & (n - 1)) == 0;
+}
+
+int spsc_ring_init(struct SpscRing* r, uint32_t capacity, uint32_t elemSize, unsigned flags)
+{
+    uint32_t stride = (uint32_t)ALIGNB(elemSize ? elemSize : 1, NATIVE_ALIGNMENT);
+
+    memset(r, 0, sizeof(*r));
+    if (!ring__power_of_2(capacity) || capacity > 0x80000000u) {
+        return -1;
+    }
+    r->slots = (unsigned char* )aligned_alloc(CACHE_LINE_SIZE, ROUND_UP_CACHE_LINE((size_t)capacity * stride));
+    if (!r->slots) {
+        return -1;
+    }
+    r->mask = capacity - 1;
+    r->stride = stride;
+    r->elemSize = elemSize;
+    r->flags = flags;
+    return 0;
+}
+
+void spsc_ring_destroy(struct SpscRing* r)
+{
+    free(r->slots);
+    r->slots = NULL;
+}
+
+int mpmc_ring_init(struct MpmcRing* r, size_t capacity, uint32_t elemSize, unsigned flags)
+{
+    uint32_t stride = (uint32_t)ALIGNB(RING__SEQ_SIZE + elemSize, NATIVE_ALIGNMENT);
+
+    memset(r, 0, sizeof(*r));
+    // with one slot, "full for this lap" (pos + 1) and "free for the next
+    // lap" (pos + capacity) are the same sequence number
+    if (capacity < 2 || !ring__power_of_2(capacity) || capacity > SIZE_MAX / stride) {
+        return -1;
+    }
+    r->slots = (unsigned char* )aligned_alloc(CACHE_LINE_SIZE, ROUND_UP_CACHE_LINE(capacity * stride));
+    if (!r->slots) {
+        return -1;
+    }
+    r->mask = capacity - 1;
+    r->stride = stride;
+    r->elemSize = elemSize;
+    r->flags = flags;
+    for (size_t i = 0; i < capacity; i++) {
+        *mpmc__seq(r, i) = i;
+    }
+    return 0;
+}
+
+void mpmc_ring_destroy(struct MpmcRing* r)
+{
+    free(r->slots);
+    r->slots = NULL;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+size_t spsc_ring_push_n(struct SpscRing* r, const void* elems, size_t n)
+{
+    const unsigned char* src = (const unsigned char* )elems;
+    uint32_t head = r->head;
+    size_t room = r->mask + 1 - (head - r->cachedTail);
+
+    if (room < n) {
+        r->cachedTail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+        room = r->mask + 1 - (head - r->cachedTail);
+    }
+    n = MIN(n, room);
+    for (size_t i = 0; i < n; i++) {
+        memcpy(r->slots + (size_t)((head + i) & r->mask) * r->stride, src + i * r->elemSize, r->elemSize);
+    }
+    if (n) {
+        __atomic_store_n(&r->head, head + (uint32_t)n, __ATOMIC_RELEASE);
+        ring__notify(&r->wait, r->flags, 1);
+    }
+    return n;
+}
+
+size_t spsc_ring_pop_n(struct SpscRing* r, void* elems, size_t n)
+{
+    unsigned char* dst = (unsigned char* )elems;
+    uint32_t tail = r->tail;
+    size_t avail = r->cachedHead - tail;
+
+    if (avail < n) {
+        r->cachedHead = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+        avail = r->cachedHead - tail;
+    }
+    n = MIN(n, avail);
+    for (size_t i = 0; i < n; i++) {
+        memcpy(dst + i * r->elemSize, r->slots + (size_t)((tail + i) & r->mask) * r->stride, r->elemSize);
+    }
+    if (n) {
+        __atomic_store_n(&r->tail, tail + (uint32_t)n, __ATOMIC_RELEASE);
+        ring__notify(&r->wait, r->flags, 0);
+    }
+    return n;
+}
+
+/** Claims up to "n" consecutive positions whose slots have sequence
+ *  pos + i + "lag" (0 to push, 1 to pop); returns the count and the first
+ *  position in "*first".
+ */
+static size_t mpmc__claim(struct MpmcRing* r, size_t* index, size_t n, size_t lag, size_t* first)
+{
+    size_t pos = __atomic_load_n(index, __ATOMIC_RELAXED);
+
+    FOREVER {
+        size_t k = 0;
+        intptr_t dif = 0;
+        // a slot found ready cannot stop being so until "index" passes it,
+        // which would make the compare-and-swap below fail
+        while (k < n) {
+            dif = (intptr_t)__atomic_load_n(mpmc__seq(r, pos + k), __ATOMIC_ACQUIRE) - (intptr_t)(pos + k + lag);
+            if (dif != 0) {
+                break;
+            }
+            k++;
+        }
+        if (k == 0 && dif < 0) {
+            return 0;
+        }
+        if (k > 0 && __atomic_compare_exchange_n(index, &pos, pos + k, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+            *first = pos;
+            return k;
+        }
+        if (k == 0) {
+            pos = __atomic_load_n(index, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+size_t mpmc_ring_push_n(struct MpmcRing* r, const void* elems, size_t n)
+{
+    const unsigned char* src = (const unsigned char* )elems;
+    size_t pos = 0;
+    size_t k = n ? mpmc__claim(r, &r->head, n, 0, &pos) : 0;
+
+    for (size_t i = 0; i < k; i++) {
+        size_t* seq = mpmc__seq(r, pos + i);
+        memcpy((unsigned char* )seq + RING__SEQ_SIZE, src + i * r->elemSize, r->elemSize);
+        __atomic_store_n(seq, pos + i + 1, __ATOMIC_RELEASE);
+    }
+    if (k) {
+        ring__notify(&r->wait, r->flags, 1);
+    }
+    return k;
+}
+
+size_t mpmc_ring_pop_n(struct MpmcRing* r, void* elems, size_t n)
+{
+    unsigned char* dst = (unsigned char* )elems;
+    size_t pos = 0;
+    size_t k = n ? mpmc__claim(r, &r->tail, n, 1, &pos) : 0;
+
+    for (size_t i = 0; i < k; i++) {
+        size_t* seq = mpmc__seq(r, pos + i);
+        memcpy(dst + i * r->elemSize, (unsigned char* )seq + RING__SEQ_SIZE, r->elemSize);
+        __atomic_store_n(seq, pos + i + r->mask + 1, __ATOMIC_RELEASE);
+    }
+    if (k) {
+        ring__notify(&r->wait, r->flags, 0);
+    }
+    return k;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+static void ring__futex_wait(uint32_t* addr, uint32_t val)
+{
+#if defined(__linux__) && defined(SYS_futex)
+    syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+#else
+    (void)addr;
+    (void)val;
+    sched_yield();
+#endif
+}
+
+static void ring__futex_wake(uint32_t* addr)
+{
+#if defined(__linux__) && defined(SYS_futex)
+    syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+#else
+    (void)addr;
+#endif
+}
+
+void ring_wait_notify(struct RingWait* w, int pushed)
+{
+    uint32_t* event = pushed ? &w->pushes : &w->pops;
+    __atomic_fetch_add(event, 1, __ATOMIC_RELEASE);
+    ring__futex_wake(event);
+}
+
+/** Sleeps until "event" moves past "seen", after registering in "waiters"
+ *  and retrying "attempt" once more; returns nonzero if the retry succeeded
+ */
+#define RING__WAIT_LOOP(w, event, waiters, attempt)  \
+    do { \
+        unsigned ring__spins = 0; \
+        while (!(attempt)) { \
+            uint32_t ring__seen; \
+            if (++ring__spins < RING__SPINS) { \
+                continue; \
+            } \
+            ring__seen = __atomic_load_n(&(w)->event, __ATOMIC_ACQUIRE); \
+            __atomic_fetch_add(&(w)->waiters, 1, __ATOMIC_RELAXED); \
+            __atomic_thread_fence(__ATOMIC_SEQ_CST); \
+            if (attempt) { \
+                __atomic_fetch_sub(&(w)->waiters, 1, __ATOMIC_RELAXED); \
+                break; \
+            } \
+            ring__futex_wait(&(w)->event, ring__seen); \
+            __atomic_fetch_sub(&(w)->waiters, 1, __ATOMIC_RELAXED); \
+            ring__spins = 0; \
+        } \
+    } while (0)
+
+void spsc_ring_push_wait(struct SpscRing* r, const void* elem)
+{
+    RING__WAIT_LOOP(&r->wait, pops, pushWaiters, spsc_ring_push(r, elem) == 0);
+}
+
+void spsc_ring_pop_wait(struct SpscRing* r, void* elem)
+{
+    RING__WAIT_LOOP(&r->wait, pushes, popWaiters, spsc_ring_pop(r, elem) == 0);
+}
+
+void mpmc_ring_push_wait(struct MpmcRing* r, const void* elem)
+{
+    RING__WAIT_LOOP(&r->wait, pops, pushWaiters, mpmc_ring_push(r, elem) == 0);
+}
+
+void mpmc_ring_pop_wait(struct MpmcRing* r, void* elem)
+{
+    RING__WAIT_LOOP(&r->wait, pushes, popWaiters, mpmc_ring_pop(r, elem) == 0);
+}
+
+#endif  // RINGBUF_IMPLEMENTATION
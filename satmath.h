@@ -0,0 +1,396 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org>
+*/
+#ifndef __SATMATH_H__
+#define __SATMATH_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "macros.h"
+
+/** @file
+ * This file contains single-evaluation, type-safe counterparts of the CLIP,
+ * UCLIP, LCLIP and BITSHIFT macros in macros.h, saturating and fixed-point
+ * (Q15/Q31) scalar helpers, and bulk array kernels built on them.
+ **/
+
+/**
+ *                      Saturating Math Overview
+ * =====================================================================
+ * SAT_CLIP(), SAT_UCLIP(), SAT_LCLIP() and SAT_BITSHIFT() evaluate each
+ * argument exactly once, so
+ *   int16_t s = SAT_CLIP(*pData++, -2048, 2047);
+ * is safe, and loops built from them are free to be auto-vectorized. The
+ * clips compare and return in the same type as CLIP() and friends (the
+ * common type of all arguments after promotion), so bounds outside the
+ * range of "val" behave exactly as they do with the macros.h versions.
+ *
+ * The sat_*() scalar functions saturate instead of wrapping:
+ *   sat_add_i8/i16/i32()     saturating add
+ *   sat_sub_i8/i16/i32()     saturating subtract
+ *   sat_mul_q15()            (a * b + 2^14) >> 15, i.e. Q15 with rounding
+ *   sat_mul_q31()            (a * b + 2^30) >> 31, i.e. Q31 with rounding
+ *   sat_shift_i16/i32()      BITSHIFT() with round-to-nearest on right
+ *                            shifts and saturation on left shifts
+ *
+ * Array Kernels
+ * ----------------------------------------------
+ * The *_array() functions apply the same operations over buffers (dst may
+ * equal a source). Each kernel is written once with GCC vector extensions,
+ * which the compiler lowers to SSE2 or NEON, and on x86 also cloned for AVX2
+ * with target_clones, so the best version is picked at load time by CPU
+ * feature. Define SATMATH_NO_DISPATCH to build only the baseline version.
+ *
+ * Define SATMATH_IMPLEMENTATION in exactly one .c file before including
+ * this file.
+ */
+
+//////////////////////////////////////////////////////////////////////////////
+/** Single-evaluation CLIP(); the result has the common type of the arguments */
+#define SAT_CLIP(val, min, max)  \
+    ({ \
+        typedef __typeof__((val) + (min) + (max)) sat__T; \
+        sat__T sat__v = (val); \
+        sat__T sat__lo = (min); \
+        sat__T sat__hi = (max); \
+        (sat__v < sat__lo) ? sat__lo : ((sat__v > sat__hi) ? sat__hi : sat__v); \
+    })
+
+/** Single-evaluation UCLIP() */
+#define SAT_UCLIP(val, max)  \
+    ({ \
+        typedef __typeof__((val) + (max)) sat__T; \
+        sat__T sat__v = (val); \
+        sat__T sat__hi = (max); \
+        (sat__v > sat__hi) ? sat__hi : sat__v; \
+    })
+
+/** Single-evaluation LCLIP() */
+#define SAT_LCLIP(val, min)  \
+    ({ \
+        typedef __typeof__((val) + (min)) sat__T; \
+        sat__T sat__v = (val); \
+        sat__T sat__lo = (min); \
+        (sat__v < sat__lo) ? sat__lo : sat__v; \
+    })
+
+/** Single-evaluation BITSHIFT(): right if shift >= 0, else left */
+#define SAT_BITSHIFT(val, shift)  \
+    ({ \
+        __typeof__(val) sat__v = (val); \
+        int sat__s = (shift); \
+        (sat__s >= 0) ? (__typeof__(val))(sat__v >> sat__s) : (__typeof__(val))(sat__v << -sat__s); \
+    })
+
+static inline int8_t sat_add_i8(int8_t a, int8_t b)
+{
+    int s = a + b;
+    return (int8_t)SAT_CLIP(s, INT8_MIN, INT8_MAX);
+}
+
+static inline int16_t sat_add_i16(int16_t a, int16_t b)
+{
+    int s = a + b;
+    return (int16_t)SAT_CLIP(s, INT16_MIN, INT16_MAX);
+}
+
+static inline int32_t sat_add_i32(int32_t a, int32_t b)
+{
+    int64_t s = (int64_t)a + b;
+    return (int32_t)SAT_CLIP(s, INT32_MIN, INT32_MAX);
+}
+
+static inline int8_t sat_sub_i8(int8_t a, int8_t b)
+{
+    int s = a - b;
+    return (int8_t)SAT_CLIP(s, INT8_MIN, INT8_MAX);
+}
+
+static inline int16_t sat_sub_i16(int16_t a, int16_t b)
+{
+    int s = a - b;
+    return (int16_t)SAT_CLIP(s, INT16_MIN, INT16_MAX);
+}
+
+static inline int32_t sat_sub_i32(int32_t a, int32_t b)
+{
+    int64_t s = (int64_t)a - b;
+    return (int32_t)SAT_CLIP(s, INT32_MIN, INT32_MAX);
+}
+
+static inline int16_t sat_mul_q15(int16_t a, int16_t b)
+{
+    int32_t p = ((int32_t)a * b + (1 << 14)) >> 15;
+    return (int16_t)SAT_UCLIP(p, INT16_MAX);     // only -1.0 * -1.0 overflows
+}
+
+static inline int32_t sat_mul_q31(int32_t a, int32_t b)
+{
+    int64_t p = ((int64_t)a * b + ((int64_t)1 << 30)) >> 31;
+    return (int32_t)SAT_UCLIP(p, (int64_t)INT32_MAX);
+}
+
+static inline int16_t sat_shift_i16(int16_t v, int shift)
+{
+    if (shift > 0) {
+        return (int16_t)((v >> shift) + ((v >> (shift - 1)) & 1));
+    }
+    if (shift < 0) {
+        int s = (int)v * (1 << -shift);
+        return (int16_t)SAT_CLIP(s, INT16_MIN, INT16_MAX);
+    }
+    return v;
+}
+
+static inline int32_t sat_shift_i32(int32_t v, int shift)
+{
+    if (shift > 0) {
+        return (v >> shift) + ((v >> (shift - 1)) & 1);
+    }
+    if (shift < 0) {
+        int64_t s = (int64_t)v * ((int64_t)1 << -shift);
+        return (int32_t)SAT_CLIP(s, INT32_MIN, INT32_MAX);
+    }
+    return v;
+}
+
+EXTERN_CPP_START
+
+void sat_clip_i8_array(int8_t* dst, const int8_t* src, size_t n, int8_t min, int8_t max);
+void sat_clip_i16_array(int16_t* dst, const int16_t* src, size_t n, int16_t min, int16_t max);
+void sat_clip_i32_array(int32_t* dst, const int32_t* src, size_t n, int32_t min, int32_t max);
+void sat_clip_f32_array(float* dst, const float* src, size_t n, float min, float max);
+
+void sat_add_i8_array(int8_t* dst, const int8_t* a, const int8_t* b, size_t n);
+void sat_add_i16_array(int16_t* dst, const int16_t* a, const int16_t* b, size_t n);
+void sat_add_i32_array(int32_t* dst, const int32_t* a, const int32_t* b, size_t n);
+void sat_sub_i8_array(int8_t* dst, const int8_t* a, const int8_t* b, size_t n);
+void sat_sub_i16_array(int16_t* dst, const int16_t* a, const int16_t* b, size_t n);
+void sat_sub_i32_array(int32_t* dst, const int32_t* a, const int32_t* b, size_t n);
+
+void sat_mul_q15_array(int16_t* dst, const int16_t* a, const int16_t* b, size_t n);
+void sat_mul_q31_array(int32_t* dst, const int32_t* a, const int32_t* b, size_t n);
+
+void sat_shift_i16_array(int16_t* dst, const int16_t* src, size_t n, int shift);
+void sat_shift_i32_array(int32_t* dst, const int32_t* src, size_t n, int shift);
+
+EXTERN_CPP_END
+
+#endif  // __SATMATH_H__
+
+
+//////////////////////////////////////////////////////////////////////////////
+#if defined(SATMATH_IMPLEMENTATION) && !defined(__SATMATH_IMPLEMENTATION__)
+#define __SATMATH_IMPLEMENTATION__
+
+#include <string.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && !defined(SATMATH_NO_DISPATCH)
+#   define SAT__DISPATCH    __attribute__((target_clones("avx2", "default")))
+#else
+#   define SAT__DISPATCH
+#endif
+
+/** One AVX2 register; two SSE2/NEON registers */
+#define SAT__VBYTES     32
+
+typedef int8_t   SatVi8   __attribute__((vector_size(SAT__VBYTES)));
+typedef uint8_t  SatVu8   __attribute__((vector_size(SAT__VBYTES)));
+typedef int16_t  SatVi16  __attribute__((vector_size(SAT__VBYTES)));
+typedef uint16_t SatVu16  __attribute__((vector_size(SAT__VBYTES)));
+typedef int32_t  SatVi32  __attribute__((vector_size(SAT__VBYTES)));
+typedef uint32_t SatVu32  __attribute__((vector_size(SAT__VBYTES)));
+typedef float    SatVf32  __attribute__((vector_size(SAT__VBYTES)));
+typedef int32_t  SatVi32w __attribute__((vector_size(2 * SAT__VBYTES)));   ///< SatVi16 widened
+typedef int64_t  SatVi64w __attribute__((vector_size(2 * SAT__VBYTES)));   ///< SatVi32 widened
+
+/** Lane-wise select using a comparison mask (C has no vector ?:) */
+#define SAT__SELECT(mask, a, b)     (((a) & (mask)) | ((b) & ~(mask)))
+
+/** Vector load/store that tolerate any alignment */
+#define SAT__LOAD(vec, ptr)         memcpy(&(vec), (ptr), sizeof(vec))
+#define SAT__STORE(ptr, vec)        memcpy((ptr), &(vec), sizeof(vec))
+
+/** Sets every lane of "vec" to "val" (compiles to a single broadcast) */
+#define SAT__SPLAT(vec, val)  \
+    do { \
+        for (size_t sat__k = 0; sat__k < sizeof(vec) / sizeof((vec)[0]); sat__k++) { \
+            (vec)[sat__k] = (val); \
+        } \
+    } while (0)
+
+/** Defines a clip kernel for an integer type */
+#define SAT__CLIP_KERNEL(name, T, V)  \
+    SAT__DISPATCH void name(T* dst, const T* src, size_t n, T min, T max) \
+    { \
+        const size_t lanes = sizeof(V) / sizeof(T); \
+        size_t i = 0; \
+        V lo, hi; \
+        SAT__SPLAT(lo, min); \
+        SAT__SPLAT(hi, max); \
+        for ( ; i + lanes <= n; i += lanes) { \
+            V v; \
+            SAT__LOAD(v, src + i); \
+            v = SAT__SELECT(v < lo, lo, v); \
+            v = SAT__SELECT(v > hi, hi, v); \
+            SAT__STORE(dst + i, v); \
+        } \
+        for ( ; i < n; i++) { \
+            dst[i] = SAT_CLIP(src[i], min, max); \
+        } \
+    }
+
+SAT__CLIP_KERNEL(sat_clip_i8_array, int8_t, SatVi8)
+SAT__CLIP_KERNEL(sat_clip_i16_array, int16_t, SatVi16)
+SAT__CLIP_KERNEL(sat_clip_i32_array, int32_t, SatVi32)
+
+SAT__DISPATCH void sat_clip_f32_array(float* dst, const float* src, size_t n, float min, float max)
+{
+    const size_t lanes = sizeof(SatVf32) / sizeof(float);
+    size_t i = 0;
+    SatVf32 lo, hi;
+    SAT__SPLAT(lo, min);
+    SAT__SPLAT(hi, max);
+    for ( ; i + lanes <= n; i += lanes) {
+        SatVf32 v;
+        SatVi32 bits;
+        SAT__LOAD(v, src + i);
+        bits = SAT__SELECT(v < lo, (SatVi32)lo, (SatVi32)v);
+        bits = SAT__SELECT((SatVf32)bits > hi, (SatVi32)hi, bits);
+        SAT__STORE(dst + i, bits);
+    }
+    for ( ; i < n; i++) {
+        dst[i] = SAT_CLIP(src[i], min, max);
+    }
+}
+
+/** Defines a saturating add or subtract kernel. The wrapped result is
+ *  computed unsigned; a lane overflowed if "ovf" (an expression of va, vb
+ *  and vr) is negative, and then saturates toward the sign of "a".
+ */
+#define SAT__ADDSUB_KERNEL(name, T, V, U, op, ovf, fn, maxval)  \
+    SAT__DISPATCH void name(T* dst, const T* a, const T* b, size_t n) \
+    { \
+        const size_t lanes = sizeof(V) / sizeof(T); \
+        size_t i = 0; \
+        V vmax; \
+        SAT__SPLAT(vmax, maxval); \
+        for ( ; i + lanes <= n; i += lanes) { \
+            V va, vb, vr, mask; \
+            SAT__LOAD(va, a + i); \
+            SAT__LOAD(vb, b + i); \
+            vr = (V)((U)va op (U)vb); \
+            mask = (ovf) >> (sizeof(T) * 8 - 1); \
+            vr = SAT__SELECT(mask, (va >> (sizeof(T) * 8 - 1)) ^ vmax, vr); \
+            SAT__STORE(dst + i, vr); \
+        } \
+        for ( ; i < n; i++) { \
+            dst[i] = fn(a[i], b[i]); \
+        } \
+    }
+
+SAT__ADDSUB_KERNEL(sat_add_i8_array, int8_t, SatVi8, SatVu8, +, (va ^ vr) & (vb ^ vr), sat_add_i8, INT8_MAX)
+SAT__ADDSUB_KERNEL(sat_add_i16_array, int16_t, SatVi16, SatVu16, +, (va ^ vr) & (vb ^ vr), sat_add_i16, INT16_MAX)
+SAT__ADDSUB_KERNEL(sat_add_i32_array, int32_t, SatVi32, SatVu32, +, (va ^ vr) & (vb ^ vr), sat_add_i32, INT32_MAX)
+SAT__ADDSUB_KERNEL(sat_sub_i8_array, int8_t, SatVi8, SatVu8, -, (va ^ vr) & (va ^ vb), sat_sub_i8, INT8_MAX)
+SAT__ADDSUB_KERNEL(sat_sub_i16_array, int16_t, SatVi16, SatVu16, -, (va ^ vr) & (va ^ vb), sat_sub_i16, INT16_MAX)
+SAT__ADDSUB_KERNEL(sat_sub_i32_array, int32_t, SatVi32, SatVu32, -, (va ^ vr) & (va ^ vb), sat_sub_i32, INT32_MAX)
+
+SAT__DISPATCH void sat_mul_q15_array(int16_t* dst, const int16_t* a, const int16_t* b, size_t n)
+{
+    const size_t lanes = sizeof(SatVi16) / sizeof(int16_t);
+    size_t i = 0;
+    for ( ; i + lanes <= n; i += lanes) {
+        SatVi16 va, vb, vr;
+        SatVi32w p;
+        SAT__LOAD(va, a + i);
+        SAT__LOAD(vb, b + i);
+        p = (__builtin_convertvector(va, SatVi32w) * __builtin_convertvector(vb, SatVi32w) + (1 << 14)) >> 15;
+        p += (p > INT16_MAX);           // mask is -1: only 0x8000 * 0x8000 gets here
+        vr = __builtin_convertvector(p, SatVi16);
+        SAT__STORE(dst + i, vr);
+    }
+    for ( ; i < n; i++) {
+        dst[i] = sat_mul_q15(a[i], b[i]);
+    }
+}
+
+SAT__DISPATCH void sat_mul_q31_array(int32_t* dst, const int32_t* a, const int32_t* b, size_t n)
+{
+    const size_t lanes = sizeof(SatVi32) / sizeof(int32_t);
+    size_t i = 0;
+    for ( ; i + lanes <= n; i += lanes) {
+        SatVi32 va, vb, vr;
+        SatVi64w p;
+        SAT__LOAD(va, a + i);
+        SAT__LOAD(vb, b + i);
+        p = (__builtin_convertvector(va, SatVi64w) * __builtin_convertvector(vb, SatVi64w) + ((int64_t)1 << 30)) >> 31;
+        p += (p > INT32_MAX);
+        vr = __builtin_convertvector(p, SatVi32);
+        SAT__STORE(dst + i, vr);
+    }
+    for ( ; i < n; i++) {
+        dst[i] = sat_mul_q31(a[i], b[i]);
+    }
+}
+
+/** Defines a rounding/saturating shift kernel; |shift| must be less than
+ *  the width of T. A left shift saturates every lane outside the range
+ *  [minval >> -shift, maxval >> -shift] that cannot overflow.
+ */
+#define SAT__SHIFT_KERNEL(name, T, V, U, fn, minval, maxval)  \
+    SAT__DISPATCH void name(T* dst, const T* src, size_t n, int shift) \
+    { \
+        const size_t lanes = sizeof(V) / sizeof(T); \
+        size_t i = 0; \
+        V lo, hi, vmin, vmax; \
+        SAT__SPLAT(lo, (T)(shift < 0 ? (minval) >> -shift : (minval))); \
+        SAT__SPLAT(hi, (T)(shift < 0 ? (maxval) >> -shift : (maxval))); \
+        SAT__SPLAT(vmin, (T)(minval)); \
+        SAT__SPLAT(vmax, (T)(maxval)); \
+        for ( ; i + lanes <= n; i += lanes) { \
+            V v; \
+            SAT__LOAD(v, src + i); \
+            if (shift > 0) { \
+                v = (v >> shift) + ((v >> (shift - 1)) & 1); \
+            } \
+            else if (shift < 0) { \
+                V r = (V)((U)v << -shift); \
+                r = SAT__SELECT(v < lo, vmin, r); \
+                v = SAT__SELECT(v > hi, vmax, r); \
+            } \
+            SAT__STORE(dst + i, v); \
+        } \
+        for ( ; i < n; i++) { \
+            dst[i] = fn(src[i], shift); \
+        } \
+    }
+
+SAT__SHIFT_KERNEL(sat_shift_i16_array, int16_t, SatVi16, SatVu16, sat_shift_i16, INT16_MIN, INT16_MAX)
+SAT__SHIFT_KERNEL(sat_shift_i32_array, int32_t, SatVi32, SatVu32, sat_shift_i32, INT32_MIN, INT32_MAX)
+
+#endif  // SATMATH_IMPLEMENTATION
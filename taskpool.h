@@ -0,0 +1,735 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org>
+*/
+#ifndef __TASKPOOL_H__
+#define __TASKPOOL_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "macros.h"
+#include "uctypes.h"
+
+/** @file
+ * This file contains a work-stealing thread pool that runs the uctypes.h
+ * PfTvpRv and PfTvpRvp callbacks, with futures, continuations and a
+ * parallel-for helper.
+ **/
+
+/**
+ *                      Task Pool Overview
+ * =====================================================================
+ * A task is a callback and its argument: a PfTvpRv for fire-and-forget work,
+ * or a PfTvpRvp whose result is delivered through a struct TaskFuture, so
+ * existing callbacks run unchanged:
+ *
+ *   struct TaskPool* tp = taskpool_create(0, TASKPOOL_PIN_CORES);
+ *   taskpool_submit(tp, flush_cache, cache);               // PfTvpRv
+ *   struct TaskFuture* f = taskpool_async(tp, decode, pkt); // PfTvpRvp
+ *   struct TaskFuture* g = task_future_then(tp, f, render); // render(decode(pkt))
+ *   void* frame = task_future_wait(tp, g);
+ *   task_future_release(f);
+ *   task_future_release(g);
+ *   taskpool_destroy(tp);                                  // runs what is queued
+ *
+ * Scheduling
+ * ----------------------------------------------
+ * Each worker owns a Chase-Lev deque: it pushes and pops tasks at the bottom
+ * without locks or atomic read-modify-writes, and idle workers steal from
+ * the top of a random victim's deque. Tasks submitted by a worker go to its
+ * own deque (so nested work stays cache-warm); tasks from other threads go
+ * to a shared injection queue. Idle workers sleep on a condition variable and
+ * are only signaled when one is actually asleep.
+ *
+ * Waiting for a future, a parallel-for or the pool to go idle does not block
+ * a worker: it runs other queued tasks meanwhile, so tasks may wait on tasks
+ * they spawned without deadlocking the pool. Past TASKPOOL_HELP_DEPTH nested
+ * waits a worker only runs tasks from its own deque, which bounds its stack.
+ * Other threads just yield while they wait.
+ *
+ * Parallel For
+ * ----------------------------------------------
+ * taskpool_parallel_for() calls body(lo, hi, ctx) over [begin, end) in
+ * pieces of at most "grain" items. Ranges are split in halves as they run,
+ * so idle workers steal large halves rather than many small pieces.
+ *
+ * Task records come from a memalloc.h pool, so MEMALLOC_IMPLEMENTATION must
+ * be defined in some .c file as well. With TASKPOOL_PIN_CORES, worker i is
+ * pinned to online CPU i modulo the CPU count (Linux only).
+ *
+ * Define TASKPOOL_IMPLEMENTATION in exactly one .c file before including
+ * this file.
+ */
+
+//////////////////////////////////////////////////////////////////////////////
+#define TASKPOOL_PIN_CORES      0x1     ///< taskpool_create() flag
+
+struct TaskPool;
+struct TaskFuture;
+
+/** Body of a parallel-for; called for [lo, hi) */
+typedef void (*PfTszszvpRv)(size_t , size_t , void* );
+
+EXTERN_CPP_START
+
+/** Starts "threads" workers (0 for one per online CPU); NULL on failure */
+struct TaskPool* taskpool_create(unsigned threads, unsigned flags);
+
+/** Waits for every queued task, then stops the workers and frees the pool */
+void taskpool_destroy(struct TaskPool* pool);
+
+/** Number of worker threads */
+unsigned taskpool_threads(const struct TaskPool* pool);
+
+/** Queues fn(arg); returns 0 on success */
+int taskpool_submit(struct TaskPool* pool, PfTvpRv fn, void* arg);
+
+/** Queues fn(arg) and returns a future for its result; NULL on failure */
+struct TaskFuture* taskpool_async(struct TaskPool* pool, PfTvpRvp fn, void* arg);
+
+/** Returns a future for fn(result of "fut"), queued once "fut" completes */
+struct TaskFuture* task_future_then(struct TaskPool* pool, struct TaskFuture* fut, PfTvpRvp fn);
+
+/** Nonzero once the result is available */
+int task_future_ready(const struct TaskFuture* fut);
+
+/** Runs other tasks until "fut" completes, then returns its result */
+void* task_future_wait(struct TaskPool* pool, struct TaskFuture* fut);
+
+/** Drops the caller's reference; the future must not be used afterwards */
+void task_future_release(struct TaskFuture* fut);
+
+/** Calls body(lo, hi, ctx) over [begin, end) in parallel and waits for it */
+void taskpool_parallel_for(struct TaskPool* pool, size_t begin, size_t end, size_t grain,
+                           PfTszszvpRv body, void* ctx);
+
+/** Runs tasks until every task submitted so far has completed */
+void taskpool_wait_idle(struct TaskPool* pool);
+
+EXTERN_CPP_END
+
+#endif  // __TASKPOOL_H__
+
+
+//////////////////////////////////////////////////////////////////////////////
+#if defined(TASKPOOL_IMPLEMENTATION) && !defined(__TASKPOOL_IMPLEMENTATION__)
+#define __TASKPOOL_IMPLEMENTATION__
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef __linux__
+#   include <sys/syscall.h>
+#endif
+
+#include "memalloc.h"
+
+#ifndef TASKPOOL_DEQUE_INIT
+#   define TASKPOOL_DEQUE_INIT      256     ///< initial deque capacity, power of 2
+#endif
+#ifndef TASKPOOL_HELP_DEPTH
+#   define TASKPOOL_HELP_DEPTH      64      ///< nested waits that may steal
+#endif
+#define TASKPOOL_SPINS              64      ///< empty polls before sleeping
+
+/** Parallel-for state shared by all pieces of one call */
+struct TaskGroup {
+    size_t          pending;        ///< pieces not yet finished
+    size_t          grain;
+    PfTszszvpRv     body;
+};
+
+struct Task {
+    struct Task*        next;       ///< continuation or injection queue link
+    PfTvpRv             fn;
+    PfTvpRvp            fnr;        ///< result-producing form; result goes to "future"
+    void*               arg;
+    struct TaskFuture*  future;
+    struct TaskGroup*   group;      ///< set for parallel-for pieces
+    size_t              lo;
+    size_t              hi;
+};
+
+struct TaskFuture {
+    void*           result;
+    int             done;
+    int             refs;           ///< the caller's and the producing task's
+    struct Task*    continuations;  ///< TASK_FUTURE_DONE once completed
+};
+
+#define TASK_FUTURE_DONE    ((struct Task* )1)
+
+struct TaskArray {
+    int64_t         mask;           ///< capacity - 1
+    struct TaskArray* retired;      ///< older, smaller arrays (freed at destroy)
+    struct Task*    slots[];
+};
+
+/** Chase-Lev deque (Le et al., "Correct and Efficient Work-Stealing for
+ *  Weak Memory Models", PPoPP 2013); "top" and "bottom" on separate lines.
+ */
+struct TaskDeque {
+    int64_t             top __attribute__((aligned(CACHE_LINE_SIZE)));
+    int64_t             bottom __attribute__((aligned(CACHE_LINE_SIZE)));
+    struct TaskArray*   array;
+};
+
+struct TaskWorker {
+    struct TaskDeque    deque;
+    struct TaskPool*    pool;
+    pthread_t           thread;
+    unsigned            index;
+    uint32_t            rand;       ///< victim selection state
+} __attribute__((aligned(CACHE_LINE_SIZE)));
+
+struct TaskPool {
+    struct TaskWorker*  workers;
+    unsigned            count;
+    unsigned            flags;
+    struct Pool         tasks;      ///< struct Task records
+    pthread_mutex_t     lock;       ///< injection queue and sleeping
+    pthread_cond_t      wake;
+    struct Task*        injectHead;
+    struct Task*        injectTail;
+    int                 queued __attribute__((aligned(CACHE_LINE_SIZE)));  ///< tasks waiting to run
+    int                 sleepers;
+    size_t              outstanding;    ///< tasks submitted and not finished
+    int                 stop;
+};
+
+static __thread struct TaskWorker* t_taskWorker;
+static __thread unsigned           t_taskHelpDepth;
+
+//////////////////////////////////////////////////////////////////////////////
+static int taskdeque_init(struct TaskDeque* d)
+{
+    d->top = 0;
+    d->bottom = 0;
+    d->array = (struct TaskArray* )calloc(1, sizeof(struct TaskArray) + TASKPOOL_DEQUE_INIT * sizeof(struct Task*));
+    if (!d->array) {
+        return -1;
+    }
+    d->array->mask = TASKPOOL_DEQUE_INIT - 1;
+    return 0;
+}
+
+static void taskdeque_destroy(struct TaskDeque* d)
+{
+    struct TaskArray* a = d->array;
+    while (a) {
+        struct TaskArray* retired = a->retired;
+        free(a);
+        a = retired;
+    }
+}
+
+/** Owner only; doubles the array. Thieves may still read the old one, so
+ *  it is kept until the pool is destroyed.
+ */
+static struct TaskArray* taskdeque_grow(struct TaskDeque* d, struct TaskArray* a, int64_t top, int64_t bottom)
+{
+    int64_t size = 2 * (a->mask + 1);
+    struct TaskArray* b = (struct TaskArray* )malloc(sizeof(struct TaskArray) + (size_t)size * sizeof(struct Task*));
+    if (!b) {
+        return NULL;
+    }
+    b->mask = size - 1;
+    b->retired = a;
+    for (int64_t i = top; i < bottom; i++) {
+        b->slots[i & b->mask] = __atomic_load_n(&a->slots[i & a->mask], __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&d->array, b, __ATOMIC_RELEASE);
+    return b;
+}
+
+/** Owner only; returns 0 on success */
+static int taskdeque_push(struct TaskDeque* d, struct Task* task)
+{
+    int64_t b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED);
+    int64_t t = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE);
+    struct TaskArray* a = __atomic_load_n(&d->array, __ATOMIC_RELAXED);
+
+    if (b - t > a->mask && (a = taskdeque_grow(d, a, t, b)) == NULL) {
+        return -1;
+    }
+    __atomic_store_n(&a->slots[b & a->mask], task, __ATOMIC_RELAXED);
+    // publishes the slot and the task it points to (thieves load acquire)
+    __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/** Owner only; newest task or NULL */
+static struct Task* taskdeque_take(struct TaskDeque* d)
+{
+    int64_t b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED) - 1;
+    struct TaskArray* a = __atomic_load_n(&d->array, __ATOMIC_RELAXED);
+    struct Task* task = NULL;
+    int64_t t;
+
+    __atomic_store_n(&d->bottom, b, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    t = __atomic_load_n(&d->top, __ATOMIC_RELAXED);
+    if (t <= b) {
+        task = __atomic_load_n(&a->slots[b & a->mask], __ATOMIC_RELAXED);
+        if (t == b) {
+            // last task: race the thieves for it
+            if (!__atomic_compare_exchange_n(&d->top, &t, t + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+                task = NULL;
+            }
+            __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+        }
+    }
+    else {
+        __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+    }
+    return task;
+}
+
+/** Any thread; oldest task or NULL (also if another thief won the race) */
+static struct Task* taskdeque_steal(struct TaskDeque* d)
+{
+    int64_t t = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE);
+    int64_t b;
+
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    b = __atomic_load_n(&d->bottom, __ATOMIC_ACQUIRE);
+    if (t < b) {
+        struct TaskArray* a = __atomic_load_n(&d->array, __ATOMIC_ACQUIRE);
+        struct Task* task = __atomic_load_n(&a->slots[t & a->mask], __ATOMIC_RELAXED);
+        if (__atomic_compare_exchange_n(&d->top, &t, t + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+            return task;
+        }
+    }
+    return NULL;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+/** Makes a task runnable: on the calling worker's deque, else the injection queue */
+static void taskpool_enqueue(struct TaskPool* pool, struct Task* task)
+{
+    struct TaskWorker* self = t_taskWorker;
+
+    if (!(self && self->pool == pool && taskdeque_push(&self->deque, task) == 0)) {
+        task->next = NULL;
+        pthread_mutex_lock(&pool->lock);
+        if (pool->injectTail) {
+            pool->injectTail->next = task;
+        }
+        else {
+            __atomic_store_n(&pool->injectHead, task, __ATOMIC_RELAXED);
+        }
+        pool->injectTail = task;
+        pthread_mutex_unlock(&pool->lock);
+    }
+    // pairs with the sleeper count in taskpool_worker(): either the worker
+    // sees "queued" or this sees it asleep
+    __atomic_fetch_add(&pool->queued, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&pool->sleepers, __ATOMIC_SEQ_CST) > 0) {
+        pthread_mutex_lock(&pool->lock);
+        pthread_cond_signal(&pool->wake);
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+/** Finds a runnable task for worker "self": own deque, then (unless
+ *  "ownOnly") the injection queue and other deques
+ */
+static struct Task* taskpool_find(struct TaskPool* pool, struct TaskWorker* self, int ownOnly)
+{
+    struct Task* task;
+    unsigned start;
+
+    if (__atomic_load_n(&pool->queued, __ATOMIC_RELAXED) <= 0) {
+        return NULL;
+    }
+    task = taskdeque_take(&self->deque);
+    if (!task && !ownOnly && __atomic_load_n(&pool->injectHead, __ATOMIC_RELAXED)) {
+        pthread_mutex_lock(&pool->lock);
+        task = pool->injectHead;
+        if (task) {
+            __atomic_store_n(&pool->injectHead, task->next, __ATOMIC_RELAXED);
+            if (!pool->injectHead) {
+                pool->injectTail = NULL;
+            }
+        }
+        pthread_mutex_unlock(&pool->lock);
+    }
+    if (!task && !ownOnly) {
+        self->rand = self->rand * 1103515245u + 12345u;
+        start = (self->rand >> 16) % pool->count;
+        for (unsigned i = 0; i < pool->count && !task; i++) {
+            struct TaskWorker* victim = &pool->workers[(start + i) % pool->count];
+            if (victim != self) {
+                task = taskdeque_steal(&victim->deque);
+            }
+        }
+    }
+    if (task) {
+        __atomic_fetch_sub(&pool->queued, 1, __ATOMIC_RELAXED);
+    }
+    return task;
+}
+
+static struct Task* taskpool_new_task(struct TaskPool* pool)
+{
+    struct Task* task = (struct Task* )pool_alloc(&pool->tasks);
+    if (task) {
+        memset(task, 0, sizeof(*task));
+        __atomic_fetch_add(&pool->outstanding, 1, __ATOMIC_RELAXED);
+    }
+    return task;
+}
+
+static void taskpool_run(struct TaskPool* pool, struct Task* task);
+
+/** Stores the result and queues the continuations */
+static void task_future_complete(struct TaskPool* pool, struct TaskFuture* fut, void* result)
+{
+    struct Task* cont;
+
+    fut->result = result;
+    __atomic_store_n(&fut->done, 1, __ATOMIC_RELEASE);
+    cont = __atomic_exchange_n(&fut->continuations, TASK_FUTURE_DONE, __ATOMIC_ACQ_REL);
+    while (cont) {
+        struct Task* next = cont->next;
+        cont->arg = result;
+        taskpool_enqueue(pool, cont);
+        cont = next;
+    }
+    task_future_release(fut);
+}
+
+static void taskpool_run(struct TaskPool* pool, struct Task* task)
+{
+    struct TaskGroup* group = task->group;
+
+    if (group) {
+        // keep the first half, hand the second to whoever steals it
+        while (task->hi - task->lo > group->grain) {
+            size_t mid = task->lo + (task->hi - task->lo) / 2;
+            struct Task* half = taskpool_new_task(pool);
+            if (!half) {
+                break;
+            }
+            half->group = group;
+            half->arg = task->arg;
+            half->lo = mid;
+            half->hi = task->hi;
+            task->hi = mid;
+            __atomic_fetch_add(&group->pending, 1, __ATOMIC_RELAXED);
+            taskpool_enqueue(pool, half);
+        }
+        group->body(task->lo, task->hi, task->arg);
+        __atomic_fetch_sub(&group->pending, 1, __ATOMIC_RELEASE);
+    }
+    else if (task->fnr) {
+        task_future_complete(pool, task->future, task->fnr(task->arg));
+    }
+    else {
+        task->fn(task->arg);
+    }
+    pool_free(&pool->tasks, task);
+    __atomic_fetch_sub(&pool->outstanding, 1, __ATOMIC_RELEASE);
+}
+
+/** Runs one queued task if the caller is a worker of "pool" and there is
+ *  one; returns nonzero if it did
+ */
+static int taskpool_help(struct TaskPool* pool)
+{
+    struct TaskWorker* self = t_taskWorker;
+    struct Task* task;
+
+    if (!self || self->pool != pool) {
+        return 0;
+    }
+    task = taskpool_find(pool, self, t_taskHelpDepth >= TASKPOOL_HELP_DEPTH);
+    if (task) {
+        t_taskHelpDepth++;
+        taskpool_run(pool, task);
+        t_taskHelpDepth--;
+        return 1;
+    }
+    return 0;
+}
+
+static void taskpool_pin(unsigned index)
+{
+#if defined(__linux__) && defined(SYS_sched_setaffinity)
+    unsigned long mask[16];
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    unsigned cpu = (unsigned)(index % (unsigned long)((cpus > 0) ? cpus : 1));
+    const unsigned bits = 8 * sizeof(mask[0]);
+
+    if (cpu < NUM_ARRAY_ELEM(mask) * bits) {
+        memset(mask, 0, sizeof(mask));
+        mask[cpu / bits] = 1UL << (cpu % bits);
+        syscall(SYS_sched_setaffinity, 0, sizeof(mask), mask);
+    }
+#else
+    (void)index;
+#endif
+}
+
+static void* taskpool_worker(void* arg)
+{
+    struct TaskWorker* self = (struct TaskWorker* )arg;
+    struct TaskPool* pool = self->pool;
+    unsigned idle = 0;
+
+    t_taskWorker = self;
+    if (pool->flags & TASKPOOL_PIN_CORES) {
+        taskpool_pin(self->index);
+    }
+    FOREVER {
+        if (taskpool_help(pool)) {
+            idle = 0;
+            continue;
+        }
+        if (++idle < TASKPOOL_SPINS) {
+            sched_yield();
+            continue;
+        }
+        pthread_mutex_lock(&pool->lock);
+        __atomic_fetch_add(&pool->sleepers, 1, __ATOMIC_SEQ_CST);
+        while (__atomic_load_n(&pool->queued, __ATOMIC_SEQ_CST) <= 0 && !pool->stop) {
+            pthread_cond_wait(&pool->wake, &pool->lock);
+        }
+        __atomic_fetch_sub(&pool->sleepers, 1, __ATOMIC_RELAXED);
+        if (pool->stop && __atomic_load_n(&pool->queued, __ATOMIC_SEQ_CST) <= 0) {
+            pthread_mutex_unlock(&pool->lock);
+            break;
+        }
+        pthread_mutex_unlock(&pool->lock);
+        idle = 0;
+    }
+    return NULL;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+/** Stops and joins the first "started" workers and frees everything */
+static void taskpool_shutdown(struct TaskPool* pool, unsigned started, unsigned threads)
+{
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = 1;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+    for (unsigned i = 0; i < started; i++) {
+        pthread_join(pool->workers[i].thread, NULL);
+    }
+    for (unsigned i = 0; i < threads; i++) {
+        taskdeque_destroy(&pool->workers[i].deque);
+    }
+    pool_destroy(&pool->tasks);
+    pthread_cond_destroy(&pool->wake);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->workers);
+    free(pool);
+}
+
+struct TaskPool* taskpool_create(unsigned threads, unsigned flags)
+{
+    struct TaskPool* pool = (struct TaskPool* )aligned_alloc(CACHE_LINE_SIZE, ROUND_UP_CACHE_LINE(sizeof(*pool)));
+    unsigned started = 0;
+
+    if (!pool) {
+        return NULL;
+    }
+    memset(pool, 0, sizeof(*pool));
+    if (threads == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = (cpus > 0) ? (unsigned)cpus : 1;
+    }
+    pool->count = threads;
+    pool->flags = flags;
+    pool->workers = (struct TaskWorker* )aligned_alloc(CACHE_LINE_SIZE, threads * sizeof(struct TaskWorker));
+    if (!pool->workers || pool_init(&pool->tasks, sizeof(struct Task), 0) != 0) {
+        free(pool->workers);
+        free(pool);
+        return NULL;
+    }
+    memset(pool->workers, 0, threads * sizeof(struct TaskWorker));
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+
+    for (unsigned i = 0; i < threads; i++) {
+        struct TaskWorker* w = &pool->workers[i];
+        w->pool = pool;
+        w->index = i;
+        w->rand = i + 1;
+        if (taskdeque_init(&w->deque) != 0) {
+            break;
+        }
+    }
+    for ( ; started < threads; started++) {
+        struct TaskWorker* w = &pool->workers[started];
+        if (!w->deque.array || pthread_create(&w->thread, NULL, taskpool_worker, w) != 0) {
+            break;
+        }
+    }
+    if (started < threads) {
+        taskpool_shutdown(pool, started, threads);
+        return NULL;
+    }
+    return pool;
+}
+
+void taskpool_destroy(struct TaskPool* pool)
+{
+    taskpool_wait_idle(pool);
+    taskpool_shutdown(pool, pool->count, pool->count);
+}
+
+unsigned taskpool_threads(const struct TaskPool* pool)
+{
+    return pool->count;
+}
+
+int taskpool_submit(struct TaskPool* pool, PfTvpRv fn, void* arg)
+{
+    struct Task* task = taskpool_new_task(pool);
+    if (!task) {
+        return -1;
+    }
+    task->fn = fn;
+    task->arg = arg;
+    taskpool_enqueue(pool, task);
+    return 0;
+}
+
+static struct TaskFuture* task_future_new(void)
+{
+    struct TaskFuture* fut = (struct TaskFuture* )calloc(1, sizeof(*fut));
+    if (fut) {
+        fut->refs = 2;
+    }
+    return fut;
+}
+
+struct TaskFuture* taskpool_async(struct TaskPool* pool, PfTvpRvp fn, void* arg)
+{
+    struct TaskFuture* fut = task_future_new();
+    struct Task* task = fut ? taskpool_new_task(pool) : NULL;
+
+    if (!task) {
+        free(fut);
+        return NULL;
+    }
+    task->fnr = fn;
+    task->arg = arg;
+    task->future = fut;
+    taskpool_enqueue(pool, task);
+    return fut;
+}
+
+struct TaskFuture* task_future_then(struct TaskPool* pool, struct TaskFuture* fut, PfTvpRvp fn)
+{
+    struct TaskFuture* next = task_future_new();
+    struct Task* task = next ? taskpool_new_task(pool) : NULL;
+    struct Task* head;
+
+    if (!task) {
+        free(next);
+        return NULL;
+    }
+    task->fnr = fn;
+    task->future = next;
+    head = __atomic_load_n(&fut->continuations, __ATOMIC_ACQUIRE);
+    do {
+        if (head == TASK_FUTURE_DONE) {
+            task->arg = fut->result;
+            taskpool_enqueue(pool, task);
+            return next;
+        }
+        task->next = head;
+    } while (!__atomic_compare_exchange_n(&fut->continuations, &head, task, 1, __ATOMIC_RELEASE, __ATOMIC_ACQUIRE));
+    return next;
+}
+
+int task_future_ready(const struct TaskFuture* fut)
+{
+    return __atomic_load_n(&fut->done, __ATOMIC_ACQUIRE);
+}
+
+void* task_future_wait(struct TaskPool* pool, struct TaskFuture* fut)
+{
+    while (!task_future_ready(fut)) {
+        if (!taskpool_help(pool)) {
+            sched_yield();
+        }
+    }
+    return fut->result;
+}
+
+void task_future_release(struct TaskFuture* fut)
+{
+    if (fut && __atomic_sub_fetch(&fut->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+        free(fut);
+    }
+}
+
+void taskpool_parallel_for(struct TaskPool* pool, size_t begin, size_t end, size_t grain,
+                           PfTszszvpRv body, void* ctx)
+{
+    struct TaskGroup group;
+    struct Task* task;
+
+    if (begin >= end) {
+        return;
+    }
+    group.pending = 1;
+    group.grain = grain ? grain : 1;
+    group.body = body;
+    task = taskpool_new_task(pool);
+    if (!task) {
+        body(begin, end, ctx);      // no memory: run it here, serially
+        return;
+    }
+    task->group = &group;
+    task->arg = ctx;
+    task->lo = begin;
+    task->hi = end;
+    // run the first piece here; the halves it splits off are stolen
+    taskpool_run(pool, task);
+    while (__atomic_load_n(&group.pending, __ATOMIC_ACQUIRE) != 0) {
+        if (!taskpool_help(pool)) {
+            sched_yield();
+        }
+    }
+}
+
+void taskpool_wait_idle(struct TaskPool* pool)
+{
+    while (__atomic_load_n(&pool->outstanding, __ATOMIC_ACQUIRE) != 0) {
+        if (!taskpool_help(pool)) {
+            sched_yield();
+        }
+    }
+}
+
+#endif  // TASKPOOL_IMPLEMENTATION
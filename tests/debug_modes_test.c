@@ -0,0 +1,66 @@
+/** Every PRINTx() macro family must compile in every combination of the
+ *  debug.h output modes; BINARY_PRINT expands to brace initializers with
+ *  bare commas, which break any macro that forwards a statement as a
+ *  single argument. This file is only compiled, once per combination:
+ *
+ *   for gate in -DCURRENT_PRINT_LEVEL=PRINT_LEVEL_INFO -DRUNTIME_PRINT_LEVEL -DDYNAMIC_PRINT; do
+ *     for bin in "" -DBINARY_PRINT; do
+ *       for rec in "" -DFLIGHT_RECORDER; do
+ *         for out in "" -DLOG_SINKS -DPRINT_PREFIX; do
+ *           cc -std=gnu11 -Wall -Wextra -Werror -I.. -fsyntax-only \
+ *              -DDEBUG_PRINT $gate $bin $rec $out debug_modes_test.c || echo "FAILED: $gate $bin $rec $out"
+ *         done
+ *       done
+ *     done
+ *   done
+ *   cc -std=gnu11 -Wall -Wextra -Werror -I.. -fsyntax-only debug_modes_test.c
+ */
+#include "debug.h"
+#include "printscope.h"
+
+PRINT_SCOPE_DEFINE(g_scopeModes, "modes");
+
+void debug_modes_test(int value, const char* name, const unsigned char* data, size_t len)
+{
+    (void)value; (void)name; (void)data; (void)len;
+
+    PRINT("plain %d %s\n", value, name);
+    PRINTW("warn %d %s\n", value, name);
+    PRINTI("info %d\n", value);
+    PRINTD("debug\n");
+    PRINTV("verbose %s\n", name);
+
+#ifdef SPRINT
+    SPRINT(PRINT_SCOPE_AREA00, "plain %d %s\n", value, name);
+    SPRINTW(PRINT_SCOPE_AREA01, "warn %d\n", value);
+    SPRINTI(PRINT_SCOPE_AREA02, "info\n");
+    SPRINTD(PRINT_SCOPE_AREA03, "debug %s\n", name);
+    SPRINTV(PRINT_SCOPE_ALL, "verbose %d %s\n", value, name);
+#endif
+
+    PRINTW_RATELIMITED("warn %d %s\n", value, name);
+    PRINTI_RATELIMITED("info\n");
+    PRINTD_RATELIMITED("debug %d\n", value);
+    PRINTW_EVERY_N(10, "warn %d %s\n", value, name);
+    PRINTI_EVERY_N(10, "info\n");
+    PRINTD_EVERY_N(10, "debug %d\n", value);
+    PRINTW_SAMPLED(100, "warn %d %s\n", value, name);
+    PRINTI_SAMPLED(100, "info\n");
+    PRINTD_SAMPLED(100, "debug %d\n", value);
+
+    PRINT_HEX(data, len);
+    PRINTW_HEX(data, len);
+    PRINTI_HEX(data, len);
+    PRINTD_HEX(data, len);
+    PRINTV_HEX(data, len);
+#ifdef SPRINT_HEX
+    SPRINT_HEX(PRINT_SCOPE_AREA00, data, len);
+    SPRINTD_HEX(PRINT_SCOPE_ALL, data, len);
+#endif
+
+    NSPRINT(g_scopeModes, "plain %d %s\n", value, name);
+    NSPRINTW(g_scopeModes, "warn %d\n", value);
+    NSPRINTI(g_scopeModes, "info\n");
+    NSPRINTD(g_scopeModes, "debug %s\n", name);
+    NSPRINTV(g_scopeModes, "verbose %d %s\n", value, name);
+}
@@ -0,0 +1,206 @@
+/** The intrusive.h containers: list and hlist operations on one thread,
+ *  and the MPSC queue with several producers pushing against one consumer,
+ *  which must see every node exactly once and each producer's nodes in
+ *  push order.
+ *
+ *   cc -O2 -Wall -I.. -o intrusive_test intrusive_test.c -lpthread && ./intrusive_test
+ */
+#include "intrusive.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+struct Item {
+    int                 id;
+    struct ListNode     link;
+    struct HListNode    hash;
+};
+
+/** Checks that the list holds exactly "ids" in order, both directions */
+static void check_list(struct ListNode* head, const int* ids, int n)
+{
+    struct Item* it;
+    struct ListNode* pos;
+    int i = 0;
+
+    LIST_FOR_EACH_ENTRY(it, head, link) {
+        assert(i < n && it->id == ids[i]);
+        i++;
+    }
+    assert(i == n);
+    for (pos = head->prev; pos != head; pos = pos->prev) {
+        assert(LIST_ENTRY(pos, struct Item, link)->id == ids[--i]);
+    }
+    assert(i == 0);
+    assert(list_empty(head) == (n == 0));
+}
+
+static void test_list(void)
+{
+    struct ListNode a = LIST_HEAD_INIT(a);
+    struct ListNode b;
+    struct Item items[6];
+    struct Item* it;
+    struct Item* tmp;
+
+    list_init(&b);
+    check_list(&a, NULL, 0);
+    for (int i = 0; i < 6; i++) {
+        items[i].id = i;
+    }
+    list_add_tail(&a, &items[1].link);
+    list_add_tail(&a, &items[2].link);
+    list_add_head(&a, &items[0].link);
+    check_list(&a, (const int[]){ 0, 1, 2 }, 3);
+
+    list_del(&items[1].link);
+    assert(list_empty(&items[1].link));
+    check_list(&a, (const int[]){ 0, 2 }, 2);
+
+    list_move_tail(&a, &items[0].link);
+    check_list(&a, (const int[]){ 2, 0 }, 2);
+
+    list_add_tail(&b, &items[3].link);
+    list_add_tail(&b, &items[4].link);
+    list_move_tail(&b, &items[2].link);
+    check_list(&a, (const int[]){ 0 }, 1);
+    check_list(&b, (const int[]){ 3, 4, 2 }, 3);
+
+    list_splice_tail(&a, &b);
+    check_list(&a, (const int[]){ 0, 3, 4, 2 }, 4);
+    check_list(&b, NULL, 0);
+    list_splice_tail(&a, &b);       // empty splice is a no-op
+    check_list(&a, (const int[]){ 0, 3, 4, 2 }, 4);
+
+    // the _SAFE iterator survives deleting the current element
+    LIST_FOR_EACH_ENTRY_SAFE(it, tmp, &a, link) {
+        if (it->id & 1 || it->id == 0) {
+            list_del(&it->link);
+        }
+    }
+    check_list(&a, (const int[]){ 4, 2 }, 2);
+    assert(LIST_FIRST_ENTRY(&a, struct Item, link) == &items[4]);
+}
+
+static void test_hlist(void)
+{
+    struct HListHead buckets[4] = { { NULL } };
+    struct Item items[10];
+    struct Item* it;
+    struct HListNode* tmp;
+    int seen;
+
+    for (int i = 0; i < 10; i++) {
+        items[i].id = i;
+        hlist_add_head(&buckets[i % 4], &items[i].hash);
+        assert(hlist_linked(&items[i].hash));
+    }
+    // newest first within a bucket
+    seen = 0;
+    HLIST_FOR_EACH_ENTRY(it, tmp, &buckets[1], hash) {
+        assert(it->id == 9 - 4 * seen);
+        seen++;
+    }
+    assert(seen == 3);
+
+    // deletes from the head, middle and tail of a bucket, without the bucket
+    hlist_del(&items[9].hash);
+    hlist_del(&items[1].hash);
+    assert(!hlist_linked(&items[1].hash));
+    HLIST_FOR_EACH_ENTRY(it, tmp, &buckets[1], hash) {
+        assert(it->id == 5);
+    }
+    hlist_del(&items[5].hash);
+    assert(hlist_empty(&buckets[1]));
+
+    // deleting every element while iterating empties the bucket
+    HLIST_FOR_EACH_ENTRY(it, tmp, &buckets[2], hash) {
+        hlist_del(&it->hash);
+    }
+    assert(hlist_empty(&buckets[2]));
+    assert(!hlist_empty(&buckets[0]) && !hlist_empty(&buckets[3]));
+}
+
+#define MPSC_PRODUCERS      4
+#define MPSC_PER_PRODUCER   200000
+
+struct Msg {
+    int                 producer;
+    int                 seq;
+    struct MpscNode     node;
+};
+
+static struct MpscQueue s_queue;
+static struct Msg* s_msgs;
+
+static void* producer(void* arg)
+{
+    int p = (int)(intptr_t)arg;
+    for (int i = 0; i < MPSC_PER_PRODUCER; i++) {
+        struct Msg* m = &s_msgs[p * MPSC_PER_PRODUCER + i];
+        m->producer = p;
+        m->seq = i;
+        mpsc_push(&s_queue, &m->node);
+    }
+    return NULL;
+}
+
+static void test_mpsc(void)
+{
+    pthread_t threads[MPSC_PRODUCERS];
+    int next[MPSC_PRODUCERS] = { 0 };
+    long total = 0;
+
+    s_msgs = (struct Msg* )calloc(MPSC_PRODUCERS * MPSC_PER_PRODUCER, sizeof(*s_msgs));
+    if (!s_msgs) {
+        perror("calloc");
+        exit(1);
+    }
+    mpsc_init(&s_queue);
+    assert(mpsc_empty(&s_queue) && mpsc_pop(&s_queue) == NULL);
+
+    for (int p = 0; p < MPSC_PRODUCERS; p++) {
+        if (pthread_create(&threads[p], NULL, producer, (void* )(intptr_t)p) != 0) {
+            perror("pthread_create");
+            exit(1);
+        }
+    }
+    while (total < (long)MPSC_PRODUCERS * MPSC_PER_PRODUCER) {
+        struct MpscNode* n = mpsc_pop(&s_queue);
+        if (!n) {
+            sched_yield();
+            continue;
+        }
+        struct Msg* m = MPSC_ENTRY(n, struct Msg, node);
+        assert(m->producer >= 0 && m->producer < MPSC_PRODUCERS);
+        assert(m->seq == next[m->producer]);    // FIFO per producer, no loss or repeat
+        next[m->producer]++;
+        total++;
+    }
+    for (int p = 0; p < MPSC_PRODUCERS; p++) {
+        pthread_join(threads[p], NULL);
+        assert(next[p] == MPSC_PER_PRODUCER);
+    }
+    assert(mpsc_pop(&s_queue) == NULL && mpsc_empty(&s_queue));
+
+    // the stub cycles back in correctly when the queue drains to one node
+    for (int i = 0; i < 3; i++) {
+        mpsc_push(&s_queue, &s_msgs[i].node);
+        assert(mpsc_pop(&s_queue) == &s_msgs[i].node);
+        assert(mpsc_pop(&s_queue) == NULL);
+    }
+    free(s_msgs);
+}
+
+int main(void)
+{
+    test_list();
+    test_hlist();
+    test_mpsc();
+    printf("intrusive_test: OK\n");
+    return 0;
+}
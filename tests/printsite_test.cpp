@@ -0,0 +1,104 @@
+/** Per-call-site registry under C++: sites in an ordinary function, an
+ *  inline function and a function template must all build together in one
+ *  file, register on their first hit and follow printsite_enable() rules.
+ *
+ *   g++ -std=gnu++17 -Wall -I.. -o printsite_test printsite_test.cpp && ./printsite_test
+ */
+#define DEBUG_PRINT
+#define DYNAMIC_PRINT
+#define CURRENT_PRINT_LEVEL     PRINT_LEVEL_WARN
+#define PRINTSITE_IMPLEMENTATION
+#include "debug.h"
+
+#include <assert.h>
+#include <stdarg.h>
+#include <string.h>
+
+unsigned short g_currentPrintLevel = PRINT_LEVEL_WARN;
+unsigned short g_currentPrintScope = PRINT_SCOPE_ALL;
+
+static char s_last[128];
+static int s_count;
+
+int ucprintf(const char* fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(s_last, sizeof(s_last), fmt, ap);
+    va_end(ap);
+    s_count++;
+    return n;
+}
+
+static void plain_site(int v)
+{
+    PRINTD("plain %d\n", v);
+}
+
+inline void inline_site(int v)
+{
+    PRINTD("inline %d\n", v);
+}
+
+template <typename T>
+void template_site(T v)
+{
+    PRINTD("template %d\n", (int)v);
+}
+
+static void literal_free_site(const char* fmt)
+{
+    PRINTW(fmt, 7);
+}
+
+static unsigned count_sites(void)
+{
+    unsigned n = 0;
+    for (struct PrintSite* site = printsite_first(); site; site = site->next) {
+        n++;
+    }
+    return n;
+}
+
+int main(void)
+{
+    // nothing has run yet, so nothing is registered
+    assert(count_sites() == 0);
+
+    // debug sites start disabled at the WARN threshold
+    plain_site(1);
+    inline_site(1);
+    template_site<int>(1);
+    template_site<short>(1);
+    assert(s_count == 0);
+    assert(count_sites() == 4);     // one site per template instance
+
+    // enabling by pattern reaches registered sites...
+    assert(printsite_enable(NULL, 0, "inline*", 1) == 1);
+    inline_site(2);
+    assert(s_count == 1 && strcmp(s_last, "inline 2\n") == 0);
+
+    // ...and the rule is replayed on sites that register later
+    assert(printsite_enable(NULL, 0, "template*", 1) == 2);
+    template_site<long>(3);
+    assert(s_count == 2 && strcmp(s_last, "template 3\n") == 0);
+    assert(count_sites() == 5);
+
+    // the format of a non-literal site is the one it was first called with
+    literal_free_site("warn %d\n");
+    assert(s_count == 3 && strcmp(s_last, "warn 7\n") == 0);
+    assert(strcmp(printsite_first()->fmt, "warn %d\n") == 0);
+
+    // a level change re-syncs every site and forgets the rules
+    printsite_set_level(PRINT_LEVEL_DEBUG);
+    plain_site(4);
+    assert(s_count == 4 && strcmp(s_last, "plain 4\n") == 0);
+    printsite_set_level(PRINT_LEVEL_WARN);
+    inline_site(5);
+    template_site<int>(5);
+    assert(s_count == 4);
+
+    printsite_list(stdout);
+    printf("printsite_test: OK\n");
+    return 0;
+}
@@ -0,0 +1,355 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org>
+*/
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "debug.h"
+#include "logclock.h"
+#include "macros.h"
+
+/** @file
+ * This file contains scoped trace spans gated by the same PRINT_SCOPE_*
+ * masks as the SPRINTx() macros in debug.h, recorded into per-thread
+ * buffers and exported as Chrome trace-event JSON.
+ **/
+
+/**
+ *                      Trace Spans
+ * =====================================================================
+ * A span measures the time between its begin and end and is recorded only
+ * if, when it begins, its scope bit is set in g_currentPrintScope and
+ * TRACE_LEVEL (default PRINT_LEVEL_DEBUG) passes the print level, i.e.,
+ * exactly when an SPRINTD() in the same scope would print. The test costs
+ * what a suppressed SPRINTD() pays, and nothing else happens for a
+ * disabled span.
+ *
+ * Enabled spans take two logclock_now() stamps and append one complete
+ * ("ph":"X") event to the calling thread's ring buffer of TRACE_BUFFER_EVENTS
+ * entries; when the ring wraps the oldest events are overwritten. Span names
+ * must be string literals (or otherwise outlive the trace). In the export,
+ * "ts" counts from the logclock.h base point taken at process start, and
+ * "dur" is scaled straight from the raw stamp difference, so short spans
+ * keep nanosecond resolution.
+ *
+ * Spans are only compiled in when DEBUG_PRINT is defined, and the project
+ * must then provide g_currentPrintScope (see debug.h) in every print mode.
+ *
+ * Usage
+ * ----------------------------------------------
+ *   void rx_packet(...)
+ *   {
+ *       TRACE_SCOPE(PRINT_SCOPE_AREA03, "rx_packet");   // C++ or GNU C
+ *       ...
+ *   }
+ *
+ *   struct TraceSpan span;                              // explicit C form
+ *   TRACE_BEGIN(&span, PRINT_SCOPE_AREA03, "parse");
+ *   ...
+ *   TRACE_END(&span);
+ *
+ *   trace_export_json_file("trace.json");   // load in Perfetto / chrome://tracing
+ *
+ * Define TRACE_IMPLEMENTATION in exactly one .c file before including this
+ * file (logclock.h needs LOGCLOCK_IMPLEMENTATION as well).
+ */
+
+//////////////////////////////////////////////////////////////////////////////
+#ifndef TRACE_BUFFER_EVENTS
+#   define TRACE_BUFFER_EVENTS  8192
+#endif
+#ifndef TRACE_LEVEL
+#   define TRACE_LEVEL          PRINT_LEVEL_DEBUG
+#endif
+
+/** Level half of the span gate, following the debug.h print mode */
+#if defined(RUNTIME_PRINT_LEVEL)
+#   define TRACE_LEVEL_ON()     (g_currentPrintLevel <= TRACE_LEVEL)
+#elif defined(CURRENT_PRINT_LEVEL)
+#   define TRACE_LEVEL_ON()     (CURRENT_PRINT_LEVEL <= TRACE_LEVEL)
+#else
+#   define TRACE_LEVEL_ON()     1
+#endif
+
+/** An open span; "active" is zero when the scope was disabled at begin */
+struct TraceSpan {
+    const char*     name;
+    uint64_t        start;
+    unsigned short  scope;
+    unsigned char   active;
+};
+
+EXTERN_CPP_START
+
+/** Records one finished span on the calling thread */
+void trace_record(const char* name, unsigned short scope, uint64_t start, uint64_t end);
+
+/** Writes every buffered span as Chrome trace-event JSON */
+void trace_export_json(FILE* out);
+
+/** Convenience wrapper that writes the JSON to "path"; returns 0 on success */
+int trace_export_json_file(const char* path);
+
+/** Discards all buffered spans */
+void trace_clear(void);
+
+EXTERN_CPP_END
+
+static inline void trace_span_begin(struct TraceSpan* span, unsigned short scope, const char* name)
+{
+    span->active = (g_currentPrintScope & scope) != 0 && TRACE_LEVEL_ON();
+    span->name = name;
+    span->scope = scope;
+    span->start = __builtin_expect(span->active, 0) ? logclock_now() : 0;
+}
+
+static inline void trace_span_end(struct TraceSpan* span)
+{
+    if (__builtin_expect(span->active, 0)) {
+        trace_record(span->name, span->scope, span->start, logclock_now());
+    }
+}
+
+#define TRACE__CAT(a, b)    TRACE__CAT_(a, b)
+#define TRACE__CAT_(a, b)   a ## b
+
+#ifdef DEBUG_PRINT
+#   define TRACE_BEGIN(span, scope, name)   trace_span_begin(span, scope, name)
+#   define TRACE_END(span)                  trace_span_end(span)
+#   ifdef __cplusplus
+    /** RAII span ended by the destructor */
+    class TraceScope {
+    public:
+        TraceScope(unsigned short scope, const char* name) { trace_span_begin(&m_span, scope, name); }
+        ~TraceScope() { trace_span_end(&m_span); }
+    private:
+        TraceScope(const TraceScope& );
+        TraceScope& operator=(const TraceScope& );
+        struct TraceSpan m_span;
+    };
+#       define TRACE_SCOPE(scope, name)  TraceScope TRACE__CAT(trace__span_, __LINE__)(scope, name)
+#   else
+    /** Span ended by the GNU C cleanup attribute when it goes out of scope */
+#       define TRACE_SCOPE(scope, name)  \
+            struct TraceSpan TRACE__CAT(trace__span_, __LINE__) __attribute__((cleanup(trace_span_end))); \
+            trace_span_begin(&TRACE__CAT(trace__span_, __LINE__), scope, name)
+#   endif
+#else
+#   define TRACE_BEGIN(span, scope, name)   do { (void)(span); } while (0)
+#   define TRACE_END(span)                  do { (void)(span); } while (0)
+#   define TRACE_SCOPE(scope, name)
+#endif
+
+#endif  // __TRACE_H__
+
+
+//////////////////////////////////////////////////////////////////////////////
+#if defined(TRACE_IMPLEMENTATION) && !defined(__TRACE_IMPLEMENTATION__)
+#define __TRACE_IMPLEMENTATION__
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+struct TraceEvent {
+    const char*     name;
+    uint64_t        start;
+    uint64_t        end;
+    int             tid;        ///< kept per event, as rings change owner
+    unsigned short  scope;
+};
+
+/** One ring per thread; never freed, so export can run at any time. Only
+ *  the owner writes "count"; trace_clear() moves "cleared" up to it instead
+ *  of resetting it, so the two never race. When its thread exits, a ring
+ *  goes on s_traceFree and is handed to a new thread once all its events
+ *  have been exported or cleared; until they are overwritten they are
+ *  still exported under the old thread ID.
+ */
+struct TraceBuffer {
+    struct TraceBuffer* next;
+    struct TraceBuffer* nextFree;   ///< s_traceFree list, under s_traceLock
+    int                 tid;
+    uint64_t            count;      ///< events ever written (monotonic)
+    uint64_t            cleared;    ///< events before this index are discarded
+    uint64_t            exported;   ///< events before this index were exported
+    struct TraceEvent   events[TRACE_BUFFER_EVENTS];
+};
+
+static struct TraceBuffer*          s_traceBuffers;
+static struct TraceBuffer*          s_traceFree;
+static pthread_mutex_t              s_traceLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t                s_traceKey;
+static pthread_once_t               s_traceOnce = PTHREAD_ONCE_INIT;
+static __thread struct TraceBuffer* t_traceBuffer;
+
+/** pthread key destructor: parks the exiting thread's ring on s_traceFree */
+static void trace_thread_exit(void* arg)
+{
+    struct TraceBuffer* buf = (struct TraceBuffer* )arg;
+    // spans recorded by later destructors get a fresh ring
+    t_traceBuffer = NULL;
+    pthread_mutex_lock(&s_traceLock);
+    buf->nextFree = s_traceFree;
+    s_traceFree = buf;
+    pthread_mutex_unlock(&s_traceLock);
+}
+
+static void trace_make_key(void)
+{
+    pthread_key_create(&s_traceKey, trace_thread_exit);
+}
+
+/** Takes a parked ring with nothing left to export off s_traceFree */
+static struct TraceBuffer* trace_reuse_buffer(void)
+{
+    struct TraceBuffer* buf;
+    struct TraceBuffer** link;
+
+    pthread_mutex_lock(&s_traceLock);
+    for (link = &s_traceFree; (buf = *link) != NULL; link = &buf->nextFree) {
+        uint64_t done = MAX(__atomic_load_n(&buf->exported, __ATOMIC_ACQUIRE),
+                            __atomic_load_n(&buf->cleared, __ATOMIC_ACQUIRE));
+        if (done >= buf->count) {
+            *link = buf->nextFree;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&s_traceLock);
+    return buf;
+}
+
+static struct TraceBuffer* trace_thread_buffer(void)
+{
+    struct TraceBuffer* buf = t_traceBuffer;
+    if (__builtin_expect(buf == NULL, 0)) {
+        pthread_once(&s_traceOnce, trace_make_key);
+        buf = trace_reuse_buffer();
+        if (!buf) {
+            buf = (struct TraceBuffer* )calloc(1, sizeof(*buf));
+            if (!buf) {
+                return NULL;
+            }
+            buf->next = __atomic_load_n(&s_traceBuffers, __ATOMIC_RELAXED);
+            while (!__atomic_compare_exchange_n(&s_traceBuffers, &buf->next, buf, 1,
+                                                __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+            }
+        }
+        buf->tid = logclock_tid();
+        pthread_setspecific(s_traceKey, buf);
+        t_traceBuffer = buf;
+    }
+    return buf;
+}
+
+void trace_record(const char* name, unsigned short scope, uint64_t start, uint64_t end)
+{
+    struct TraceBuffer* buf = trace_thread_buffer();
+    struct TraceEvent* ev;
+
+    if (!buf) {
+        return;
+    }
+    ev = &buf->events[buf->count % TRACE_BUFFER_EVENTS];
+    ev->name = name;
+    ev->start = start;
+    ev->end = end;
+    ev->tid = buf->tid;
+    ev->scope = scope;
+    __atomic_store_n(&buf->count, buf->count + 1, __ATOMIC_RELEASE);
+}
+
+/** Microseconds for a raw stamp difference, as Chrome trace expects */
+static double trace_us(uint64_t from, uint64_t to)
+{
+    return (double)logclock_delta_ns(from, to) / 1e3;
+}
+
+static void trace_json_string(FILE* out, const char* s)
+{
+    fputc('"', out);
+    for ( ; *s; s++) {
+        if (*s == '"' || *s == '\\') {
+            fputc('\\', out);
+            fputc(*s, out);
+        }
+        else if ((unsigned char)*s < 0x20) {
+            fprintf(out, "\\u%04x", (unsigned char)*s);
+        }
+        else {
+            fputc(*s, out);
+        }
+    }
+    fputc('"', out);
+}
+
+void trace_export_json(FILE* out)
+{
+    const char* sep = "";
+    int pid = (int)getpid();
+    uint64_t base = g_logClock.baseTicks;
+
+    fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[", out);
+    for (struct TraceBuffer* buf = __atomic_load_n(&s_traceBuffers, __ATOMIC_ACQUIRE); buf; buf = buf->next) {
+        uint64_t count = __atomic_load_n(&buf->count, __ATOMIC_ACQUIRE);
+        uint64_t first = (count > TRACE_BUFFER_EVENTS) ? count - TRACE_BUFFER_EVENTS : 0;
+        first = MAX(first, __atomic_load_n(&buf->cleared, __ATOMIC_ACQUIRE));
+        for (uint64_t i = first; i < count; i++) {
+            const struct TraceEvent* ev = &buf->events[i % TRACE_BUFFER_EVENTS];
+            fprintf(out, "%s\n{\"name\":", sep);
+            trace_json_string(out, ev->name);
+            fprintf(out, ",\"cat\":\"scope%04x\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d}",
+                    ev->scope, trace_us(base, ev->start), trace_us(ev->start, ev->end), pid, ev->tid);
+            sep = ",";
+        }
+        if (count > __atomic_load_n(&buf->exported, __ATOMIC_RELAXED)) {
+            __atomic_store_n(&buf->exported, count, __ATOMIC_RELEASE);
+        }
+    }
+    fputs("\n]}\n", out);
+}
+
+int trace_export_json_file(const char* path)
+{
+    FILE* out = fopen(path, "w");
+    if (!out) {
+        return -1;
+    }
+    trace_export_json(out);
+    return fclose(out) == 0 ? 0 : -1;
+}
+
+void trace_clear(void)
+{
+    for (struct TraceBuffer* buf = __atomic_load_n(&s_traceBuffers, __ATOMIC_ACQUIRE); buf; buf = buf->next) {
+        __atomic_store_n(&buf->cleared, __atomic_load_n(&buf->count, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+    }
+}
+
+#endif  // TRACE_IMPLEMENTATION
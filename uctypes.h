@@ -27,8 +27,9 @@ For more information, please refer to <http://unlicense.org>
 #ifndef __UCTYPES_H__
 #define __UCTYPES_H__
 
-// Include the two standard type headers
+// Include the standard type headers
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 
@@ -75,12 +76,13 @@ typedef void* (*PfTvpRvp)(void* );
 #define NATIVE_ALIGNMENT            sizeof(void*)
 #define NATIVE_ALIGNMENT_MASK       (NATIVE_ALIGNMENT - 1)
 #define ROUND_UP_NATIVE_ALIGNMENT(nbytes) \
- (Uint32 )((nbytes) & NATIVE_ALIGNMENT_MASK ? \
+ (size_t )((nbytes) & NATIVE_ALIGNMENT_MASK ? \
            (nbytes) + NATIVE_ALIGNMENT - ((nbytes) & NATIVE_ALIGNMENT_MASK) : (nbytes))
 
 /** Here is a portable way to make sure that when we do allocations, we make
  *  sure we have rounded up to the size needed to hold multiples of the largest
- *  possible type. NOTE: not using long double's.
+ *  possible type. NOTE: not using long double's. The allocators in memalloc.h
+ *  round with this.
  */
 union MaxDataTypeSize {
     int         i;
@@ -94,45 +96,228 @@ union MaxDataTypeSize {
 #define MAX_DATATYPE_SIZE       sizeof(union MaxDataTypeSize)
 #define MAX_DATATYPE_SIZE_MASK  (MAX_DATATYPE_SIZE - 1)
 #define ROUND_UP_DATATYPE_SIZE(nbytes) \
- (Uint32 )((nbytes) & MAX_DATATYPE_SIZE_MASK ? \
+ (size_t )((nbytes) & MAX_DATATYPE_SIZE_MASK ? \
            (nbytes) + MAX_DATATYPE_SIZE - ((nbytes) & MAX_DATATYPE_SIZE_MASK) : (nbytes))
 
+/** Cache line size, for keeping data written by different threads apart */
+#ifndef CACHE_LINE_SIZE
+#   define CACHE_LINE_SIZE      64
+#endif
+#define ROUND_UP_CACHE_LINE(nbytes) \
+ (((size_t )(nbytes) + CACHE_LINE_SIZE - 1) & ~((size_t )CACHE_LINE_SIZE - 1))
+
 /** Test that an address is properly aligned */
 //#define IS_PTR_ALIGNED(addr)    (!(((intptr_t )addr) & (NATIVE_ALIGNMENT - 1)))
 
 ////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
-/** Macros for converting between big- and little-endian
- *  Native host to network byte order short & long
- *  Network byte order to native host short & long
+/** Host byte order. An explicit BIG_ENDIAN or LITTLE_ENDIAN define (but not
+ *  both; glibc's <endian.h> defines both as values) takes precedence,
+ *  otherwise the compiler's __BYTE_ORDER__ is used.
  */
 #if defined(BIG_ENDIAN) && !defined(LITTLE_ENDIAN)
+#   define UC_BIG_ENDIAN_HOST      1
+#elif defined(LITTLE_ENDIAN) && !defined(BIG_ENDIAN)
+#   define UC_BIG_ENDIAN_HOST      0
+#elif defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+#   define UC_BIG_ENDIAN_HOST      1
+#elif defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#   define UC_BIG_ENDIAN_HOST      0
+#endif
+
+/** Unconditional byte swaps; each compiles to a single instruction */
+#ifndef bswap16
+#   define bswap16(x)      __builtin_bswap16((uint16_t)(x))
+#endif
+#ifndef bswap32
+#   define bswap32(x)      __builtin_bswap32((uint32_t)(x))
+#endif
+#ifndef bswap64
+#   define bswap64(x)      __builtin_bswap64((uint64_t)(x))
+#endif
+
+/** Macros for converting between big- and little-endian
+ *  Native host to network byte order short, long & long long
+ *  Network byte order to native host short, long & long long
+ *  (wiretypes.h has typed be16/be32/... fields that read wire buffers in place)
+ */
+#if defined(UC_BIG_ENDIAN_HOST) && UC_BIG_ENDIAN_HOST
 /** No conversion needed for big-endian to/from network byte order */
-#   define htons(x)        (x)
-#   define htonl(x)        (x)
-#   define ntohs(x)        (x)
-#   define ntohl(x)        (x)
+#   define htons(x)        ((uint16_t)(x))
+#   define htonl(x)        ((uint32_t)(x))
+#   define htonll(x)       ((uint64_t)(x))
+#   define ntohs(x)        ((uint16_t)(x))
+#   define ntohl(x)        ((uint32_t)(x))
+#   define ntohll(x)       ((uint64_t)(x))
 
-#elif defined(LITTLE_ENDIAN) && !defined(BIG_ENDIAN)
+#elif defined(UC_BIG_ENDIAN_HOST)
 /** Swap bytes appropriately for little-endian to/from network byte order */
-#   define htons(x)        ((((Uint16)(x) & 0xFF00) >> 8) | \
-                            (((Uint16)(x) & 0x00FF) << 8))
-#   define htonl(x)        ((((Uint32)(x) & 0xFF000000) >> 24) | \
-                            (((Uint32)(x) & 0x00FF0000) >>  8) | \
-                            (((Uint32)(x) & 0x0000FF00) <<  8) | \
-                            (((Uint32)(x) & 0x000000FF) << 24))
+#   define htons(x)        bswap16(x)
+#   define htonl(x)        bswap32(x)
+#   define htonll(x)       bswap64(x)
 #   define ntohs           htons
 #   define ntohl           htonl
+#   define ntohll          htonll
 
 #else
 /** Replace with garbage that should fail compilation to ensure that either
- *  LITTLE_ENDIAN or BIG_ENDIAN (and not both) are defined
+ *  LITTLE_ENDIAN or BIG_ENDIAN (and not both) are defined when the compiler
+ *  does not report its byte order
  */
 #   define htons           @@@
 #   define htonl           @@@@
-#   define ntohs           @@@@@
-#   define ntohl           @@@@@@
+#   define htonll          @@@@@
+#   define ntohs           @@@@@@
+#   define ntohl           @@@@@@@
+#   define ntohll          @@@@@@@@
+#endif
+
+/** Bulk byte swaps of whole arrays ("dst" may equal "src" for in-place
+ *  conversion, but must not otherwise overlap it). Vectorized with PSHUFB
+ *  (SSSE3 or AVX2, picked by CPU feature on first use) or NEON TBL, with
+ *  BSWAP per element as the fallback.
+ *  Define UCTYPES_IMPLEMENTATION in exactly one .c file to build them.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+void bswap16_array(uint16_t* dst, const uint16_t* src, size_t n);
+void bswap32_array(uint32_t* dst, const uint32_t* src, size_t n);
+void bswap64_array(uint64_t* dst, const uint64_t* src, size_t n);
+#ifdef __cplusplus
+}
+#endif
+
+/** Host to/from network byte order over arrays */
+#if defined(UC_BIG_ENDIAN_HOST) && UC_BIG_ENDIAN_HOST
+#   define hton16_array(dst, src, n)    uc__copy_array(dst, src, (n) * sizeof(uint16_t))
+#   define hton32_array(dst, src, n)    uc__copy_array(dst, src, (n) * sizeof(uint32_t))
+#   define hton64_array(dst, src, n)    uc__copy_array(dst, src, (n) * sizeof(uint64_t))
+#   include <string.h>
+    static inline void uc__copy_array(void* dst, const void* src, size_t nbytes)
+    {
+        if (dst != src) {
+            memmove(dst, src, nbytes);
+        }
+    }
+#else
+#   define hton16_array(dst, src, n)    bswap16_array(dst, src, n)
+#   define hton32_array(dst, src, n)    bswap32_array(dst, src, n)
+#   define hton64_array(dst, src, n)    bswap64_array(dst, src, n)
 #endif
+#define ntoh16_array                    hton16_array
+#define ntoh32_array                    hton32_array
+#define ntoh64_array                    hton64_array
 
 #endif  // __UCTYPES_H__
 
+
+
+////////////////////////////////////////////////////////////////////////////////
+#if defined(UCTYPES_IMPLEMENTATION) && !defined(__UCTYPES_IMPLEMENTATION__)
+#define __UCTYPES_IMPLEMENTATION__
+
+#include <string.h>
+
+typedef uint8_t UcVu8x16 __attribute__((vector_size(16)));
+typedef uint8_t UcVu8x32 __attribute__((vector_size(32)));
+
+/** Byte permutations for one 16-byte lane; none crosses a lane, so the
+ *  32-byte forms are a single VPSHUFB
+ */
+#define UC__SWAP16_IDX  1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14
+#define UC__SWAP32_IDX  3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12
+#define UC__SWAP64_IDX  7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8
+#define UC__SWAP16_IDX2 UC__SWAP16_IDX, 17, 16, 19, 18, 21, 20, 23, 22, 25, 24, 27, 26, 29, 28, 31, 30
+#define UC__SWAP32_IDX2 UC__SWAP32_IDX, 19, 18, 17, 16, 23, 22, 21, 20, 27, 26, 25, 24, 31, 30, 29, 28
+#define UC__SWAP64_IDX2 UC__SWAP64_IDX, 23, 22, 21, 20, 19, 18, 17, 16, 31, 30, 29, 28, 27, 26, 25, 24
+
+/** Constant byte permutation of one vector (PSHUFB/TBL) */
+#ifdef __clang__
+#   define UC__SHUFFLE(V, v, idx...)    __builtin_shufflevector(v, v, idx)
+#else
+#   define UC__SHUFFLE(V, v, idx...)    __builtin_shuffle(v, (V){ idx })
+#endif
+
+/** Defines a swap kernel: whole vectors of type V, then the scalar tail */
+#define UC__BSWAP_KERNEL(attr, name, T, V, swap, idx...)  \
+    attr void name(T* dst, const T* src, size_t n) \
+    { \
+        const size_t lanes = sizeof(V) / sizeof(T); \
+        size_t i = 0; \
+        for ( ; i + lanes <= n; i += lanes) { \
+            V v; \
+            memcpy(&v, src + i, sizeof(v)); \
+            v = UC__SHUFFLE(V, v, idx); \
+            memcpy(dst + i, &v, sizeof(v)); \
+        } \
+        for ( ; i < n; i++) { \
+            dst[i] = swap(src[i]); \
+        } \
+    }
+#define UC__BSWAP_SCALAR(name, T, swap)  \
+    static void name(T* dst, const T* src, size_t n) \
+    { \
+        for (size_t i = 0; i < n; i++) { \
+            dst[i] = swap(src[i]); \
+        } \
+    }
+
+#if (defined(__x86_64__) || defined(__i386__)) && !defined(UCTYPES_NO_DISPATCH)
+/** Plain x86-64 has no byte shuffle, so BSWAP per element is the baseline;
+ *  the first call picks the SSSE3 or AVX2 kernel by CPU feature.
+ */
+#define UC__SSSE3   static __attribute__((target("ssse3")))
+#define UC__AVX2    static __attribute__((target("avx2")))
+UC__BSWAP_KERNEL(UC__SSSE3, uc__bswap16_ssse3, uint16_t, UcVu8x16, bswap16, UC__SWAP16_IDX)
+UC__BSWAP_KERNEL(UC__SSSE3, uc__bswap32_ssse3, uint32_t, UcVu8x16, bswap32, UC__SWAP32_IDX)
+UC__BSWAP_KERNEL(UC__SSSE3, uc__bswap64_ssse3, uint64_t, UcVu8x16, bswap64, UC__SWAP64_IDX)
+UC__BSWAP_KERNEL(UC__AVX2, uc__bswap16_avx2, uint16_t, UcVu8x32, bswap16, UC__SWAP16_IDX2)
+UC__BSWAP_KERNEL(UC__AVX2, uc__bswap32_avx2, uint32_t, UcVu8x32, bswap32, UC__SWAP32_IDX2)
+UC__BSWAP_KERNEL(UC__AVX2, uc__bswap64_avx2, uint64_t, UcVu8x32, bswap64, UC__SWAP64_IDX2)
+UC__BSWAP_SCALAR(uc__bswap16_scalar, uint16_t, bswap16)
+UC__BSWAP_SCALAR(uc__bswap32_scalar, uint32_t, bswap32)
+UC__BSWAP_SCALAR(uc__bswap64_scalar, uint64_t, bswap64)
+
+#define UC__BSWAP_DISPATCH(name, T, bits)  \
+    static void uc__bswap ## bits ## _resolve(T* dst, const T* src, size_t n); \
+    static void (*s_ucBswap ## bits)(T* , const T* , size_t) = uc__bswap ## bits ## _resolve; \
+    static void uc__bswap ## bits ## _resolve(T* dst, const T* src, size_t n) \
+    { \
+        void (*fn)(T* , const T* , size_t) = uc__bswap ## bits ## _scalar; \
+        __builtin_cpu_init(); \
+        if (__builtin_cpu_supports("avx2")) { \
+            fn = uc__bswap ## bits ## _avx2; \
+        } \
+        else if (__builtin_cpu_supports("ssse3")) { \
+            fn = uc__bswap ## bits ## _ssse3; \
+        } \
+        __atomic_store_n(&s_ucBswap ## bits, fn, __ATOMIC_RELAXED); \
+        fn(dst, src, n); \
+    } \
+    void name(T* dst, const T* src, size_t n) \
+    { \
+        __atomic_load_n(&s_ucBswap ## bits, __ATOMIC_RELAXED)(dst, src, n); \
+    }
+
+UC__BSWAP_DISPATCH(bswap16_array, uint16_t, 16)
+UC__BSWAP_DISPATCH(bswap32_array, uint32_t, 32)
+UC__BSWAP_DISPATCH(bswap64_array, uint64_t, 64)
+
+#elif defined(__ARM_NEON) || defined(__SSSE3__)
+/** The vector unit is always there: TBL on NEON, or PSHUFB if built for it */
+UC__BSWAP_KERNEL(, bswap16_array, uint16_t, UcVu8x16, bswap16, UC__SWAP16_IDX)
+UC__BSWAP_KERNEL(, bswap32_array, uint32_t, UcVu8x16, bswap32, UC__SWAP32_IDX)
+UC__BSWAP_KERNEL(, bswap64_array, uint64_t, UcVu8x16, bswap64, UC__SWAP64_IDX)
+
+#else
+UC__BSWAP_SCALAR(uc__bswap16_scalar, uint16_t, bswap16)
+UC__BSWAP_SCALAR(uc__bswap32_scalar, uint32_t, bswap32)
+UC__BSWAP_SCALAR(uc__bswap64_scalar, uint64_t, bswap64)
+void bswap16_array(uint16_t* dst, const uint16_t* src, size_t n) { uc__bswap16_scalar(dst, src, n); }
+void bswap32_array(uint32_t* dst, const uint32_t* src, size_t n) { uc__bswap32_scalar(dst, src, n); }
+void bswap64_array(uint64_t* dst, const uint64_t* src, size_t n) { uc__bswap64_scalar(dst, src, n); }
+#endif
+
+#endif  // UCTYPES_IMPLEMENTATION
@@ -0,0 +1,192 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org>
+*/
+#ifndef __WIRETYPES_H__
+#define __WIRETYPES_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "macros.h"
+#include "uctypes.h"
+
+/** @file
+ * This file contains fixed-endian integer types that can be overlaid
+ * directly on wire buffers, and bounds-checked views for reading them.
+ **/
+
+/**
+ *                      Wire Types Overview
+ * =====================================================================
+ * be16, be32, be64 (big-endian) and le16, le32, le64 (little-endian) are
+ * packed, byte-aligned wrappers around the raw bytes of a field. Because
+ * their alignment is 1, a struct built only from them and uint8_t fields
+ * can be cast onto an arbitrary (unaligned) receive buffer and read in
+ * place, with no memcpy into a host-order copy:
+ *
+ *   struct UdpHdr {
+ *       be16    srcPort;
+ *       be16    dstPort;
+ *       be16    length;
+ *       be16    checksum;
+ *   };
+ *
+ * Fields convert on access with xx_to_cpu() and cpu_to_xx(); on a host of
+ * the same byte order these are plain loads and stores, otherwise a single
+ * BSWAP/REV. In C++ the types also convert implicitly to and from host
+ * values (uint16_t n = hdr->length). fcc32 holds a four character tag in
+ * wire order and compares against FCC() from macros.h.
+ *
+ * Views
+ * ----------------------------------------------
+ * A struct WireView is a pointer and a length. WIRE_VIEW_AT() returns a
+ * typed pointer into it, or NULL if the object would run past the end, and
+ * wire_view_be16() etc. read one field with the same check:
+ *
+ *   struct WireView pkt = wire_view(buf, len);
+ *   const struct UdpHdr* udp = WIRE_VIEW_AT(pkt, ipHdrLen, struct UdpHdr);
+ *   if (!udp) { return -1; }
+ *   port = be16_to_cpu(udp->dstPort);
+ */
+
+//////////////////////////////////////////////////////////////////////////////
+#if !defined(UC_BIG_ENDIAN_HOST)
+#   error "wiretypes.h needs the host byte order; define BIG_ENDIAN or LITTLE_ENDIAN"
+#endif
+
+#define WIRE__NOSWAP(x)     (x)
+#if UC_BIG_ENDIAN_HOST
+#   define WIRE__BE(bits)   WIRE__NOSWAP
+#   define WIRE__LE(bits)   bswap ## bits
+#else
+#   define WIRE__BE(bits)   bswap ## bits
+#   define WIRE__LE(bits)   WIRE__NOSWAP
+#endif
+
+#ifdef __cplusplus
+#   define WIRE__MEMBERS(name, T, swap)  \
+        operator T() const { return (T)swap(raw); } \
+        name& operator=(T v) { raw = (T)swap(v); return *this; }
+#else
+#   define WIRE__MEMBERS(name, T, swap)
+#endif
+
+/** Defines a wire type and its converters */
+#define WIRE__DEFINE(name, T, swap)  \
+    typedef struct name { \
+        T raw; \
+        WIRE__MEMBERS(name, T, swap) \
+    } __attribute__((packed)) name; \
+    static inline T name ## _to_cpu(name v) \
+    { \
+        return (T)swap(v.raw); \
+    } \
+    static inline name cpu_to_ ## name(T v) \
+    { \
+        name w; \
+        w.raw = (T)swap(v); \
+        return w; \
+    }
+
+WIRE__DEFINE(be16, uint16_t, WIRE__BE(16))
+WIRE__DEFINE(be32, uint32_t, WIRE__BE(32))
+WIRE__DEFINE(be64, uint64_t, WIRE__BE(64))
+WIRE__DEFINE(le16, uint16_t, WIRE__LE(16))
+WIRE__DEFINE(le32, uint32_t, WIRE__LE(32))
+WIRE__DEFINE(le64, uint64_t, WIRE__LE(64))
+
+/** Four character tag in wire order, e.g., the "RIFF" of a RIFF header */
+typedef struct fcc32 {
+    uint8_t c[4];
+} fcc32;
+
+/** Returns the tag as FCC() would build it from the same characters */
+static inline uint32_t fcc32_to_cpu(fcc32 v)
+{
+    return FCC(v.c[0], v.c[1], v.c[2], v.c[3]);
+}
+
+/** Nonzero if the tag matches FCC(ch1, ch2, ch3, ch4) */
+static inline int fcc32_is(fcc32 v, uint32_t code)
+{
+    return fcc32_to_cpu(v) == code;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+/** A byte span that all reads are checked against */
+struct WireView {
+    const uint8_t*  data;
+    size_t          size;
+};
+
+static inline struct WireView wire_view(const void* data, size_t size)
+{
+    struct WireView v;
+    v.data = (const uint8_t* )data;
+    v.size = size;
+    return v;
+}
+
+/** Returns data + offset if "len" bytes fit there, else NULL */
+static inline const void* wire_view_at(struct WireView v, size_t offset, size_t len)
+{
+    return (offset <= v.size && len <= v.size - offset) ? v.data + offset : NULL;
+}
+
+/** Typed, bounds-checked pointer into a view (NULL if out of range) */
+#define WIRE_VIEW_AT(view, offset, type)    ((const type* )wire_view_at(view, offset, sizeof(type)))
+
+/** Narrows a view to [offset, offset + len); returns 0 on success */
+static inline int wire_view_sub(struct WireView v, size_t offset, size_t len, struct WireView* out)
+{
+    const void* p = wire_view_at(v, offset, len);
+    if (!p) {
+        return -1;
+    }
+    *out = wire_view(p, len);
+    return 0;
+}
+
+/** Defines wire_view_<type>(view, offset, &value); returns 0 on success */
+#define WIRE__VIEW_READER(name, T)  \
+    static inline int wire_view_ ## name(struct WireView v, size_t offset, T* out) \
+    { \
+        const name* p = WIRE_VIEW_AT(v, offset, name); \
+        if (!p) { \
+            return -1; \
+        } \
+        *out = name ## _to_cpu(*p); \
+        return 0; \
+    }
+
+WIRE__VIEW_READER(be16, uint16_t)
+WIRE__VIEW_READER(be32, uint32_t)
+WIRE__VIEW_READER(be64, uint64_t)
+WIRE__VIEW_READER(le16, uint16_t)
+WIRE__VIEW_READER(le32, uint32_t)
+WIRE__VIEW_READER(le64, uint64_t)
+
+#endif  // __WIRETYPES_H__